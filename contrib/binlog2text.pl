@@ -0,0 +1,141 @@
+#!/usr/bin/perl -w
+
+# Decodes the access log written with the "binary" log_format
+# into the tab separated text, one line per record.
+#
+# usage: binlog2text.pl [-z] [file ...]
+#
+#   -z    read the gzip compressed log ("access_log ... gzip")
+#
+# the record is the 32-bit payload length followed by the fields,
+# each field starts with its type byte, integers are big-endian:
+#
+#   1   32-bit unsigned integer
+#   2   64-bit unsigned integer
+#   3   string: 16-bit length and bytes
+#   4   the variable was not found, printed as "-"
+#   5   IPv4 address, 4 bytes
+#   6   time, 64-bit milliseconds since the Epoch
+
+
+use warnings;
+use strict;
+
+use POSIX qw(strftime);
+
+
+my $gzip = 0;
+
+if (@ARGV && $ARGV[0] eq '-z') {
+	$gzip = 1;
+	shift @ARGV;
+}
+
+push @ARGV, '-' unless @ARGV;
+
+for my $name (@ARGV) {
+	my $fh;
+
+	if ($gzip) {
+		open($fh, '-|', 'gzip', '-dc', $name) or die "gzip $name: $!\n";
+
+	} elsif ($name eq '-') {
+		$fh = \*STDIN;
+
+	} else {
+		open($fh, '<', $name) or die "$name: $!\n";
+	}
+
+	binmode $fh;
+
+	decode($fh, $name);
+
+	close $fh;
+}
+
+
+sub readn {
+	my ($fh, $n) = @_;
+	my $buf = '';
+
+	while (length($buf) < $n) {
+		my $r = read($fh, $buf, $n - length($buf), length($buf));
+		die "read: $!\n" unless defined $r;
+		last if $r == 0;
+	}
+
+	return $buf;
+}
+
+
+sub decode {
+	my ($fh, $name) = @_;
+
+	while (1) {
+		my $hdr = readn($fh, 4);
+
+		last if length($hdr) == 0;
+		die "$name: truncated record\n" if length($hdr) < 4;
+
+		my $len = unpack('N', $hdr);
+		my $rec = readn($fh, $len);
+
+		die "$name: truncated record\n" if length($rec) < $len;
+
+		my @fields;
+		my $p = 0;
+
+		while ($p < $len) {
+			my $type = ord(substr($rec, $p++, 1));
+
+			if ($type == 1) {
+				push @fields, unpack('N', substr($rec, $p, 4));
+				$p += 4;
+
+			} elsif ($type == 2) {
+				push @fields, uint64(substr($rec, $p, 8));
+				$p += 8;
+
+			} elsif ($type == 3) {
+				my $n = unpack('n', substr($rec, $p, 2));
+				push @fields, escape(substr($rec, $p + 2, $n));
+				$p += 2 + $n;
+
+			} elsif ($type == 4) {
+				push @fields, '-';
+
+			} elsif ($type == 5) {
+				push @fields, join('.', unpack('C4', substr($rec, $p, 4)));
+				$p += 4;
+
+			} elsif ($type == 6) {
+				my $ms = uint64(substr($rec, $p, 8));
+				push @fields, strftime('%Y-%m-%dT%H:%M:%S',
+						       localtime(int($ms / 1000)))
+					      . sprintf('.%03d', $ms % 1000);
+				$p += 8;
+
+			} else {
+				die "$name: unknown field type $type\n";
+			}
+		}
+
+		print join("\t", @fields), "\n";
+	}
+}
+
+
+sub uint64 {
+	my ($hi, $lo) = unpack('NN', $_[0]);
+
+	return $hi * 4294967296 + $lo;
+}
+
+
+sub escape {
+	my $s = shift;
+
+	$s =~ s/([\x00-\x1f\x7f\\])/sprintf('\\x%02X', ord($1))/ge;
+
+	return $s;
+}
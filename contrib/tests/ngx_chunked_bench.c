@@ -0,0 +1,209 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ */
+
+
+/*
+ * The allocation count of the chunked filter for a streaming response:
+ * a HTTP/1.1 response without a length is passed to the filter in the
+ * given number of memory buffers, one buffer per call, and the next filter
+ * sends everything at once.  ngx_palloc() and ngx_pcalloc() are wrapped
+ * by the linker to count the pool allocations.
+ *
+ *     objs/tests/ngx_chunked_bench [chunks [size]]
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+
+
+void *__real_ngx_palloc(ngx_pool_t *pool, size_t size);
+void *__real_ngx_pcalloc(ngx_pool_t *pool, size_t size);
+void *__wrap_ngx_palloc(ngx_pool_t *pool, size_t size);
+void *__wrap_ngx_pcalloc(ngx_pool_t *pool, size_t size);
+
+
+extern ngx_module_t  ngx_http_chunked_filter_module;
+
+
+static ngx_uint_t  ngx_test_allocs;
+static size_t      ngx_test_alloc_size;
+static off_t       ngx_test_sent;
+
+
+void *
+__wrap_ngx_palloc(ngx_pool_t *pool, size_t size)
+{
+    ngx_test_allocs++;
+    ngx_test_alloc_size += size;
+
+    return __real_ngx_palloc(pool, size);
+}
+
+
+void *
+__wrap_ngx_pcalloc(ngx_pool_t *pool, size_t size)
+{
+    ngx_test_allocs++;
+    ngx_test_alloc_size += size;
+
+    return __real_ngx_pcalloc(pool, size);
+}
+
+
+static ngx_int_t
+ngx_test_header_filter(ngx_http_request_t *r)
+{
+    return NGX_OK;
+}
+
+
+/* the write filter that sends all the passed data at once */
+
+static ngx_int_t
+ngx_test_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
+{
+    ngx_chain_t  *cl;
+
+    for (cl = in; cl; cl = cl->next) {
+        ngx_test_sent += cl->buf->last - cl->buf->pos;
+        cl->buf->pos = cl->buf->last;
+    }
+
+    return NGX_OK;
+}
+
+
+int ngx_cdecl
+main(int argc, char *const *argv)
+{
+    u_char              *data;
+    double               sec;
+    ngx_int_t            chunks, size, i;
+    ngx_log_t            log;
+    ngx_buf_t            b;
+    ngx_uint_t           m, allocs;
+    ngx_chain_t          cl;
+    ngx_connection_t     c;
+    ngx_open_file_t      file;
+    ngx_http_module_t   *module;
+    ngx_http_request_t   r;
+    struct timeval       start, end;
+
+    chunks = 10000;
+    size = 4096;
+
+    if (argc > 1) {
+        chunks = ngx_atoi((u_char *) argv[1], ngx_strlen(argv[1]));
+    }
+
+    if (argc > 2) {
+        size = ngx_atoi((u_char *) argv[2], ngx_strlen(argv[2]));
+    }
+
+    if (chunks <= 0 || size <= 0) {
+        printf("usage: ngx_chunked_bench [chunks [size]]\n");
+        return 2;
+    }
+
+    ngx_pagesize = getpagesize();
+
+    ngx_memzero(&file, sizeof(ngx_open_file_t));
+    file.fd = ngx_stderr_fileno;
+
+    ngx_memzero(&log, sizeof(ngx_log_t));
+    log.file = &file;
+    log.log_level = NGX_LOG_ERR;
+
+    ngx_http_max_module = 0;
+    for (m = 0; ngx_modules[m]; m++) {
+        if (ngx_modules[m]->type == NGX_HTTP_MODULE) {
+            ngx_modules[m]->ctx_index = ngx_http_max_module++;
+        }
+    }
+
+    /* the chunked filter is the only one in the chain */
+
+    ngx_http_top_header_filter = ngx_test_header_filter;
+    ngx_http_top_body_filter = ngx_test_body_filter;
+
+    module = ngx_http_chunked_filter_module.ctx;
+
+    if (module->postconfiguration(NULL) != NGX_OK) {
+        return 1;
+    }
+
+    ngx_memzero(&c, sizeof(ngx_connection_t));
+    c.log = &log;
+
+    ngx_memzero(&r, sizeof(ngx_http_request_t));
+    r.main = &r;
+    r.connection = &c;
+    r.http_version = NGX_HTTP_VERSION_11;
+    r.headers_out.status = NGX_HTTP_OK;
+    r.headers_out.content_length_n = -1;
+
+    r.pool = ngx_create_pool(NGX_DEFAULT_POOL_SIZE, &log);
+    if (r.pool == NULL) {
+        return 1;
+    }
+
+    r.ctx = ngx_pcalloc(r.pool, sizeof(void *) * ngx_http_max_module);
+    if (r.ctx == NULL) {
+        return 1;
+    }
+
+    data = ngx_alloc(size, &log);
+    if (data == NULL) {
+        return 1;
+    }
+
+    ngx_memset(data, 'x', size);
+
+    if (ngx_http_top_header_filter(&r) != NGX_OK || !r.chunked) {
+        printf("the response is not chunked\n");
+        return 1;
+    }
+
+    ngx_test_allocs = 0;
+    ngx_test_alloc_size = 0;
+
+    ngx_gettimeofday(&start);
+
+    for (i = 0; i < chunks; i++) {
+        ngx_memzero(&b, sizeof(ngx_buf_t));
+
+        b.pos = data;
+        b.last = data + size;
+        b.memory = 1;
+        b.last_buf = (i == chunks - 1);
+
+        cl.buf = &b;
+        cl.next = NULL;
+
+        if (ngx_http_top_body_filter(&r, &cl) != NGX_OK) {
+            printf("the chunked filter failed\n");
+            return 1;
+        }
+    }
+
+    ngx_gettimeofday(&end);
+
+    sec = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+
+    allocs = ngx_test_allocs;
+
+    printf("%ld chunks of %ld bytes, %ld bytes sent\n",
+           (long) chunks, (long) size, (long) ngx_test_sent);
+    printf("pool allocations: %lu (%.2f per chunk), %lu bytes\n",
+           (u_long) allocs, (double) allocs / chunks,
+           (u_long) ngx_test_alloc_size);
+    printf("time: %.1f ns per chunk\n", sec * 1e9 / chunks);
+
+    ngx_destroy_pool(r.pool);
+
+    return 0;
+}
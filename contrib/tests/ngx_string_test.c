@@ -0,0 +1,606 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ */
+
+
+/*
+ * The differential test and the benchmark of the word at a time string
+ * functions: ngx_strnstr(), ngx_strstrn(), ngx_strcasestrn(),
+ * ngx_unescape_uri() and ngx_escape_html() are compared on the random
+ * inputs with the byte at a time versions kept here as the reference.
+ *
+ *     objs/tests/ngx_string_test [iterations]
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+
+
+#define NGX_TEST_MAX_LEN    160
+#define NGX_TEST_BENCH_LEN  4096
+
+
+static u_char *ngx_ref_strnstr(u_char *s1, char *s2, size_t len);
+static u_char *ngx_ref_strstrn(u_char *s1, char *s2, size_t n);
+static u_char *ngx_ref_strcasestrn(u_char *s1, char *s2, size_t n);
+static void ngx_ref_unescape_uri(u_char **dst, u_char **src, size_t size,
+    ngx_uint_t type);
+static uintptr_t ngx_ref_escape_html(u_char *dst, u_char *src, size_t size);
+
+
+static void ngx_cdecl ngx_test_log(const char *fmt, ...);
+
+
+static u_char  ngx_test_alphabet[] = "aAbBzZ09%?<>&/.-_ \x80\xff";
+
+static ngx_uint_t  ngx_test_types[] = {
+    0,
+    NGX_UNESCAPE_URI,
+    NGX_UNESCAPE_REDIRECT,
+    NGX_UNESCAPE_URI|NGX_UNESCAPE_REDIRECT
+};
+
+
+static void
+ngx_test_random(u_char *p, size_t n, ngx_uint_t plain)
+{
+    size_t  i;
+
+    for (i = 0; i < n; i++) {
+
+        /* the long runs of the plain characters exercise the word loop */
+
+        if (plain && ngx_random() % 8) {
+            p[i] = (u_char) ('a' + ngx_random() % 26);
+            continue;
+        }
+
+        p[i] = ngx_test_alphabet[ngx_random()
+                                 % (sizeof(ngx_test_alphabet) - 1)];
+    }
+}
+
+
+static ngx_uint_t
+ngx_test_fuzz(ngx_uint_t iterations)
+{
+    u_char      *r1, *r2, *d1, *d2, *s1, *s2;
+    size_t       n, m, i;
+    uintptr_t    l1, l2;
+    ngx_uint_t   it, t, failed;
+    u_char       s[NGX_TEST_MAX_LEN + 1], z[NGX_TEST_MAX_LEN + 1];
+    u_char       needle[8], lneedle[8];
+    u_char       a[NGX_TEST_MAX_LEN], b[NGX_TEST_MAX_LEN];
+    u_char       o1[NGX_TEST_MAX_LEN * 5], o2[NGX_TEST_MAX_LEN * 5];
+
+    failed = 0;
+
+    for (it = 0; it < iterations; it++) {
+
+        n = ngx_random() % NGX_TEST_MAX_LEN;
+        m = 1 + ngx_random() % 5;
+
+        ngx_test_random(s, n, it & 1);
+        s[n] = '\0';
+
+        ngx_test_random(needle, m, 0);
+        needle[m] = '\0';
+
+        if (needle[0] == '\0') {
+            needle[0] = 'a';
+        }
+
+        /* ngx_strnstr() stops at the NUL, the others need a string */
+
+        r1 = ngx_ref_strnstr(s, (char *) needle, n);
+        r2 = ngx_strnstr(s, (char *) needle, n);
+
+        if (r1 != r2) {
+            failed++;
+            ngx_test_log("ngx_strnstr(\"%*s\", \"%s\") mismatch",
+                         n, s, needle);
+        }
+
+        for (i = 0; i < n; i++) {
+            z[i] = s[i] ? s[i] : 'x';
+        }
+
+        z[n] = '\0';
+
+        r1 = ngx_ref_strstrn(z, (char *) needle, ngx_strlen(needle) - 1);
+        r2 = ngx_strstrn(z, (char *) needle, ngx_strlen(needle) - 1);
+
+        if (r1 != r2) {
+            failed++;
+            ngx_test_log("ngx_strstrn(\"%s\", \"%s\") mismatch", z, needle);
+        }
+
+        /* the tail of the ngx_strcasestrn() substring must be lowercase */
+
+        for (i = 0; i <= ngx_strlen(needle); i++) {
+            lneedle[i] = (i && needle[i] >= 'A' && needle[i] <= 'Z')
+                         ? (needle[i] | 0x20) : needle[i];
+        }
+
+        /*
+         * the byte at a time version sign extends the first character
+         * and never finds a non-ASCII one, the substrings are literals
+         */
+
+        if (lneedle[0] >= 0x80) {
+            lneedle[0] = 'a';
+        }
+
+        m = ngx_strlen(lneedle) - 1;
+
+        r1 = ngx_ref_strcasestrn(z, (char *) lneedle, m);
+        r2 = ngx_strcasestrn(z, (char *) lneedle, m);
+
+        if (r1 != r2) {
+            failed++;
+            ngx_test_log("ngx_strcasestrn(\"%s\", \"%s\") mismatch",
+                         z, lneedle);
+        }
+
+        for (t = 0; t < sizeof(ngx_test_types) / sizeof(ngx_uint_t); t++) {
+
+            /* in place, as the request line is unescaped */
+
+            ngx_memcpy(a, s, n);
+            ngx_memcpy(b, s, n);
+
+            d1 = a; s1 = a;
+            d2 = b; s2 = b;
+
+            ngx_ref_unescape_uri(&d1, &s1, n, ngx_test_types[t]);
+            ngx_unescape_uri(&d2, &s2, n, ngx_test_types[t]);
+
+            if (d1 - a != d2 - b || s1 - a != s2 - b
+                || ngx_memcmp(a, b, d1 - a) != 0)
+            {
+                failed++;
+                ngx_test_log("in place ngx_unescape_uri(\"%*s\", %ui) "
+                             "mismatch", n, s, ngx_test_types[t]);
+            }
+
+            d1 = o1; s1 = s;
+            d2 = o2; s2 = s;
+
+            ngx_ref_unescape_uri(&d1, &s1, n, ngx_test_types[t]);
+            ngx_unescape_uri(&d2, &s2, n, ngx_test_types[t]);
+
+            if (d1 - o1 != d2 - o2 || s1 != s2
+                || ngx_memcmp(o1, o2, d1 - o1) != 0)
+            {
+                failed++;
+                ngx_test_log("ngx_unescape_uri(\"%*s\", %ui) mismatch",
+                             n, s, ngx_test_types[t]);
+            }
+        }
+
+        l1 = ngx_ref_escape_html(NULL, s, n);
+        l2 = ngx_escape_html(NULL, s, n);
+
+        d1 = (u_char *) ngx_ref_escape_html(o1, s, n);
+        d2 = (u_char *) ngx_escape_html(o2, s, n);
+
+        if (l1 != l2 || d1 - o1 != d2 - o2
+            || ngx_memcmp(o1, o2, d1 - o1) != 0)
+        {
+            failed++;
+            ngx_test_log("ngx_escape_html(\"%*s\") mismatch", n, s);
+        }
+
+        if (failed > 20) {
+            break;
+        }
+    }
+
+    return failed;
+}
+
+
+static void
+ngx_test_report(char *name, struct timeval *start, ngx_uint_t bytes)
+{
+    double          sec;
+    struct timeval  tv;
+
+    ngx_gettimeofday(&tv);
+
+    sec = (tv.tv_sec - start->tv_sec) + (tv.tv_usec - start->tv_usec) / 1e6;
+
+    printf("%-28s %8.1f MB/s\n", name, bytes / sec / 1e6);
+}
+
+
+#define ngx_test_bench(name, expr)                                            \
+    ngx_gettimeofday(&tv);                                                    \
+    for (i = 0; i < rounds; i++) {                                            \
+        sink += (uintptr_t) (expr);                                           \
+    }                                                                         \
+    ngx_test_report(name, &tv, rounds * NGX_TEST_BENCH_LEN)
+
+
+static void
+ngx_test_benchmark(void)
+{
+    u_char          *d, *s, *volatile t;
+    ngx_uint_t       i, rounds;
+    uintptr_t        sink;
+    struct timeval   tv;
+    static u_char    text[NGX_TEST_BENCH_LEN + 1];
+    static u_char    out[NGX_TEST_BENCH_LEN * 5];
+
+    /* a plain text without the characters to escape or to find */
+
+    for (i = 0; i < NGX_TEST_BENCH_LEN; i++) {
+        text[i] = (u_char) "abcdefghijklmnopqrstuvwxyz/.-_0123456789"[i % 40];
+    }
+
+    text[NGX_TEST_BENCH_LEN] = '\0';
+
+    /* the volatile pointer keeps the compiler from hoisting the calls */
+
+    t = text;
+
+    rounds = 100000;
+    sink = 0;
+
+    ngx_test_bench("ngx_strnstr reference",
+                   ngx_ref_strnstr(t, "QQ", NGX_TEST_BENCH_LEN));
+    ngx_test_bench("ngx_strnstr",
+                   ngx_strnstr(t, "QQ", NGX_TEST_BENCH_LEN));
+
+    ngx_test_bench("ngx_strstrn reference", ngx_ref_strstrn(t, "QQ", 1));
+    ngx_test_bench("ngx_strstrn", ngx_strstrn(t, "QQ", 1));
+
+    ngx_test_bench("ngx_strcasestrn reference",
+                   ngx_ref_strcasestrn(t, "qq", 1));
+    ngx_test_bench("ngx_strcasestrn", ngx_strcasestrn(t, "qq", 1));
+
+    ngx_test_bench("ngx_escape_html reference",
+                   ngx_ref_escape_html(out, t, NGX_TEST_BENCH_LEN));
+    ngx_test_bench("ngx_escape_html",
+                   ngx_escape_html(out, t, NGX_TEST_BENCH_LEN));
+
+    ngx_test_bench("ngx_unescape_uri reference",
+                   (d = out, s = t,
+                    ngx_ref_unescape_uri(&d, &s, NGX_TEST_BENCH_LEN, 0), d));
+    ngx_test_bench("ngx_unescape_uri",
+                   (d = out, s = t,
+                    ngx_unescape_uri(&d, &s, NGX_TEST_BENCH_LEN, 0), d));
+
+    if (sink == 0) {
+        printf("\n");
+    }
+}
+
+
+int ngx_cdecl
+main(int argc, char *const *argv)
+{
+    ngx_int_t   n;
+    ngx_uint_t  failed;
+
+    n = 1000000;
+
+    if (argc > 1) {
+        n = ngx_atoi((u_char *) argv[1], ngx_strlen(argv[1]));
+
+        if (n == NGX_ERROR) {
+            ngx_test_log("invalid number of iterations \"%s\"", argv[1]);
+            return 2;
+        }
+    }
+
+    srandom(1);
+
+    failed = ngx_test_fuzz((ngx_uint_t) n);
+
+    printf("%s: %lu iterations, %lu mismatches\n",
+           failed ? "FAILED" : "ok", (u_long) n, (u_long) failed);
+
+    if (failed) {
+        return 1;
+    }
+
+    ngx_test_benchmark();
+
+    return 0;
+}
+
+
+static void ngx_cdecl
+ngx_test_log(const char *fmt, ...)
+{
+    u_char   *p;
+    va_list   args;
+    u_char    msg[NGX_MAX_ERROR_STR];
+
+    va_start(args, fmt);
+    p = ngx_vsnprintf(msg, NGX_MAX_ERROR_STR - 1, fmt, args);
+    va_end(args);
+
+    *p++ = LF;
+
+    (void) ngx_write_fd(ngx_stderr_fileno, msg, p - msg);
+}
+
+
+/* the byte at a time versions */
+
+static u_char *
+ngx_ref_strnstr(u_char *s1, char *s2, size_t len)
+{
+    u_char  c1, c2;
+    size_t  n;
+
+    c2 = *(u_char *) s2++;
+
+    n = ngx_strlen(s2);
+
+    do {
+        do {
+            if (len-- == 0) {
+                return NULL;
+            }
+
+            c1 = *s1++;
+
+            if (c1 == 0) {
+                return NULL;
+            }
+
+        } while (c1 != c2);
+
+        if (n > len) {
+            return NULL;
+        }
+
+    } while (ngx_strncmp(s1, (u_char *) s2, n) != 0);
+
+    return --s1;
+}
+
+
+static u_char *
+ngx_ref_strstrn(u_char *s1, char *s2, size_t n)
+{
+    u_char  c1, c2;
+
+    c2 = *(u_char *) s2++;
+
+    do {
+        do {
+            c1 = *s1++;
+
+            if (c1 == 0) {
+                return NULL;
+            }
+
+        } while (c1 != c2);
+
+    } while (ngx_strncmp(s1, (u_char *) s2, n) != 0);
+
+    return --s1;
+}
+
+
+static u_char *
+ngx_ref_strcasestrn(u_char *s1, char *s2, size_t n)
+{
+    ngx_uint_t  c1, c2;
+
+    c2 = (ngx_uint_t) *s2++;
+    c2  = (c2 >= 'A' && c2 <= 'Z') ? (c2 | 0x20) : c2;
+
+    do {
+        do {
+            c1 = (ngx_uint_t) *s1++;
+
+            if (c1 == 0) {
+                return NULL;
+            }
+
+            c1  = (c1 >= 'A' && c1 <= 'Z') ? (c1 | 0x20) : c1;
+
+        } while (c1 != c2);
+
+    } while (ngx_strncasecmp(s1, (u_char *) s2, n) != 0);
+
+    return --s1;
+}
+
+
+static void
+ngx_ref_unescape_uri(u_char **dst, u_char **src, size_t size, ngx_uint_t type)
+{
+    u_char  *d, *s, ch, c, decoded;
+    enum {
+        sw_usual = 0,
+        sw_quoted,
+        sw_quoted_second
+    } state;
+
+    d = *dst;
+    s = *src;
+
+    state = 0;
+    decoded = 0;
+
+    while (size--) {
+
+        ch = *s++;
+
+        switch (state) {
+        case sw_usual:
+            if (ch == '?'
+                && (type & (NGX_UNESCAPE_URI|NGX_UNESCAPE_REDIRECT)))
+            {
+                *d++ = ch;
+                goto done;
+            }
+
+            if (ch == '%') {
+                state = sw_quoted;
+                break;
+            }
+
+            *d++ = ch;
+            break;
+
+        case sw_quoted:
+
+            if (ch >= '0' && ch <= '9') {
+                decoded = (u_char) (ch - '0');
+                state = sw_quoted_second;
+                break;
+            }
+
+            c = (u_char) (ch | 0x20);
+            if (c >= 'a' && c <= 'f') {
+                decoded = (u_char) (c - 'a' + 10);
+                state = sw_quoted_second;
+                break;
+            }
+
+            /* the invalid quoted character */
+
+            state = sw_usual;
+
+            *d++ = ch;
+
+            break;
+
+        case sw_quoted_second:
+
+            state = sw_usual;
+
+            if (ch >= '0' && ch <= '9') {
+                ch = (u_char) ((decoded << 4) + ch - '0');
+
+                if (type & NGX_UNESCAPE_REDIRECT) {
+                    if (ch > '%' && ch < 0x7f) {
+                        *d++ = ch;
+                        break;
+                    }
+
+                    *d++ = '%'; *d++ = *(s - 2); *d++ = *(s - 1);
+
+                    break;
+                }
+
+                *d++ = ch;
+
+                break;
+            }
+
+            c = (u_char) (ch | 0x20);
+            if (c >= 'a' && c <= 'f') {
+                ch = (u_char) ((decoded << 4) + c - 'a' + 10);
+
+                if (type & NGX_UNESCAPE_URI) {
+                    if (ch == '?') {
+                        *d++ = ch;
+                        goto done;
+                    }
+
+                    *d++ = ch;
+                    break;
+                }
+
+                if (type & NGX_UNESCAPE_REDIRECT) {
+                    if (ch == '?') {
+                        *d++ = ch;
+                        goto done;
+                    }
+
+                    if (ch > '%' && ch < 0x7f) {
+                        *d++ = ch;
+                        break;
+                    }
+
+                    *d++ = '%'; *d++ = *(s - 2); *d++ = *(s - 1);
+                    break;
+                }
+
+                *d++ = ch;
+
+                break;
+            }
+
+            /* the invalid quoted character */
+
+            break;
+        }
+    }
+
+done:
+
+    *dst = d;
+    *src = s;
+}
+
+
+static uintptr_t
+ngx_ref_escape_html(u_char *dst, u_char *src, size_t size)
+{
+    u_char      ch;
+    ngx_uint_t  i, len;
+
+    if (dst == NULL) {
+
+        len = 0;
+
+        for (i = 0; i < size; i++) {
+            switch (*src++) {
+
+            case '<':
+                len += sizeof("&lt;") - 2;
+                break;
+
+            case '>':
+                len += sizeof("&gt;") - 2;
+                break;
+
+            case '&':
+                len += sizeof("&amp;") - 2;
+                break;
+
+            default:
+                break;
+            }
+        }
+
+        return (uintptr_t) len;
+    }
+
+    for (i = 0; i < size; i++) {
+        ch = *src++;
+
+        switch (ch) {
+
+        case '<':
+            *dst++ = '&'; *dst++ = 'l'; *dst++ = 't'; *dst++ = ';';
+            break;
+
+        case '>':
+            *dst++ = '&'; *dst++ = 'g'; *dst++ = 't'; *dst++ = ';';
+            break;
+
+        case '&':
+            *dst++ = '&'; *dst++ = 'a'; *dst++ = 'm'; *dst++ = 'p';
+            *dst++ = ';';
+            break;
+
+        default:
+            *dst++ = ch;
+            break;
+        }
+    }
+
+    return (uintptr_t) dst;
+}
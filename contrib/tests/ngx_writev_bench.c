@@ -0,0 +1,210 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ */
+
+
+/*
+ * The benchmark of the iovec staging in ngx_writev_chain() and
+ * ngx_linux_sendfile_chain(): a chunked response of the given number of
+ * pieces of the given size, each one with its chunk size line and CRLF,
+ * is sent in one call.  writev() is wrapped by the linker: it counts
+ * the calls and the iovecs and reports everything as written.
+ *
+ *     objs/tests/ngx_writev_bench [pieces [size]]
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_event.h>
+
+
+ssize_t __wrap_writev(int fd, const struct iovec *iov, int iovcnt);
+
+
+#define NGX_TEST_ROUNDS  10000
+
+
+static ngx_uint_t  ngx_test_calls;
+static ngx_uint_t  ngx_test_iovs;
+
+
+ssize_t
+__wrap_writev(int fd, const struct iovec *iov, int iovcnt)
+{
+    int      i;
+    ssize_t  n;
+
+    ngx_test_calls++;
+    ngx_test_iovs += iovcnt;
+
+    n = 0;
+
+    for (i = 0; i < iovcnt; i++) {
+        n += iov[i].iov_len;
+    }
+
+    return n;
+}
+
+
+typedef ngx_chain_t *(*ngx_test_send_chain_pt)(ngx_connection_t *c,
+    ngx_chain_t *in, off_t limit);
+
+
+static void
+ngx_test_run(char *name, ngx_test_send_chain_pt send_chain,
+    ngx_connection_t *c, ngx_chain_t *out, ngx_uint_t n)
+{
+    double           sec;
+    ngx_uint_t       i, k;
+    ngx_chain_t     *cl;
+    struct timeval   start, end;
+
+    ngx_test_calls = 0;
+    ngx_test_iovs = 0;
+
+    ngx_gettimeofday(&start);
+
+    for (k = 0; k < NGX_TEST_ROUNDS; k++) {
+
+        for (i = 0; i < n; i++) {
+            out[i].buf->pos = out[i].buf->start;
+        }
+
+        c->sent = 0;
+
+        cl = send_chain(c, out, 0);
+
+        if (cl != NULL) {
+            printf("%s: the chain is not sent\n", name);
+            return;
+        }
+    }
+
+    ngx_gettimeofday(&end);
+
+    sec = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+
+    printf("%-26s %4lu writev(), %6lu iovecs, %8.1f us per response\n",
+           name, (u_long) ngx_test_calls / NGX_TEST_ROUNDS,
+           (u_long) ngx_test_iovs / NGX_TEST_ROUNDS,
+           sec * 1e6 / NGX_TEST_ROUNDS);
+}
+
+
+int ngx_cdecl
+main(int argc, char *const *argv)
+{
+    u_char            *data, *text, *p, *t;
+    ngx_int_t          pieces, size;
+    ngx_log_t          log;
+    ngx_buf_t         *b;
+    ngx_uint_t         i, n;
+    ngx_pool_t        *pool;
+    ngx_event_t        wev;
+    ngx_chain_t       *out;
+    ngx_connection_t   c;
+    ngx_open_file_t    file;
+
+    pieces = 200;
+    size = 64;
+
+    if (argc > 1) {
+        pieces = ngx_atoi((u_char *) argv[1], ngx_strlen(argv[1]));
+    }
+
+    if (argc > 2) {
+        size = ngx_atoi((u_char *) argv[2], ngx_strlen(argv[2]));
+    }
+
+    if (pieces <= 0 || size <= 0) {
+        printf("usage: ngx_writev_bench [pieces [size]]\n");
+        return 2;
+    }
+
+    ngx_pagesize = getpagesize();
+
+    ngx_memzero(&file, sizeof(ngx_open_file_t));
+    file.fd = ngx_stderr_fileno;
+
+    ngx_memzero(&log, sizeof(ngx_log_t));
+    log.file = &file;
+    log.log_level = NGX_LOG_ERR;
+
+    pool = ngx_create_pool(NGX_DEFAULT_POOL_SIZE, &log);
+    if (pool == NULL) {
+        return 1;
+    }
+
+    /*
+     * the chunk size line, the piece and the CRLF of every piece,
+     * the pieces are not adjacent to the chunk size lines and CRLFs
+     */
+
+    n = 3 * pieces;
+
+    out = ngx_pcalloc(pool, n * sizeof(ngx_chain_t));
+    b = ngx_pcalloc(pool, n * sizeof(ngx_buf_t));
+    data = ngx_palloc(pool, pieces * sizeof("ffffffff" CRLF CRLF));
+    text = ngx_palloc(pool, pieces * (size + 1));
+
+    if (out == NULL || b == NULL || data == NULL || text == NULL) {
+        return 1;
+    }
+
+    p = data;
+    t = text;
+
+    for (i = 0; i < n; i++) {
+
+        switch (i % 3) {
+        case 0:
+            b[i].start = p;
+            p = ngx_sprintf(p, "%xi" CRLF, size);
+            b[i].last = p;
+            break;
+        case 1:
+            b[i].start = t;
+            ngx_memset(t, 'x', size);
+            t += size;
+            b[i].last = t++;
+            break;
+        default:
+            b[i].start = p;
+            *p++ = CR; *p++ = LF;
+            b[i].last = p++;
+            break;
+        }
+
+        b[i].pos = b[i].start;
+        b[i].temporary = 1;
+
+        out[i].buf = &b[i];
+        out[i].next = (i + 1 < n) ? &out[i + 1] : NULL;
+    }
+
+    ngx_memzero(&wev, sizeof(ngx_event_t));
+    wev.ready = 1;
+    wev.log = &log;
+
+    ngx_memzero(&c, sizeof(ngx_connection_t));
+    c.fd = -1;
+    c.write = &wev;
+    c.pool = pool;
+    c.log = &log;
+
+    printf("%ld pieces of %ld bytes\n", (long) pieces, (long) size);
+
+    ngx_test_run("ngx_writev_chain", ngx_writev_chain, &c, out, n);
+
+#if (NGX_HAVE_SENDFILE && NGX_LINUX)
+    ngx_test_run("ngx_linux_sendfile_chain", ngx_linux_sendfile_chain,
+                 &c, out, n);
+#endif
+
+    ngx_destroy_pool(pool);
+
+    return 0;
+}
@@ -8,12 +8,57 @@
 #include <ngx_core.h>
 
 
+/*
+ * the parse cache keeps the token streams of the configuration files
+ * across reconfigurations, so the unchanged files are not read and
+ * tokenized again.  The cache lives in the master process memory,
+ * a file is identified by its name, inode, size, and modification time.
+ *
+ * The token stream is a sequence of the statements:
+ *
+ *     uint32_t  rc, line, nargs;
+ *     nargs * { uint32_t len; u_char data[len + 1]; }
+ */
+
+#define NGX_CONF_CACHE_HASH  1024
+
+
+typedef struct ngx_conf_cache_s  ngx_conf_cache_t;
+
+struct ngx_conf_cache_s {
+    ngx_conf_cache_t  *next;
+
+    ngx_str_t          name;
+    ngx_uint_t         uniq;
+    off_t              size;
+    time_t             mtime;
+    time_t             created;
+
+    ngx_uint_t         generation;
+
+    u_char            *tokens;
+    size_t             len;
+};
+
+
 static ngx_int_t ngx_conf_handler(ngx_conf_t *cf, ngx_int_t last);
 static ngx_int_t ngx_conf_read_token(ngx_conf_t *cf);
+static ngx_int_t ngx_conf_scan_token(ngx_conf_t *cf);
+static ngx_int_t ngx_conf_replay_token(ngx_conf_t *cf);
+static ngx_int_t ngx_conf_record_token(ngx_conf_t *cf, ngx_int_t rc);
+static ngx_conf_cache_t *ngx_conf_cache_lookup(ngx_str_t *name,
+    ngx_file_info_t *fi);
+static void ngx_conf_cache_add(ngx_conf_t *cf, ngx_str_t *name,
+    ngx_file_info_t *fi, time_t created, ngx_buf_t *tokens);
+static void ngx_conf_cache_expire(void);
 static char *ngx_conf_include(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
 static void ngx_conf_flush_files(ngx_cycle_t *cycle);
 
 
+static ngx_conf_cache_t  *ngx_conf_cache[NGX_CONF_CACHE_HASH];
+static ngx_uint_t         ngx_conf_cache_generation;
+
+
 static ngx_command_t  ngx_conf_commands[] = {
 
     { ngx_string("include"),
@@ -60,58 +105,110 @@ static int argument_number[] = {
 char *
 ngx_conf_parse(ngx_conf_t *cf, ngx_str_t *filename)
 {
-    char             *rv;
-    ngx_fd_t          fd;
-    ngx_int_t         rc;
-    ngx_buf_t        *b;
-    ngx_uint_t        block;
-    ngx_conf_file_t  *prev;
+    char              *rv;
+    time_t             created;
+    ngx_fd_t           fd;
+    ngx_int_t          rc;
+    ngx_buf_t         *b;
+    ngx_uint_t         block;
+    ngx_file_info_t    fi;
+    ngx_conf_file_t   *prev;
+    ngx_conf_cache_t  *cache;
 
 #if (NGX_SUPPRESS_WARN)
     fd = NGX_INVALID_FILE;
     prev = NULL;
+    created = 0;
 #endif
 
     if (filename) {
 
-        /* open configuration file */
+        if (cf->conf_file == NULL) {
+            ngx_conf_cache_generation++;
+        }
+
+        cache = ngx_conf_cache_lookup(filename, &fi);
 
-        fd = ngx_open_file(filename->data, NGX_FILE_RDONLY, NGX_FILE_OPEN, 0);
-        if (fd == NGX_INVALID_FILE) {
-            ngx_conf_log_error(NGX_LOG_EMERG, cf, ngx_errno,
-                               ngx_open_file_n " \"%s\" failed",
-                               filename->data);
-            return NGX_CONF_ERROR;
+        if (cache == NULL) {
+
+            /* open configuration file */
+
+            fd = ngx_open_file(filename->data, NGX_FILE_RDONLY,
+                               NGX_FILE_OPEN, 0);
+            if (fd == NGX_INVALID_FILE) {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, ngx_errno,
+                                   ngx_open_file_n " \"%s\" failed",
+                                   filename->data);
+                return NGX_CONF_ERROR;
+            }
+
+            created = ngx_time();
+
+        } else {
+            fd = NGX_INVALID_FILE;
         }
 
         prev = cf->conf_file;
 
-        cf->conf_file = ngx_palloc(cf->pool, sizeof(ngx_conf_file_t));
+        cf->conf_file = ngx_pcalloc(cf->pool, sizeof(ngx_conf_file_t));
         if (cf->conf_file == NULL) {
             return NGX_CONF_ERROR;
         }
 
-        if (ngx_fd_info(fd, &cf->conf_file->file.info) == -1) {
-            ngx_log_error(NGX_LOG_EMERG, cf->log, ngx_errno,
-                          ngx_fd_info_n " \"%s\" failed", filename->data);
-        }
-
         b = ngx_calloc_buf(cf->pool);
         if (b == NULL) {
             return NGX_CONF_ERROR;
         }
 
-        cf->conf_file->buffer = b;
+        cf->conf_file->tokens = b;
 
-        b->start = ngx_alloc(ngx_pagesize, cf->log);
-        if (b->start == NULL) {
-            return NGX_CONF_ERROR;
-        }
+        if (cache) {
+            ngx_log_debug1(NGX_LOG_DEBUG_CORE, cf->log, 0,
+                           "conf cache hit: \"%s\"", filename->data);
+
+            cache->generation = ngx_conf_cache_generation;
 
-        b->pos = b->start;
-        b->last = b->start;
-        b->end = b->last + ngx_pagesize;
-        b->temporary = 1;
+            cf->conf_file->file.info = fi;
+            cf->conf_file->replay = 1;
+
+            b->start = cache->tokens;
+            b->pos = cache->tokens;
+            b->last = cache->tokens + cache->len;
+            b->end = b->last;
+
+        } else {
+            if (ngx_fd_info(fd, &cf->conf_file->file.info) == -1) {
+                ngx_log_error(NGX_LOG_EMERG, cf->log, ngx_errno,
+                              ngx_fd_info_n " \"%s\" failed", filename->data);
+            }
+
+            b->start = ngx_alloc(ngx_pagesize, cf->log);
+            if (b->start == NULL) {
+                return NGX_CONF_ERROR;
+            }
+
+            b->pos = b->start;
+            b->last = b->start;
+            b->end = b->last + ngx_pagesize;
+            b->temporary = 1;
+
+            b = ngx_calloc_buf(cf->pool);
+            if (b == NULL) {
+                return NGX_CONF_ERROR;
+            }
+
+            cf->conf_file->buffer = b;
+
+            b->start = ngx_alloc(ngx_pagesize, cf->log);
+            if (b->start == NULL) {
+                return NGX_CONF_ERROR;
+            }
+
+            b->pos = b->start;
+            b->last = b->start;
+            b->end = b->last + ngx_pagesize;
+            b->temporary = 1;
+        }
 
         cf->conf_file->file.fd = fd;
         cf->conf_file->file.name.len = filename->len;
@@ -198,17 +295,33 @@ failed:
 
 done:
 
-    if (filename) {
+    if (filename && !cf->conf_file->replay) {
         ngx_free(cf->conf_file->buffer->start);
 
+        b = cf->conf_file->tokens;
+
+        if (rc == NGX_CONF_FILE_DONE && b->start) {
+            ngx_conf_cache_add(cf, filename, &cf->conf_file->file.info,
+                               created, b);
+
+        } else {
+            ngx_free(b->start);
+        }
+
         if (ngx_close_file(fd) == NGX_FILE_ERROR) {
             ngx_log_error(NGX_LOG_ALERT, cf->log, ngx_errno,
                           ngx_close_file_n " %s failed",
                           cf->conf_file->file.name.data);
             return NGX_CONF_ERROR;
         }
+    }
 
+    if (filename) {
         cf->conf_file = prev;
+
+        if (prev == NULL && rc != NGX_ERROR) {
+            ngx_conf_cache_expire();
+        }
     }
 
     if (rc == NGX_ERROR) {
@@ -375,6 +488,33 @@ invalid:
 
 static ngx_int_t
 ngx_conf_read_token(ngx_conf_t *cf)
+{
+    ngx_int_t  rc;
+
+    if (cf->conf_file->replay) {
+        return ngx_conf_replay_token(cf);
+    }
+
+    rc = ngx_conf_scan_token(cf);
+
+    if (cf->conf_file->tokens == NULL || cf->conf_file->tokens->start == NULL) {
+        return rc;
+    }
+
+    if (rc == NGX_OK || rc == NGX_CONF_BLOCK_START || rc == NGX_CONF_BLOCK_DONE)
+    {
+        if (ngx_conf_record_token(cf, rc) != NGX_OK) {
+            ngx_free(cf->conf_file->tokens->start);
+            cf->conf_file->tokens->start = NULL;
+        }
+    }
+
+    return rc;
+}
+
+
+static ngx_int_t
+ngx_conf_scan_token(ngx_conf_t *cf)
 {
     u_char      *start, ch, *src, *dst;
     int          len;
@@ -628,6 +768,238 @@ ngx_conf_read_token(ngx_conf_t *cf)
 }
 
 
+static ngx_int_t
+ngx_conf_replay_token(ngx_conf_t *cf)
+{
+    uint32_t    rc, line, nargs, len;
+    ngx_buf_t  *b;
+    ngx_str_t  *word;
+
+    cf->args->nelts = 0;
+    b = cf->conf_file->tokens;
+
+    if (b->pos == b->last) {
+        return NGX_CONF_FILE_DONE;
+    }
+
+    ngx_memcpy(&rc, b->pos, sizeof(uint32_t));
+    b->pos += sizeof(uint32_t);
+    ngx_memcpy(&line, b->pos, sizeof(uint32_t));
+    b->pos += sizeof(uint32_t);
+    ngx_memcpy(&nargs, b->pos, sizeof(uint32_t));
+    b->pos += sizeof(uint32_t);
+
+    cf->conf_file->line = line;
+
+    while (nargs--) {
+        ngx_memcpy(&len, b->pos, sizeof(uint32_t));
+        b->pos += sizeof(uint32_t);
+
+        word = ngx_array_push(cf->args);
+        if (word == NULL) {
+            return NGX_ERROR;
+        }
+
+        /* the directive handlers keep the arguments in the cycle pool */
+
+        word->data = ngx_palloc(cf->pool, len + 1);
+        if (word->data == NULL) {
+            return NGX_ERROR;
+        }
+
+        ngx_memcpy(word->data, b->pos, len + 1);
+        word->len = len;
+
+        b->pos += len + 1;
+    }
+
+    return rc;
+}
+
+
+static ngx_int_t
+ngx_conf_record_token(ngx_conf_t *cf, ngx_int_t rc)
+{
+    u_char      *p;
+    size_t       size, len;
+    uint32_t     n;
+    ngx_str_t   *word;
+    ngx_buf_t   *b;
+    ngx_uint_t   i;
+
+    word = cf->args->elts;
+
+    size = 3 * sizeof(uint32_t);
+
+    for (i = 0; i < cf->args->nelts; i++) {
+        size += sizeof(uint32_t) + word[i].len + 1;
+    }
+
+    b = cf->conf_file->tokens;
+
+    if ((size_t) (b->end - b->last) < size) {
+        len = 2 * (b->end - b->start);
+
+        if (len < (size_t) (b->last - b->start) + size) {
+            len = (b->last - b->start) + size;
+        }
+
+        p = ngx_alloc(len, cf->log);
+        if (p == NULL) {
+            return NGX_ERROR;
+        }
+
+        b->last = ngx_cpymem(p, b->start, b->last - b->start);
+        ngx_free(b->start);
+
+        b->start = p;
+        b->pos = p;
+        b->end = p + len;
+    }
+
+    p = b->last;
+
+    n = (uint32_t) rc;
+    p = ngx_cpymem(p, &n, sizeof(uint32_t));
+    n = (uint32_t) cf->conf_file->line;
+    p = ngx_cpymem(p, &n, sizeof(uint32_t));
+    n = (uint32_t) cf->args->nelts;
+    p = ngx_cpymem(p, &n, sizeof(uint32_t));
+
+    for (i = 0; i < cf->args->nelts; i++) {
+        n = (uint32_t) word[i].len;
+        p = ngx_cpymem(p, &n, sizeof(uint32_t));
+        p = ngx_cpymem(p, word[i].data, word[i].len + 1);
+    }
+
+    b->last = p;
+
+    return NGX_OK;
+}
+
+
+static ngx_conf_cache_t *
+ngx_conf_cache_lookup(ngx_str_t *name, ngx_file_info_t *fi)
+{
+    ngx_conf_cache_t  *cache;
+
+    for (cache = ngx_conf_cache[ngx_hash_key(name->data, name->len)
+                                % NGX_CONF_CACHE_HASH];
+         cache;
+         cache = cache->next)
+    {
+        if (cache->name.len == name->len
+            && ngx_strcmp(cache->name.data, name->data) == 0)
+        {
+            break;
+        }
+    }
+
+    if (cache == NULL) {
+        return NULL;
+    }
+
+    if (ngx_file_info(name->data, fi) == -1) {
+        return NULL;
+    }
+
+    /*
+     * the file modified in the same second when it was read
+     * may be changed again without the modification time change
+     */
+
+    if (cache->uniq != (ngx_uint_t) ngx_file_uniq(fi)
+        || cache->size != ngx_file_size(fi)
+        || cache->mtime != ngx_file_mtime(fi)
+        || cache->mtime >= cache->created)
+    {
+        return NULL;
+    }
+
+    return cache;
+}
+
+
+static void
+ngx_conf_cache_add(ngx_conf_t *cf, ngx_str_t *name, ngx_file_info_t *fi,
+    time_t created, ngx_buf_t *tokens)
+{
+    ngx_uint_t         key;
+    ngx_conf_cache_t  *cache, **cachep;
+
+    key = ngx_hash_key(name->data, name->len) % NGX_CONF_CACHE_HASH;
+
+    for (cachep = &ngx_conf_cache[key]; *cachep; cachep = &(*cachep)->next) {
+        cache = *cachep;
+
+        if (cache->name.len == name->len
+            && ngx_strcmp(cache->name.data, name->data) == 0)
+        {
+            *cachep = cache->next;
+
+            ngx_free(cache->tokens);
+            ngx_free(cache);
+
+            break;
+        }
+    }
+
+    cache = ngx_alloc(sizeof(ngx_conf_cache_t) + name->len + 1, cf->log);
+    if (cache == NULL) {
+        ngx_free(tokens->start);
+        return;
+    }
+
+    cache->name.len = name->len;
+    cache->name.data = (u_char *) cache + sizeof(ngx_conf_cache_t);
+    ngx_memcpy(cache->name.data, name->data, name->len + 1);
+
+    cache->uniq = (ngx_uint_t) ngx_file_uniq(fi);
+    cache->size = ngx_file_size(fi);
+    cache->mtime = ngx_file_mtime(fi);
+    cache->created = created;
+    cache->generation = ngx_conf_cache_generation;
+
+    cache->tokens = tokens->start;
+    cache->len = tokens->last - tokens->start;
+
+    cache->next = ngx_conf_cache[key];
+    ngx_conf_cache[key] = cache;
+
+    ngx_log_debug2(NGX_LOG_DEBUG_CORE, cf->log, 0,
+                   "conf cache add: \"%s\" %uz", name->data, cache->len);
+}
+
+
+static void
+ngx_conf_cache_expire(void)
+{
+    ngx_uint_t         i;
+    ngx_conf_cache_t  *cache, **cachep;
+
+    /* the files that were not used by the last configuration */
+
+    for (i = 0; i < NGX_CONF_CACHE_HASH; i++) {
+
+        cachep = &ngx_conf_cache[i];
+
+        while (*cachep) {
+            cache = *cachep;
+
+            if (cache->generation == ngx_conf_cache_generation) {
+                cachep = &cache->next;
+                continue;
+            }
+
+            *cachep = cache->next;
+
+            ngx_free(cache->tokens);
+            ngx_free(cache);
+        }
+    }
+}
+
+
 static char *
 ngx_conf_include(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 {
@@ -798,6 +1170,9 @@ ngx_conf_open_file(ngx_cycle_t *cycle, ngx_str_t *name)
     }
 
     file->buffer = NULL;
+    file->ring = NULL;
+    file->flush = NULL;
+    file->data = NULL;
 
     return file;
 }
@@ -833,6 +1208,11 @@ ngx_conf_flush_files(ngx_cycle_t *cycle)
             continue;
         }
 
+        if (file[i].flush) {
+            file[i].flush(&file[i], cycle->log);
+            continue;
+        }
+
         n = ngx_write_fd(file[i].fd, file[i].buffer, len);
 
         if (n == NGX_FILE_ERROR) {
@@ -94,12 +94,17 @@ struct ngx_open_file_s {
     u_char               *pos;
     u_char               *last;
 
+    ngx_log_ring_t       *ring;
+
+    /* writes out the buffer, e.g. compressing it */
+    void                (*flush)(ngx_open_file_t *file, ngx_log_t *log);
+    void                 *data;
+
 #if 0
     /* e.g. append mode, error_log */
     ngx_uint_t            flags;
     /* e.g. reopen db file */
     ngx_uint_t          (*handler)(void *data, ngx_open_file_t *file);
-    void                 *data;
 #endif
 };
 
@@ -155,6 +160,10 @@ typedef struct {
     ngx_file_t            file;
     ngx_buf_t            *buffer;
     ngx_uint_t            line;
+
+    /* the token stream that is replayed from or recorded to the parse cache */
+    ngx_buf_t            *tokens;
+    unsigned              replay:1;
 } ngx_conf_file_t;
 
 
@@ -136,6 +136,10 @@ struct ngx_connection_s {
 
     ngx_uint_t          requests;
 
+#if (NGX_HTTP_STATUS)
+    uint64_t            start_usec;
+#endif
+
     unsigned            buffered:8;
 
     unsigned            log_error:3;     /* ngx_connection_log_error_e */
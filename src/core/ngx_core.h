@@ -20,6 +20,7 @@ typedef struct ngx_command_s     ngx_command_t;
 typedef struct ngx_file_s        ngx_file_t;
 typedef struct ngx_event_s       ngx_event_t;
 typedef struct ngx_connection_s  ngx_connection_t;
+typedef struct ngx_syslog_peer_s ngx_syslog_peer_t;
 
 typedef void (*ngx_event_handler_pt)(ngx_event_t *ev);
 typedef void (*ngx_connection_handler_pt)(ngx_connection_t *c);
@@ -71,6 +72,8 @@ typedef void (*ngx_connection_handler_pt)(ngx_connection_t *c);
 #include <ngx_event_openssl.h>
 #endif
 #include <ngx_process_cycle.h>
+#include <ngx_log_ring.h>
+#include <ngx_syslog.h>
 #include <ngx_conf_file.h>
 #include <ngx_resolver.h>
 #include <ngx_open_file_cache.h>
@@ -996,7 +996,10 @@ ngx_reopen_files(ngx_cycle_t *cycle, ngx_uid_t user)
 
         len = file[i].pos - file[i].buffer;
 
-        if (file[i].buffer && len != 0) {
+        if (file[i].buffer && len != 0 && file[i].flush) {
+            file[i].flush(&file[i], cycle->log);
+
+        } else if (file[i].buffer && len != 0) {
 
             n = ngx_write_fd(file[i].fd, file[i].buffer, len);
 
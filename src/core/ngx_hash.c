@@ -8,6 +8,10 @@
 #include <ngx_core.h>
 
 
+static ngx_int_t ngx_hash_perfect_init(ngx_hash_init_t *hinit,
+    ngx_hash_key_t *names, ngx_uint_t nelts);
+
+
 void *
 ngx_hash_find(ngx_hash_t *hash, ngx_uint_t key, u_char *name, size_t len)
 {
@@ -22,7 +26,15 @@ ngx_hash_find(ngx_hash_t *hash, ngx_uint_t key, u_char *name, size_t len)
     ngx_log_error(NGX_LOG_ALERT, ngx_cycle->log, 0, "hf:\"%V\"", &line);
 #endif
 
-    elt = hash->buckets[key % hash->size];
+    if (hash->displacements) {
+        i = ngx_hash_perfect_key(key, 0) % hash->bins;
+        i = ngx_hash_perfect_key(key, hash->displacements[i] + 1) % hash->size;
+
+    } else {
+        i = key % hash->size;
+    }
+
+    elt = hash->buckets[i];
 
     if (elt == NULL) {
         return NULL;
@@ -235,6 +247,7 @@ ngx_hash_init(ngx_hash_init_t *hinit, ngx_hash_key_t *names, ngx_uint_t nelts)
     u_char          *elts;
     size_t           len;
     u_short         *test;
+    ngx_int_t        rc;
     ngx_uint_t       i, n, key, size, start, bucket_size;
     ngx_hash_elt_t  *elt, **buckets;
 
@@ -246,7 +259,15 @@ ngx_hash_init(ngx_hash_init_t *hinit, ngx_hash_key_t *names, ngx_uint_t nelts)
                           &names[n].key, names[n].key.len);
             return NGX_ERROR;
         }
+    }
+
+    rc = ngx_hash_perfect_init(hinit, names, nelts);
+
+    if (rc != NGX_DECLINED) {
+        return rc;
+    }
 
+    for (n = 0; n < nelts; n++) {
         if (hinit->bucket_size < NGX_HASH_ELT_SIZE(&names[n]) + sizeof(void *))
         {
             ngx_log_error(NGX_LOG_EMERG, hinit->pool->log, 0,
@@ -411,6 +432,8 @@ found:
 
     hinit->hash->buckets = buckets;
     hinit->hash->size = size;
+    hinit->hash->displacements = NULL;
+    hinit->hash->bins = 0;
 
 #if 0
 
@@ -446,6 +469,243 @@ found:
 }
 
 
+/*
+ * The perfect hash is built using the "hash and displace" method.
+ * The keys are split into the bins by the first hash function, then
+ * the bins are placed starting from the largest one: for each bin the
+ * displacement is searched that maps all its keys to the free slots.
+ * So a lookup costs two hash calculations and a single slot probe,
+ * and there are no bucket size and hash size limits to tune.
+ *
+ * The keys with the same hash value can not be separated, they share
+ * the slot and are found by the linear search as in the ordinary hash.
+ */
+
+static ngx_int_t
+ngx_hash_perfect_init(ngx_hash_init_t *hinit, ngx_hash_key_t *names,
+    ngx_uint_t nelts)
+{
+    u_char          *elts, *busy;
+    size_t           len;
+    u_short         *test, *displacements;
+    ngx_uint_t       i, j, n, d, s, bin, bins, size, max, *first, *next,
+                    *slot, *nkeys;
+    ngx_hash_elt_t  *elt, **buckets;
+
+    n = 0;
+
+    for (i = 0; i < nelts; i++) {
+        if (names[i].key.data) {
+            n++;
+        }
+    }
+
+    if (n == 0) {
+        return NGX_DECLINED;
+    }
+
+    bins = n / NGX_HASH_PERFECT_BIN + 1;
+
+    /* the load factor is 0.8 */
+    size = n + n / 4 + 1;
+
+    len = (2 * bins + 2 * nelts) * sizeof(ngx_uint_t)
+          + size * (sizeof(u_short) + 1);
+
+    first = ngx_alloc(len, hinit->pool->log);
+    if (first == NULL) {
+        return NGX_ERROR;
+    }
+
+    nkeys = first + bins;
+    next = nkeys + bins;
+    slot = next + nelts;
+    test = (u_short *) (slot + nelts);
+    busy = (u_char *) (test + size);
+
+    ngx_memzero(nkeys, bins * sizeof(ngx_uint_t));
+    ngx_memzero(busy, size);
+
+    for (bin = 0; bin < bins; bin++) {
+        first[bin] = nelts;
+    }
+
+    max = 0;
+
+    for (i = 0; i < nelts; i++) {
+        if (names[i].key.data == NULL) {
+            continue;
+        }
+
+        bin = ngx_hash_perfect_key(names[i].key_hash, 0) % bins;
+
+        next[i] = first[bin];
+        first[bin] = i;
+
+        if (++nkeys[bin] > max) {
+            max = nkeys[bin];
+        }
+    }
+
+    displacements = ngx_pcalloc(hinit->pool, bins * sizeof(u_short));
+    if (displacements == NULL) {
+        ngx_free(first);
+        return NGX_ERROR;
+    }
+
+    for ( /* void */ ; max; max--) {
+
+        for (bin = 0; bin < bins; bin++) {
+
+            if (nkeys[bin] != max) {
+                continue;
+            }
+
+            for (d = 0; d < NGX_HASH_PERFECT_TRIES; d++) {
+
+                for (i = first[bin]; i != nelts; i = next[i]) {
+
+                    s = ngx_hash_perfect_key(names[i].key_hash, d + 1) % size;
+
+                    if (busy[s]) {
+                        goto next;
+                    }
+
+                    for (j = first[bin]; j != i; j = next[j]) {
+                        if (slot[j] == s
+                            && (uint32_t) names[j].key_hash
+                               != (uint32_t) names[i].key_hash)
+                        {
+                            goto next;
+                        }
+                    }
+
+                    slot[i] = s;
+                }
+
+                goto found;
+
+            next:
+
+                continue;
+            }
+
+            ngx_log_debug1(NGX_LOG_DEBUG_CORE, hinit->pool->log, 0,
+                           "could not build the perfect %s", hinit->name);
+
+            ngx_free(first);
+
+            return NGX_DECLINED;
+
+        found:
+
+            displacements[bin] = (u_short) d;
+
+            for (i = first[bin]; i != nelts; i = next[i]) {
+                busy[slot[i]] = 1;
+            }
+        }
+    }
+
+    for (s = 0; s < size; s++) {
+        test[s] = sizeof(void *);
+    }
+
+    len = 0;
+
+    for (i = 0; i < nelts; i++) {
+        if (names[i].key.data == NULL) {
+            continue;
+        }
+
+        s = slot[i];
+
+        test[s] = (u_short) (test[s] + NGX_HASH_ELT_SIZE(&names[i]));
+        len += NGX_HASH_ELT_SIZE(&names[i]);
+    }
+
+    for (s = 0; s < size; s++) {
+        if (busy[s]) {
+            len += sizeof(void *);
+        }
+    }
+
+    if (hinit->hash == NULL) {
+        hinit->hash = ngx_pcalloc(hinit->pool, sizeof(ngx_hash_wildcard_t)
+                                             + size * sizeof(ngx_hash_elt_t *));
+        if (hinit->hash == NULL) {
+            ngx_free(first);
+            return NGX_ERROR;
+        }
+
+        buckets = (ngx_hash_elt_t **)
+                      ((u_char *) hinit->hash + sizeof(ngx_hash_wildcard_t));
+
+    } else {
+        buckets = ngx_pcalloc(hinit->pool, size * sizeof(ngx_hash_elt_t *));
+        if (buckets == NULL) {
+            ngx_free(first);
+            return NGX_ERROR;
+        }
+    }
+
+    elts = ngx_palloc(hinit->pool, len);
+    if (elts == NULL) {
+        ngx_free(first);
+        return NGX_ERROR;
+    }
+
+    for (s = 0; s < size; s++) {
+        if (!busy[s]) {
+            continue;
+        }
+
+        buckets[s] = (ngx_hash_elt_t *) elts;
+        elts += test[s];
+
+        test[s] = 0;
+    }
+
+    for (i = 0; i < nelts; i++) {
+        if (names[i].key.data == NULL) {
+            continue;
+        }
+
+        s = slot[i];
+
+        elt = (ngx_hash_elt_t *) ((u_char *) buckets[s] + test[s]);
+
+        elt->value = names[i].value;
+        elt->len = (u_char) names[i].key.len;
+
+        for (j = 0; j < names[i].key.len; j++) {
+            elt->name[j] = ngx_tolower(names[i].key.data[j]);
+        }
+
+        test[s] = (u_short) (test[s] + NGX_HASH_ELT_SIZE(&names[i]));
+    }
+
+    for (s = 0; s < size; s++) {
+        if (buckets[s] == NULL) {
+            continue;
+        }
+
+        elt = (ngx_hash_elt_t *) ((u_char *) buckets[s] + test[s]);
+
+        elt->value = NULL;
+    }
+
+    ngx_free(first);
+
+    hinit->hash->buckets = buckets;
+    hinit->hash->size = size;
+    hinit->hash->displacements = displacements;
+    hinit->hash->bins = bins;
+
+    return NGX_OK;
+}
+
+
 ngx_int_t
 ngx_hash_wildcard_init(ngx_hash_init_t *hinit, ngx_hash_key_t *names,
     ngx_uint_t nelts)
@@ -22,6 +22,10 @@ typedef struct {
 typedef struct {
     ngx_hash_elt_t  **buckets;
     ngx_uint_t        size;
+
+    /* the perfect hash: the displacements of the first level bins */
+    u_short          *displacements;
+    ngx_uint_t        bins;
 } ngx_hash_t;
 
 
@@ -67,6 +71,10 @@ typedef struct {
 #define NGX_HASH_LARGE_ASIZE      16384
 #define NGX_HASH_LARGE_HSIZE      10007
 
+/* the average number of keys in the perfect hash bin */
+#define NGX_HASH_PERFECT_BIN      4
+#define NGX_HASH_PERFECT_TRIES    65535
+
 #define NGX_HASH_WILDCARD_KEY     1
 #define NGX_HASH_READONLY_KEY     2
 
@@ -116,4 +124,21 @@ ngx_int_t ngx_hash_add_key(ngx_hash_keys_arrays_t *ha, ngx_str_t *key,
     void *value, ngx_uint_t flags);
 
 
+static ngx_inline ngx_uint_t
+ngx_hash_perfect_key(ngx_uint_t key, ngx_uint_t seed)
+{
+    uint32_t  h;
+
+    h = (uint32_t) key ^ ((uint32_t) seed * 0x9e3779b9);
+
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+
+    return h;
+}
+
+
 #endif /* _NGX_HASH_H_INCLUDED_ */
@@ -81,7 +81,7 @@ ngx_log_error_core(ngx_uint_t level, ngx_log_t *log, ngx_err_t err,
 #endif
     u_char   errstr[NGX_MAX_ERROR_STR], *p, *last;
 
-    if (log->file->fd == NGX_INVALID_FILE) {
+    if (log->file->fd == NGX_INVALID_FILE && log->syslog == NULL) {
         return;
     }
 
@@ -144,6 +144,16 @@ ngx_log_error_core(ngx_uint_t level, ngx_log_t *log, ngx_err_t err,
         p = log->handler(log, p, last - p);
     }
 
+    if (log->syslog) {
+
+        /* syslog adds its own time, the nginx levels start from "stderr" */
+
+        ngx_syslog_send(log->syslog, level ? level - 1 : 0,
+                        errstr + ngx_cached_err_log_time.len + 1,
+                        p - errstr - ngx_cached_err_log_time.len - 1);
+        return;
+    }
+
     if (p > last - NGX_LINEFEED_SIZE) {
         p = last - NGX_LINEFEED_SIZE;
     }
@@ -256,6 +266,28 @@ ngx_log_create_errlog(ngx_cycle_t *cycle, ngx_array_t *args)
 }
 
 
+ngx_syslog_peer_t *
+ngx_log_create_syslog(ngx_conf_t *cf, ngx_str_t *value)
+{
+    ngx_syslog_peer_t  *peer;
+
+    peer = ngx_syslog_create(cf, value);
+    if (peer == NULL) {
+        return NULL;
+    }
+
+    /* the master process has no timers to send a batch */
+
+    if (peer->start) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "\"batch\" is not supported for error_log");
+        return NULL;
+    }
+
+    return peer;
+}
+
+
 char *
 ngx_set_error_log_levels(ngx_conf_t *cf, ngx_log_t *log)
 {
@@ -325,6 +357,15 @@ ngx_set_error_log(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
         cf->cycle->new_log->file->name.len = 0;
         cf->cycle->new_log->file->name.data = NULL;
 
+    } else if (ngx_strncmp(value[1].data, "syslog:", 7) == 0) {
+
+        /* the default file is still opened for the early startup messages */
+
+        cf->cycle->new_log->syslog = ngx_log_create_syslog(cf, &value[1]);
+        if (cf->cycle->new_log->syslog == NULL) {
+            return NGX_CONF_ERROR;
+        }
+
     } else {
         cf->cycle->new_log->file->name = value[1];
 
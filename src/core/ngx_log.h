@@ -47,6 +47,7 @@ typedef u_char *(*ngx_log_handler_pt) (ngx_log_t *log, u_char *buf, size_t len);
 struct ngx_log_s {
     ngx_uint_t           log_level;
     ngx_open_file_t     *file;
+    ngx_syslog_peer_t   *syslog;
 
     ngx_atomic_uint_t    connection;
 
@@ -197,6 +198,7 @@ void ngx_cdecl ngx_log_debug_core(ngx_log_t *log, ngx_err_t err,
 
 ngx_log_t *ngx_log_init(void);
 ngx_log_t *ngx_log_create_errlog(ngx_cycle_t *cycle, ngx_array_t *args);
+ngx_syslog_peer_t *ngx_log_create_syslog(ngx_conf_t *cf, ngx_str_t *value);
 char *ngx_set_error_log_levels(ngx_conf_t *cf, ngx_log_t *log);
 void ngx_log_abort(ngx_err_t err, const char *text, void *param);
 
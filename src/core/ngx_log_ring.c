@@ -0,0 +1,370 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+
+
+/*
+ * The log ring is a byte ring in the shared memory: the worker processes
+ * reserve the space for a record by moving the head atomically, format
+ * the record in place and commit it by setting its length.  The single
+ * writer process writes the committed records from the tail to the file
+ * and moves the tail.  A record never wraps around the ring end, the rest
+ * of the ring is skipped by a padding record.
+ *
+ * The head and tail grow monotonically, the ring size is a power of two,
+ * so their wrap around the ngx_atomic_uint_t does not break the offsets.
+ *
+ * The writer zeroes the released space before it moves the tail, so the
+ * header of a just reserved record reads as uncommitted.  The record keeps
+ * the pid of its process: an uncommitted record is skipped only after its
+ * process has exited, because a live process still may write in it.
+ *
+ * The producer that fills the ring over the half wakes the writer up by
+ * SIGIO instead of waiting for its flush timer.  The exiting writer closes
+ * the ring by the low bit of the head, so no record may be reserved after
+ * its last flush.
+ */
+
+typedef struct {
+    uint32_t             size;
+    uint32_t             len;
+    uint32_t             pid;
+    uint32_t             reserved;
+} ngx_log_ring_rec_t;
+
+
+#define NGX_LOG_RING_PAD     0xffffffff
+#define NGX_LOG_RING_WAKEUP  SIGIO
+
+
+static void ngx_log_ring_clear(ngx_log_ring_t *ring, ngx_atomic_uint_t from,
+    ngx_atomic_uint_t to);
+
+
+u_char *
+ngx_log_ring_reserve(ngx_log_ring_t *ring, size_t len)
+{
+    size_t               size, pad;
+    ngx_pid_t            pid;
+    ngx_atomic_uint_t    head, tail, off;
+    ngx_log_ring_rec_t  *rec;
+
+    size = ngx_align(sizeof(ngx_log_ring_rec_t) + len,
+                     sizeof(ngx_log_ring_rec_t));
+
+    if (size > ring->size / 4) {
+        return NULL;
+    }
+
+    for ( ;; ) {
+        head = ring->head;
+        tail = ring->tail;
+
+        if (head & NGX_LOG_RING_CLOSED) {
+            return NULL;
+        }
+
+        off = head & (ring->size - 1);
+        pad = (off + size > ring->size) ? ring->size - off : 0;
+
+        if (head + pad + size - tail > ring->size) {
+            return NULL;
+        }
+
+        if (ngx_atomic_cmp_set(&ring->head, head, head + pad + size)) {
+            break;
+        }
+    }
+
+    if (head + pad + size - tail > ring->size / 2
+        && ring->wakeup == 0
+        && ngx_atomic_cmp_set(&ring->wakeup, 0, 1))
+    {
+        pid = (ngx_pid_t) ring->writer;
+
+        if (pid) {
+            (void) kill(pid, NGX_LOG_RING_WAKEUP);
+        }
+    }
+
+    if (pad) {
+        rec = (ngx_log_ring_rec_t *) (ring->start + off);
+        rec->size = (uint32_t) pad;
+        rec->pid = (uint32_t) ngx_pid;
+
+        ngx_memory_barrier();
+
+        rec->len = NGX_LOG_RING_PAD;
+
+        off = 0;
+    }
+
+    rec = (ngx_log_ring_rec_t *) (ring->start + off);
+    rec->size = (uint32_t) size;
+    rec->pid = (uint32_t) ngx_pid;
+
+    return (u_char *) rec + sizeof(ngx_log_ring_rec_t);
+}
+
+
+void
+ngx_log_ring_commit(u_char *p, size_t len)
+{
+    ngx_log_ring_rec_t  *rec;
+
+    /* len must not be zero: it marks the uncommitted records */
+
+    rec = (ngx_log_ring_rec_t *) (p - sizeof(ngx_log_ring_rec_t));
+
+    ngx_memory_barrier();
+
+    rec->len = (uint32_t) len;
+}
+
+
+ngx_int_t
+ngx_log_ring_attach(ngx_log_ring_t *ring)
+{
+    ngx_pid_t          pid;
+    ngx_atomic_uint_t  head;
+
+    pid = (ngx_pid_t) ring->writer;
+
+    if (pid == ngx_pid) {
+        return NGX_OK;
+    }
+
+    if (pid && !(kill(pid, 0) == -1 && ngx_errno == NGX_ESRCH)) {
+        return NGX_BUSY;
+    }
+
+    /* the ring is free or its writer has exited */
+
+    if (!ngx_atomic_cmp_set(&ring->writer, pid, ngx_pid)) {
+        return NGX_BUSY;
+    }
+
+    /* reopen the ring closed by the previous writer */
+
+    for ( ;; ) {
+        head = ring->head;
+
+        if (!(head & NGX_LOG_RING_CLOSED)) {
+            return NGX_OK;
+        }
+
+        if (ngx_atomic_cmp_set(&ring->head, head,
+                               head & ~NGX_LOG_RING_CLOSED))
+        {
+            return NGX_OK;
+        }
+    }
+}
+
+
+void
+ngx_log_ring_close(ngx_log_ring_t *ring)
+{
+    ngx_atomic_uint_t  head;
+
+    for ( ;; ) {
+        head = ring->head;
+
+        if (head & NGX_LOG_RING_CLOSED) {
+            return;
+        }
+
+        if (ngx_atomic_cmp_set(&ring->head, head,
+                               head | NGX_LOG_RING_CLOSED))
+        {
+            return;
+        }
+    }
+}
+
+
+void
+ngx_log_ring_detach(ngx_log_ring_t *ring)
+{
+    (void) ngx_atomic_cmp_set(&ring->writer, ngx_pid, 0);
+}
+
+
+ssize_t
+ngx_log_ring_flush(ngx_log_ring_t *ring, ngx_open_file_t *file,
+    ngx_log_t *log)
+{
+    size_t                sent, size;
+    ssize_t               n;
+    uint32_t              len;
+    ngx_pid_t             pid;
+    ngx_uint_t            niovs;
+    ngx_atomic_uint_t     head, tail, t;
+    ngx_log_ring_rec_t   *rec;
+    struct iovec          iovs[NGX_IOVS_MAX];
+
+    sent = 0;
+
+    ring->wakeup = 0;
+
+    for ( ;; ) {
+        head = ring->head & ~NGX_LOG_RING_CLOSED;
+        tail = ring->tail;
+
+        niovs = 0;
+        size = 0;
+
+        for (t = tail; t != head && niovs < NGX_IOVS_MAX; t += rec->size) {
+
+            rec = (ngx_log_ring_rec_t *) (ring->start
+                                          + (t & (ring->size - 1)));
+
+            len = ((volatile ngx_log_ring_rec_t *) rec)->len;
+
+            if (len == 0) {
+                break;
+            }
+
+            ngx_memory_barrier();
+
+            if (len == NGX_LOG_RING_PAD) {
+                continue;
+            }
+
+            iovs[niovs].iov_base = (char *) rec + sizeof(ngx_log_ring_rec_t);
+            iovs[niovs].iov_len = len;
+            niovs++;
+
+            size += len;
+        }
+
+        if (t != tail) {
+
+            if (niovs) {
+                n = writev(file->fd, iovs, niovs);
+
+                if (n == -1) {
+                    ngx_log_error(NGX_LOG_ALERT, log, ngx_errno,
+                                  "writev() to \"%V\" failed", &file->name);
+
+                } else if ((size_t) n != size) {
+                    ngx_log_error(NGX_LOG_ALERT, log, 0,
+                                  "writev() to \"%V\" was incomplete: "
+                                  "%z of %uz", &file->name, n, size);
+
+                } else {
+                    sent += size;
+                }
+            }
+
+            /* release the written records */
+
+            ngx_log_ring_clear(ring, tail, t);
+
+            ngx_memory_barrier();
+
+            ring->tail = t;
+            ring->stalled = 0;
+
+            continue;
+        }
+
+        if (tail == head) {
+            return sent;
+        }
+
+        /*
+         * the record at the tail is not committed: its process is
+         * still formatting it or has exited while doing it
+         */
+
+        if (ring->stalled == 0) {
+            ring->stalled = ngx_current_msec;
+            return sent;
+        }
+
+        if (ngx_current_msec - ring->stalled < NGX_LOG_RING_STALL) {
+            return sent;
+        }
+
+        rec = (ngx_log_ring_rec_t *) (ring->start + (tail & (ring->size - 1)));
+
+        pid = (ngx_pid_t) ((volatile ngx_log_ring_rec_t *) rec)->pid;
+        size = ((volatile ngx_log_ring_rec_t *) rec)->size;
+
+        if (size == 0) {
+
+            /*
+             * the process has exited just after the reservation, before
+             * it has written the header: the record is still zeroed, so
+             * it ends at the first written header, if any
+             */
+
+            for (t = tail + sizeof(ngx_log_ring_rec_t);
+                 t != head;
+                 t += sizeof(ngx_log_ring_rec_t))
+            {
+                rec = (ngx_log_ring_rec_t *) (ring->start
+                                              + (t & (ring->size - 1)));
+
+                if (((volatile ngx_log_ring_rec_t *) rec)->size) {
+                    break;
+                }
+            }
+
+            if (t == head) {
+                return sent;
+            }
+
+            ngx_log_error(NGX_LOG_ALERT, log, 0,
+                          "record without header in \"%V\" log ring, "
+                          "%uA bytes skipped", &file->name, t - tail);
+
+        } else {
+
+            /* the process has not written its pid yet or has exited */
+
+            if (pid && !(kill(pid, 0) == -1 && ngx_errno == NGX_ESRCH)) {
+                return sent;
+            }
+
+            t = tail + size;
+
+            ngx_log_error(NGX_LOG_ALERT, log, 0,
+                          "uncommitted record of exited process %P "
+                          "in \"%V\" log ring, %uA bytes skipped",
+                          pid, &file->name, t - tail);
+        }
+
+        ngx_log_ring_clear(ring, tail, t);
+
+        ngx_memory_barrier();
+
+        ring->tail = t;
+        ring->stalled = 0;
+    }
+}
+
+
+static void
+ngx_log_ring_clear(ngx_log_ring_t *ring, ngx_atomic_uint_t from,
+    ngx_atomic_uint_t to)
+{
+    size_t  start, end;
+
+    start = from & (ring->size - 1);
+    end = to & (ring->size - 1);
+
+    if (start < end) {
+        ngx_memzero(ring->start + start, end - start);
+
+    } else {
+        ngx_memzero(ring->start + start, ring->size - start);
+        ngx_memzero(ring->start, end);
+    }
+}
@@ -0,0 +1,50 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ */
+
+
+#ifndef _NGX_LOG_RING_H_INCLUDED_
+#define _NGX_LOG_RING_H_INCLUDED_
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+
+
+#define NGX_LOG_RING_FLUSH   1000
+#define NGX_LOG_RING_STALL   10000
+
+/* the low bit of the head closes the ring for the new records */
+#define NGX_LOG_RING_CLOSED  1
+
+
+typedef struct {
+    ngx_atomic_t         head;
+    u_char               pad[NGX_CPU_CACHE_LINE - sizeof(ngx_atomic_t)];
+
+    ngx_atomic_t         tail;
+    ngx_atomic_t         writer;
+    ngx_atomic_t         wakeup;
+    ngx_msec_t           stalled;
+
+    size_t               size;
+    ngx_msec_t           flush;
+    u_char              *start;
+} ngx_log_ring_t;
+
+
+u_char *ngx_log_ring_reserve(ngx_log_ring_t *ring, size_t len);
+void ngx_log_ring_commit(u_char *p, size_t len);
+ngx_int_t ngx_log_ring_attach(ngx_log_ring_t *ring);
+void ngx_log_ring_close(ngx_log_ring_t *ring);
+void ngx_log_ring_detach(ngx_log_ring_t *ring);
+ssize_t ngx_log_ring_flush(ngx_log_ring_t *ring, ngx_open_file_t *file,
+    ngx_log_t *log);
+
+
+#define ngx_log_ring_empty(ring)                                              \
+    (((ring)->head & ~NGX_LOG_RING_CLOSED) == (ring)->tail)
+
+
+#endif /* _NGX_LOG_RING_H_INCLUDED_ */
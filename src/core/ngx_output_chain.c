@@ -17,12 +17,36 @@
 #define NGX_NONE            1
 
 
+/*
+ * the memory of the recycled output bufs is kept in the per-process cache
+ * when the request pool is destroyed and is given to the next request,
+ * so the keepalive connections do not allocate and fault in the new pages
+ * for every request
+ */
+
+#define NGX_OUTPUT_CHAIN_CACHE  (1024 * 1024)
+
+
+typedef struct ngx_output_chain_cached_s  ngx_output_chain_cached_t;
+
+struct ngx_output_chain_cached_s {
+    ngx_output_chain_cached_t  *next;
+    size_t                      size;
+};
+
+
 static ngx_inline ngx_int_t
     ngx_output_chain_need_to_copy(ngx_output_chain_ctx_t *ctx, ngx_buf_t *buf);
 static ngx_int_t ngx_output_chain_add_copy(ngx_pool_t *pool,
     ngx_chain_t **chain, ngx_chain_t *in);
 static ngx_int_t ngx_output_chain_copy_buf(ngx_buf_t *dst, ngx_buf_t *src,
     ngx_uint_t sendfile);
+static ngx_buf_t *ngx_output_chain_alloc_buf(ngx_pool_t *pool, size_t size);
+static void ngx_output_chain_cache_buf(void *data);
+
+
+static ngx_output_chain_cached_t  *ngx_output_chain_cache;
+static size_t                      ngx_output_chain_cached;
 
 
 ngx_int_t
@@ -161,7 +185,13 @@ ngx_output_chain(ngx_output_chain_ctx_t *ctx, ngx_chain_t *in)
                         }
                     }
 
-                    ctx->buf = ngx_create_temp_buf(ctx->pool, size);
+                    if (recycled) {
+                        ctx->buf = ngx_output_chain_alloc_buf(ctx->pool, size);
+
+                    } else {
+                        ctx->buf = ngx_create_temp_buf(ctx->pool, size);
+                    }
+
                     if (ctx->buf == NULL) {
                         return NGX_ERROR;
                     }
@@ -428,6 +458,100 @@ ngx_output_chain_copy_buf(ngx_buf_t *dst, ngx_buf_t *src, ngx_uint_t sendfile)
 }
 
 
+static ngx_buf_t *
+ngx_output_chain_alloc_buf(ngx_pool_t *pool, size_t size)
+{
+    u_char                      *p;
+    ngx_buf_t                   *b;
+    ngx_pool_cleanup_t          *cln;
+    ngx_output_chain_cached_t   *cached, **cp;
+
+    if (size < sizeof(ngx_output_chain_cached_t)) {
+        return ngx_create_temp_buf(pool, size);
+    }
+
+    b = ngx_calloc_buf(pool);
+    if (b == NULL) {
+        return NULL;
+    }
+
+    cln = ngx_pool_cleanup_add(pool, 0);
+    if (cln == NULL) {
+        return NULL;
+    }
+
+    p = NULL;
+
+    for (cp = &ngx_output_chain_cache; *cp; cp = &(*cp)->next) {
+
+        cached = *cp;
+
+        if (cached->size == size) {
+            *cp = cached->next;
+            ngx_output_chain_cached -= size;
+
+#if (NGX_STAT_STUB)
+            (void) ngx_atomic_fetch_add(ngx_stat_output_cached,
+                                        -(ngx_atomic_int_t) size);
+#endif
+
+            p = (u_char *) cached;
+            break;
+        }
+    }
+
+    if (p == NULL) {
+        p = ngx_alloc(size, pool->log);
+        if (p == NULL) {
+            return NULL;
+        }
+    }
+
+    ngx_log_debug2(NGX_LOG_DEBUG_CORE, pool->log, 0,
+                   "output chain buf: %p %uz", p, size);
+
+    b->start = p;
+    b->pos = p;
+    b->last = p;
+    b->end = p + size;
+    b->temporary = 1;
+
+    cln->handler = ngx_output_chain_cache_buf;
+    cln->data = b;
+
+    return b;
+}
+
+
+static void
+ngx_output_chain_cache_buf(void *data)
+{
+    ngx_buf_t *b = data;
+
+    size_t                      size;
+    ngx_output_chain_cached_t  *cached;
+
+    size = b->end - b->start;
+
+    if (ngx_output_chain_cached + size > NGX_OUTPUT_CHAIN_CACHE) {
+        ngx_free(b->start);
+        return;
+    }
+
+    cached = (ngx_output_chain_cached_t *) b->start;
+
+    cached->next = ngx_output_chain_cache;
+    cached->size = size;
+
+    ngx_output_chain_cache = cached;
+    ngx_output_chain_cached += size;
+
+#if (NGX_STAT_STUB)
+    (void) ngx_atomic_fetch_add(ngx_stat_output_cached, size);
+#endif
+}
+
+
 ngx_int_t
 ngx_chain_writer(void *data, ngx_chain_t *in)
 {
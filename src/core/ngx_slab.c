@@ -124,6 +124,11 @@ ngx_slab_init(ngx_slab_pool_t *pool)
 
     p += n * sizeof(ngx_slab_page_t);
 
+    pool->stats = (ngx_slab_stat_t *) p;
+    ngx_memzero(pool->stats, n * sizeof(ngx_slab_stat_t));
+
+    p += n * sizeof(ngx_slab_stat_t);
+
     pages = (ngx_uint_t) (size / (ngx_pagesize + sizeof(ngx_slab_page_t)));
 
     ngx_memzero(p, pages * sizeof(ngx_slab_page_t));
@@ -147,6 +152,11 @@ ngx_slab_init(ngx_slab_pool_t *pool)
         pool->pages->slab = pages;
     }
 
+    pool->npages = pages;
+    pool->pfree = pages;
+    pool->preqs = 0;
+    pool->pfails = 0;
+
 #if 0
     ngx_log_error(NGX_LOG_ALERT, ngx_cycle->log, 0, "slab: %p, %p, %ui, %d",
                   pool, pool->start, pages,
@@ -177,12 +187,16 @@ ngx_slab_alloc_locked(ngx_slab_pool_t *pool, size_t size)
     uintptr_t         p, n, m, mask, *bitmap;
     ngx_uint_t        i, slot, shift, map;
     ngx_slab_page_t  *page, *prev, *slots;
+    ngx_slab_stat_t  *stat;
 
     if (size >= ngx_slab_max_size) {
 
         ngx_log_debug1(NGX_LOG_DEBUG_ALLOC, ngx_cycle->log, 0,
                        "slab alloc: %uz", size);
 
+        stat = NULL;
+        pool->preqs++;
+
         page = ngx_slab_alloc_pages(pool, (size + ngx_pagesize - 1)
                                           >> ngx_pagesize_shift);
         if (page) {
@@ -191,6 +205,7 @@ ngx_slab_alloc_locked(ngx_slab_pool_t *pool, size_t size)
 
         } else {
             p = 0;
+            pool->pfails++;
         }
 
         goto done;
@@ -210,6 +225,9 @@ ngx_slab_alloc_locked(ngx_slab_pool_t *pool, size_t size)
     ngx_log_debug2(NGX_LOG_DEBUG_ALLOC, ngx_cycle->log, 0,
                    "slab alloc: %uz slot: %ui", size, slot);
 
+    stat = &pool->stats[slot];
+    stat->reqs++;
+
     slots = (ngx_slab_page_t *) ((u_char *) pool + sizeof(ngx_slab_pool_t));
     page = slots[slot].next;
 
@@ -373,6 +391,10 @@ ngx_slab_alloc_locked(ngx_slab_pool_t *pool, size_t size)
 
             slots[slot].next = page;
 
+            /* the bitmap occupies the first n chunks */
+
+            stat->total += (ngx_pagesize >> shift) - n;
+
             p = ((page - pool->pages) << ngx_pagesize_shift) + s * n;
             p += (uintptr_t) pool->start;
 
@@ -386,6 +408,8 @@ ngx_slab_alloc_locked(ngx_slab_pool_t *pool, size_t size)
 
             slots[slot].next = page;
 
+            stat->total += 8 * sizeof(uintptr_t);
+
             p = (page - pool->pages) << ngx_pagesize_shift;
             p += (uintptr_t) pool->start;
 
@@ -399,6 +423,8 @@ ngx_slab_alloc_locked(ngx_slab_pool_t *pool, size_t size)
 
             slots[slot].next = page;
 
+            stat->total += ngx_pagesize >> shift;
+
             p = (page - pool->pages) << ngx_pagesize_shift;
             p += (uintptr_t) pool->start;
 
@@ -410,6 +436,15 @@ ngx_slab_alloc_locked(ngx_slab_pool_t *pool, size_t size)
 
 done:
 
+    if (stat) {
+        if (p) {
+            stat->used++;
+
+        } else {
+            stat->fails++;
+        }
+    }
+
     ngx_log_debug1(NGX_LOG_DEBUG_ALLOC, ngx_cycle->log, 0, "slab alloc: %p", p);
 
     return (void *) p;
@@ -432,8 +467,9 @@ ngx_slab_free_locked(ngx_slab_pool_t *pool, void *p)
 {
     size_t            size;
     uintptr_t         slab, m, *bitmap;
-    ngx_uint_t        n, type, slot, shift, map;
+    ngx_uint_t        n, type, slot, shift, map, chunks;
     ngx_slab_page_t  *slots, *page;
+    ngx_slab_stat_t  *stat;
 
     ngx_log_debug1(NGX_LOG_DEBUG_ALLOC, ngx_cycle->log, 0, "slab free: %p", p);
 
@@ -480,6 +516,9 @@ ngx_slab_free_locked(ngx_slab_pool_t *pool, void *p)
 
             bitmap[n] &= ~m;
 
+            stat = &pool->stats[shift - pool->min_shift];
+            stat->used--;
+
             n = (1 << (ngx_pagesize_shift - shift)) / 8 / (1 << shift);
 
             if (n == 0) {
@@ -490,6 +529,8 @@ ngx_slab_free_locked(ngx_slab_pool_t *pool, void *p)
                 goto done;
             }
 
+            chunks = (ngx_pagesize >> shift) - n;
+
             map = (1 << (ngx_pagesize_shift - shift)) / (sizeof(uintptr_t) * 8);
 
             for (n = 1; n < map; n++) {
@@ -498,6 +539,8 @@ ngx_slab_free_locked(ngx_slab_pool_t *pool, void *p)
                 }
             }
 
+            stat->total -= chunks;
+
             ngx_slab_free_pages(pool, page, 1);
 
             goto done;
@@ -530,10 +573,15 @@ ngx_slab_free_locked(ngx_slab_pool_t *pool, void *p)
 
             page->slab &= ~m;
 
+            stat = &pool->stats[ngx_slab_exact_shift - pool->min_shift];
+            stat->used--;
+
             if (page->slab) {
                 goto done;
             }
 
+            stat->total -= 8 * sizeof(uintptr_t);
+
             ngx_slab_free_pages(pool, page, 1);
 
             goto done;
@@ -569,10 +617,15 @@ ngx_slab_free_locked(ngx_slab_pool_t *pool, void *p)
 
             page->slab &= ~m;
 
+            stat = &pool->stats[shift - pool->min_shift];
+            stat->used--;
+
             if (page->slab & NGX_SLAB_MAP_MASK) {
                 goto done;
             }
 
+            stat->total -= ngx_pagesize >> shift;
+
             ngx_slab_free_pages(pool, page, 1);
 
             goto done;
@@ -645,6 +698,8 @@ ngx_slab_alloc_pages(ngx_slab_pool_t *pool, ngx_uint_t pages)
 
         if (page->slab >= pages) {
 
+            pool->pfree -= pages;
+
             if (page->slab > pages) {
                 page[pages].slab = page->slab - pages;
                 page[pages].next = page->next;
@@ -692,6 +747,8 @@ ngx_slab_free_pages(ngx_slab_pool_t *pool, ngx_slab_page_t *page,
 {
     ngx_slab_page_t  *prev;
 
+    pool->pfree += pages;
+
     page->slab = pages--;
 
     if (pages) {
@@ -21,6 +21,15 @@ struct ngx_slab_page_s {
 };
 
 
+typedef struct {
+    ngx_uint_t        total;
+    ngx_uint_t        used;
+
+    ngx_uint_t        reqs;
+    ngx_uint_t        fails;
+} ngx_slab_stat_t;
+
+
 typedef struct {
     ngx_atomic_t      lock;
 
@@ -30,6 +39,14 @@ typedef struct {
     ngx_slab_page_t  *pages;
     ngx_slab_page_t   free;
 
+    ngx_slab_stat_t  *stats;
+    ngx_uint_t        npages;
+    ngx_uint_t        pfree;
+
+    /* the allocations of the whole pages */
+    ngx_uint_t        preqs;
+    ngx_uint_t        pfails;
+
     u_char           *start;
     u_char           *end;
 
@@ -8,6 +8,10 @@
 #include <ngx_core.h>
 
 
+static ngx_inline u_char *ngx_skip_word3(u_char *p, u_char *last, u_char c1,
+    u_char c2, u_char c3);
+
+
 u_char *
 ngx_cpystrn(u_char *dst, u_char *src, size_t n)
 {
@@ -521,34 +525,38 @@ ngx_strncasecmp(u_char *s1, u_char *s2, size_t n)
 u_char *
 ngx_strnstr(u_char *s1, char *s2, size_t len)
 {
-    u_char  c1, c2;
-    size_t  n;
+    u_char  *p, c2;
+    size_t   n;
 
     c2 = *(u_char *) s2++;
 
+    if (c2 == '\0') {
+        return NULL;
+    }
+
     n = ngx_strlen(s2);
 
-    do {
-        do {
-            if (len-- == 0) {
-                return NULL;
-            }
+    for ( ;; ) {
 
-            c1 = *s1++;
+        /* memchr() scans a word or a vector at a time */
 
-            if (c1 == 0) {
-                return NULL;
-            }
+        p = memchr(s1, c2, len);
+
+        if (p == NULL || memchr(s1, '\0', p - s1)) {
+            return NULL;
+        }
 
-        } while (c1 != c2);
+        len -= p - s1 + 1;
+        s1 = p + 1;
 
         if (n > len) {
             return NULL;
         }
 
-    } while (ngx_strncmp(s1, (u_char *) s2, n) != 0);
-
-    return --s1;
+        if (ngx_strncmp(s1, (u_char *) s2, n) == 0) {
+            return p;
+        }
+    }
 }
 
 
@@ -561,49 +569,56 @@ ngx_strnstr(u_char *s1, char *s2, size_t len)
 u_char *
 ngx_strstrn(u_char *s1, char *s2, size_t n)
 {
-    u_char  c1, c2;
+    u_char  c2;
 
     c2 = *(u_char *) s2++;
 
-    do {
-        do {
-            c1 = *s1++;
-
-            if (c1 == 0) {
-                return NULL;
-            }
+    if (c2 == '\0') {
+        return NULL;
+    }
 
-        } while (c1 != c2);
+    for ( ;; ) {
+        s1 = (u_char *) ngx_strchr(s1, c2);
 
-    } while (ngx_strncmp(s1, (u_char *) s2, n) != 0);
+        if (s1 == NULL) {
+            return NULL;
+        }
 
-    return --s1;
+        if (ngx_strncmp(++s1, (u_char *) s2, n) == 0) {
+            return --s1;
+        }
+    }
 }
 
 
 u_char *
 ngx_strcasestrn(u_char *s1, char *s2, size_t n)
 {
-    ngx_uint_t  c1, c2;
+    u_char  c2, set[3];
 
-    c2 = (ngx_uint_t) *s2++;
-    c2  = (c2 >= 'A' && c2 <= 'Z') ? (c2 | 0x20) : c2;
+    c2 = (u_char) *s2++;
 
-    do {
-        do {
-            c1 = (ngx_uint_t) *s1++;
+    if (c2 == '\0') {
+        return NULL;
+    }
 
-            if (c1 == 0) {
-                return NULL;
-            }
+    /* search for the both cases of the first character at once */
 
-            c1  = (c1 >= 'A' && c1 <= 'Z') ? (c1 | 0x20) : c1;
+    set[0] = (u_char) ((c2 >= 'A' && c2 <= 'Z') ? (c2 | 0x20) : c2);
+    set[1] = (u_char) ((c2 >= 'a' && c2 <= 'z') ? (c2 & ~0x20) : c2);
+    set[2] = '\0';
 
-        } while (c1 != c2);
+    for ( ;; ) {
+        s1 = (u_char *) strpbrk((char *) s1, (char *) set);
 
-    } while (ngx_strncasecmp(s1, (u_char *) s2, n) != 0);
+        if (s1 == NULL) {
+            return NULL;
+        }
 
-    return --s1;
+        if (ngx_strncasecmp(++s1, (u_char *) s2, n) == 0) {
+            return --s1;
+        }
+    }
 }
 
 
@@ -1242,7 +1257,7 @@ ngx_escape_uri(u_char *dst, u_char *src, size_t size, ngx_uint_t type)
 void
 ngx_unescape_uri(u_char **dst, u_char **src, size_t size, ngx_uint_t type)
 {
-    u_char  *d, *s, ch, c, decoded;
+    u_char  *d, *s, *p, ch, c, q, decoded;
     enum {
         sw_usual = 0,
         sw_quoted,
@@ -1255,8 +1270,32 @@ ngx_unescape_uri(u_char **dst, u_char **src, size_t size, ngx_uint_t type)
     state = 0;
     decoded = 0;
 
-    while (size--) {
+    q = (type & (NGX_UNESCAPE_URI|NGX_UNESCAPE_REDIRECT)) ? '?' : '%';
+
+    while (size) {
+
+        if (state == sw_usual) {
+
+            /* copy the run of the usual characters at once */
 
+            p = ngx_skip_word3(s, s + size, '%', q, q);
+
+            if (p != s) {
+                if (d != s) {
+                    ngx_memmove(d, s, p - s);
+                }
+
+                d += p - s;
+                size -= p - s;
+                s = p;
+
+                if (size == 0) {
+                    break;
+                }
+            }
+        }
+
+        size--;
         ch = *s++;
 
         switch (state) {
@@ -1372,14 +1411,22 @@ done:
 uintptr_t
 ngx_escape_html(u_char *dst, u_char *src, size_t size)
 {
-    u_char      ch;
-    ngx_uint_t  i, len;
+    u_char      ch, *p, *last;
+    ngx_uint_t  len;
+
+    last = src + size;
 
     if (dst == NULL) {
 
         len = 0;
 
-        for (i = 0; i < size; i++) {
+        for ( ;; ) {
+            src = ngx_skip_word3(src, last, '<', '>', '&');
+
+            if (src == last) {
+                break;
+            }
+
             switch (*src++) {
 
             case '<':
@@ -1402,7 +1449,18 @@ ngx_escape_html(u_char *dst, u_char *src, size_t size)
         return (uintptr_t) len;
     }
 
-    for (i = 0; i < size; i++) {
+    for ( ;; ) {
+        p = ngx_skip_word3(src, last, '<', '>', '&');
+
+        if (p != src) {
+            dst = ngx_cpymem(dst, src, p - src);
+            src = p;
+        }
+
+        if (src == last) {
+            break;
+        }
+
         ch = *src++;
 
         switch (ch) {
@@ -1430,6 +1488,70 @@ ngx_escape_html(u_char *dst, u_char *src, size_t size)
 }
 
 
+/*
+ * ngx_skip_word3() skips the machine words that do not contain any of
+ * the three characters, it returns the start of the first word that may
+ * contain one of them or the tail shorter than a word
+ */
+
+#define NGX_WORD_ONES   ((uintptr_t) -1 / 0xff)
+#define NGX_WORD_HIGHS  (NGX_WORD_ONES * 0x80)
+
+#define ngx_word_has_zero(w)                                                 \
+    (((w) - NGX_WORD_ONES) & ~(w) & NGX_WORD_HIGHS)
+
+#define ngx_word_has(w, c)                                                    \
+    ngx_word_has_zero((w) ^ (NGX_WORD_ONES * (c)))
+
+
+static ngx_inline u_char *
+ngx_skip_word3(u_char *p, u_char *last, u_char c1, u_char c2, u_char c3)
+{
+    uintptr_t  w;
+
+    while ((size_t) (last - p) >= sizeof(uintptr_t)) {
+
+        /* memcpy() is compiled to the unaligned load */
+
+        ngx_memcpy(&w, p, sizeof(uintptr_t));
+
+        if (ngx_word_has(w, c1) | ngx_word_has(w, c2) | ngx_word_has(w, c3)) {
+            break;
+        }
+
+        p += sizeof(uintptr_t);
+    }
+
+    return p;
+}
+
+
+/* ngx_skip_ascii() returns the first byte with the high bit set or "last" */
+
+u_char *
+ngx_skip_ascii(u_char *p, u_char *last)
+{
+    uintptr_t  w;
+
+    while ((size_t) (last - p) >= sizeof(uintptr_t)) {
+
+        ngx_memcpy(&w, p, sizeof(uintptr_t));
+
+        if (w & NGX_WORD_HIGHS) {
+            break;
+        }
+
+        p += sizeof(uintptr_t);
+    }
+
+    while (p < last && *p < 0x80) {
+        p++;
+    }
+
+    return p;
+}
+
+
 /* ngx_sort() is implemented as insertion sort because we need stable sort */
 
 void
@@ -0,0 +1,433 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_event.h>
+
+
+/*
+ * The messages are sent over a non-blocking datagram socket, either UDP
+ * or a unix domain one, e.g. /dev/log.  If the socket buffer is full the
+ * message is dropped and counted rather than blocking the process.
+ *
+ * With the "batch" parameter several messages separated by a line feed
+ * are sent in one datagram, the batch is sent when it is full or after
+ * the "flush" time.  The receiver must split the datagram by the lines.
+ * The batch is limited by the largest UDP payload, a unix domain socket
+ * may have a lower limit, then a too large datagram is only dropped.
+ */
+
+
+#define NGX_SYSLOG_MAX_HDR  (sizeof("<191>Oct 18 12:00:00  : ") - 1        \
+                             + NGX_MAXHOSTNAMELEN + 32)
+
+
+static ngx_int_t ngx_syslog_open(ngx_syslog_peer_t *peer);
+static void ngx_syslog_write(ngx_syslog_peer_t *peer, struct iovec *iov,
+    int niov);
+static u_char *ngx_syslog_header(ngx_syslog_peer_t *peer, u_char *buf,
+    ngx_uint_t severity);
+static void ngx_syslog_flush_handler(ngx_event_t *ev);
+static void ngx_syslog_cleanup(void *data);
+
+
+static char  *ngx_syslog_facilities[] = {
+    "kern", "user", "mail", "daemon", "auth", "syslog", "lpr", "news",
+    "uucp", "cron", "authpriv", "ftp", "ntp", "audit", "alert", "clock",
+    "local0", "local1", "local2", "local3", "local4", "local5", "local6",
+    "local7", NULL
+};
+
+
+static char  *ngx_syslog_severities[] = {
+    "emerg", "alert", "crit", "error", "warn", "notice", "info", "debug",
+    NULL
+};
+
+
+ngx_syslog_peer_t *
+ngx_syslog_create(ngx_conf_t *cf, ngx_str_t *value)
+{
+    u_char              *p, *last, *comma;
+    ssize_t              batch;
+    ngx_str_t            param, server;
+    ngx_uint_t           n;
+    ngx_url_t            u;
+    ngx_pool_cleanup_t  *cln;
+    ngx_syslog_peer_t   *peer;
+
+    peer = ngx_pcalloc(cf->pool, sizeof(ngx_syslog_peer_t));
+    if (peer == NULL) {
+        return NULL;
+    }
+
+    peer->fd = (ngx_socket_t) -1;
+    peer->facility = NGX_SYSLOG_FACILITY;
+    peer->severity = NGX_SYSLOG_SEVERITY;
+    peer->tag.len = sizeof("nginx") - 1;
+    peer->tag.data = (u_char *) "nginx";
+    peer->flush = NGX_SYSLOG_FLUSH;
+
+    batch = 0;
+    server.len = 0;
+
+    p = value->data + sizeof("syslog:") - 1;
+    last = value->data + value->len;
+
+    while (p < last) {
+
+        comma = ngx_strlchr(p, last, ',');
+
+        param.data = p;
+        param.len = (comma ? comma : last) - p;
+
+        p = comma ? comma + 1 : last;
+
+        if (param.len > 7 && ngx_strncmp(param.data, "server=", 7) == 0) {
+            server.len = param.len - 7;
+            server.data = param.data + 7;
+            continue;
+        }
+
+        if (param.len > 9 && ngx_strncmp(param.data, "facility=", 9) == 0) {
+
+            for (n = 0; ngx_syslog_facilities[n]; n++) {
+                if (ngx_strlen(ngx_syslog_facilities[n]) == param.len - 9
+                    && ngx_strncmp(ngx_syslog_facilities[n], param.data + 9,
+                                   param.len - 9)
+                       == 0)
+                {
+                    peer->facility = n;
+                    goto next;
+                }
+            }
+
+            goto invalid;
+        }
+
+        if (param.len > 9 && ngx_strncmp(param.data, "severity=", 9) == 0) {
+
+            for (n = 0; ngx_syslog_severities[n]; n++) {
+                if (ngx_strlen(ngx_syslog_severities[n]) == param.len - 9
+                    && ngx_strncmp(ngx_syslog_severities[n], param.data + 9,
+                                   param.len - 9)
+                       == 0)
+                {
+                    peer->severity = n;
+                    goto next;
+                }
+            }
+
+            goto invalid;
+        }
+
+        if (param.len > 4 && ngx_strncmp(param.data, "tag=", 4) == 0) {
+
+            if (param.len - 4 > 32) {
+                goto invalid;
+            }
+
+            peer->tag.len = param.len - 4;
+            peer->tag.data = param.data + 4;
+
+            continue;
+        }
+
+        if (param.len > 6 && ngx_strncmp(param.data, "batch=", 6) == 0) {
+
+            param.len -= 6;
+            param.data += 6;
+
+            batch = ngx_parse_size(&param);
+
+            if (batch == NGX_ERROR || batch == 0) {
+                goto invalid;
+            }
+
+            if (batch > NGX_SYSLOG_MAX_BATCH) {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "syslog batch must not be more than %z",
+                                   (ssize_t) NGX_SYSLOG_MAX_BATCH);
+                return NULL;
+            }
+
+            continue;
+        }
+
+        if (param.len > 6 && ngx_strncmp(param.data, "flush=", 6) == 0) {
+
+            param.len -= 6;
+            param.data += 6;
+
+            peer->flush = ngx_parse_time(&param, 0);
+
+            if (peer->flush == (ngx_msec_t) NGX_ERROR || peer->flush == 0) {
+                goto invalid;
+            }
+
+            continue;
+        }
+
+        goto invalid;
+
+    next:
+
+        continue;
+    }
+
+    if (server.len == 0) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "no syslog server in \"%V\"", value);
+        return NULL;
+    }
+
+    ngx_memzero(&u, sizeof(ngx_url_t));
+
+    u.url = server;
+    u.default_port = NGX_SYSLOG_PORT;
+
+    if (ngx_parse_url(cf->pool, &u) != NGX_OK) {
+        if (u.err) {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "%s in syslog server \"%V\"", u.err, &u.url);
+        }
+
+        return NULL;
+    }
+
+    if (u.naddrs == 0) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "no address of syslog server \"%V\"", &u.url);
+        return NULL;
+    }
+
+    peer->addr = &u.addrs[0];
+
+    if (batch) {
+        peer->start = ngx_palloc(cf->pool, batch);
+        if (peer->start == NULL) {
+            return NULL;
+        }
+
+        peer->pos = peer->start;
+        peer->end = peer->start + batch;
+
+        peer->event = ngx_pcalloc(cf->pool, sizeof(ngx_event_t));
+        if (peer->event == NULL) {
+            return NULL;
+        }
+
+        peer->event->handler = ngx_syslog_flush_handler;
+        peer->event->data = peer;
+        peer->event->log = cf->cycle->new_log;
+    }
+
+    cln = ngx_pool_cleanup_add(cf->pool, 0);
+    if (cln == NULL) {
+        return NULL;
+    }
+
+    cln->handler = ngx_syslog_cleanup;
+    cln->data = peer;
+
+    return peer;
+
+invalid:
+
+    ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                       "invalid syslog parameter \"%V\"", &param);
+
+    return NULL;
+}
+
+
+void
+ngx_syslog_send(ngx_syslog_peer_t *peer, ngx_uint_t severity, u_char *msg,
+    size_t len)
+{
+    u_char        *p;
+    size_t         size;
+    struct iovec   iov[2];
+    u_char         hdr[NGX_SYSLOG_MAX_HDR];
+
+    p = ngx_syslog_header(peer, hdr, severity);
+
+    size = (p - hdr) + len + 1;
+
+    if (peer->start) {
+
+        if (size > (size_t) (peer->end - peer->pos)) {
+            ngx_syslog_flush(peer);
+        }
+
+        if (size <= (size_t) (peer->end - peer->pos)) {
+
+            if (peer->pos == peer->start && !peer->event->timer_set) {
+                ngx_add_timer(peer->event, peer->flush);
+            }
+
+            peer->pos = ngx_cpymem(peer->pos, hdr, p - hdr);
+            peer->pos = ngx_cpymem(peer->pos, msg, len);
+            *peer->pos++ = LF;
+
+            return;
+        }
+
+        /* the message is larger than the batch */
+    }
+
+    iov[0].iov_base = (void *) hdr;
+    iov[0].iov_len = p - hdr;
+    iov[1].iov_base = (void *) msg;
+    iov[1].iov_len = len;
+
+    ngx_syslog_write(peer, iov, 2);
+}
+
+
+void
+ngx_syslog_flush(ngx_syslog_peer_t *peer)
+{
+    struct iovec  iov;
+
+    if (peer->start == NULL) {
+        return;
+    }
+
+    if (peer->event->timer_set) {
+        ngx_del_timer(peer->event);
+    }
+
+    if (peer->pos == peer->start) {
+        return;
+    }
+
+    /* the last line feed is not sent */
+
+    iov.iov_base = (void *) peer->start;
+    iov.iov_len = peer->pos - peer->start - 1;
+
+    ngx_syslog_write(peer, &iov, 1);
+
+    peer->pos = peer->start;
+}
+
+
+static ngx_int_t
+ngx_syslog_open(ngx_syslog_peer_t *peer)
+{
+    ngx_socket_t  fd;
+
+    fd = ngx_socket(peer->addr->sockaddr->sa_family, SOCK_DGRAM, 0);
+
+    if (fd == -1) {
+        return NGX_ERROR;
+    }
+
+    if (ngx_nonblocking(fd) == -1
+        || connect(fd, peer->addr->sockaddr, peer->addr->socklen) == -1)
+    {
+        (void) ngx_close_socket(fd);
+        return NGX_ERROR;
+    }
+
+    peer->fd = fd;
+
+    return NGX_OK;
+}
+
+
+/*
+ * the errors are not logged: the error log itself may be sent
+ * to the same peer
+ */
+
+static void
+ngx_syslog_write(ngx_syslog_peer_t *peer, struct iovec *iov, int niov)
+{
+    ngx_err_t      err;
+    struct msghdr  msg;
+
+    if (peer->fd == (ngx_socket_t) -1 && ngx_syslog_open(peer) != NGX_OK) {
+        peer->dropped++;
+        return;
+    }
+
+    ngx_memzero(&msg, sizeof(struct msghdr));
+
+    msg.msg_iov = iov;
+    msg.msg_iovlen = niov;
+
+    if (sendmsg(peer->fd, &msg, 0) != -1) {
+        return;
+    }
+
+    err = ngx_socket_errno;
+
+    peer->dropped++;
+
+    if (err == NGX_EAGAIN || err == ENOBUFS || err == EMSGSIZE) {
+        return;
+    }
+
+    /* e.g. the syslog daemon has been restarted, reconnect next time */
+
+    (void) ngx_close_socket(peer->fd);
+    peer->fd = (ngx_socket_t) -1;
+}
+
+
+static u_char *
+ngx_syslog_header(ngx_syslog_peer_t *peer, u_char *buf, ngx_uint_t severity)
+{
+    u_char  *t;
+
+    /* "Oct 18 12:00:00" from "18/Oct/2009:12:00:00 +0000" */
+
+    t = ngx_cached_http_log_time.data;
+
+    buf = ngx_sprintf(buf, "<%ui>", peer->facility * 8 + severity);
+
+    buf = ngx_cpymem(buf, t + 3, 3);
+    *buf++ = ' ';
+    *buf++ = (t[0] == '0') ? ' ' : t[0];
+    *buf++ = t[1];
+    *buf++ = ' ';
+    buf = ngx_cpymem(buf, t + 12, 8);
+    *buf++ = ' ';
+
+    if (ngx_cycle->hostname.len) {
+        buf = ngx_cpymem(buf, ngx_cycle->hostname.data,
+                         ngx_cycle->hostname.len);
+        *buf++ = ' ';
+    }
+
+    buf = ngx_cpymem(buf, peer->tag.data, peer->tag.len);
+    *buf++ = ':';
+    *buf++ = ' ';
+
+    return buf;
+}
+
+
+static void
+ngx_syslog_flush_handler(ngx_event_t *ev)
+{
+    ngx_syslog_flush(ev->data);
+}
+
+
+static void
+ngx_syslog_cleanup(void *data)
+{
+    ngx_syslog_peer_t  *peer = data;
+
+    if (peer->fd != (ngx_socket_t) -1) {
+        (void) ngx_close_socket(peer->fd);
+        peer->fd = (ngx_socket_t) -1;
+    }
+}
@@ -0,0 +1,48 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ */
+
+
+#ifndef _NGX_SYSLOG_H_INCLUDED_
+#define _NGX_SYSLOG_H_INCLUDED_
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+
+
+#define NGX_SYSLOG_PORT       514
+#define NGX_SYSLOG_FACILITY   23           /* local7 */
+#define NGX_SYSLOG_SEVERITY   6            /* info */
+#define NGX_SYSLOG_FLUSH      1000
+#define NGX_SYSLOG_MAX_BATCH  65507        /* the largest UDP payload */
+
+
+struct ngx_syslog_peer_s {
+    ngx_peer_addr_t      *addr;
+    ngx_socket_t          fd;
+
+    ngx_uint_t            facility;
+    ngx_uint_t            severity;
+    ngx_str_t             tag;
+
+    /* the batch of the messages sent in one datagram */
+    u_char               *start;
+    u_char               *pos;
+    u_char               *end;
+
+    ngx_msec_t            flush;
+    ngx_event_t          *event;
+
+    ngx_uint_t            dropped;
+};
+
+
+ngx_syslog_peer_t *ngx_syslog_create(ngx_conf_t *cf, ngx_str_t *value);
+void ngx_syslog_send(ngx_syslog_peer_t *peer, ngx_uint_t severity,
+    u_char *msg, size_t len);
+void ngx_syslog_flush(ngx_syslog_peer_t *peer);
+
+
+#endif /* _NGX_SYSLOG_H_INCLUDED_ */
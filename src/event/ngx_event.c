@@ -33,6 +33,10 @@ static char *ngx_event_debug_connection(ngx_conf_t *cf, ngx_command_t *cmd,
 static void *ngx_event_create_conf(ngx_cycle_t *cycle);
 static char *ngx_event_init_conf(ngx_cycle_t *cycle, void *conf);
 
+static void ngx_event_stats_claim(ngx_cycle_t *cycle);
+static void ngx_event_loop_account(ngx_uint_t events, ngx_uint_t timers,
+    ngx_uint_t posted);
+
 
 static ngx_uint_t     ngx_timer_resolution;
 sig_atomic_t          ngx_event_timer_alarm;
@@ -57,6 +61,26 @@ ngx_int_t             ngx_accept_disabled;
 ngx_file_t            ngx_accept_mutex_lock_file;
 
 
+/*
+ * the event loop counters are kept in the slots of the shared memory:
+ * every worker claims its own slot and updates it without the locked
+ * instructions, the last slot is shared by the processes that have not
+ * found a free slot and is updated atomically
+ */
+
+static ngx_atomic_t   ngx_event_stats0[NGX_EVENT_STAT_COUNTERS];
+static ngx_atomic_t  *ngx_event_stats = ngx_event_stats0;
+static ngx_atomic_t  *ngx_event_stats_slots = ngx_event_stats0;
+static ngx_atomic_t  *ngx_event_stats_owner;
+static ngx_uint_t     ngx_event_stats_nslots;
+static ngx_uint_t     ngx_event_stats_stride;
+static ngx_uint_t     ngx_event_stats_slot;
+ngx_uint_t            ngx_event_loop_stats;
+ngx_msec_t            ngx_event_stall_threshold;
+ngx_uint_t            ngx_event_calls;
+static uint64_t       ngx_event_wakeup;
+
+
 #if (NGX_STAT_STUB)
 
 ngx_atomic_t   ngx_stat_accepted0;
@@ -71,6 +95,8 @@ ngx_atomic_t   ngx_stat_reading0;
 ngx_atomic_t  *ngx_stat_reading = &ngx_stat_reading0;
 ngx_atomic_t   ngx_stat_writing0;
 ngx_atomic_t  *ngx_stat_writing = &ngx_stat_writing0;
+ngx_atomic_t   ngx_stat_output_cached0;
+ngx_atomic_t  *ngx_stat_output_cached = &ngx_stat_output_cached0;
 
 #endif
 
@@ -159,6 +185,20 @@ static ngx_command_t  ngx_event_core_commands[] = {
       offsetof(ngx_event_conf_t, accept_mutex_delay),
       NULL },
 
+    { ngx_string("loop_stats"),
+      NGX_EVENT_CONF|NGX_CONF_FLAG,
+      ngx_conf_set_flag_slot,
+      0,
+      offsetof(ngx_event_conf_t, loop_stats),
+      NULL },
+
+    { ngx_string("stall_threshold"),
+      NGX_EVENT_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_msec_slot,
+      0,
+      offsetof(ngx_event_conf_t, stall_threshold),
+      NULL },
+
     { ngx_string("debug_connection"),
       NGX_EVENT_CONF|NGX_CONF_TAKE1,
       ngx_event_debug_connection,
@@ -198,7 +238,7 @@ ngx_module_t  ngx_event_core_module = {
 void
 ngx_process_events_and_timers(ngx_cycle_t *cycle)
 {
-    ngx_uint_t  flags;
+    ngx_uint_t  flags, events, timers;
     ngx_msec_t  timer, delta;
 
     if (ngx_timer_resolution) {
@@ -240,6 +280,9 @@ ngx_process_events_and_timers(ngx_cycle_t *cycle)
         }
     }
 
+    ngx_event_calls = 0;
+    ngx_event_wakeup = 0;
+
     delta = ngx_current_msec;
 
     (void) ngx_process_events(cycle, timer, flags);
@@ -249,6 +292,14 @@ ngx_process_events_and_timers(ngx_cycle_t *cycle)
     ngx_log_debug1(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
                    "timer delta: %M", delta);
 
+    /* the handlers called by the event method itself */
+
+    events = ngx_event_calls;
+
+    if (ngx_event_loop_stats && ngx_event_wakeup == 0) {
+        ngx_event_wakeup = ngx_monotonic_usec();
+    }
+
     if (ngx_posted_accept_events) {
         ngx_event_process_posted(cycle, &ngx_posted_accept_events);
     }
@@ -257,10 +308,14 @@ ngx_process_events_and_timers(ngx_cycle_t *cycle)
         ngx_shmtx_unlock(&ngx_accept_mutex);
     }
 
+    timers = ngx_event_calls;
+
     if (delta) {
         ngx_event_expire_timers();
     }
 
+    timers = ngx_event_calls - timers;
+
     ngx_log_debug1(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
                    "posted events %p", ngx_posted_events);
 
@@ -272,6 +327,191 @@ ngx_process_events_and_timers(ngx_cycle_t *cycle)
             ngx_event_process_posted(cycle, &ngx_posted_events);
         }
     }
+
+    if (ngx_event_loop_stats) {
+        ngx_event_loop_account(events, timers,
+                               ngx_event_calls - events - timers);
+    }
+}
+
+
+static ngx_inline void
+ngx_event_stat_add(ngx_uint_t n, ngx_atomic_int_t add)
+{
+    if (ngx_event_stats_slot == ngx_event_stats_nslots) {
+        (void) ngx_atomic_fetch_add(&ngx_event_stats[n], add);
+        return;
+    }
+
+    ngx_event_stats[n] += add;
+}
+
+
+void
+ngx_event_call_timed(ngx_event_t *ev)
+{
+    int                    write;
+    void                  *data;
+    uint64_t               start, usec;
+    ngx_socket_t           fd;
+    ngx_atomic_uint_t      number;
+    ngx_connection_t      *c;
+    ngx_event_handler_pt   handler;
+
+    start = ngx_monotonic_usec();
+
+    if (ngx_event_calls++ == 0) {
+        ngx_event_wakeup = start;
+    }
+
+    if (ngx_event_stall_threshold == 0) {
+        ev->handler(ev);
+        return;
+    }
+
+    /* the event may be freed by its handler */
+
+    handler = ev->handler;
+    write = ev->write;
+    data = ev->data;
+
+    c = data;
+
+    if (c >= ngx_cycle->connections
+        && c < ngx_cycle->connections + ngx_cycle->connection_n)
+    {
+        number = c->number;
+        fd = c->fd;
+
+    } else {
+        c = NULL;
+        number = 0;
+        fd = (ngx_socket_t) -1;
+    }
+
+    handler(ev);
+
+    usec = ngx_monotonic_usec() - start;
+
+    if (usec < (uint64_t) ngx_event_stall_threshold * 1000) {
+        return;
+    }
+
+    ngx_event_stat_add(NGX_EVENT_STAT_STALLS, 1);
+
+    if (c) {
+        ngx_log_error(NGX_LOG_WARN, ngx_cycle->log, 0,
+                      "event handler %p stalled for %uL.%03uL ms "
+                      "on %s event of *%uA, fd:%d",
+                      handler, usec / 1000, usec % 1000,
+                      write ? "write" : "read", number, fd);
+
+    } else {
+        ngx_log_error(NGX_LOG_WARN, ngx_cycle->log, 0,
+                      "event handler %p stalled for %uL.%03uL ms, data:%p",
+                      handler, usec / 1000, usec % 1000, data);
+    }
+}
+
+
+static ngx_inline ngx_uint_t
+ngx_event_stat_bucket(uint64_t value)
+{
+    ngx_uint_t  n;
+
+    for (n = 0; value && n < NGX_EVENT_STAT_BUCKETS - 1; n++) {
+        value >>= 1;
+    }
+
+    return n;
+}
+
+
+static void
+ngx_event_loop_account(ngx_uint_t events, ngx_uint_t timers,
+    ngx_uint_t posted)
+{
+    uint64_t  usec;
+
+    /* the time since the wakeup from the event method */
+
+    usec = ngx_monotonic_usec() - ngx_event_wakeup;
+
+    ngx_event_stat_add(NGX_EVENT_STAT_ITERATIONS, 1);
+    ngx_event_stat_add(NGX_EVENT_STAT_BUSY, (ngx_atomic_int_t) usec);
+
+    ngx_event_stat_add(NGX_EVENT_STAT_DURATION + ngx_event_stat_bucket(usec),
+                       1);
+    ngx_event_stat_add(NGX_EVENT_STAT_BATCH + ngx_event_stat_bucket(events),
+                       1);
+
+    if (events) {
+        ngx_event_stat_add(NGX_EVENT_STAT_EVENTS, events);
+    }
+
+    if (timers) {
+        ngx_event_stat_add(NGX_EVENT_STAT_TIMERS, timers);
+    }
+
+    if (posted) {
+        ngx_event_stat_add(NGX_EVENT_STAT_POSTED, posted);
+    }
+}
+
+
+void
+ngx_event_loop_stats_sum(ngx_atomic_int_t *total)
+{
+    ngx_uint_t     i, n;
+    ngx_atomic_t  *stats;
+
+    ngx_memzero(total, NGX_EVENT_STAT_COUNTERS * sizeof(ngx_atomic_int_t));
+
+    for (i = 0; i <= ngx_event_stats_nslots; i++) {
+        stats = ngx_event_stats_slots + i * ngx_event_stats_stride;
+
+        for (n = 0; n < NGX_EVENT_STAT_COUNTERS; n++) {
+            total[n] += (ngx_atomic_int_t) stats[n];
+        }
+    }
+}
+
+
+static void
+ngx_event_stats_claim(ngx_cycle_t *cycle)
+{
+    ngx_pid_t   pid;
+    ngx_uint_t  i;
+
+    for (i = 0; i < ngx_event_stats_nslots; i++) {
+        pid = (ngx_pid_t) ngx_event_stats_owner[i];
+
+        if (pid == ngx_pid) {
+            break;
+        }
+
+        if (pid == 0) {
+            if (ngx_atomic_cmp_set(&ngx_event_stats_owner[i], 0, ngx_pid)) {
+                break;
+            }
+
+            continue;
+        }
+
+        /* the slot of an exited worker is taken over with its counters */
+
+        if (kill(pid, 0) == -1 && ngx_errno == NGX_ESRCH) {
+            if (ngx_atomic_cmp_set(&ngx_event_stats_owner[i], pid, ngx_pid)) {
+                break;
+            }
+        }
+    }
+
+    ngx_log_debug1(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
+                   "event stats slot: %ui", i);
+
+    ngx_event_stats_slot = i;
+    ngx_event_stats = ngx_event_stats_slots + i * ngx_event_stats_stride;
 }
 
 
@@ -427,7 +667,8 @@ ngx_event_module_init(ngx_cycle_t *cycle)
 {
     void              ***cf;
     u_char              *shared;
-    size_t               size, cl;
+    size_t               size, cl, stats;
+    ngx_int_t            n;
     ngx_shm_t            shm;
     ngx_core_conf_t     *ccf;
     ngx_event_conf_t    *ecf;
@@ -501,10 +742,33 @@ ngx_event_module_init(ngx_cycle_t *cycle)
            + cl          /* ngx_stat_requests */
            + cl          /* ngx_stat_active */
            + cl          /* ngx_stat_reading */
-           + cl;         /* ngx_stat_writing */
+           + cl          /* ngx_stat_writing */
+           + cl;         /* ngx_stat_output_cached */
 
 #endif
 
+    /*
+     * a slot per worker, the garbage collector and the log writer,
+     * for both the new and the old cycle
+     */
+
+    n = (ccf->worker_processes > ngx_ncpu) ? ccf->worker_processes : ngx_ncpu;
+
+    ngx_event_stats_nslots = 2 * (n + 2);
+
+    if (ngx_event_stats_nslots > NGX_EVENT_STAT_MAX_SLOTS) {
+        ngx_event_stats_nslots = NGX_EVENT_STAT_MAX_SLOTS;
+    }
+
+    ngx_event_stats_stride = ngx_align(NGX_EVENT_STAT_COUNTERS,
+                                       cl / sizeof(ngx_atomic_t));
+
+    stats = ngx_align(ngx_event_stats_nslots * sizeof(ngx_atomic_t), cl)
+            + (ngx_event_stats_nslots + 1) * ngx_event_stats_stride
+              * sizeof(ngx_atomic_t);
+
+    size += stats;       /* ngx_event_stats */
+
     shm.size = size;
     shm.log = cycle->log;
 
@@ -532,9 +796,21 @@ ngx_event_module_init(ngx_cycle_t *cycle)
     ngx_stat_active = (ngx_atomic_t *) (shared + 5 * cl);
     ngx_stat_reading = (ngx_atomic_t *) (shared + 6 * cl);
     ngx_stat_writing = (ngx_atomic_t *) (shared + 7 * cl);
+    ngx_stat_output_cached = (ngx_atomic_t *) (shared + 8 * cl);
 
 #endif
 
+    ngx_event_stats_owner = (ngx_atomic_t *) (shared + size - stats);
+    ngx_event_stats_slots = (ngx_atomic_t *) (shared + size - stats
+                              + ngx_align(ngx_event_stats_nslots
+                                          * sizeof(ngx_atomic_t), cl));
+
+    /* a process uses the shared slot until it claims its own one */
+
+    ngx_event_stats_slot = ngx_event_stats_nslots;
+    ngx_event_stats = ngx_event_stats_slots
+                      + ngx_event_stats_nslots * ngx_event_stats_stride;
+
     *ngx_connection_counter = 1;
 
     ngx_log_debug2(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
@@ -585,6 +861,13 @@ ngx_event_process_init(ngx_cycle_t *cycle)
         ngx_use_accept_mutex = 0;
     }
 
+    ngx_event_loop_stats = ecf->loop_stats;
+    ngx_event_stall_threshold = ecf->stall_threshold;
+
+    if (ngx_event_loop_stats || ngx_event_stall_threshold) {
+        ngx_event_stats_claim(cycle);
+    }
+
 #if (NGX_THREADS)
     ngx_posted_events_mutex = ngx_mutex_init(cycle->log, 0);
     if (ngx_posted_events_mutex == NULL) {
@@ -1109,6 +1392,8 @@ ngx_event_create_conf(ngx_cycle_t *cycle)
     ecf->multi_accept = NGX_CONF_UNSET;
     ecf->accept_mutex = NGX_CONF_UNSET;
     ecf->accept_mutex_delay = NGX_CONF_UNSET_MSEC;
+    ecf->loop_stats = NGX_CONF_UNSET;
+    ecf->stall_threshold = NGX_CONF_UNSET_MSEC;
     ecf->name = (void *) NGX_CONF_UNSET;
 
 #if (NGX_DEBUG)
@@ -1234,6 +1519,8 @@ ngx_event_init_conf(ngx_cycle_t *cycle, void *conf)
     ngx_conf_init_value(ecf->multi_accept, 0);
     ngx_conf_init_value(ecf->accept_mutex, 1);
     ngx_conf_init_msec_value(ecf->accept_mutex_delay, 500);
+    ngx_conf_init_value(ecf->loop_stats, 0);
+    ngx_conf_init_msec_value(ecf->stall_threshold, 0);
 
 
 #if (NGX_HAVE_RTSIG)
@@ -448,6 +448,9 @@ typedef struct {
 
     ngx_msec_t    accept_mutex_delay;
 
+    ngx_flag_t    loop_stats;
+    ngx_msec_t    stall_threshold;
+
     u_char       *name;
 
 #if (NGX_DEBUG)
@@ -485,10 +488,39 @@ extern ngx_atomic_t  *ngx_stat_requests;
 extern ngx_atomic_t  *ngx_stat_active;
 extern ngx_atomic_t  *ngx_stat_reading;
 extern ngx_atomic_t  *ngx_stat_writing;
+extern ngx_atomic_t  *ngx_stat_output_cached;
 
 #endif
 
 
+/*
+ * the event loop counters summed over all workers, the durations are
+ * in microseconds, the histogram bucket n counts the values from 2^(n-1)
+ * to 2^n - 1, and the last bucket counts all larger values as well
+ */
+
+#define NGX_EVENT_STAT_ITERATIONS  0
+#define NGX_EVENT_STAT_BUSY        1
+#define NGX_EVENT_STAT_EVENTS      2
+#define NGX_EVENT_STAT_TIMERS      3
+#define NGX_EVENT_STAT_POSTED      4
+#define NGX_EVENT_STAT_STALLS      5
+#define NGX_EVENT_STAT_DURATION    6
+#define NGX_EVENT_STAT_BATCH       (NGX_EVENT_STAT_DURATION                  \
+                                    + NGX_EVENT_STAT_BUCKETS)
+#define NGX_EVENT_STAT_COUNTERS    (NGX_EVENT_STAT_BATCH                     \
+                                    + NGX_EVENT_STAT_BUCKETS)
+
+#define NGX_EVENT_STAT_BUCKETS     20
+
+#define NGX_EVENT_STAT_MAX_SLOTS   64
+
+
+extern ngx_uint_t             ngx_event_loop_stats;
+extern ngx_msec_t             ngx_event_stall_threshold;
+extern ngx_uint_t             ngx_event_calls;
+
+
 #define NGX_UPDATE_TIME         1
 #define NGX_POST_EVENTS         2
 #define NGX_POST_THREAD_EVENTS  4
@@ -511,6 +543,8 @@ u_char *ngx_accept_log_error(ngx_log_t *log, u_char *buf, size_t len);
 
 
 void ngx_process_events_and_timers(ngx_cycle_t *cycle);
+void ngx_event_call_timed(ngx_event_t *ev);
+void ngx_event_loop_stats_sum(ngx_atomic_int_t *total);
 ngx_int_t ngx_handle_read_event(ngx_event_t *rev, ngx_uint_t flags);
 ngx_int_t ngx_handle_write_event(ngx_event_t *wev, size_t lowat);
 
@@ -529,6 +563,20 @@ ngx_int_t ngx_send_lowat(ngx_connection_t *c, size_t lowat);
 #define ngx_event_ident(p)  ((ngx_connection_t *) (p))->fd
 
 
+/* the event handlers are called by the event methods, timers and posted */
+
+static ngx_inline void
+ngx_event_call(ngx_event_t *ev)
+{
+    if (ngx_event_loop_stats || ngx_event_stall_threshold) {
+        ngx_event_call_timed(ev);
+        return;
+    }
+
+    ev->handler(ev);
+}
+
+
 #include <ngx_event_timer.h>
 #include <ngx_event_posted.h>
 #include <ngx_event_busy_lock.h>
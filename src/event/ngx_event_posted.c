@@ -36,7 +36,7 @@ ngx_event_process_posted(ngx_cycle_t *cycle,
 
         ngx_delete_posted_event(ev);
 
-        ev->handler(ev);
+        ngx_event_call(ev);
     }
 }
 
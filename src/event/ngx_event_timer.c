@@ -146,7 +146,7 @@ ngx_event_expire_timers(void)
 
             ev->timedout = 1;
 
-            ev->handler(ev);
+            ngx_event_call(ev);
 
             continue;
         }
@@ -20,6 +20,7 @@
 
 typedef struct {
     u_char                    **tables;
+    u_char                     *ascii;          /* ASCII is not recoded */
     ngx_str_t                   name;
 
     unsigned                    length:16;
@@ -69,6 +70,7 @@ typedef struct {
     unsigned                    length:16;
     unsigned                    from_utf8:1;
     unsigned                    to_utf8:1;
+    unsigned                    ascii:1;
 } ngx_http_charset_ctx_t;
 
 
@@ -83,7 +85,8 @@ static ngx_int_t ngx_http_charset_get_charset(ngx_http_charset_t *charsets,
     ngx_uint_t n, ngx_str_t *charset);
 static ngx_int_t ngx_http_charset_set_charset(ngx_http_request_t *r,
     ngx_http_charset_t *charsets, ngx_int_t charset, ngx_int_t source_charset);
-static ngx_uint_t ngx_http_charset_recode(ngx_buf_t *b, u_char *table);
+static ngx_uint_t ngx_http_charset_recode(ngx_buf_t *b, u_char *table,
+    ngx_uint_t ascii);
 static ngx_chain_t *ngx_http_charset_recode_from_utf8(ngx_pool_t *pool,
     ngx_buf_t *buf, ngx_http_charset_ctx_t *ctx);
 static ngx_chain_t *ngx_http_charset_recode_to_utf8(ngx_pool_t *pool,
@@ -102,6 +105,7 @@ static char *ngx_http_charset_map(ngx_conf_t *cf, ngx_command_t *dummy,
 static char *ngx_http_set_charset_slot(ngx_conf_t *cf, ngx_command_t *cmd,
     void *conf);
 static ngx_int_t ngx_http_add_charset(ngx_array_t *charsets, ngx_str_t *name);
+static ngx_uint_t ngx_http_charset_ascii(u_char *table, ngx_uint_t utf8);
 
 static void *ngx_http_charset_create_main_conf(ngx_conf_t *cf);
 static void *ngx_http_charset_create_loc_conf(ngx_conf_t *cf);
@@ -439,6 +443,7 @@ ngx_http_charset_set_charset(ngx_http_request_t *r,
     ctx->length = charsets[charset].length;
     ctx->from_utf8 = charsets[source_charset].utf8;
     ctx->to_utf8 = charsets[charset].utf8;
+    ctx->ascii = charsets[source_charset].ascii[charset];
 
     r->filter_need_in_memory = 1;
 
@@ -557,7 +562,7 @@ ngx_http_charset_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
     }
 
     for (cl = in; cl; cl = cl->next) {
-        (void) ngx_http_charset_recode(cl->buf, ctx->table);
+        (void) ngx_http_charset_recode(cl->buf, ctx->table, ctx->ascii);
     }
 
     return ngx_http_next_body_filter(r, in);
@@ -565,7 +570,7 @@ ngx_http_charset_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
 
 
 static ngx_uint_t
-ngx_http_charset_recode(ngx_buf_t *b, u_char *table)
+ngx_http_charset_recode(ngx_buf_t *b, u_char *table, ngx_uint_t ascii)
 {
     u_char  *p, *last;
 
@@ -573,6 +578,14 @@ ngx_http_charset_recode(ngx_buf_t *b, u_char *table)
 
     for (p = b->pos; p < last; p++) {
 
+        if (ascii && *p < 0x80) {
+            p = ngx_skip_ascii(p, last);
+
+            if (p == last) {
+                break;
+            }
+        }
+
         if (*p != table[*p]) {
             goto recode;
         }
@@ -583,6 +596,14 @@ ngx_http_charset_recode(ngx_buf_t *b, u_char *table)
 recode:
 
     do {
+        if (ascii && *p < 0x80) {
+            p = ngx_skip_ascii(p, last);
+
+            if (p == last) {
+                break;
+            }
+        }
+
         if (*p != table[*p]) {
             *p = table[*p];
         }
@@ -612,11 +633,11 @@ ngx_http_charset_recode_from_utf8(ngx_pool_t *pool, ngx_buf_t *buf,
 
     if (ctx->saved_len == 0) {
 
-        for ( /* void */ ; src < buf->last; src++) {
+        /* skip ASCII a word at a time, it is never recoded */
 
-            if (*src < 0x80) {
-                continue;
-            }
+        src = ngx_skip_ascii(src, buf->last);
+
+        if (src < buf->last) {
 
             len = src - buf->pos;
 
@@ -812,7 +833,17 @@ recode:
         }
 
         if (*src < 0x80) {
-            *dst++ = *src++;
+            p = ngx_skip_ascii(src, buf->last);
+
+            len = p - src;
+
+            if (len > (size_t) (b->end - dst)) {
+                len = b->end - dst;
+            }
+
+            dst = ngx_cpymem(dst, src, len);
+            src += len;
+
             continue;
         }
 
@@ -890,6 +921,15 @@ ngx_http_charset_recode_to_utf8(ngx_pool_t *pool, ngx_buf_t *buf,
     table = ctx->table;
 
     for (src = buf->pos; src < buf->last; src++) {
+
+        if (ctx->ascii && *src < 0x80) {
+            src = ngx_skip_ascii(src, buf->last);
+
+            if (src == buf->last) {
+                break;
+            }
+        }
+
         if (table[*src * NGX_UTF_LEN] == '\1') {
             continue;
         }
@@ -966,6 +1006,23 @@ recode:
 
     while (src < buf->last) {
 
+        if (ctx->ascii && *src < 0x80) {
+            p = ngx_skip_ascii(src, buf->last);
+
+            len = p - src;
+
+            if (len > (size_t) (b->end - dst)) {
+                len = b->end - dst;
+            }
+
+            if (len) {
+                dst = ngx_cpymem(dst, src, len);
+                src += len;
+
+                continue;
+            }
+        }
+
         p = &table[*src++ * NGX_UTF_LEN];
         len = *p++;
 
@@ -1402,6 +1459,30 @@ ngx_http_add_charset(ngx_array_t *charsets, ngx_str_t *name)
 }
 
 
+static ngx_uint_t
+ngx_http_charset_ascii(u_char *table, ngx_uint_t utf8)
+{
+    u_char      *p;
+    ngx_uint_t   i;
+
+    for (i = 0; i < 128; i++) {
+
+        if (utf8) {
+            p = &table[i * NGX_UTF_LEN];
+
+            if (p[0] != '\1' || p[1] != i) {
+                return 0;
+            }
+
+        } else if (table[i] != i) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+
 static void *
 ngx_http_charset_create_main_conf(ngx_conf_t *cf)
 {
@@ -1510,7 +1591,7 @@ ngx_http_charset_postconfiguration(ngx_conf_t *cf)
 {
     u_char                       **src, **dst;
     ngx_int_t                      c;
-    ngx_uint_t                     i, t;
+    ngx_uint_t                     i, t, utf8;
     ngx_http_charset_t            *charset;
     ngx_http_charset_recode_t     *recode;
     ngx_http_charset_tables_t     *tables;
@@ -1559,6 +1640,12 @@ ngx_http_charset_postconfiguration(ngx_conf_t *cf)
             }
 
             charset[tables[t].src].tables = src;
+
+            charset[tables[t].src].ascii = ngx_pcalloc(cf->pool,
+                                                       mcf->charsets.nelts);
+            if (charset[tables[t].src].ascii == NULL) {
+                return NGX_ERROR;
+            }
         }
 
         dst = charset[tables[t].dst].tables;
@@ -1570,10 +1657,29 @@ ngx_http_charset_postconfiguration(ngx_conf_t *cf)
             }
 
             charset[tables[t].dst].tables = dst;
+
+            charset[tables[t].dst].ascii = ngx_pcalloc(cf->pool,
+                                                       mcf->charsets.nelts);
+            if (charset[tables[t].dst].ascii == NULL) {
+                return NGX_ERROR;
+            }
         }
 
         src[tables[t].dst] = tables[t].src2dst;
         dst[tables[t].src] = tables[t].dst2src;
+
+        /*
+         * a recoding from UTF-8 always copies ASCII as is,
+         * the other tables are tested once here
+         */
+
+        utf8 = charset[tables[t].dst].utf8;
+
+        charset[tables[t].src].ascii[tables[t].dst] =
+                      (u_char) ngx_http_charset_ascii(tables[t].src2dst, utf8);
+
+        charset[tables[t].dst].ascii[tables[t].src] =
+                (u_char) (utf8 || ngx_http_charset_ascii(tables[t].dst2src, 0));
     }
 
     ngx_http_next_header_filter = ngx_http_top_header_filter;
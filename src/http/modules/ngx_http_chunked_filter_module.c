@@ -9,6 +9,23 @@
 #include <ngx_http.h>
 
 
+/*
+ * the chunk size line, the chunk trailer CRLF and the last chunk
+ * use the buffers of this size that are allocated in batches
+ */
+
+#define NGX_HTTP_CHUNKED_LEN    (sizeof(CRLF "0000000000000000" CRLF) - 1)
+#define NGX_HTTP_CHUNKED_BATCH  4
+
+
+typedef struct {
+    ngx_chain_t         *free;
+    ngx_chain_t         *busy;
+} ngx_http_chunked_filter_ctx_t;
+
+
+static ngx_buf_t *ngx_http_chunked_get_buf(ngx_http_request_t *r,
+    ngx_http_chunked_filter_ctx_t *ctx, ngx_chain_t ***ll);
 static ngx_int_t ngx_http_chunked_filter_init(ngx_conf_t *cf);
 
 
@@ -50,6 +67,8 @@ static ngx_http_output_body_filter_pt    ngx_http_next_body_filter;
 static ngx_int_t
 ngx_http_chunked_header_filter(ngx_http_request_t *r)
 {
+    ngx_http_chunked_filter_ctx_t  *ctx;
+
     if (r->headers_out.status == NGX_HTTP_NOT_MODIFIED
         || r->headers_out.status == NGX_HTTP_NO_CONTENT
         || r->headers_out.status == NGX_HTTP_CREATED
@@ -64,6 +83,13 @@ ngx_http_chunked_header_filter(ngx_http_request_t *r)
 
         } else {
             r->chunked = 1;
+
+            ctx = ngx_pcalloc(r->pool, sizeof(ngx_http_chunked_filter_ctx_t));
+            if (ctx == NULL) {
+                return NGX_ERROR;
+            }
+
+            ngx_http_set_ctx(r, ctx, ngx_http_chunked_filter_module);
         }
     }
 
@@ -74,17 +100,20 @@ ngx_http_chunked_header_filter(ngx_http_request_t *r)
 static ngx_int_t
 ngx_http_chunked_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
 {
-    u_char       *chunk;
-    off_t         size;
-    ngx_buf_t    *b;
-    ngx_chain_t   out, tail, *cl, *tl, **ll;
+    off_t                           size;
+    ngx_int_t                       rc;
+    ngx_buf_t                      *b;
+    ngx_chain_t                    *out, *cl, *tl, *next, *hl, **ll, **hll;
+    ngx_http_chunked_filter_ctx_t  *ctx;
 
     if (in == NULL || !r->chunked || r->header_only) {
         return ngx_http_next_body_filter(r, in);
     }
 
-    out.buf = NULL;
-    ll = &out.next;
+    ctx = ngx_http_get_module_ctx(r, ngx_http_chunked_filter_module);
+
+    out = NULL;
+    ll = &out;
 
     size = 0;
     cl = in;
@@ -117,68 +146,137 @@ ngx_http_chunked_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
         cl = cl->next;
     }
 
+    *ll = NULL;
+
     if (size) {
-        b = ngx_calloc_buf(r->pool);
+        hll = &hl;
+
+        b = ngx_http_chunked_get_buf(r, ctx, &hll);
         if (b == NULL) {
             return NGX_ERROR;
         }
 
         /* the "0000000000000000" is 64-bit hexadimal string */
 
-        chunk = ngx_palloc(r->pool, sizeof("0000000000000000" CRLF) - 1);
-        if (chunk == NULL) {
-            return NGX_ERROR;
-        }
+        b->last = ngx_sprintf(b->pos, "%xO" CRLF, size);
 
-        b->temporary = 1;
-        b->pos = chunk;
-        b->last = ngx_sprintf(chunk, "%xO" CRLF, size);
-
-        out.buf = b;
+        hl->next = out;
+        out = hl;
     }
 
     if (cl->buf->last_buf) {
-        b = ngx_calloc_buf(r->pool);
+
+        b = ngx_http_chunked_get_buf(r, ctx, &ll);
         if (b == NULL) {
             return NGX_ERROR;
         }
 
-        b->memory = 1;
+        b->last = ngx_cpymem(b->pos, CRLF "0" CRLF CRLF, 7);
         b->last_buf = 1;
-        b->pos = (u_char *) CRLF "0" CRLF CRLF;
-        b->last = b->pos + 7;
 
         cl->buf->last_buf = 0;
 
         if (size == 0) {
             b->pos += 2;
-            out.buf = b;
-            out.next = NULL;
+        }
 
-            return ngx_http_next_body_filter(r, &out);
+    } else if (size) {
+
+        b = ngx_http_chunked_get_buf(r, ctx, &ll);
+        if (b == NULL) {
+            return NGX_ERROR;
         }
 
-    } else {
-        if (size == 0) {
-            *ll = NULL;
-            return ngx_http_next_body_filter(r, out.next);
+        *b->last++ = CR; *b->last++ = LF;
+    }
+
+    rc = ngx_http_next_body_filter(r, out);
+
+    /*
+     * the write filter has copied the chain links, so the links of
+     * the passed buffers are freed, and our buffers are kept in the busy
+     * chain until they are sent
+     */
+
+    hll = &hl;
+
+    for (cl = out; cl; cl = next) {
+        next = cl->next;
+
+        if (cl->buf->tag == (ngx_buf_tag_t) &ngx_http_chunked_filter_module) {
+            *hll = cl;
+            hll = &cl->next;
+            continue;
         }
 
-        b = ngx_calloc_buf(r->pool);
+        ngx_free_chain(r->pool, cl);
+    }
+
+    *hll = NULL;
+
+    ngx_chain_update_chains(&ctx->free, &ctx->busy, &hl,
+                            (ngx_buf_tag_t) &ngx_http_chunked_filter_module);
+
+    return rc;
+}
+
+
+static ngx_buf_t *
+ngx_http_chunked_get_buf(ngx_http_request_t *r,
+    ngx_http_chunked_filter_ctx_t *ctx, ngx_chain_t ***ll)
+{
+    u_char       *p;
+    ngx_buf_t    *b;
+    ngx_uint_t    i;
+    ngx_chain_t  *cl;
+
+    if (ctx->free == NULL) {
+
+        cl = ngx_palloc(r->pool,
+                        NGX_HTTP_CHUNKED_BATCH * sizeof(ngx_chain_t));
+        if (cl == NULL) {
+            return NULL;
+        }
+
+        b = ngx_pcalloc(r->pool, NGX_HTTP_CHUNKED_BATCH * sizeof(ngx_buf_t));
         if (b == NULL) {
-            return NGX_ERROR;
+            return NULL;
         }
 
-        b->memory = 1;
-        b->pos = (u_char *) CRLF;
-        b->last = b->pos + 2;
+        p = ngx_palloc(r->pool, NGX_HTTP_CHUNKED_BATCH * NGX_HTTP_CHUNKED_LEN);
+        if (p == NULL) {
+            return NULL;
+        }
+
+        for (i = 0; i < NGX_HTTP_CHUNKED_BATCH; i++) {
+            b[i].start = p;
+            b[i].end = p + NGX_HTTP_CHUNKED_LEN;
+            b[i].tag = (ngx_buf_tag_t) &ngx_http_chunked_filter_module;
+
+            cl[i].buf = &b[i];
+            cl[i].next = ctx->free;
+            ctx->free = &cl[i];
+
+            p += NGX_HTTP_CHUNKED_LEN;
+        }
     }
 
-    tail.buf = b;
-    tail.next = NULL;
-    *ll = &tail;
+    cl = ctx->free;
+    ctx->free = cl->next;
+
+    b = cl->buf;
+
+    b->temporary = 1;
+    b->last_buf = 0;
+    b->pos = b->start;
+    b->last = b->start;
+
+    cl->next = NULL;
+
+    **ll = cl;
+    *ll = &cl->next;
 
-    return ngx_http_next_body_filter(r, &out);
+    return b;
 }
 
 
@@ -11,11 +11,51 @@
 #include <zlib.h>
 
 
+typedef struct ngx_http_gzip_codec_s  ngx_http_gzip_codec_t;
+
+
+typedef struct {
+    ngx_http_gzip_codec_t  *codec;
+    ngx_int_t               level;
+} ngx_http_gzip_codec_conf_t;
+
+
+/* the interval between the cleanups of a cache directory */
+
+#define NGX_HTTP_GZIP_CACHE_CLEAN  60
+
+
+typedef struct {
+    ngx_path_t          *path;
+    time_t               inactive;
+    off_t                max_size;
+
+    time_t               next;
+    ngx_event_t          event;
+} ngx_http_gzip_cache_t;
+
+
+typedef struct {
+    ngx_str_t            name;
+    time_t               mtime;
+    off_t                size;
+} ngx_http_gzip_cache_file_t;
+
+
+typedef struct {
+    time_t               inactive;
+    off_t                size;
+    ngx_array_t         *files;     /* array of ngx_http_gzip_cache_file_t */
+    ngx_pool_t          *pool;
+} ngx_http_gzip_cache_clean_t;
+
+
 typedef struct {
     ngx_flag_t           enable;
     ngx_flag_t           no_buffer;
 
     ngx_array_t         *types;     /* array of ngx_str_t */
+    ngx_array_t         *codecs;    /* array of ngx_http_gzip_codec_conf_t */
 
     ngx_bufs_t           bufs;
 
@@ -23,6 +63,8 @@ typedef struct {
     size_t               wbits;
     size_t               memlevel;
     ssize_t              min_length;
+
+    ngx_http_gzip_cache_t  *cache;
 } ngx_http_gzip_conf_t;
 
 
@@ -52,14 +94,71 @@ typedef struct {
     uint32_t             crc32;
     z_stream             zstream;
     ngx_http_request_t  *request;
+
+    ngx_http_gzip_codec_t  *codec;
+    ngx_int_t               level;
+
+    /* the compressed variant that is sent from or stored to the cache */
+    ngx_buf_t           *cached;
+    ngx_temp_file_t     *cache_file;
+    ngx_str_t            cache_name;
+    ngx_str_t            cache_key;
+    unsigned             cache_sent:1;
 } ngx_http_gzip_ctx_t;
 
 
+/*
+ * a codec compresses the data between the zstream next_in/avail_in and
+ * next_out/avail_out pointers, flushes the output on Z_SYNC_FLUSH, and
+ * returns Z_STREAM_END after Z_FINISH when all output has been done;
+ * the header is sent before the compressed data and the trailer of the
+ * given size is written after them
+ */
+
+struct ngx_http_gzip_codec_s {
+    ngx_str_t            encoding;
+    ngx_str_t            header;
+    size_t               trailer;
+
+    ngx_int_t          (*init)(ngx_http_gzip_ctx_t *ctx, int wbits,
+                           int memlevel);
+    int                (*compress)(ngx_http_gzip_ctx_t *ctx, int flush);
+    int                (*end)(ngx_http_gzip_ctx_t *ctx);
+    void               (*write_trailer)(ngx_http_gzip_ctx_t *ctx, u_char *p);
+};
+
+
+static ngx_int_t ngx_http_gzip_init(ngx_http_gzip_ctx_t *ctx, int wbits,
+    int memlevel);
+static int ngx_http_gzip_compress(ngx_http_gzip_ctx_t *ctx, int flush);
+static void ngx_http_gzip_trailer(ngx_http_gzip_ctx_t *ctx, u_char *p);
+static ngx_int_t ngx_http_deflate_init(ngx_http_gzip_ctx_t *ctx, int wbits,
+    int memlevel);
+static int ngx_http_deflate_compress(ngx_http_gzip_ctx_t *ctx, int flush);
+static int ngx_http_deflate_end(ngx_http_gzip_ctx_t *ctx);
+
 static void *ngx_http_gzip_filter_alloc(void *opaque, u_int items,
     u_int size);
 static void ngx_http_gzip_filter_free(void *opaque, void *address);
 static void ngx_http_gzip_error(ngx_http_gzip_ctx_t *ctx);
 
+static ngx_int_t ngx_http_gzip_cache_open(ngx_http_request_t *r,
+    ngx_http_gzip_ctx_t *ctx, ngx_http_gzip_conf_t *conf);
+static ngx_int_t ngx_http_gzip_cache_key(ngx_http_request_t *r,
+    ngx_http_gzip_ctx_t *ctx);
+static ssize_t ngx_http_gzip_cache_vary(ngx_http_request_t *r, u_char *buf);
+static ngx_int_t ngx_http_gzip_cache_send(ngx_http_request_t *r,
+    ngx_http_gzip_ctx_t *ctx, ngx_chain_t *in);
+static void ngx_http_gzip_cache_write(ngx_http_request_t *r,
+    ngx_http_gzip_ctx_t *ctx, ngx_chain_t *out);
+static void ngx_http_gzip_cache_clean(ngx_event_t *ev);
+static ngx_int_t ngx_http_gzip_cache_clean_file(ngx_tree_ctx_t *ctx,
+    ngx_str_t *path);
+static ngx_int_t ngx_http_gzip_cache_noop(ngx_tree_ctx_t *ctx,
+    ngx_str_t *path);
+static int ngx_libc_cdecl ngx_http_gzip_cache_cmp_files(const void *one,
+    const void *two);
+
 static ngx_int_t ngx_http_gzip_add_variables(ngx_conf_t *cf);
 static ngx_int_t ngx_http_gzip_ratio_variable(ngx_http_request_t *r,
     ngx_http_variable_value_t *v, uintptr_t data);
@@ -68,8 +167,12 @@ static ngx_int_t ngx_http_gzip_filter_init(ngx_conf_t *cf);
 static void *ngx_http_gzip_create_conf(ngx_conf_t *cf);
 static char *ngx_http_gzip_merge_conf(ngx_conf_t *cf,
     void *parent, void *child);
+static char *ngx_http_gzip_cache(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf);
 static char *ngx_http_gzip_types(ngx_conf_t *cf, ngx_command_t *cmd,
     void *conf);
+static char *ngx_http_gzip_codecs(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf);
 static char *ngx_http_gzip_window(ngx_conf_t *cf, void *post, void *data);
 static char *ngx_http_gzip_hash(ngx_conf_t *cf, void *post, void *data);
 
@@ -106,6 +209,13 @@ static ngx_command_t  ngx_http_gzip_filter_commands[] = {
       0,
       NULL },
 
+    { ngx_string("gzip_codecs"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_1MORE,
+      ngx_http_gzip_codecs,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      0,
+      NULL },
+
     { ngx_string("gzip_comp_level"),
       NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
       ngx_conf_set_num_slot,
@@ -141,6 +251,13 @@ static ngx_command_t  ngx_http_gzip_filter_commands[] = {
       offsetof(ngx_http_gzip_conf_t, min_length),
       NULL },
 
+    { ngx_string("gzip_cache"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_1MORE,
+      ngx_http_gzip_cache,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      0,
+      NULL },
+
       ngx_null_command
 };
 
@@ -195,6 +312,30 @@ struct gztrailer {
 #endif
 
 
+/* the order of preference is set by the "gzip_codecs" directive */
+
+static ngx_http_gzip_codec_t  ngx_http_gzip_known_codecs[] = {
+
+    { ngx_string("gzip"),
+      { sizeof(gzheader), gzheader },
+      sizeof(struct gztrailer),
+      ngx_http_gzip_init,
+      ngx_http_gzip_compress,
+      ngx_http_deflate_end,
+      ngx_http_gzip_trailer },
+
+    { ngx_string("deflate"),
+      ngx_null_string,
+      0,
+      ngx_http_deflate_init,
+      ngx_http_deflate_compress,
+      ngx_http_deflate_end,
+      NULL },
+
+    { ngx_null_string, ngx_null_string, 0, NULL, NULL, NULL, NULL }
+};
+
+
 static ngx_str_t  ngx_http_gzip_ratio = ngx_string("gzip_ratio");
 
 static ngx_http_output_header_filter_pt  ngx_http_next_header_filter;
@@ -204,11 +345,13 @@ static ngx_http_output_body_filter_pt    ngx_http_next_body_filter;
 static ngx_int_t
 ngx_http_gzip_header_filter(ngx_http_request_t *r)
 {
-    ngx_str_t             *type;
-    ngx_uint_t             i;
-    ngx_table_elt_t       *h;
-    ngx_http_gzip_ctx_t   *ctx;
-    ngx_http_gzip_conf_t  *conf;
+    ngx_int_t                    rc;
+    ngx_str_t                   *type;
+    ngx_uint_t                   i, q, best;
+    ngx_table_elt_t             *h;
+    ngx_http_gzip_ctx_t         *ctx;
+    ngx_http_gzip_conf_t        *conf;
+    ngx_http_gzip_codec_conf_t  *codec, *cc;
 
     conf = ngx_http_get_module_loc_conf(r, ngx_http_gzip_filter_module);
 
@@ -241,6 +384,25 @@ ngx_http_gzip_header_filter(ngx_http_request_t *r)
 
 found:
 
+    /* the codec with the highest client quality, the first one of equals */
+
+    codec = NULL;
+    best = 0;
+
+    cc = conf->codecs->elts;
+    for (i = 0; i < conf->codecs->nelts; i++) {
+        q = ngx_http_gzip_accept(r, &cc[i].codec->encoding);
+
+        if (q > best) {
+            codec = &cc[i];
+            best = q;
+        }
+    }
+
+    if (codec == NULL) {
+        return ngx_http_next_header_filter(r);
+    }
+
     ctx = ngx_pcalloc(r->pool, sizeof(ngx_http_gzip_ctx_t));
     if (ctx == NULL) {
         return NGX_ERROR;
@@ -249,6 +411,8 @@ found:
     ngx_http_set_ctx(r, ctx, ngx_http_gzip_filter_module);
 
     ctx->request = r;
+    ctx->codec = codec->codec;
+    ctx->level = (codec->level != NGX_CONF_UNSET) ? codec->level : conf->level;
 
     h = ngx_list_push(&r->headers_out.headers);
     if (h == NULL) {
@@ -258,13 +422,33 @@ found:
     h->hash = 1;
     h->key.len = sizeof("Content-Encoding") - 1;
     h->key.data = (u_char *) "Content-Encoding";
-    h->value.len = sizeof("gzip") - 1;
-    h->value.data = (u_char *) "gzip";
+    h->value = ctx->codec->encoding;
 
     r->headers_out.content_encoding = h;
 
     ctx->length = r->headers_out.content_length_n;
 
+    if (conf->cache) {
+        rc = ngx_http_gzip_cache_open(r, ctx, conf);
+
+        if (rc == NGX_ERROR) {
+            return NGX_ERROR;
+        }
+
+        if (rc == NGX_OK) {
+
+            /* the response body is replaced by the cached variant */
+
+            ngx_http_clear_content_length(r);
+            ngx_http_clear_accept_ranges(r);
+
+            r->headers_out.content_length_n = ctx->cached->file_last
+                                              - ctx->cached->file_pos;
+
+            return ngx_http_next_header_filter(r);
+        }
+    }
+
     r->main_filter_need_in_memory = 1;
 
     ngx_http_clear_content_length(r);
@@ -279,7 +463,6 @@ ngx_http_gzip_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
 {
     int                    rc, wbits, memlevel;
     ngx_int_t              last;
-    struct gztrailer      *trailer;
     ngx_buf_t             *b;
     ngx_chain_t           *cl, out;
     ngx_http_gzip_ctx_t   *ctx;
@@ -291,6 +474,10 @@ ngx_http_gzip_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
         return ngx_http_next_body_filter(r, in);
     }
 
+    if (ctx->cached) {
+        return ngx_http_gzip_cache_send(r, ctx, in);
+    }
+
     conf = ngx_http_get_module_loc_conf(r, ngx_http_gzip_filter_module);
 
     if (ctx->preallocated == NULL) {
@@ -332,46 +519,47 @@ ngx_http_gzip_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
         ctx->zstream.zfree = ngx_http_gzip_filter_free;
         ctx->zstream.opaque = ctx;
 
-        rc = deflateInit2(&ctx->zstream, (int) conf->level, Z_DEFLATED,
-                          -wbits, memlevel, Z_DEFAULT_STRATEGY);
-
-        if (rc != Z_OK) {
-            ngx_log_error(NGX_LOG_ALERT, r->connection->log, 0,
-                          "deflateInit2() failed: %d", rc);
+        if (ctx->codec->init(ctx, wbits, memlevel) != NGX_OK) {
             ngx_http_gzip_error(ctx);
             return NGX_ERROR;
         }
 
-        b = ngx_pcalloc(r->pool, sizeof(ngx_buf_t));
-        if (b == NULL) {
-            ngx_http_gzip_error(ctx);
-            return NGX_ERROR;
-        }
+        if (ctx->codec->header.len) {
+            b = ngx_pcalloc(r->pool, sizeof(ngx_buf_t));
+            if (b == NULL) {
+                ngx_http_gzip_error(ctx);
+                return NGX_ERROR;
+            }
 
-        b->memory = 1;
-        b->pos = gzheader;
-        b->last = b->pos + 10;
+            b->memory = 1;
+            b->pos = ctx->codec->header.data;
+            b->last = b->pos + ctx->codec->header.len;
 
-        out.buf = b;
-        out.next = NULL;
+            out.buf = b;
+            out.next = NULL;
 
-        /*
-         * We pass the gzheader to the next filter now to avoid its linking
-         * to the ctx->busy chain.  zlib does not usually output the compressed
-         * data in the initial iterations, so the gzheader that was linked
-         * to the ctx->busy chain would be flushed by ngx_http_write_filter().
-         */
+            /*
+             * We pass the gzheader to the next filter now to avoid its linking
+             * to the ctx->busy chain.  zlib does not usually output the
+             * compressed data in the initial iterations, so the gzheader that
+             * was linked to the ctx->busy chain would be flushed by
+             * ngx_http_write_filter().
+             */
 
-        if (ngx_http_next_body_filter(r, &out) == NGX_ERROR) {
-            ngx_http_gzip_error(ctx);
-            return NGX_ERROR;
+            if (ctx->cache_file) {
+                ngx_http_gzip_cache_write(r, ctx, &out);
+            }
+
+            if (ngx_http_next_body_filter(r, &out) == NGX_ERROR) {
+                ngx_http_gzip_error(ctx);
+                return NGX_ERROR;
+            }
         }
 
         r->connection->buffered |= NGX_HTTP_GZIP_BUFFERED;
 
         ctx->last_out = &ctx->out;
 
-        ctx->crc32 = crc32(0L, Z_NULL, 0);
         ctx->flush = Z_NO_FLUSH;
     }
 
@@ -428,14 +616,10 @@ ngx_http_gzip_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
                     ctx->flush = Z_SYNC_FLUSH;
                 }
 
-                if (ctx->zstream.avail_in == 0) {
-                    if (ctx->flush == Z_NO_FLUSH) {
-                        continue;
-                    }
-
-                } else {
-                    ctx->crc32 = crc32(ctx->crc32, ctx->zstream.next_in,
-                                       ctx->zstream.avail_in);
+                if (ctx->zstream.avail_in == 0
+                    && ctx->flush == Z_NO_FLUSH)
+                {
+                    continue;
                 }
             }
 
@@ -475,11 +659,12 @@ ngx_http_gzip_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
                          ctx->zstream.avail_in, ctx->zstream.avail_out,
                          ctx->flush, ctx->redo);
 
-            rc = deflate(&ctx->zstream, ctx->flush);
+            rc = ctx->codec->compress(ctx, ctx->flush);
 
             if (rc != Z_OK && rc != Z_STREAM_END) {
                 ngx_log_error(NGX_LOG_ALERT, r->connection->log, 0,
-                              "deflate() failed: %d, %d", ctx->flush, rc);
+                              "%V compression failed: %d, %d",
+                              &ctx->codec->encoding, ctx->flush, rc);
                 ngx_http_gzip_error(ctx);
                 return NGX_ERROR;
             }
@@ -550,13 +735,15 @@ ngx_http_gzip_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
             if (rc == Z_STREAM_END) {
 
                 ctx->zin = ctx->zstream.total_in;
-                ctx->zout = 10 + ctx->zstream.total_out + 8;
+                ctx->zout = ctx->codec->header.len + ctx->zstream.total_out
+                            + ctx->codec->trailer;
 
-                rc = deflateEnd(&ctx->zstream);
+                rc = ctx->codec->end(ctx);
 
                 if (rc != Z_OK) {
                     ngx_log_error(NGX_LOG_ALERT, r->connection->log, 0,
-                                  "deflateEnd() failed: %d", rc);
+                                  "%V compression end failed: %d",
+                                  &ctx->codec->encoding, rc);
                     ngx_http_gzip_error(ctx);
                     return NGX_ERROR;
                 }
@@ -574,20 +761,16 @@ ngx_http_gzip_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
                 *ctx->last_out = cl;
                 ctx->last_out = &cl->next;
 
-                if (ctx->zstream.avail_out >= 8) {
-                    trailer = (struct gztrailer *) ctx->out_buf->last;
-                    ctx->out_buf->last += 8;
-                    ctx->out_buf->last_buf = 1;
+                if (ctx->zstream.avail_out >= ctx->codec->trailer) {
+                    b = ctx->out_buf;
 
                 } else {
-                    b = ngx_create_temp_buf(r->pool, 8);
+                    b = ngx_create_temp_buf(r->pool, ctx->codec->trailer);
                     if (b == NULL) {
                         ngx_http_gzip_error(ctx);
                         return NGX_ERROR;
                     }
 
-                    b->last_buf = 1;
-
                     cl = ngx_alloc_chain_link(r->pool);
                     if (cl == NULL) {
                         ngx_http_gzip_error(ctx);
@@ -598,26 +781,14 @@ ngx_http_gzip_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
                     cl->next = NULL;
                     *ctx->last_out = cl;
                     ctx->last_out = &cl->next;
-                    trailer = (struct gztrailer *) b->pos;
-                    b->last += 8;
                 }
 
-#if (NGX_HAVE_LITTLE_ENDIAN && NGX_HAVE_NONALIGNED)
-
-                trailer->crc32 = ctx->crc32;
-                trailer->zlen = ctx->zin;
+                if (ctx->codec->write_trailer) {
+                    ctx->codec->write_trailer(ctx, b->last);
+                    b->last += ctx->codec->trailer;
+                }
 
-#else
-                trailer->crc32[0] = (u_char) (ctx->crc32 & 0xff);
-                trailer->crc32[1] = (u_char) ((ctx->crc32 >> 8) & 0xff);
-                trailer->crc32[2] = (u_char) ((ctx->crc32 >> 16) & 0xff);
-                trailer->crc32[3] = (u_char) ((ctx->crc32 >> 24) & 0xff);
-
-                trailer->zlen[0] = (u_char) (ctx->zin & 0xff);
-                trailer->zlen[1] = (u_char) ((ctx->zin >> 8) & 0xff);
-                trailer->zlen[2] = (u_char) ((ctx->zin >> 16) & 0xff);
-                trailer->zlen[3] = (u_char) ((ctx->zin >> 24) & 0xff);
-#endif
+                b->last_buf = 1;
 
                 ctx->zstream.avail_in = 0;
                 ctx->zstream.avail_out = 0;
@@ -657,6 +828,10 @@ ngx_http_gzip_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
             }
         }
 
+        if (ctx->cache_file && ctx->out) {
+            ngx_http_gzip_cache_write(r, ctx, ctx->out);
+        }
+
         last = ngx_http_next_body_filter(r, ctx->out);
 
         /*
@@ -680,6 +855,95 @@ ngx_http_gzip_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
 }
 
 
+static ngx_int_t
+ngx_http_gzip_init(ngx_http_gzip_ctx_t *ctx, int wbits, int memlevel)
+{
+    ctx->crc32 = crc32(0L, Z_NULL, 0);
+
+    /* the raw deflate stream, the gzip header and trailer are ours */
+
+    return ngx_http_deflate_init(ctx, -wbits, memlevel);
+}
+
+
+static int
+ngx_http_gzip_compress(ngx_http_gzip_ctx_t *ctx, int flush)
+{
+    int      rc;
+    u_char  *p;
+
+    p = ctx->zstream.next_in;
+
+    rc = deflate(&ctx->zstream, flush);
+
+    if (p && ctx->zstream.next_in != p) {
+        ctx->crc32 = crc32(ctx->crc32, p, ctx->zstream.next_in - p);
+    }
+
+    return rc;
+}
+
+
+static void
+ngx_http_gzip_trailer(ngx_http_gzip_ctx_t *ctx, u_char *p)
+{
+    struct gztrailer  *trailer;
+
+    trailer = (struct gztrailer *) p;
+
+#if (NGX_HAVE_LITTLE_ENDIAN && NGX_HAVE_NONALIGNED)
+
+    trailer->crc32 = ctx->crc32;
+    trailer->zlen = ctx->zin;
+
+#else
+    trailer->crc32[0] = (u_char) (ctx->crc32 & 0xff);
+    trailer->crc32[1] = (u_char) ((ctx->crc32 >> 8) & 0xff);
+    trailer->crc32[2] = (u_char) ((ctx->crc32 >> 16) & 0xff);
+    trailer->crc32[3] = (u_char) ((ctx->crc32 >> 24) & 0xff);
+
+    trailer->zlen[0] = (u_char) (ctx->zin & 0xff);
+    trailer->zlen[1] = (u_char) ((ctx->zin >> 8) & 0xff);
+    trailer->zlen[2] = (u_char) ((ctx->zin >> 16) & 0xff);
+    trailer->zlen[3] = (u_char) ((ctx->zin >> 24) & 0xff);
+#endif
+}
+
+
+/* the "deflate" encoding is the zlib stream with its own header and adler32 */
+
+static ngx_int_t
+ngx_http_deflate_init(ngx_http_gzip_ctx_t *ctx, int wbits, int memlevel)
+{
+    int  rc;
+
+    rc = deflateInit2(&ctx->zstream, (int) ctx->level, Z_DEFLATED,
+                      wbits, memlevel, Z_DEFAULT_STRATEGY);
+
+    if (rc != Z_OK) {
+        ngx_log_error(NGX_LOG_ALERT, ctx->request->connection->log, 0,
+                      "deflateInit2() failed: %d", rc);
+        return NGX_ERROR;
+    }
+
+    return NGX_OK;
+}
+
+
+static int
+ngx_http_deflate_compress(ngx_http_gzip_ctx_t *ctx, int flush)
+{
+    return deflate(&ctx->zstream, flush);
+}
+
+
+static int
+ngx_http_deflate_end(ngx_http_gzip_ctx_t *ctx)
+{
+    return deflateEnd(&ctx->zstream);
+}
+
+
 static void *
 ngx_http_gzip_filter_alloc(void *opaque, u_int items, u_int size)
 {
@@ -737,7 +1001,11 @@ ngx_http_gzip_filter_free(void *opaque, void *address)
 static void
 ngx_http_gzip_error(ngx_http_gzip_ctx_t *ctx)
 {
-    deflateEnd(&ctx->zstream);
+    (void) ctx->codec->end(ctx);
+
+    /* the incomplete temporary file is deleted by the pool cleanup */
+
+    ctx->cache_file = NULL;
 
     if (ctx->preallocated) {
         ngx_pfree(ctx->request->pool, ctx->preallocated);
@@ -752,128 +1020,874 @@ ngx_http_gzip_error(ngx_http_gzip_ctx_t *ctx)
 }
 
 
+/*
+ * the compressed variants are stored in the gzip_cache directory,
+ * a static file is identified by its device, inode, modification time,
+ * and size, and a proxied response is identified by the upstream URL,
+ * the last modification time, the length, and the request headers listed
+ * in the "Vary" response header.  The cached file starts with the
+ * "KEY: ...\n" line that is compared on every hit, because the file name
+ * is only the CRC32 of the key.
+ */
+
 static ngx_int_t
-ngx_http_gzip_add_variables(ngx_conf_t *cf)
+ngx_http_gzip_cache_open(ngx_http_request_t *r, ngx_http_gzip_ctx_t *ctx,
+    ngx_http_gzip_conf_t *conf)
 {
-    ngx_http_variable_t  *var;
+    u_char                   *p;
+    ssize_t                   n;
+    uint32_t                  crc;
+    ngx_fd_t                  fd;
+    ngx_int_t                 rc;
+    ngx_buf_t                *b;
+    ngx_path_t               *path;
+    ngx_file_t                file;
+    ngx_file_info_t           fi;
+    ngx_temp_file_t          *tf;
+    ngx_pool_cleanup_t       *cln;
+    ngx_pool_cleanup_file_t  *clnf;
+
+    /* the cached variant is sent as a file */
+
+    if (r != r->main
+        || !r->connection->sendfile
+        || r->headers_out.status != NGX_HTTP_OK
+        || r->headers_out.content_length_n <= 0)
+    {
+        return NGX_DECLINED;
+    }
 
-    var = ngx_http_add_variable(cf, &ngx_http_gzip_ratio, NGX_HTTP_VAR_NOHASH);
-    if (var == NULL) {
+    rc = ngx_http_gzip_cache_key(r, ctx);
+
+    if (rc != NGX_OK) {
+        return rc;
+    }
+
+    path = conf->cache->path;
+
+    ctx->cache_name.len = path->name.len + 1 + path->len + 8;
+
+    ctx->cache_name.data = ngx_palloc(r->pool, ctx->cache_name.len + 1);
+    if (ctx->cache_name.data == NULL) {
         return NGX_ERROR;
     }
 
-    var->get_handler = ngx_http_gzip_ratio_variable;
+    ngx_memcpy(ctx->cache_name.data, path->name.data, path->name.len);
 
-    return NGX_OK;
-}
+    crc = ngx_crc32_long(ctx->cache_key.data, ctx->cache_key.len);
 
+    (void) ngx_sprintf(ctx->cache_name.data + path->name.len + 1 + path->len,
+                       "%08xD%Z", crc);
 
-static ngx_int_t
-ngx_http_gzip_ratio_variable(ngx_http_request_t *r,
-    ngx_http_variable_value_t *v, uintptr_t data)
-{
-    ngx_uint_t            zint, zfrac;
-    ngx_http_gzip_ctx_t  *ctx;
+    ngx_create_hashed_filename(path, ctx->cache_name.data,
+                               ctx->cache_name.len);
 
-    v->valid = 1;
-    v->no_cacheable = 0;
-    v->not_found = 0;
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "gzip cache: \"%s\"", ctx->cache_name.data);
 
-    ctx = ngx_http_get_module_ctx(r, ngx_http_gzip_filter_module);
+    fd = ngx_open_file(ctx->cache_name.data, NGX_FILE_RDONLY, NGX_FILE_OPEN, 0);
 
-    if (ctx == NULL || ctx->zout == 0) {
-        v->not_found = 1;
-        return NGX_OK;
+    if (fd == NGX_INVALID_FILE) {
+        goto miss;
     }
 
-    v->data = ngx_palloc(r->pool, NGX_INT32_LEN + 3);
-    if (v->data == NULL) {
+    cln = ngx_pool_cleanup_add(r->pool, sizeof(ngx_pool_cleanup_file_t));
+    if (cln == NULL) {
+        (void) ngx_close_file(fd);
         return NGX_ERROR;
     }
 
-    zint = (ngx_uint_t) (ctx->zin / ctx->zout);
-    zfrac = (ngx_uint_t) ((ctx->zin * 100 / ctx->zout) % 100);
-
-    if ((ctx->zin * 1000 / ctx->zout) % 10 > 4) {
+    cln->handler = ngx_pool_cleanup_file;
+    clnf = cln->data;
 
-        /* the rounding, e.g., 2.125 to 2.13 */
+    clnf->fd = fd;
+    clnf->name = ctx->cache_name.data;
+    clnf->log = r->pool->log;
 
-        zfrac++;
+    if (ngx_fd_info(fd, &fi) == NGX_FILE_ERROR) {
+        ngx_log_error(NGX_LOG_CRIT, r->connection->log, ngx_errno,
+                      ngx_fd_info_n " \"%s\" failed", ctx->cache_name.data);
+        goto miss;
+    }
 
-        if (zfrac > 99) {
-            zint++;
-            zfrac = 0;
-        }
+    if (ngx_file_size(&fi) <= (off_t) ctx->cache_key.len) {
+        goto miss;
     }
 
-    v->len = ngx_sprintf(v->data, "%ui.%02ui", zint, zfrac) - v->data;
+    ngx_memzero(&file, sizeof(ngx_file_t));
 
-    return NGX_OK;
-}
+    file.fd = fd;
+    file.name = ctx->cache_name;
+    file.log = r->connection->log;
 
+    p = ngx_palloc(r->pool, ctx->cache_key.len);
+    if (p == NULL) {
+        return NGX_ERROR;
+    }
 
-static void *
-ngx_http_gzip_create_conf(ngx_conf_t *cf)
-{
-    ngx_http_gzip_conf_t  *conf;
+    n = ngx_read_file(&file, p, ctx->cache_key.len, 0);
 
-    conf = ngx_pcalloc(cf->pool, sizeof(ngx_http_gzip_conf_t));
-    if (conf == NULL) {
-        return NGX_CONF_ERROR;
+    if (n != (ssize_t) ctx->cache_key.len
+        || ngx_memcmp(p, ctx->cache_key.data, n) != 0)
+    {
+        goto miss;
     }
 
-    /*
-     * set by ngx_pcalloc():
-     *
-     *     conf->bufs.num = 0;
-     *     conf->types = NULL;
-     */
+    b = ngx_calloc_buf(r->pool);
+    if (b == NULL) {
+        return NGX_ERROR;
+    }
 
-    conf->enable = NGX_CONF_UNSET;
-    conf->no_buffer = NGX_CONF_UNSET;
+    b->file = ngx_pcalloc(r->pool, sizeof(ngx_file_t));
+    if (b->file == NULL) {
+        return NGX_ERROR;
+    }
 
-    conf->level = NGX_CONF_UNSET;
-    conf->wbits = (size_t) NGX_CONF_UNSET;
-    conf->memlevel = (size_t) NGX_CONF_UNSET;
-    conf->min_length = NGX_CONF_UNSET;
+    b->file_pos = ctx->cache_key.len;
+    b->file_last = ngx_file_size(&fi);
 
-    return conf;
-}
+    b->in_file = 1;
+    b->last_buf = 1;
 
+    b->file->fd = fd;
+    b->file->name = ctx->cache_name;
+    b->file->log = r->connection->log;
 
-static char *
-ngx_http_gzip_merge_conf(ngx_conf_t *cf, void *parent, void *child)
-{
-    ngx_http_gzip_conf_t *prev = parent;
-    ngx_http_gzip_conf_t *conf = child;
+    ctx->cached = b;
 
-    ngx_str_t  *type;
+    /* a hit keeps the variant from being removed as inactive */
 
-    ngx_conf_merge_value(conf->enable, prev->enable, 0);
+    if (ngx_file_mtime(&fi) + NGX_HTTP_GZIP_CACHE_CLEAN < ngx_time()) {
+        (void) ngx_set_file_time(ctx->cache_name.data, fd, ngx_time());
+    }
 
-    ngx_conf_merge_bufs_value(conf->bufs, prev->bufs, 4, ngx_pagesize);
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "gzip cache hit");
 
-    ngx_conf_merge_value(conf->level, prev->level, 1);
-    ngx_conf_merge_size_value(conf->wbits, prev->wbits, MAX_WBITS);
-    ngx_conf_merge_size_value(conf->memlevel, prev->memlevel,
-                              MAX_MEM_LEVEL - 1);
-    ngx_conf_merge_value(conf->min_length, prev->min_length, 20);
-    ngx_conf_merge_value(conf->no_buffer, prev->no_buffer, 0);
+#if (NGX_HTTP_STATUS)
+    ngx_http_status_cache(r, 1);
+#endif
 
-    if (conf->types == NULL) {
-        if (prev->types == NULL) {
-            conf->types = ngx_array_create(cf->pool, 1, sizeof(ngx_str_t));
-            if (conf->types == NULL) {
-                return NGX_CONF_ERROR;
-            }
+    return NGX_OK;
 
-            type = ngx_array_push(conf->types);
-            if (type == NULL) {
-                return NGX_CONF_ERROR;
-            }
+miss:
 
-            type->len = sizeof("text/html") - 1;
-            type->data = (u_char *) "text/html";
+#if (NGX_HTTP_STATUS)
+    ngx_http_status_cache(r, 0);
+#endif
+
+    tf = ngx_pcalloc(r->pool, sizeof(ngx_temp_file_t));
+    if (tf == NULL) {
+        return NGX_ERROR;
+    }
+
+    tf->file.fd = NGX_INVALID_FILE;
+    tf->file.log = r->connection->log;
+    tf->path = path;
+    tf->pool = r->pool;
+    tf->persistent = 1;
+    tf->clean = 1;
+
+    ctx->cache_file = tf;
+
+    return NGX_DECLINED;
+}
+
+
+static ngx_int_t
+ngx_http_gzip_cache_key(ngx_http_request_t *r, ngx_http_gzip_ctx_t *ctx)
+{
+    u_char                *p, *last;
+    size_t                 len, root;
+    time_t                 lm;
+    ssize_t                vary;
+    in_port_t              port;
+    ngx_str_t              path, *host;
+    ngx_file_info_t        fi;
+    ngx_http_upstream_t   *u;
+
+    u = r->upstream;
+
+    len = sizeof("KEY:  :\n") - 1 + ctx->codec->encoding.len + NGX_INT_T_LEN;
+
+    if (u == NULL) {
+
+        /* the response is sent from a file if the file matches it */
+
+        last = ngx_http_map_uri_to_path(r, &path, &root, 0);
+        if (last == NULL) {
+            return NGX_ERROR;
+        }
+
+        if (ngx_file_info(path.data, &fi) == NGX_FILE_ERROR
+            || !ngx_is_file(&fi)
+            || ngx_file_mtime(&fi) != r->headers_out.last_modified_time
+            || ngx_file_size(&fi) != r->headers_out.content_length_n)
+        {
+            return NGX_DECLINED;
+        }
+
+        host = NULL;
+        vary = 0;
+
+        len += NGX_INT64_LEN + sizeof(":") - 1 + NGX_INT64_LEN
+               + sizeof(" ") - 1 + NGX_TIME_T_LEN
+               + sizeof(" ") - 1 + NGX_OFF_T_LEN;
+
+    } else {
+
+        /* a proxied response is identified by the upstream URL */
+
+        if (u->uri.len == 0) {
+            return NGX_DECLINED;
+        }
+
+        /* the upstream "Last-Modified" header is passed as is */
+
+        lm = r->headers_out.last_modified_time;
+
+        if (lm == -1 && r->headers_out.last_modified) {
+            lm = ngx_http_parse_time(r->headers_out.last_modified->value.data,
+                                     r->headers_out.last_modified->value.len);
+        }
+
+        if (lm == NGX_ERROR) {
+            return NGX_DECLINED;
+        }
+
+        if (u->resolved) {
+            host = &u->resolved->host;
+            port = u->resolved->port;
+
+        } else if (u->conf->upstream) {
+            host = &u->conf->upstream->host;
+            port = u->conf->upstream->port;
+
+        } else {
+            return NGX_DECLINED;
+        }
+
+        vary = ngx_http_gzip_cache_vary(r, NULL);
+
+        if (vary == NGX_DECLINED) {
+            return NGX_DECLINED;
+        }
+
+        len += u->schema.len + host->len + sizeof(":65535") - 1 + u->uri.len
+               + sizeof(" ") - 1 + NGX_TIME_T_LEN
+               + sizeof(" ") - 1 + NGX_OFF_T_LEN + vary;
+    }
+
+    ctx->cache_key.data = ngx_palloc(r->pool, len);
+    if (ctx->cache_key.data == NULL) {
+        return NGX_ERROR;
+    }
+
+    if (u == NULL) {
+        p = ngx_sprintf(ctx->cache_key.data, "KEY: %uL:%uL %T %O",
+                        (uint64_t) ngx_file_dev(&fi),
+                        (uint64_t) ngx_file_uniq(&fi),
+                        ngx_file_mtime(&fi), ngx_file_size(&fi));
+
+    } else {
+        p = ngx_sprintf(ctx->cache_key.data, "KEY: %V%V:%d%V %T %O",
+                        &u->schema, host, (int) port, &u->uri, lm,
+                        r->headers_out.content_length_n);
+
+        p += ngx_http_gzip_cache_vary(r, p);
+    }
+
+    p = ngx_sprintf(p, " %V:%i\n", &ctx->codec->encoding, ctx->level);
+
+    ctx->cache_key.len = p - ctx->cache_key.data;
+
+    return NGX_OK;
+}
+
+
+/*
+ * the values of the request headers listed in the "Vary" response
+ * headers are added to the key as " name=value", "Vary: *" is not cached
+ */
+
+static ssize_t
+ngx_http_gzip_cache_vary(ngx_http_request_t *r, u_char *buf)
+{
+    u_char           *p, *last, *name;
+    size_t            len;
+    ngx_uint_t        i, j, k;
+    ngx_list_part_t  *part, *in;
+    ngx_table_elt_t  *header, *h;
+
+    len = 0;
+
+    part = &r->headers_out.headers.part;
+    header = part->elts;
+
+    for (i = 0; /* void */ ; i++) {
+
+        if (i >= part->nelts) {
+            if (part->next == NULL) {
+                break;
+            }
+
+            part = part->next;
+            header = part->elts;
+            i = 0;
+        }
+
+        if (header[i].hash == 0
+            || header[i].key.len != sizeof("Vary") - 1
+            || ngx_strncasecmp(header[i].key.data, (u_char *) "Vary",
+                               sizeof("Vary") - 1) != 0)
+        {
+            continue;
+        }
+
+        p = header[i].value.data;
+        last = p + header[i].value.len;
+
+        while (p < last) {
+
+            if (*p == ' ' || *p == ',') {
+                p++;
+                continue;
+            }
+
+            name = p;
+
+            while (p < last && *p != ' ' && *p != ',') {
+                p++;
+            }
+
+            if (p - name == 1 && *name == '*') {
+                return NGX_DECLINED;
+            }
+
+            if (buf) {
+                *buf++ = ' ';
+                buf = ngx_cpymem(buf, name, p - name);
+                *buf++ = '=';
+            }
+
+            len += sizeof(" =") - 1 + (p - name);
+
+            in = &r->headers_in.headers.part;
+            h = in->elts;
+
+            for (j = 0; /* void */ ; j++) {
+
+                if (j >= in->nelts) {
+                    if (in->next == NULL) {
+                        break;
+                    }
+
+                    in = in->next;
+                    h = in->elts;
+                    j = 0;
+                }
+
+                k = p - name;
+
+                if (h[j].key.len != k
+                    || ngx_strncasecmp(h[j].key.data, name, k) != 0)
+                {
+                    continue;
+                }
+
+                if (buf) {
+                    buf = ngx_cpymem(buf, h[j].value.data, h[j].value.len);
+                }
+
+                len += h[j].value.len;
+
+                break;
+            }
+        }
+    }
+
+    return len;
+}
+
+
+static ngx_int_t
+ngx_http_gzip_cache_send(ngx_http_request_t *r, ngx_http_gzip_ctx_t *ctx,
+    ngx_chain_t *in)
+{
+    ngx_chain_t  *cl, out;
+
+    /* the original response body is not needed */
+
+    for (cl = in; cl; cl = cl->next) {
+        cl->buf->pos = cl->buf->last;
+        cl->buf->file_pos = cl->buf->file_last;
+    }
+
+    if (ctx->cache_sent) {
+
+        /* the rest of the original body only flushes the buffered data */
+
+        if (!r->connection->buffered) {
+            return NGX_OK;
+        }
+
+        return ngx_http_next_body_filter(r, NULL);
+    }
+
+    ctx->cache_sent = 1;
+
+    out.buf = ctx->cached;
+    out.next = NULL;
+
+    return ngx_http_next_body_filter(r, &out);
+}
+
+
+static void
+ngx_http_gzip_cache_write(ngx_http_request_t *r, ngx_http_gzip_ctx_t *ctx,
+    ngx_chain_t *out)
+{
+    ssize_t                 n;
+    ngx_buf_t               b;
+    ngx_chain_t             key;
+    ngx_event_t            *ev;
+    ngx_temp_file_t        *tf;
+    ngx_http_gzip_conf_t   *conf;
+    ngx_ext_rename_file_t   ext;
+
+    tf = ctx->cache_file;
+
+    if (tf->offset == 0) {
+        ngx_memzero(&b, sizeof(ngx_buf_t));
+
+        b.memory = 1;
+        b.pos = ctx->cache_key.data;
+        b.last = ctx->cache_key.data + ctx->cache_key.len;
+
+        key.buf = &b;
+        key.next = out;
+
+        out = &key;
+    }
+
+    n = ngx_write_chain_to_temp_file(tf, out);
+
+    if (n == NGX_ERROR) {
+        ctx->cache_file = NULL;
+        return;
+    }
+
+    tf->offset += n;
+
+    if (!ctx->done) {
+        return;
+    }
+
+    ext.access = NGX_FILE_DEFAULT_ACCESS;
+    ext.time = -1;
+    ext.create_path = 1;
+    ext.delete_file = 1;
+    ext.log = r->connection->log;
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "gzip cache stores \"%s\" to \"%s\"",
+                   tf->file.name.data, ctx->cache_name.data);
+
+    (void) ngx_ext_rename_file(&tf->file.name, &ctx->cache_name, &ext);
+
+    ctx->cache_file = NULL;
+
+    /* the cache grows only here, so it is cleaned after a store */
+
+    conf = ngx_http_get_module_loc_conf(r, ngx_http_gzip_filter_module);
+
+    if (conf->cache->next <= ngx_time()) {
+        ev = &conf->cache->event;
+        ngx_post_event(ev, &ngx_posted_events);
+    }
+}
+
+
+/*
+ * the workers clean a cache directory once in NGX_HTTP_GZIP_CACHE_CLEAN
+ * seconds: the worker that finds the ".clean" file older than that
+ * updates its time and removes the variants that have not been stored
+ * or hit during the inactive time, and then the least recently used ones
+ * while the cache is larger than max_size
+ */
+
+static void
+ngx_http_gzip_cache_clean(ngx_event_t *ev)
+{
+    u_char                       *p;
+    off_t                         size;
+    time_t                        now;
+    ngx_fd_t                      fd;
+    ngx_int_t                     rc;
+    ngx_str_t                     name;
+    ngx_uint_t                    i;
+    ngx_pool_t                   *pool;
+    ngx_file_info_t               fi;
+    ngx_tree_ctx_t                tree;
+    ngx_http_gzip_cache_t        *cache;
+    ngx_http_gzip_cache_file_t   *file;
+    ngx_http_gzip_cache_clean_t   clean;
+
+    cache = ev->data;
+
+    now = ngx_time();
+    cache->next = now + NGX_HTTP_GZIP_CACHE_CLEAN;
+
+    pool = ngx_create_pool(16384, ev->log);
+    if (pool == NULL) {
+        return;
+    }
+
+    name.len = cache->path->name.len + sizeof("/.clean") - 1;
+
+    name.data = ngx_palloc(pool, name.len + 1);
+    if (name.data == NULL) {
+        goto done;
+    }
+
+    p = ngx_cpymem(name.data, cache->path->name.data, cache->path->name.len);
+    (void) ngx_cpystrn(p, (u_char *) "/.clean", sizeof("/.clean"));
+
+    if (ngx_file_info(name.data, &fi) != NGX_FILE_ERROR
+        && ngx_file_mtime(&fi) + NGX_HTTP_GZIP_CACHE_CLEAN > now)
+    {
+        /* another worker has cleaned the cache recently */
+
+        cache->next = ngx_file_mtime(&fi) + NGX_HTTP_GZIP_CACHE_CLEAN;
+        goto done;
+    }
+
+    fd = ngx_open_file(name.data, NGX_FILE_RDWR, NGX_FILE_CREATE_OR_OPEN,
+                       NGX_FILE_DEFAULT_ACCESS);
+
+    if (fd == NGX_INVALID_FILE) {
+        ngx_log_error(NGX_LOG_CRIT, ev->log, ngx_errno,
+                      ngx_open_file_n " \"%s\" failed", name.data);
+        goto done;
+    }
+
+    if (ngx_set_file_time(name.data, fd, now) != NGX_OK) {
+        ngx_log_error(NGX_LOG_CRIT, ev->log, ngx_errno,
+                      ngx_set_file_time_n " \"%s\" failed", name.data);
+        rc = NGX_ERROR;
+
+    } else {
+        rc = NGX_OK;
+    }
+
+    if (ngx_close_file(fd) == NGX_FILE_ERROR) {
+        ngx_log_error(NGX_LOG_ALERT, ev->log, ngx_errno,
+                      ngx_close_file_n " \"%s\" failed", name.data);
+    }
+
+    if (rc != NGX_OK) {
+        goto done;
+    }
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, ev->log, 0,
+                   "gzip cache clean \"%V\"", &cache->path->name);
+
+    clean.inactive = now - cache->inactive;
+    clean.size = 0;
+    clean.pool = pool;
+
+    if (cache->max_size) {
+        clean.files = ngx_array_create(pool, 256,
+                                       sizeof(ngx_http_gzip_cache_file_t));
+        if (clean.files == NULL) {
+            goto done;
+        }
+
+    } else {
+        clean.files = NULL;
+    }
+
+    tree.init_handler = NULL;
+    tree.file_handler = ngx_http_gzip_cache_clean_file;
+    tree.pre_tree_handler = ngx_http_gzip_cache_noop;
+    tree.post_tree_handler = ngx_http_gzip_cache_noop;
+    tree.spec_handler = ngx_http_gzip_cache_noop;
+    tree.data = &clean;
+    tree.alloc = 0;
+    tree.log = ev->log;
+
+    if (ngx_walk_tree(&tree, &cache->path->name) != NGX_OK) {
+        goto done;
+    }
+
+    if (clean.files == NULL || clean.size <= cache->max_size) {
+        goto done;
+    }
+
+    ngx_qsort(clean.files->elts, (size_t) clean.files->nelts,
+              sizeof(ngx_http_gzip_cache_file_t),
+              ngx_http_gzip_cache_cmp_files);
+
+    size = clean.size;
+    file = clean.files->elts;
+
+    for (i = 0; i < clean.files->nelts && size > cache->max_size; i++) {
+
+        ngx_log_debug1(NGX_LOG_DEBUG_HTTP, ev->log, 0,
+                       "gzip cache remove \"%s\"", file[i].name.data);
+
+        if (ngx_delete_file(file[i].name.data) == NGX_FILE_ERROR
+            && ngx_errno != NGX_ENOENT)
+        {
+            ngx_log_error(NGX_LOG_CRIT, ev->log, ngx_errno,
+                          ngx_delete_file_n " \"%s\" failed",
+                          file[i].name.data);
+            continue;
+        }
+
+        size -= file[i].size;
+    }
+
+done:
+
+    ngx_destroy_pool(pool);
+}
+
+
+static ngx_int_t
+ngx_http_gzip_cache_clean_file(ngx_tree_ctx_t *ctx, ngx_str_t *path)
+{
+    u_char                       *p;
+    ngx_http_gzip_cache_file_t   *file;
+    ngx_http_gzip_cache_clean_t  *clean;
+
+    clean = ctx->data;
+
+    for (p = path->data + path->len; p > path->data; p--) {
+        if (p[-1] == '/') {
+            break;
+        }
+    }
+
+    if (*p == '.') {
+        return NGX_OK;
+    }
+
+    if (ctx->mtime < clean->inactive) {
+
+        ngx_log_debug1(NGX_LOG_DEBUG_HTTP, ctx->log, 0,
+                       "gzip cache remove inactive \"%s\"", path->data);
+
+        if (ngx_delete_file(path->data) == NGX_FILE_ERROR
+            && ngx_errno != NGX_ENOENT)
+        {
+            ngx_log_error(NGX_LOG_CRIT, ctx->log, ngx_errno,
+                          ngx_delete_file_n " \"%s\" failed", path->data);
+        }
+
+        return NGX_OK;
+    }
+
+    clean->size += ctx->size;
+
+    if (clean->files == NULL) {
+        return NGX_OK;
+    }
+
+    file = ngx_array_push(clean->files);
+    if (file == NULL) {
+        return NGX_ABORT;
+    }
+
+    file->name.len = path->len;
+    file->name.data = ngx_palloc(clean->pool, path->len + 1);
+    if (file->name.data == NULL) {
+        return NGX_ABORT;
+    }
+
+    ngx_memcpy(file->name.data, path->data, path->len + 1);
+
+    file->mtime = ctx->mtime;
+    file->size = ctx->size;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_gzip_cache_noop(ngx_tree_ctx_t *ctx, ngx_str_t *path)
+{
+    return NGX_OK;
+}
+
+
+static int ngx_libc_cdecl
+ngx_http_gzip_cache_cmp_files(const void *one, const void *two)
+{
+    ngx_http_gzip_cache_file_t *first, *second;
+
+    first = (ngx_http_gzip_cache_file_t *) one;
+    second = (ngx_http_gzip_cache_file_t *) two;
+
+    if (first->mtime == second->mtime) {
+        return 0;
+    }
+
+    return (first->mtime < second->mtime) ? -1 : 1;
+}
+
+
+
+static ngx_int_t
+ngx_http_gzip_add_variables(ngx_conf_t *cf)
+{
+    ngx_http_variable_t  *var;
+
+    var = ngx_http_add_variable(cf, &ngx_http_gzip_ratio, NGX_HTTP_VAR_NOHASH);
+    if (var == NULL) {
+        return NGX_ERROR;
+    }
+
+    var->get_handler = ngx_http_gzip_ratio_variable;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_gzip_ratio_variable(ngx_http_request_t *r,
+    ngx_http_variable_value_t *v, uintptr_t data)
+{
+    ngx_uint_t            zint, zfrac;
+    ngx_http_gzip_ctx_t  *ctx;
+
+    v->valid = 1;
+    v->no_cacheable = 0;
+    v->not_found = 0;
+
+    ctx = ngx_http_get_module_ctx(r, ngx_http_gzip_filter_module);
+
+    if (ctx == NULL || ctx->zout == 0) {
+        v->not_found = 1;
+        return NGX_OK;
+    }
+
+    v->data = ngx_palloc(r->pool, NGX_INT32_LEN + 3);
+    if (v->data == NULL) {
+        return NGX_ERROR;
+    }
+
+    zint = (ngx_uint_t) (ctx->zin / ctx->zout);
+    zfrac = (ngx_uint_t) ((ctx->zin * 100 / ctx->zout) % 100);
+
+    if ((ctx->zin * 1000 / ctx->zout) % 10 > 4) {
+
+        /* the rounding, e.g., 2.125 to 2.13 */
+
+        zfrac++;
+
+        if (zfrac > 99) {
+            zint++;
+            zfrac = 0;
+        }
+    }
+
+    v->len = ngx_sprintf(v->data, "%ui.%02ui", zint, zfrac) - v->data;
+
+    return NGX_OK;
+}
+
+
+static void *
+ngx_http_gzip_create_conf(ngx_conf_t *cf)
+{
+    ngx_http_gzip_conf_t  *conf;
+
+    conf = ngx_pcalloc(cf->pool, sizeof(ngx_http_gzip_conf_t));
+    if (conf == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    /*
+     * set by ngx_pcalloc():
+     *
+     *     conf->bufs.num = 0;
+     *     conf->types = NULL;
+     *     conf->codecs = NULL;
+     *     conf->cache = NULL;
+     */
+
+    conf->enable = NGX_CONF_UNSET;
+    conf->no_buffer = NGX_CONF_UNSET;
+
+    conf->level = NGX_CONF_UNSET;
+    conf->wbits = (size_t) NGX_CONF_UNSET;
+    conf->memlevel = (size_t) NGX_CONF_UNSET;
+    conf->min_length = NGX_CONF_UNSET;
+
+    return conf;
+}
+
+
+static char *
+ngx_http_gzip_merge_conf(ngx_conf_t *cf, void *parent, void *child)
+{
+    ngx_http_gzip_conf_t *prev = parent;
+    ngx_http_gzip_conf_t *conf = child;
+
+    ngx_str_t                   *type;
+    ngx_http_gzip_codec_conf_t  *codec;
+
+    ngx_conf_merge_value(conf->enable, prev->enable, 0);
+
+    ngx_conf_merge_bufs_value(conf->bufs, prev->bufs, 4, ngx_pagesize);
+
+    ngx_conf_merge_value(conf->level, prev->level, 1);
+    ngx_conf_merge_size_value(conf->wbits, prev->wbits, MAX_WBITS);
+    ngx_conf_merge_size_value(conf->memlevel, prev->memlevel,
+                              MAX_MEM_LEVEL - 1);
+    ngx_conf_merge_value(conf->min_length, prev->min_length, 20);
+    ngx_conf_merge_value(conf->no_buffer, prev->no_buffer, 0);
+
+    if (conf->cache == NULL) {
+        conf->cache = prev->cache;
+    }
+
+    if (conf->codecs == NULL) {
+        if (prev->codecs == NULL) {
+            conf->codecs = ngx_array_create(cf->pool, 1,
+                                          sizeof(ngx_http_gzip_codec_conf_t));
+            if (conf->codecs == NULL) {
+                return NGX_CONF_ERROR;
+            }
+
+            codec = ngx_array_push(conf->codecs);
+            if (codec == NULL) {
+                return NGX_CONF_ERROR;
+            }
+
+            codec->codec = &ngx_http_gzip_known_codecs[0];
+            codec->level = NGX_CONF_UNSET;
+
+        } else {
+            conf->codecs = prev->codecs;
+        }
+    }
+
+    if (conf->types == NULL) {
+        if (prev->types == NULL) {
+            conf->types = ngx_array_create(cf->pool, 1, sizeof(ngx_str_t));
+            if (conf->types == NULL) {
+                return NGX_CONF_ERROR;
+            }
+
+            type = ngx_array_push(conf->types);
+            if (type == NULL) {
+                return NGX_CONF_ERROR;
+            }
+
+            type->len = sizeof("text/html") - 1;
+            type->data = (u_char *) "text/html";
 
         } else {
             conf->types = prev->types;
@@ -897,6 +1911,108 @@ ngx_http_gzip_filter_init(ngx_conf_t *cf)
 }
 
 
+static char *
+ngx_http_gzip_cache(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_http_gzip_conf_t *gcf = conf;
+
+    ssize_t                 level;
+    ngx_str_t              *value, s;
+    ngx_uint_t              i, n;
+    ngx_path_t             *path;
+    ngx_http_gzip_cache_t  *cache;
+
+    if (gcf->cache) {
+        return "is duplicate";
+    }
+
+    cache = ngx_pcalloc(cf->pool, sizeof(ngx_http_gzip_cache_t));
+    if (cache == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    path = ngx_pcalloc(cf->pool, sizeof(ngx_path_t));
+    if (path == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    value = cf->args->elts;
+
+    path->name = value[1];
+
+    if (path->name.data[path->name.len - 1] == '/') {
+        path->name.len--;
+    }
+
+    if (ngx_conf_full_name(cf->cycle, &path->name, 0) == NGX_ERROR) {
+        return NGX_CONF_ERROR;
+    }
+
+    path->conf_file = cf->conf_file->file.name.data;
+    path->line = cf->conf_file->line;
+
+    cache->inactive = 600;
+
+    for (i = 2, n = 0; i < cf->args->nelts; i++) {
+
+        if (ngx_strncmp(value[i].data, "inactive=", 9) == 0) {
+
+            s.len = value[i].len - 9;
+            s.data = value[i].data + 9;
+
+            cache->inactive = ngx_parse_time(&s, 1);
+            if (cache->inactive == NGX_ERROR) {
+                goto invalid;
+            }
+
+            continue;
+        }
+
+        if (ngx_strncmp(value[i].data, "max_size=", 9) == 0) {
+
+            s.len = value[i].len - 9;
+            s.data = value[i].data + 9;
+
+            cache->max_size = ngx_parse_offset(&s);
+            if (cache->max_size == NGX_ERROR) {
+                goto invalid;
+            }
+
+            continue;
+        }
+
+        level = ngx_atoi(value[i].data, value[i].len);
+        if (level == NGX_ERROR || level == 0 || n == NGX_MAX_PATH_LEVEL) {
+            goto invalid;
+        }
+
+        path->level[n++] = level;
+        path->len += level + 1;
+    }
+
+    cache->path = path;
+
+    if (ngx_add_path(cf, &cache->path) == NGX_ERROR) {
+        return NGX_CONF_ERROR;
+    }
+
+    cache->event.handler = ngx_http_gzip_cache_clean;
+    cache->event.data = cache;
+    cache->event.log = cf->cycle->new_log;
+
+    gcf->cache = cache;
+
+    return NGX_CONF_OK;
+
+invalid:
+
+    ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                       "invalid parameter \"%V\"", &value[i]);
+
+    return NGX_CONF_ERROR;
+}
+
+
 static char *
 ngx_http_gzip_types(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 {
@@ -947,6 +2063,92 @@ ngx_http_gzip_types(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 }
 
 
+static char *
+ngx_http_gzip_codecs(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_http_gzip_conf_t *gcf = conf;
+
+    u_char                      *colon;
+    ngx_str_t                   *value, name;
+    ngx_int_t                    level;
+    ngx_uint_t                   i, n, k;
+    ngx_http_gzip_codec_t       *known;
+    ngx_http_gzip_codec_conf_t  *codec;
+
+    if (gcf->codecs) {
+        return "is duplicate";
+    }
+
+    gcf->codecs = ngx_array_create(cf->pool, cf->args->nelts - 1,
+                                   sizeof(ngx_http_gzip_codec_conf_t));
+    if (gcf->codecs == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    value = cf->args->elts;
+
+    for (i = 1; i < cf->args->nelts; i++) {
+
+        /* "gzip" or "gzip:6" */
+
+        name = value[i];
+        level = NGX_CONF_UNSET;
+
+        colon = ngx_strlchr(name.data, name.data + name.len, ':');
+
+        if (colon) {
+            name.len = colon - name.data;
+
+            level = ngx_atoi(colon + 1, value[i].len - name.len - 1);
+
+            if (level < 1 || level > 9) {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "invalid compression level in \"%V\"",
+                                   &value[i]);
+                return NGX_CONF_ERROR;
+            }
+        }
+
+        known = ngx_http_gzip_known_codecs;
+
+        for (n = 0; known[n].encoding.len; n++) {
+            if (known[n].encoding.len == name.len
+                && ngx_strncasecmp(known[n].encoding.data, name.data, name.len)
+                   == 0)
+            {
+                goto found;
+            }
+        }
+
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "unknown compression codec \"%V\"", &name);
+        return NGX_CONF_ERROR;
+
+    found:
+
+        codec = gcf->codecs->elts;
+        for (k = 0; k < gcf->codecs->nelts; k++) {
+            if (codec[k].codec == &known[n]) {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "duplicate compression codec \"%V\"",
+                                   &name);
+                return NGX_CONF_ERROR;
+            }
+        }
+
+        codec = ngx_array_push(gcf->codecs);
+        if (codec == NULL) {
+            return NGX_CONF_ERROR;
+        }
+
+        codec->codec = &known[n];
+        codec->level = level;
+    }
+
+    return NGX_CONF_OK;
+}
+
+
 static char *
 ngx_http_gzip_window(ngx_conf_t *cf, void *post, void *data)
 {
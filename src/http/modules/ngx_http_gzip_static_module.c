@@ -65,6 +65,9 @@ ngx_module_t  ngx_http_gzip_static_module = {
 };
 
 
+static ngx_str_t  ngx_http_gzip_static_encoding = ngx_string("gzip");
+
+
 static ngx_int_t
 ngx_http_gzip_static_handler(ngx_http_request_t *r)
 {
@@ -96,7 +99,10 @@ ngx_http_gzip_static_handler(ngx_http_request_t *r)
 
     gzcf = ngx_http_get_module_loc_conf(r, ngx_http_gzip_static_module);
 
-    if (!gzcf->enable || ngx_http_gzip_ok(r) != NGX_OK) {
+    if (!gzcf->enable
+        || ngx_http_gzip_ok(r) != NGX_OK
+        || ngx_http_gzip_accept(r, &ngx_http_gzip_static_encoding) == 0)
+    {
         return NGX_DECLINED;
     }
 
@@ -9,6 +9,10 @@
 #include <ngx_http.h>
 #include <nginx.h>
 
+#if (NGX_ZLIB)
+#include <zlib.h>
+#endif
+
 
 typedef struct ngx_http_log_op_s  ngx_http_log_op_t;
 
@@ -30,6 +34,7 @@ struct ngx_http_log_op_s {
 typedef struct {
     ngx_str_t                   name;
     ngx_array_t                *ops;        /* array of ngx_http_log_op_t */
+    ngx_uint_t                  binary;     /* unsigned  binary:1 */
 } ngx_http_log_fmt_t;
 
 
@@ -41,9 +46,16 @@ typedef struct {
 
 typedef struct {
     ngx_open_file_t            *file;
+    ngx_syslog_peer_t          *syslog;
     time_t                      disk_full_time;
     time_t                      error_log_time;
     ngx_array_t                *ops;        /* array of ngx_http_log_op_t */
+    ngx_uint_t                  binary;     /* unsigned  binary:1 */
+
+    ngx_int_t                   filter;     /* "if" variable index */
+    ngx_uint_t                  sample;
+    ngx_uint_t                  sampled;
+    ngx_msec_t                  slow;
 } ngx_http_log_t;
 
 
@@ -60,8 +72,47 @@ typedef struct {
 } ngx_http_log_var_t;
 
 
+typedef struct {
+    ngx_open_file_t            *file;
+    size_t                      size;
+    ngx_msec_t                  flush;
+} ngx_http_log_async_t;
+
+
+#define NGX_HTTP_LOG_RING_SIZE         4194304
+#define NGX_HTTP_LOG_RING_WORKER_SIZE  1048576
+#define NGX_HTTP_LOG_LINE_SIZE         1024
+#define NGX_HTTP_LOG_GZIP_SIZE         65536
+#define NGX_HTTP_LOG_SLOW              1000
+
+
+/*
+ * the binary log record is the 32-bit payload length followed by
+ * the fields, each field starts with its type byte, all integers
+ * are in the network byte order
+ */
+
+#define NGX_HTTP_LOG_BIN_UINT32  1
+#define NGX_HTTP_LOG_BIN_UINT64  2
+#define NGX_HTTP_LOG_BIN_STRING  3         /* 16-bit length and bytes */
+#define NGX_HTTP_LOG_BIN_NULL    4
+#define NGX_HTTP_LOG_BIN_INET    5         /* IPv4 address */
+#define NGX_HTTP_LOG_BIN_MSEC    6         /* 64-bit msec since the Epoch */
+
+
+static ngx_int_t ngx_http_log_skip(ngx_http_request_t *r,
+    ngx_http_log_t *log);
+static u_char *ngx_http_log_format(ngx_http_request_t *r,
+    ngx_http_log_t *log, size_t *len);
 static void ngx_http_log_write(ngx_http_request_t *r, ngx_http_log_t *log,
     u_char *buf, size_t len);
+static void ngx_http_log_syslog(ngx_http_request_t *r, ngx_http_log_t *log,
+    u_char *buf, size_t len);
+#if (NGX_ZLIB)
+static ssize_t ngx_http_log_gzip(ngx_fd_t fd, u_char *buf, size_t len,
+    ngx_int_t level, ngx_log_t *log);
+static void ngx_http_log_flush(ngx_open_file_t *file, ngx_log_t *log);
+#endif
 
 static u_char *ngx_http_log_connection(ngx_http_request_t *r, u_char *buf,
     ngx_http_log_op_t *op);
@@ -82,13 +133,36 @@ static u_char *ngx_http_log_body_bytes_sent(ngx_http_request_t *r,
 static u_char *ngx_http_log_request_length(ngx_http_request_t *r, u_char *buf,
     ngx_http_log_op_t *op);
 
+static u_char *ngx_http_log_bin_connection(ngx_http_request_t *r,
+    u_char *buf, ngx_http_log_op_t *op);
+static u_char *ngx_http_log_bin_pipe(ngx_http_request_t *r, u_char *buf,
+    ngx_http_log_op_t *op);
+static u_char *ngx_http_log_bin_msec(ngx_http_request_t *r, u_char *buf,
+    ngx_http_log_op_t *op);
+static u_char *ngx_http_log_bin_request_time(ngx_http_request_t *r,
+    u_char *buf, ngx_http_log_op_t *op);
+static u_char *ngx_http_log_bin_status(ngx_http_request_t *r, u_char *buf,
+    ngx_http_log_op_t *op);
+static u_char *ngx_http_log_bin_bytes_sent(ngx_http_request_t *r,
+    u_char *buf, ngx_http_log_op_t *op);
+static u_char *ngx_http_log_bin_body_bytes_sent(ngx_http_request_t *r,
+    u_char *buf, ngx_http_log_op_t *op);
+static u_char *ngx_http_log_bin_request_length(ngx_http_request_t *r,
+    u_char *buf, ngx_http_log_op_t *op);
+static u_char *ngx_http_log_bin_remote_addr(ngx_http_request_t *r,
+    u_char *buf, ngx_http_log_op_t *op);
+static size_t ngx_http_log_bin_variable_getlen(ngx_http_request_t *r,
+    uintptr_t data);
+static u_char *ngx_http_log_bin_variable(ngx_http_request_t *r, u_char *buf,
+    ngx_http_log_op_t *op);
+
 static ngx_int_t ngx_http_log_variable_compile(ngx_conf_t *cf,
     ngx_http_log_op_t *op, ngx_str_t *value);
 static size_t ngx_http_log_variable_getlen(ngx_http_request_t *r,
     uintptr_t data);
 static u_char *ngx_http_log_variable(ngx_http_request_t *r, u_char *buf,
     ngx_http_log_op_t *op);
-static uintptr_t ngx_http_log_escape(u_char *dst, u_char *src, size_t size);
+static u_char *ngx_http_log_escape(u_char *dst, u_char *src, size_t size);
 
 
 static void *ngx_http_log_create_main_conf(ngx_conf_t *cf);
@@ -99,8 +173,17 @@ static char *ngx_http_log_set_log(ngx_conf_t *cf, ngx_command_t *cmd,
     void *conf);
 static char *ngx_http_log_set_format(ngx_conf_t *cf, ngx_command_t *cmd,
     void *conf);
+#if (NGX_HAVE_ATOMIC_OPS)
+static char *ngx_http_log_set_async(ngx_conf_t *cf, ngx_http_log_t *log,
+    size_t size, ngx_msec_t flush);
+static ngx_int_t ngx_http_log_init_ring(ngx_shm_zone_t *shm_zone,
+    void *data);
+#endif
 static char *ngx_http_log_compile_format(ngx_conf_t *cf,
     ngx_array_t *ops, ngx_array_t *args, ngx_uint_t s);
+static ngx_int_t ngx_http_log_fuse_literal(ngx_conf_t *cf, ngx_array_t *ops);
+static char *ngx_http_log_compile_binary(ngx_conf_t *cf,
+    ngx_array_t *ops, ngx_array_t *args, ngx_uint_t s);
 static ngx_int_t ngx_http_log_init(ngx_conf_t *cf);
 
 
@@ -115,7 +198,7 @@ static ngx_command_t  ngx_http_log_commands[] = {
 
     { ngx_string("access_log"),
       NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_HTTP_LIF_CONF
-                        |NGX_HTTP_LMT_CONF|NGX_CONF_TAKE123,
+                        |NGX_HTTP_LMT_CONF|NGX_CONF_1MORE,
       ngx_http_log_set_log,
       NGX_HTTP_LOC_CONF_OFFSET,
       0,
@@ -186,15 +269,59 @@ static ngx_http_log_var_t  ngx_http_log_vars[] = {
 };
 
 
+static ngx_http_log_var_t  ngx_http_log_bin_vars[] = {
+    { ngx_string("connection"), 1 + 8, ngx_http_log_bin_connection },
+    { ngx_string("pipe"), 1 + 4, ngx_http_log_bin_pipe },
+    { ngx_string("time_local"), 1 + 8, ngx_http_log_bin_msec },
+    { ngx_string("msec"), 1 + 8, ngx_http_log_bin_msec },
+    { ngx_string("request_time"), 1 + 4, ngx_http_log_bin_request_time },
+    { ngx_string("status"), 1 + 4, ngx_http_log_bin_status },
+    { ngx_string("bytes_sent"), 1 + 8, ngx_http_log_bin_bytes_sent },
+    { ngx_string("body_bytes_sent"), 1 + 8,
+                          ngx_http_log_bin_body_bytes_sent },
+    { ngx_string("apache_bytes_sent"), 1 + 8,
+                          ngx_http_log_bin_body_bytes_sent },
+    { ngx_string("request_length"), 1 + 8,
+                          ngx_http_log_bin_request_length },
+    { ngx_string("remote_addr"), 1 + 4, ngx_http_log_bin_remote_addr },
+
+    { ngx_null_string, 0, NULL }
+};
+
+
+static ngx_inline u_char *
+ngx_http_log_put32(u_char *p, uint32_t n)
+{
+    *p++ = (u_char) (n >> 24);
+    *p++ = (u_char) (n >> 16);
+    *p++ = (u_char) (n >> 8);
+    *p++ = (u_char) n;
+
+    return p;
+}
+
+
+static ngx_inline u_char *
+ngx_http_log_put64(u_char *p, uint64_t n)
+{
+    p = ngx_http_log_put32(p, (uint32_t) (n >> 32));
+
+    return ngx_http_log_put32(p, (uint32_t) n);
+}
+
+
+static u_char  *ngx_http_log_line;
+static size_t   ngx_http_log_line_size;
+
+
 ngx_int_t
 ngx_http_log_handler(ngx_http_request_t *r)
 {
     u_char                   *line, *p;
     size_t                    len;
-    ngx_uint_t                i, l;
+    ngx_uint_t                l;
     ngx_http_log_t           *log;
     ngx_open_file_t          *file;
-    ngx_http_log_op_t        *op;
     ngx_http_log_loc_conf_t  *lcf;
 
     ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
@@ -220,21 +347,37 @@ ngx_http_log_handler(ngx_http_request_t *r)
             continue;
         }
 
-        len = 0;
-        op = log[l].ops->elts;
-        for (i = 0; i < log[l].ops->nelts; i++) {
-            if (op[i].len == 0) {
-                len += op[i].getlen(r, op[i].data);
+        if ((log[l].sample || log[l].filter != NGX_CONF_UNSET)
+            && ngx_http_log_skip(r, &log[l]))
+        {
+            continue;
+        }
 
-            } else {
-                len += op[i].len;
-            }
+        line = ngx_http_log_format(r, &log[l], &len);
+        if (line == NULL) {
+            return NGX_ERROR;
         }
 
-        len += NGX_LINEFEED_SIZE;
+        if (log[l].syslog) {
+            ngx_http_log_syslog(r, &log[l], line, len - NGX_LINEFEED_SIZE);
+            continue;
+        }
 
         file = log[l].file;
 
+        if (file->ring && file->ring->writer) {
+
+            p = ngx_log_ring_reserve(file->ring, len);
+
+            if (p) {
+                ngx_memcpy(p, line, len);
+                ngx_log_ring_commit(p, len);
+                continue;
+            }
+
+            /* the ring is full, write the line synchronously */
+        }
+
         if (file->buffer) {
 
             if (len > (size_t) (file->last - file->pos)) {
@@ -246,38 +389,156 @@ ngx_http_log_handler(ngx_http_request_t *r)
             }
 
             if (len <= (size_t) (file->last - file->pos)) {
+                file->pos = ngx_cpymem(file->pos, line, len);
+                continue;
+            }
+        }
 
-                p = file->pos;
+        ngx_http_log_write(r, &log[l], line, len);
+    }
 
-                for (i = 0; i < log[l].ops->nelts; i++) {
-                    p = op[i].run(r, p, &op[i]);
-                }
+    return NGX_OK;
+}
 
-                ngx_linefeed(p);
 
-                file->pos = p;
+/*
+ * the "if" condition and sampling are checked before any formatting,
+ * however the server errors and the slow requests are always logged
+ */
 
-                continue;
-            }
+static ngx_int_t
+ngx_http_log_skip(ngx_http_request_t *r, ngx_http_log_t *log)
+{
+    ngx_uint_t                  status;
+    ngx_time_t                 *tp;
+    ngx_msec_int_t              ms;
+    ngx_http_variable_value_t  *value;
+
+    status = r->err_status ? r->err_status : r->headers_out.status;
+
+    if (status >= NGX_HTTP_INTERNAL_SERVER_ERROR) {
+        return 0;
+    }
+
+    tp = ngx_timeofday();
+
+    ms = (ngx_msec_int_t)
+             ((tp->sec - r->start_sec) * 1000 + (tp->msec - r->start_msec));
+
+    if (ms >= (ngx_msec_int_t) log->slow) {
+        return 0;
+    }
+
+    if (log->filter != NGX_CONF_UNSET) {
+        value = ngx_http_get_indexed_variable(r, log->filter);
+
+        if (value == NULL
+            || value->not_found
+            || value->len == 0
+            || (value->len == 1 && value->data[0] == '0'))
+        {
+            return 1;
         }
+    }
 
-        line = ngx_palloc(r->pool, len);
-        if (line == NULL) {
-            return NGX_ERROR;
+    if (log->sample) {
+        return (log->sampled++ % log->sample) ? 1 : 0;
+    }
+
+    return 0;
+}
+
+
+/*
+ * the line is formatted in one pass into the process wide buffer:
+ * each operation reserves its maximum length that is either fixed
+ * or is known from the already evaluated variable value, and the buffer
+ * grows when the reservation does not fit
+ */
+
+static u_char *
+ngx_http_log_format(ngx_http_request_t *r, ngx_http_log_t *log, size_t *len)
+{
+    u_char             *p, *last, *line;
+    size_t              size, need;
+    ngx_uint_t          i;
+    ngx_array_t        *ops;
+    ngx_http_log_op_t  *op;
+
+    if (ngx_http_log_line == NULL) {
+        ngx_http_log_line = ngx_alloc(NGX_HTTP_LOG_LINE_SIZE,
+                                      r->connection->log);
+        if (ngx_http_log_line == NULL) {
+            return NULL;
         }
 
-        p = line;
+        ngx_http_log_line_size = NGX_HTTP_LOG_LINE_SIZE;
+    }
+
+    p = ngx_http_log_line;
+    last = ngx_http_log_line + ngx_http_log_line_size;
+
+    if (log->binary) {
+        /* the record length */
+        p += sizeof(uint32_t);
+    }
+
+    ops = log->ops;
+    op = ops->elts;
 
-        for (i = 0; i < log[l].ops->nelts; i++) {
-            p = op[i].run(r, p, &op[i]);
+    for (i = 0; i <= ops->nelts; i++) {
+
+        if (i == ops->nelts) {
+            need = log->binary ? 0 : NGX_LINEFEED_SIZE;
+
+        } else if (op[i].len) {
+            need = op[i].len;
+
+        } else {
+            need = op[i].getlen(r, op[i].data);
         }
 
-        ngx_linefeed(p);
+        if (need > (size_t) (last - p)) {
+
+            size = 2 * ngx_http_log_line_size;
+
+            while (need > size - (p - ngx_http_log_line)) {
+                size *= 2;
+            }
 
-        ngx_http_log_write(r, &log[l], line, p - line);
+            line = ngx_alloc(size, r->connection->log);
+            if (line == NULL) {
+                return NULL;
+            }
+
+            p = ngx_cpymem(line, ngx_http_log_line, p - ngx_http_log_line);
+
+            ngx_free(ngx_http_log_line);
+
+            ngx_http_log_line = line;
+            ngx_http_log_line_size = size;
+
+            last = line + size;
+        }
+
+        if (i == ops->nelts) {
+            break;
+        }
+
+        p = op[i].run(r, p, &op[i]);
     }
 
-    return NGX_OK;
+    if (log->binary) {
+        (void) ngx_http_log_put32(ngx_http_log_line,
+                      (uint32_t) (p - ngx_http_log_line - sizeof(uint32_t)));
+
+    } else {
+        ngx_linefeed(p);
+    }
+
+    *len = p - ngx_http_log_line;
+
+    return ngx_http_log_line;
 }
 
 
@@ -289,7 +550,17 @@ ngx_http_log_write(ngx_http_request_t *r, ngx_http_log_t *log, u_char *buf,
     ssize_t    n;
     ngx_err_t  err;
 
+#if (NGX_ZLIB)
+    if (log->file->data) {
+        n = ngx_http_log_gzip(log->file->fd, buf, len,
+                              *(ngx_int_t *) log->file->data,
+                              r->connection->log);
+    } else {
+        n = ngx_write_fd(log->file->fd, buf, len);
+    }
+#else
     n = ngx_write_fd(log->file->fd, buf, len);
+#endif
 
     if (n == (ssize_t) len) {
         return;
@@ -325,6 +596,130 @@ ngx_http_log_write(ngx_http_request_t *r, ngx_http_log_t *log, u_char *buf,
 }
 
 
+static void
+ngx_http_log_syslog(ngx_http_request_t *r, ngx_http_log_t *log, u_char *buf,
+    size_t len)
+{
+    time_t              now;
+    ngx_syslog_peer_t  *peer;
+
+    peer = log->syslog;
+
+    ngx_syslog_send(peer, peer->severity, buf, len);
+
+    if (peer->dropped == 0) {
+        return;
+    }
+
+    now = ngx_time();
+
+    if (now - log->error_log_time > 59) {
+        ngx_log_error(NGX_LOG_WARN, r->connection->log, 0,
+                      "%ui access log messages to syslog were dropped",
+                      peer->dropped);
+
+        peer->dropped = 0;
+        log->error_log_time = now;
+    }
+}
+
+
+#if (NGX_ZLIB)
+
+/*
+ * each buffer is compressed into a separate gzip member,
+ * gunzip and zcat read the concatenated members as one stream
+ */
+
+static ssize_t
+ngx_http_log_gzip(ngx_fd_t fd, u_char *buf, size_t len, ngx_int_t level,
+    ngx_log_t *log)
+{
+    int          rc;
+    u_char      *out;
+    size_t       size;
+    ssize_t      n;
+    z_stream     zstream;
+
+    ngx_memzero(&zstream, sizeof(z_stream));
+
+    rc = deflateInit2(&zstream, (int) level, Z_DEFLATED, MAX_WBITS + 16,
+                      MAX_MEM_LEVEL - 1, Z_DEFAULT_STRATEGY);
+
+    if (rc != Z_OK) {
+        ngx_log_error(NGX_LOG_ALERT, log, 0, "deflateInit2() failed: %d", rc);
+        return -1;
+    }
+
+    size = deflateBound(&zstream, len);
+
+    out = ngx_alloc(size, log);
+    if (out == NULL) {
+        (void) deflateEnd(&zstream);
+        return -1;
+    }
+
+    zstream.next_in = buf;
+    zstream.avail_in = len;
+    zstream.next_out = out;
+    zstream.avail_out = size;
+
+    rc = deflate(&zstream, Z_FINISH);
+
+    (void) deflateEnd(&zstream);
+
+    if (rc != Z_STREAM_END) {
+        ngx_log_error(NGX_LOG_ALERT, log, 0,
+                      "deflate(Z_FINISH) failed: %d", rc);
+        ngx_free(out);
+        return -1;
+    }
+
+    size -= zstream.avail_out;
+
+    n = ngx_write_fd(fd, out, size);
+
+    ngx_free(out);
+
+    if (n == (ssize_t) size) {
+        return len;
+    }
+
+    return (n == -1) ? -1 : 0;
+}
+
+
+static void
+ngx_http_log_flush(ngx_open_file_t *file, ngx_log_t *log)
+{
+    size_t   len;
+    ssize_t  n;
+
+    len = file->pos - file->buffer;
+
+    if (len == 0) {
+        return;
+    }
+
+    n = ngx_http_log_gzip(file->fd, file->buffer, len,
+                          *(ngx_int_t *) file->data, log);
+
+    if (n == -1) {
+        ngx_log_error(NGX_LOG_ALERT, log, ngx_errno,
+                      ngx_write_fd_n " to \"%V\" failed", &file->name);
+
+    } else if ((size_t) n != len) {
+        ngx_log_error(NGX_LOG_ALERT, log, 0,
+                      ngx_write_fd_n " to \"%V\" was incomplete",
+                      &file->name);
+    }
+
+    file->pos = file->buffer;
+}
+
+#endif
+
+
 static u_char *
 ngx_http_log_copy_short(ngx_http_request_t *r, u_char *buf,
     ngx_http_log_op_t *op)
@@ -456,108 +851,244 @@ ngx_http_log_request_length(ngx_http_request_t *r, u_char *buf,
 }
 
 
-static ngx_int_t
-ngx_http_log_variable_compile(ngx_conf_t *cf, ngx_http_log_op_t *op,
-    ngx_str_t *value)
+static u_char *
+ngx_http_log_bin_connection(ngx_http_request_t *r, u_char *buf,
+    ngx_http_log_op_t *op)
 {
-    ngx_int_t  index;
-
-    index = ngx_http_get_variable_index(cf, value);
-    if (index == NGX_ERROR) {
-        return NGX_ERROR;
-    }
-
-    op->len = 0;
-    op->getlen = ngx_http_log_variable_getlen;
-    op->run = ngx_http_log_variable;
-    op->data = index;
+    *buf++ = NGX_HTTP_LOG_BIN_UINT64;
 
-    return NGX_OK;
+    return ngx_http_log_put64(buf, r->connection->number);
 }
 
 
-static size_t
-ngx_http_log_variable_getlen(ngx_http_request_t *r, uintptr_t data)
+static u_char *
+ngx_http_log_bin_pipe(ngx_http_request_t *r, u_char *buf,
+    ngx_http_log_op_t *op)
 {
-    uintptr_t                   len;
-    ngx_http_variable_value_t  *value;
+    *buf++ = NGX_HTTP_LOG_BIN_UINT32;
 
-    value = ngx_http_get_indexed_variable(r, data);
+    return ngx_http_log_put32(buf, r->pipeline ? 1 : 0);
+}
 
-    if (value == NULL || value->not_found) {
-        return 1;
-    }
 
-    len = ngx_http_log_escape(NULL, value->data, value->len);
+static u_char *
+ngx_http_log_bin_msec(ngx_http_request_t *r, u_char *buf,
+    ngx_http_log_op_t *op)
+{
+    ngx_time_t  *tp;
+
+    tp = ngx_timeofday();
 
-    value->escape = len ? 1 : 0;
+    *buf++ = NGX_HTTP_LOG_BIN_MSEC;
 
-    return value->len + len * 3;
+    return ngx_http_log_put64(buf, (uint64_t) tp->sec * 1000 + tp->msec);
 }
 
 
 static u_char *
-ngx_http_log_variable(ngx_http_request_t *r, u_char *buf, ngx_http_log_op_t *op)
+ngx_http_log_bin_request_time(ngx_http_request_t *r, u_char *buf,
+    ngx_http_log_op_t *op)
 {
-    ngx_http_variable_value_t  *value;
+    ngx_time_t      *tp;
+    ngx_msec_int_t   ms;
 
-    value = ngx_http_get_indexed_variable(r, op->data);
+    tp = ngx_timeofday();
 
-    if (value == NULL || value->not_found) {
-        *buf = '-';
-        return buf + 1;
-    }
+    ms = (ngx_msec_int_t)
+             ((tp->sec - r->start_sec) * 1000 + (tp->msec - r->start_msec));
+    ms = (ms >= 0) ? ms : 0;
 
-    if (value->escape == 0) {
-        return ngx_cpymem(buf, value->data, value->len);
+    *buf++ = NGX_HTTP_LOG_BIN_UINT32;
 
-    } else {
-        return (u_char *) ngx_http_log_escape(buf, value->data, value->len);
-    }
+    return ngx_http_log_put32(buf, (uint32_t) ms);
 }
 
 
-static uintptr_t
-ngx_http_log_escape(u_char *dst, u_char *src, size_t size)
+static u_char *
+ngx_http_log_bin_status(ngx_http_request_t *r, u_char *buf,
+    ngx_http_log_op_t *op)
 {
-    ngx_uint_t      i, n;
-    static u_char   hex[] = "0123456789ABCDEF";
+    *buf++ = NGX_HTTP_LOG_BIN_UINT32;
 
-    static uint32_t   escape[] = {
-        0xffffffff, /* 1111 1111 1111 1111  1111 1111 1111 1111 */
+    return ngx_http_log_put32(buf, (uint32_t)
+                       (r->err_status ? r->err_status : r->headers_out.status));
+}
 
-                    /* ?>=< ;:98 7654 3210  /.-, +*)( '&%$ #"!  */
-        0x00000004, /* 0000 0000 0000 0000  0000 0000 0000 0100 */
 
-                    /* _^]\ [ZYX WVUT SRQP  ONML KJIH GFED CBA@ */
-        0x10000000, /* 0001 0000 0000 0000  0000 0000 0000 0000 */
+static u_char *
+ngx_http_log_bin_bytes_sent(ngx_http_request_t *r, u_char *buf,
+    ngx_http_log_op_t *op)
+{
+    *buf++ = NGX_HTTP_LOG_BIN_UINT64;
 
-                    /*  ~}| {zyx wvut srqp  onml kjih gfed cba` */
-        0x00000000, /* 0000 0000 0000 0000  0000 0000 0000 0000 */
+    return ngx_http_log_put64(buf, r->connection->sent);
+}
 
-        0x00000000, /* 0000 0000 0000 0000  0000 0000 0000 0000 */
-        0x00000000, /* 0000 0000 0000 0000  0000 0000 0000 0000 */
-        0x00000000, /* 0000 0000 0000 0000  0000 0000 0000 0000 */
-        0x00000000, /* 0000 0000 0000 0000  0000 0000 0000 0000 */
-    };
 
+static u_char *
+ngx_http_log_bin_body_bytes_sent(ngx_http_request_t *r, u_char *buf,
+    ngx_http_log_op_t *op)
+{
+    off_t  length;
 
-    if (dst == NULL) {
+    length = r->connection->sent - r->header_size;
 
-        /* find the number of the characters to be escaped */
+    *buf++ = NGX_HTTP_LOG_BIN_UINT64;
 
-        n  = 0;
+    return ngx_http_log_put64(buf, length > 0 ? length : 0);
+}
 
-        for (i = 0; i < size; i++) {
-            if (escape[*src >> 5] & (1 << (*src & 0x1f))) {
-                n++;
-            }
-            src++;
-        }
 
-        return (uintptr_t) n;
+static u_char *
+ngx_http_log_bin_request_length(ngx_http_request_t *r, u_char *buf,
+    ngx_http_log_op_t *op)
+{
+    *buf++ = NGX_HTTP_LOG_BIN_UINT64;
+
+    return ngx_http_log_put64(buf, r->request_length);
+}
+
+
+static u_char *
+ngx_http_log_bin_remote_addr(ngx_http_request_t *r, u_char *buf,
+    ngx_http_log_op_t *op)
+{
+    struct sockaddr_in  *sin;
+
+    sin = (struct sockaddr_in *) r->connection->sockaddr;
+
+    *buf++ = NGX_HTTP_LOG_BIN_INET;
+
+    /* the address is already in the network byte order */
+
+    return ngx_cpymem(buf, &sin->sin_addr.s_addr, 4);
+}
+
+
+static size_t
+ngx_http_log_bin_variable_getlen(ngx_http_request_t *r, uintptr_t data)
+{
+    ngx_http_variable_value_t  *value;
+
+    value = ngx_http_get_indexed_variable(r, data);
+
+    if (value == NULL || value->not_found) {
+        return 1;
+    }
+
+    return 1 + 2 + (value->len > 0xffff ? 0xffff : value->len);
+}
+
+
+static u_char *
+ngx_http_log_bin_variable(ngx_http_request_t *r, u_char *buf,
+    ngx_http_log_op_t *op)
+{
+    size_t                      len;
+    ngx_http_variable_value_t  *value;
+
+    value = ngx_http_get_indexed_variable(r, op->data);
+
+    if (value == NULL || value->not_found) {
+        *buf++ = NGX_HTTP_LOG_BIN_NULL;
+        return buf;
+    }
+
+    /* the longer values are truncated */
+
+    len = value->len > 0xffff ? 0xffff : value->len;
+
+    *buf++ = NGX_HTTP_LOG_BIN_STRING;
+    *buf++ = (u_char) (len >> 8);
+    *buf++ = (u_char) len;
+
+    return ngx_cpymem(buf, value->data, len);
+}
+
+
+static ngx_int_t
+ngx_http_log_variable_compile(ngx_conf_t *cf, ngx_http_log_op_t *op,
+    ngx_str_t *value)
+{
+    ngx_int_t  index;
+
+    index = ngx_http_get_variable_index(cf, value);
+    if (index == NGX_ERROR) {
+        return NGX_ERROR;
+    }
+
+    op->len = 0;
+    op->getlen = ngx_http_log_variable_getlen;
+    op->run = ngx_http_log_variable;
+    op->data = index;
+
+    return NGX_OK;
+}
+
+
+/*
+ * the length is an upper bound: every byte may be escaped as "\xXX",
+ * so the value is not scanned twice
+ */
+
+static size_t
+ngx_http_log_variable_getlen(ngx_http_request_t *r, uintptr_t data)
+{
+    ngx_http_variable_value_t  *value;
+
+    value = ngx_http_get_indexed_variable(r, data);
+
+    if (value == NULL || value->not_found) {
+        return 1;
     }
 
+    return value->len * 4;
+}
+
+
+static u_char *
+ngx_http_log_variable(ngx_http_request_t *r, u_char *buf, ngx_http_log_op_t *op)
+{
+    ngx_http_variable_value_t  *value;
+
+    /* the value is cached in r->variables by the getlen call */
+
+    value = ngx_http_get_indexed_variable(r, op->data);
+
+    if (value == NULL || value->not_found) {
+        *buf = '-';
+        return buf + 1;
+    }
+
+    return ngx_http_log_escape(buf, value->data, value->len);
+}
+
+
+static u_char *
+ngx_http_log_escape(u_char *dst, u_char *src, size_t size)
+{
+    ngx_uint_t      i;
+    static u_char   hex[] = "0123456789ABCDEF";
+
+    static uint32_t   escape[] = {
+        0xffffffff, /* 1111 1111 1111 1111  1111 1111 1111 1111 */
+
+                    /* ?>=< ;:98 7654 3210  /.-, +*)( '&%$ #"!  */
+        0x00000004, /* 0000 0000 0000 0000  0000 0000 0000 0100 */
+
+                    /* _^]\ [ZYX WVUT SRQP  ONML KJIH GFED CBA@ */
+        0x10000000, /* 0001 0000 0000 0000  0000 0000 0000 0000 */
+
+                    /*  ~}| {zyx wvut srqp  onml kjih gfed cba` */
+        0x00000000, /* 0000 0000 0000 0000  0000 0000 0000 0000 */
+
+        0x00000000, /* 0000 0000 0000 0000  0000 0000 0000 0000 */
+        0x00000000, /* 0000 0000 0000 0000  0000 0000 0000 0000 */
+        0x00000000, /* 0000 0000 0000 0000  0000 0000 0000 0000 */
+        0x00000000, /* 0000 0000 0000 0000  0000 0000 0000 0000 */
+    };
+
+
     for (i = 0; i < size; i++) {
         if (escape[*src >> 5] & (1 << (*src & 0x1f))) {
             *dst++ = '\\';
@@ -571,7 +1102,7 @@ ngx_http_log_escape(u_char *dst, u_char *src, size_t size)
         }
     }
 
-    return (uintptr_t) dst;
+    return dst;
 }
 
 
@@ -600,6 +1131,7 @@ ngx_http_log_create_main_conf(ngx_conf_t *cf)
 
     fmt->name.len = sizeof("combined") - 1;
     fmt->name.data = (u_char *) "combined";
+    fmt->binary = 0;
 
     fmt->ops = ngx_array_create(cf->pool, 16, sizeof(ngx_http_log_op_t));
     if (fmt->ops == NULL) {
@@ -659,14 +1191,21 @@ ngx_http_log_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child)
         return NGX_CONF_ERROR;
     }
 
+    log->syslog = NULL;
+
     log->disk_full_time = 0;
     log->error_log_time = 0;
+    log->filter = NGX_CONF_UNSET;
+    log->sample = 0;
+    log->sampled = 0;
+    log->slow = NGX_HTTP_LOG_SLOW;
 
     lmcf = ngx_http_conf_get_module_main_conf(cf, ngx_http_log_module);
     fmt = lmcf->formats.elts;
 
     /* the default "combined" format */
     log->ops = fmt[0].ops;
+    log->binary = 0;
     lmcf->combined_used = 1;
 
     return NGX_CONF_OK;
@@ -679,11 +1218,20 @@ ngx_http_log_set_log(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
     ngx_http_log_loc_conf_t *llcf = conf;
 
     ssize_t                    buf;
-    ngx_uint_t                 i;
+    ngx_int_t                  gzip, n;
+    ngx_uint_t                 i, async;
+    ngx_msec_t                 slow;
     ngx_str_t                 *value, name;
+    ngx_msec_t                 flush;
     ngx_http_log_t            *log;
     ngx_http_log_fmt_t        *fmt;
     ngx_http_log_main_conf_t  *lmcf;
+#if (NGX_ZLIB)
+    ngx_int_t                 *level;
+#endif
+#if (NGX_HAVE_ATOMIC_OPS)
+    ngx_core_conf_t           *ccf;
+#endif
 
     value = cf->args->elts;
 
@@ -706,13 +1254,29 @@ ngx_http_log_set_log(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
         return NGX_CONF_ERROR;
     }
 
-    log->file = ngx_conf_open_file(cf->cycle, &value[1]);
-    if (log->file == NULL) {
-        return NGX_CONF_ERROR;
+    if (ngx_strncmp(value[1].data, "syslog:", 7) == 0) {
+        log->file = NULL;
+
+        log->syslog = ngx_syslog_create(cf, &value[1]);
+        if (log->syslog == NULL) {
+            return NGX_CONF_ERROR;
+        }
+
+    } else {
+        log->syslog = NULL;
+
+        log->file = ngx_conf_open_file(cf->cycle, &value[1]);
+        if (log->file == NULL) {
+            return NGX_CONF_ERROR;
+        }
     }
 
     log->disk_full_time = 0;
     log->error_log_time = 0;
+    log->filter = NGX_CONF_UNSET;
+    log->sample = 0;
+    log->sampled = 0;
+    log->slow = NGX_HTTP_LOG_SLOW;
 
     if (cf->args->nelts >= 3) {
         name = value[2];
@@ -733,6 +1297,7 @@ ngx_http_log_set_log(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
             && ngx_strcasecmp(fmt[i].name.data, name.data) == 0)
         {
             log->ops = fmt[i].ops;
+            log->binary = fmt[i].binary;
             goto buffer;
         }
     }
@@ -743,24 +1308,199 @@ ngx_http_log_set_log(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 
 buffer:
 
-    if (cf->args->nelts == 4) {
-        if (ngx_strncmp(value[3].data, "buffer=", 7) != 0) {
+    buf = 0;
+    flush = NGX_CONF_UNSET_MSEC;
+    slow = NGX_CONF_UNSET_MSEC;
+    async = 0;
+    gzip = 0;
+
+    for (i = 3; i < cf->args->nelts; i++) {
+
+        if (ngx_strncmp(value[i].data, "buffer=", 7) == 0) {
+
+            name.len = value[i].len - 7;
+            name.data = value[i].data + 7;
+
+            buf = ngx_parse_size(&name);
+
+            if (buf == NGX_ERROR || buf == 0) {
+                goto invalid;
+            }
+
+            continue;
+        }
+
+        if (ngx_strncmp(value[i].data, "flush=", 6) == 0) {
+
+            name.len = value[i].len - 6;
+            name.data = value[i].data + 6;
+
+            flush = ngx_parse_time(&name, 0);
+
+            if (flush == (ngx_msec_t) NGX_ERROR || flush == 0) {
+                goto invalid;
+            }
+
+            continue;
+        }
+
+        if (ngx_strcmp(value[i].data, "async") == 0) {
+            async = 1;
+            continue;
+        }
+
+        if (ngx_strncmp(value[i].data, "sample=1/", 9) == 0) {
+
+            n = ngx_atoi(value[i].data + 9, value[i].len - 9);
+
+            if (n == NGX_ERROR || n == 0) {
+                goto invalid;
+            }
+
+            log->sample = n;
+
+            continue;
+        }
+
+        if (ngx_strncmp(value[i].data, "if=$", 4) == 0) {
+
+            name.len = value[i].len - 4;
+            name.data = value[i].data + 4;
+
+            log->filter = ngx_http_get_variable_index(cf, &name);
+
+            if (log->filter == NGX_ERROR) {
+                return NGX_CONF_ERROR;
+            }
+
+            continue;
+        }
+
+        if (ngx_strncmp(value[i].data, "slow=", 5) == 0) {
+
+            name.len = value[i].len - 5;
+            name.data = value[i].data + 5;
+
+            slow = ngx_parse_time(&name, 0);
+
+            if (slow == (ngx_msec_t) NGX_ERROR) {
+                goto invalid;
+            }
+
+            log->slow = slow;
+
+            continue;
+        }
+
+        if (ngx_strcmp(value[i].data, "gzip") == 0) {
+            gzip = 1;
+            continue;
+        }
+
+        if (ngx_strncmp(value[i].data, "gzip=", 5) == 0) {
+
+            gzip = ngx_atoi(value[i].data + 5, value[i].len - 5);
+
+            if (gzip < 1 || gzip > 9) {
+                goto invalid;
+            }
+
+            continue;
+        }
+
+        goto invalid;
+    }
+
+    if (log->syslog) {
+        if (buf || async || gzip || log->binary) {
             ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
-                               "invalid parameter \"%V\"", &value[3]);
+                               "\"buffer\", \"async\", \"gzip\" and "
+                               "binary formats cannot be used with syslog");
             return NGX_CONF_ERROR;
         }
 
-        name.len = value[3].len - 7;
-        name.data = value[3].data + 7;
+        return NGX_CONF_OK;
+    }
 
-        buf = ngx_parse_size(&name);
+    if (gzip) {
+#if (NGX_ZLIB)
+        if (async) {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "\"gzip\" cannot be used with \"async\"");
+            return NGX_CONF_ERROR;
+        }
 
-        if (buf == NGX_ERROR) {
+        if (log->file->data && *(ngx_int_t *) log->file->data != gzip) {
             ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
-                               "invalid parameter \"%V\"", &value[3]);
+                               "access_log \"%V\" already defined "
+                               "with different gzip level", &value[1]);
+            return NGX_CONF_ERROR;
+        }
+
+        level = ngx_palloc(cf->pool, sizeof(ngx_int_t));
+        if (level == NULL) {
             return NGX_CONF_ERROR;
         }
 
+        *level = gzip;
+
+        log->file->data = level;
+        log->file->flush = ngx_http_log_flush;
+
+        if (buf == 0) {
+            buf = NGX_HTTP_LOG_GZIP_SIZE;
+        }
+#else
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "nginx was built without zlib support");
+        return NGX_CONF_ERROR;
+#endif
+    }
+
+    if (slow != NGX_CONF_UNSET_MSEC
+        && log->sample == 0 && log->filter == NGX_CONF_UNSET)
+    {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "\"slow\" parameter requires \"sample\" or \"if\"");
+        return NGX_CONF_ERROR;
+    }
+
+    if (flush != NGX_CONF_UNSET_MSEC && !async) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "\"flush\" parameter requires \"async\"");
+        return NGX_CONF_ERROR;
+    }
+
+    if (async) {
+#if (NGX_HAVE_ATOMIC_OPS)
+        if (buf == 0) {
+
+            /* the default ring grows with the number of the workers */
+
+            ccf = (ngx_core_conf_t *) ngx_get_conf(cf->cycle->conf_ctx,
+                                                   ngx_core_module);
+
+            buf = ccf->worker_processes * NGX_HTTP_LOG_RING_WORKER_SIZE;
+
+            if (buf < NGX_HTTP_LOG_RING_SIZE) {
+                buf = NGX_HTTP_LOG_RING_SIZE;
+            }
+        }
+
+        if (flush == NGX_CONF_UNSET_MSEC) {
+            flush = NGX_LOG_RING_FLUSH;
+        }
+
+        return ngx_http_log_set_async(cf, log, buf, flush);
+#else
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "\"async\" parameter is not supported "
+                           "on this platform");
+        return NGX_CONF_ERROR;
+#endif
+    }
+
+    if (buf) {
         if (log->file->buffer && log->file->last - log->file->pos != buf) {
             ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
                                "access_log \"%V\" already defined "
@@ -778,9 +1518,110 @@ buffer:
     }
 
     return NGX_CONF_OK;
+
+invalid:
+
+    ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                       "invalid parameter \"%V\"", &value[i]);
+    return NGX_CONF_ERROR;
 }
 
 
+#if (NGX_HAVE_ATOMIC_OPS)
+
+static char *
+ngx_http_log_set_async(ngx_conf_t *cf, ngx_http_log_t *log, size_t size,
+    ngx_msec_t flush)
+{
+    size_t                 n;
+    ngx_shm_zone_t        *shm_zone;
+    ngx_http_log_async_t  *async;
+
+    /* the ring size must be a power of two */
+
+    for (n = ngx_pagesize; n < size; n <<= 1) { /* void */ }
+
+    /* the ring, the slab page descriptors and the pool header */
+
+    shm_zone = ngx_shared_memory_add(cf, &log->file->name,
+                                     n + n / 64 + 8 * ngx_pagesize,
+                                     &ngx_http_log_module);
+    if (shm_zone == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    async = shm_zone->data;
+
+    if (async) {
+        if (flush < async->flush) {
+            async->flush = flush;
+        }
+
+        return NGX_CONF_OK;
+    }
+
+    async = ngx_palloc(cf->pool, sizeof(ngx_http_log_async_t));
+    if (async == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    async->file = log->file;
+    async->size = n;
+    async->flush = flush;
+
+    shm_zone->init = ngx_http_log_init_ring;
+    shm_zone->data = async;
+
+    return NGX_CONF_OK;
+}
+
+
+static ngx_int_t
+ngx_http_log_init_ring(ngx_shm_zone_t *shm_zone, void *data)
+{
+    ngx_http_log_async_t  *oasync = data;
+
+    ngx_log_ring_t        *ring;
+    ngx_slab_pool_t       *shpool;
+    ngx_http_log_async_t  *async;
+
+    async = shm_zone->data;
+
+    if (oasync) {
+        ring = oasync->file->ring;
+        ring->flush = async->flush;
+        async->file->ring = ring;
+
+        return NGX_OK;
+    }
+
+    shpool = (ngx_slab_pool_t *) shm_zone->shm.addr;
+
+    ring = ngx_slab_alloc(shpool, sizeof(ngx_log_ring_t));
+    if (ring == NULL) {
+        return NGX_ERROR;
+    }
+
+    ngx_memzero(ring, sizeof(ngx_log_ring_t));
+
+    ring->start = ngx_slab_alloc(shpool, async->size);
+    if (ring->start == NULL) {
+        return NGX_ERROR;
+    }
+
+    ngx_memzero(ring->start, async->size);
+
+    ring->size = async->size;
+    ring->flush = async->flush;
+
+    async->file->ring = ring;
+
+    return NGX_OK;
+}
+
+#endif
+
+
 static char *
 ngx_http_log_set_format(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 {
@@ -813,6 +1654,13 @@ ngx_http_log_set_format(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
         return NGX_CONF_ERROR;
     }
 
+    if (ngx_strcmp(value[2].data, "binary") == 0) {
+        fmt->binary = 1;
+        return ngx_http_log_compile_binary(cf, fmt->ops, cf->args, 3);
+    }
+
+    fmt->binary = 0;
+
     return ngx_http_log_compile_format(cf, fmt->ops, cf->args, 2);
 }
 
@@ -975,6 +1823,10 @@ ngx_http_log_compile_format(ngx_conf_t *cf, ngx_array_t *ops,
                     ngx_memcpy(p, data, len);
                     op->data = (uintptr_t) p;
                 }
+
+                if (ngx_http_log_fuse_literal(cf, ops) != NGX_OK) {
+                    return NGX_CONF_ERROR;
+                }
             }
         }
     }
@@ -989,6 +1841,146 @@ invalid:
 }
 
 
+/*
+ * the literal that follows another literal, e.g. from the next
+ * log_format argument, is merged with it into one copy operation
+ */
+
+static ngx_int_t
+ngx_http_log_fuse_literal(ngx_conf_t *cf, ngx_array_t *ops)
+{
+    u_char             *p;
+    size_t              len;
+    ngx_http_log_op_t  *op, *prev;
+
+    if (ops->nelts < 2) {
+        return NGX_OK;
+    }
+
+    op = ops->elts;
+    op = &op[ops->nelts - 1];
+    prev = op - 1;
+
+    if (prev->run != ngx_http_log_copy_short
+        && prev->run != ngx_http_log_copy_long)
+    {
+        return NGX_OK;
+    }
+
+    len = prev->len + op->len;
+
+    p = ngx_palloc(cf->pool, len);
+    if (p == NULL) {
+        return NGX_ERROR;
+    }
+
+    /* the copy operations do not use the request */
+
+    (void) op->run(NULL, prev->run(NULL, p, prev), op);
+
+    prev->len = len;
+
+    if (len <= sizeof(uintptr_t)) {
+        prev->run = ngx_http_log_copy_short;
+        prev->data = 0;
+
+        while (len--) {
+            prev->data <<= 8;
+            prev->data |= p[len];
+        }
+
+    } else {
+        prev->run = ngx_http_log_copy_long;
+        prev->data = (uintptr_t) p;
+    }
+
+    ops->nelts--;
+
+    return NGX_OK;
+}
+
+
+static char *
+ngx_http_log_compile_binary(ngx_conf_t *cf, ngx_array_t *ops,
+    ngx_array_t *args, ngx_uint_t s)
+{
+    ngx_str_t           *value, var;
+    ngx_http_log_op_t   *op;
+    ngx_http_log_var_t  *v;
+
+    value = args->elts;
+
+    if (s == args->nelts) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "no fields in binary log format");
+        return NGX_CONF_ERROR;
+    }
+
+    for ( /* void */ ; s < args->nelts; s++) {
+
+        var = value[s];
+
+        if (var.len < 2 || var.data[0] != '$') {
+            goto invalid;
+        }
+
+        var.len--;
+        var.data++;
+
+        if (var.data[0] == '{') {
+            if (var.len < 3 || var.data[var.len - 1] != '}') {
+                goto invalid;
+            }
+
+            var.len -= 2;
+            var.data++;
+        }
+
+        op = ngx_array_push(ops);
+        if (op == NULL) {
+            return NGX_CONF_ERROR;
+        }
+
+        for (v = ngx_http_log_bin_vars; v->name.len; v++) {
+
+            if (v->name.len == var.len
+                && ngx_strncmp(v->name.data, var.data, var.len) == 0)
+            {
+                op->len = v->len;
+                op->getlen = NULL;
+                op->run = v->run;
+                op->data = 0;
+
+                goto next;
+            }
+        }
+
+        op->data = ngx_http_get_variable_index(cf, &var);
+        if (op->data == (uintptr_t) NGX_ERROR) {
+            return NGX_CONF_ERROR;
+        }
+
+        op->len = 0;
+        op->getlen = ngx_http_log_bin_variable_getlen;
+        op->run = ngx_http_log_bin_variable;
+
+    next:
+
+        continue;
+    }
+
+    return NGX_CONF_OK;
+
+invalid:
+
+    ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                       "binary log format field \"%V\" is not a variable",
+                       &value[s]);
+
+    return NGX_CONF_ERROR;
+}
+
+
 static ngx_int_t
 ngx_http_log_init(ngx_conf_t *cf)
 {
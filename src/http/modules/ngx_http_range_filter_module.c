@@ -47,7 +47,7 @@
 typedef struct {
     off_t        start;
     off_t        end;
-    ngx_str_t    content_range;
+    ngx_str_t    content_range;      /* the whole part header */
 } ngx_http_range_t;
 
 
@@ -58,6 +58,8 @@ typedef struct {
 } ngx_http_range_filter_ctx_t;
 
 
+static ngx_int_t ngx_http_range_singlepart_body(ngx_http_request_t *r,
+    ngx_http_range_filter_ctx_t *ctx, ngx_chain_t *in);
 static ngx_int_t ngx_http_range_header_filter_init(ngx_conf_t *cf);
 static ngx_int_t ngx_http_range_body_filter_init(ngx_conf_t *cf);
 
@@ -133,20 +135,24 @@ ngx_http_range_header_filter(ngx_http_request_t *r)
 {
     u_char                       *p;
     size_t                        len;
-    off_t                         start, end;
+    off_t                         start, end, size;
     time_t                        if_range;
     ngx_int_t                     rc;
-    ngx_uint_t                    suffix, i;
+    ngx_uint_t                    suffix, i, n;
     ngx_atomic_uint_t             boundary;
     ngx_table_elt_t              *content_range;
     ngx_http_range_t             *range;
+    ngx_http_core_loc_conf_t     *clcf;
     ngx_http_range_filter_ctx_t  *ctx;
 
+    clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
+
     if (r->http_version < NGX_HTTP_VERSION_10
         || r->headers_out.status != NGX_HTTP_OK
         || r != r->main
         || r->headers_out.content_length_n == -1
-        || !r->allow_ranges)
+        || !r->allow_ranges
+        || clcf->max_ranges == 0)
     {
         return ngx_http_next_header_filter(r);
     }
@@ -323,6 +329,52 @@ ngx_http_range_header_filter(ngx_http_request_t *r)
         return rc;
     }
 
+    /*
+     * merge the overlapping and adjacent ranges that follow each other,
+     * download managers and PDF viewers often send such ranges
+     */
+
+    range = ctx->ranges.elts;
+    size = 0;
+    n = 0;
+
+    for (i = 0; i < ctx->ranges.nelts; i++) {
+
+        if (n
+            && range[i].start <= range[n - 1].end
+            && range[i].end >= range[n - 1].start)
+        {
+            if (range[i].start < range[n - 1].start) {
+                size -= range[n - 1].start - range[i].start;
+                range[n - 1].start = range[i].start;
+            }
+
+            if (range[i].end > range[n - 1].end) {
+                size += range[i].end - range[n - 1].end;
+                range[n - 1].end = range[i].end;
+            }
+
+            continue;
+        }
+
+        range[n++] = range[i];
+        size += range[i].end - range[i].start;
+    }
+
+    ctx->ranges.nelts = n;
+
+    /*
+     * too many ranges or the ranges that still overlap and are larger
+     * than the response itself are ignored, the whole response is sent
+     */
+
+    if (n > clcf->max_ranges || size > r->headers_out.content_length_n) {
+        ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                       "http range ignored, ranges:%ui size:%O", n, size);
+
+        goto next_filter;
+    }
+
     ngx_http_set_ctx(r, ctx, ngx_http_range_body_filter_module);
 
     r->headers_out.status = NGX_HTTP_PARTIAL_CONTENT;
@@ -431,6 +483,18 @@ ngx_http_range_header_filter(ngx_http_request_t *r)
                            - r->headers_out.content_type.data;
 
 
+    /*
+     * the whole part headers are allocated at once, every part header is
+     * the boundary header followed by "SSSS-EEEE/TTTT" CRLF CRLF
+     */
+
+    p = ngx_palloc(r->pool, ctx->ranges.nelts
+                            * (ctx->boundary_header.len
+                               + 3 * NGX_OFF_T_LEN + 2 + 4));
+    if (p == NULL) {
+        return NGX_ERROR;
+    }
+
     /* the size of the last boundary CRLF "--0123456789--" CRLF */
 
     len = sizeof(CRLF "--") - 1 + NGX_ATOMIC_T_LEN + sizeof("--" CRLF) - 1;
@@ -438,23 +502,17 @@ ngx_http_range_header_filter(ngx_http_request_t *r)
     range = ctx->ranges.elts;
     for (i = 0; i < ctx->ranges.nelts; i++) {
 
-        /* the size of the range: "SSSS-EEEE/TTTT" CRLF CRLF */
-
-        range[i].content_range.data =
-                                ngx_palloc(r->pool, 3 * NGX_OFF_T_LEN + 2 + 4);
+        range[i].content_range.data = p;
 
-        if (range[i].content_range.data == NULL) {
-            return NGX_ERROR;
-        }
+        p = ngx_cpymem(p, ctx->boundary_header.data, ctx->boundary_header.len);
+        p = ngx_sprintf(p, "%O-%O/%O" CRLF CRLF,
+                        range[i].start, range[i].end - 1,
+                        r->headers_out.content_length_n);
 
-        range[i].content_range.len = ngx_sprintf(range[i].content_range.data,
-                                               "%O-%O/%O" CRLF CRLF,
-                                               range[i].start, range[i].end - 1,
-                                               r->headers_out.content_length_n)
-                                     - range[i].content_range.data;
+        range[i].content_range.len = p - range[i].content_range.data;
 
-        len += ctx->boundary_header.len + range[i].content_range.len
-                                    + (size_t) (range[i].end - range[i].start);
+        len += range[i].content_range.len
+               + (size_t) (range[i].end - range[i].start);
     }
 
     r->headers_out.content_length_n = len;
@@ -488,8 +546,8 @@ ngx_http_range_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
 {
     off_t                         start, last;
     ngx_buf_t                    *b, *buf;
-    ngx_uint_t                    i;
-    ngx_chain_t                  *out, *hcl, *rcl, *dcl, **ll;
+    ngx_uint_t                    i, n;
+    ngx_chain_t                  *out, *cl;
     ngx_http_range_t             *range;
     ngx_http_range_filter_ctx_t  *ctx;
 
@@ -503,6 +561,10 @@ ngx_http_range_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
         return ngx_http_next_body_filter(r, in);
     }
 
+    if (ctx->ranges.nelts == 1) {
+        return ngx_http_range_singlepart_body(r, ctx, in);
+    }
+
     buf = in->buf;
 
     if (ngx_buf_special(in->buf)) {
@@ -533,83 +595,49 @@ ngx_http_range_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
         }
     }
 
-    /*
-     * the optimized version for the responses
-     * that are passed in the single buffer
-     */
-
     ctx->offset = ngx_buf_size(buf);
 
-    if (ctx->ranges.nelts == 1) {
+    /*
+     * the part headers and the parts data are allocated at once,
+     * the parts data are slices of the original buffer, so the file
+     * parts are sent with sendfile() without copying
+     */
 
-        if (buf->in_file) {
-            buf->file_pos = range->start;
-            buf->file_last = range->end;
-        }
+    n = 2 * ctx->ranges.nelts + 1;
 
-        if (ngx_buf_in_memory(buf)) {
-            buf->pos = buf->start + (size_t) range->start;
-            buf->last = buf->start + (size_t) range->end;
-        }
+    b = ngx_pcalloc(r->pool, n * sizeof(ngx_buf_t));
+    if (b == NULL) {
+        return NGX_ERROR;
+    }
 
-        return ngx_http_next_body_filter(r, in);
+    out = ngx_palloc(r->pool, n * sizeof(ngx_chain_t));
+    if (out == NULL) {
+        return NGX_ERROR;
     }
 
-    ll = &out;
+    cl = out;
 
     for (i = 0; i < ctx->ranges.nelts; i++) {
 
         /*
-         * The boundary header of the range:
+         * The part header:
          * CRLF
          * "--0123456789" CRLF
          * "Content-Type: image/jpeg" CRLF
-         * "Content-Range: bytes "
+         * "Content-Range: bytes SSSS-EEEE/TTTT" CRLF CRLF
          */
 
-        b = ngx_calloc_buf(r->pool);
-        if (b == NULL) {
-            return NGX_ERROR;
-        }
-
         b->memory = 1;
-        b->pos = ctx->boundary_header.data;
-        b->last = ctx->boundary_header.data + ctx->boundary_header.len;
-
-        hcl = ngx_alloc_chain_link(r->pool);
-        if (hcl == NULL) {
-            return NGX_ERROR;
-        }
-
-        hcl->buf = b;
-
-
-        /* "SSSS-EEEE/TTTT" CRLF CRLF */
-
-        b = ngx_calloc_buf(r->pool);
-        if (b == NULL) {
-            return NGX_ERROR;
-        }
-
-        b->temporary = 1;
         b->pos = range[i].content_range.data;
         b->last = range[i].content_range.data + range[i].content_range.len;
 
-        rcl = ngx_alloc_chain_link(r->pool);
-        if (rcl == NULL) {
-            return NGX_ERROR;
-        }
-
-        rcl->buf = b;
+        cl->buf = b++;
+        cl->next = cl + 1;
+        cl++;
 
 
         /* the range data */
 
-        b = ngx_calloc_buf(r->pool);
-        if (b == NULL) {
-            return NGX_ERROR;
-        }
-
         b->in_file = buf->in_file;
         b->temporary = buf->temporary;
         b->memory = buf->memory;
@@ -626,26 +654,13 @@ ngx_http_range_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
             b->last = buf->start + (size_t) range[i].end;
         }
 
-        dcl = ngx_alloc_chain_link(r->pool);
-        if (dcl == NULL) {
-            return NGX_ERROR;
-        }
-
-        dcl->buf = b;
-
-        *ll = hcl;
-        hcl->next = rcl;
-        rcl->next = dcl;
-        ll = &dcl->next;
+        cl->buf = b++;
+        cl->next = cl + 1;
+        cl++;
     }
 
     /* the last boundary CRLF "--0123456789--" CRLF  */
 
-    b = ngx_calloc_buf(r->pool);
-    if (b == NULL) {
-        return NGX_ERROR;
-    }
-
     b->temporary = 1;
     b->last_buf = 1;
 
@@ -660,15 +675,8 @@ ngx_http_range_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
     *b->last++ = '-'; *b->last++ = '-';
     *b->last++ = CR; *b->last++ = LF;
 
-    hcl = ngx_alloc_chain_link(r->pool);
-    if (hcl == NULL) {
-        return NGX_ERROR;
-    }
-
-    hcl->buf = b;
-    hcl->next = NULL;
-
-    *ll = hcl;
+    cl->buf = b;
+    cl->next = NULL;
 
     return ngx_http_next_body_filter(r, out);
 
@@ -681,6 +689,88 @@ overlapped:
 }
 
 
+/*
+ * the single range may be cut from the response passed in several buffers,
+ * the buffers outside the range are skipped
+ */
+
+static ngx_int_t
+ngx_http_range_singlepart_body(ngx_http_request_t *r,
+    ngx_http_range_filter_ctx_t *ctx, ngx_chain_t *in)
+{
+    off_t              start, last;
+    ngx_buf_t         *buf;
+    ngx_chain_t       *out, *cl, **ll;
+    ngx_http_range_t  *range;
+
+    out = NULL;
+    ll = &out;
+    range = ctx->ranges.elts;
+
+    for (cl = in; cl; cl = cl->next) {
+
+        buf = cl->buf;
+
+        start = ctx->offset;
+        last = ctx->offset + ngx_buf_size(buf);
+
+        ctx->offset = last;
+
+        ngx_log_debug4(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                       "http range body buf: %O-%O, range: %O-%O",
+                       start, last, range->start, range->end);
+
+        if (range->end <= start || range->start >= last) {
+
+            ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                           "http range body skip");
+
+            if (buf->in_file) {
+                buf->file_pos = buf->file_last;
+            }
+
+            buf->pos = buf->last;
+            buf->sync = 1;
+
+            continue;
+        }
+
+        if (range->start > start) {
+
+            if (buf->in_file) {
+                buf->file_pos += range->start - start;
+            }
+
+            if (ngx_buf_in_memory(buf)) {
+                buf->pos += (size_t) (range->start - start);
+            }
+        }
+
+        if (range->end <= last) {
+
+            if (buf->in_file) {
+                buf->file_last -= last - range->end;
+            }
+
+            if (ngx_buf_in_memory(buf)) {
+                buf->last -= (size_t) (last - range->end);
+            }
+
+            buf->last_buf = 1;
+            *ll = cl;
+            cl->next = NULL;
+
+            break;
+        }
+
+        *ll = cl;
+        ll = &cl->next;
+    }
+
+    return ngx_http_next_body_filter(r, out);
+}
+
+
 static ngx_int_t
 ngx_http_range_header_filter_init(ngx_conf_t *cf)
 {
@@ -167,6 +167,12 @@ ngx_http_rewrite_handler(ngx_http_request_t *r)
         e->captures = NULL;
     }
 
+    e->regs = ngx_palloc(r->pool,
+                   NGX_HTTP_SCRIPT_REGS * sizeof(ngx_http_variable_value_t *));
+    if (e->regs == NULL) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+
     e->ip = rlcf->codes->elts;
     e->request = r;
     e->quote = 1;
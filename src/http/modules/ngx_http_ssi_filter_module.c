@@ -43,6 +43,46 @@ typedef struct {
 } ngx_http_ssi_block_t;
 
 
+typedef struct {
+    ngx_rbtree_t                 rbtree;
+    ngx_rbtree_node_t            sentinel;
+    ngx_queue_t                  queue;
+} ngx_http_ssi_cache_sh_t;
+
+
+typedef struct {
+    ngx_http_ssi_cache_sh_t     *sh;
+    ngx_slab_pool_t             *shpool;
+} ngx_http_ssi_cache_t;
+
+
+typedef struct {
+    ngx_rbtree_node_t            node;
+    ngx_queue_t                  queue;
+
+    time_t                       expire;
+    size_t                       len;
+    u_short                      key_len;
+    u_char                       data[1];
+} ngx_http_ssi_cache_node_t;
+
+
+typedef struct {
+    ngx_str_t                    key;
+    uint32_t                     hash;
+    time_t                       valid;
+
+    ngx_chain_t                 *bufs;
+    ngx_chain_t                **last;
+    size_t                       size;
+    size_t                       max_size;
+
+    ngx_http_post_subrequest_t  *post;
+
+    unsigned                     capture:1;
+} ngx_http_ssi_fragment_t;
+
+
 typedef enum {
     ssi_start_state = 0,
     ssi_tag_state,
@@ -71,6 +111,25 @@ static ngx_int_t ngx_http_ssi_output(ngx_http_request_t *r,
     ngx_http_ssi_ctx_t *ctx);
 static ngx_int_t ngx_http_ssi_parse(ngx_http_request_t *r,
     ngx_http_ssi_ctx_t *ctx);
+static ngx_int_t ngx_http_ssi_command(ngx_http_request_t *r,
+    ngx_http_ssi_ctx_t *ctx);
+static ngx_buf_t *ngx_http_ssi_errmsg(ngx_http_request_t *r,
+    ngx_http_ssi_ctx_t *ctx);
+static ngx_int_t ngx_http_ssi_replay(ngx_http_request_t *r,
+    ngx_http_ssi_ctx_t *ctx);
+static ngx_int_t ngx_http_ssi_record(ngx_http_request_t *r,
+    ngx_http_ssi_ctx_t *ctx, ngx_int_t rc);
+static ngx_int_t ngx_http_ssi_template_lookup(ngx_http_request_t *r,
+    ngx_http_ssi_ctx_t *ctx);
+static void ngx_http_ssi_template_insert(ngx_http_request_t *r,
+    ngx_http_ssi_template_t *tpl);
+static void ngx_http_ssi_template_delete(ngx_http_ssi_templates_t *templates,
+    ngx_http_ssi_template_t *tpl);
+static ngx_http_ssi_template_t *ngx_http_ssi_template_find(
+    ngx_http_ssi_templates_t *templates, uint32_t hash, ngx_str_t *name);
+static void ngx_http_ssi_template_rbtree_insert_value(ngx_rbtree_node_t *temp,
+    ngx_rbtree_node_t *node, ngx_rbtree_node_t *sentinel);
+static void ngx_http_ssi_template_cleanup(void *data);
 static ngx_str_t *ngx_http_ssi_get_variable(ngx_http_request_t *r,
     ngx_str_t *name, ngx_uint_t key);
 static ngx_int_t ngx_http_ssi_evaluate_string(ngx_http_request_t *r,
@@ -82,6 +141,16 @@ static ngx_int_t ngx_http_ssi_stub_output(ngx_http_request_t *r, void *data,
     ngx_int_t rc);
 static ngx_int_t ngx_http_ssi_set_variable(ngx_http_request_t *r, void *data,
     ngx_int_t rc);
+static ngx_int_t ngx_http_ssi_cache_lookup(ngx_http_request_t *r,
+    ngx_http_ssi_fragment_t *fr, ngx_str_t *value);
+static ngx_int_t ngx_http_ssi_cache_store(ngx_http_request_t *r, void *data,
+    ngx_int_t rc);
+static ngx_http_ssi_cache_node_t *ngx_http_ssi_cache_find(
+    ngx_http_ssi_cache_t *cache, ngx_http_ssi_fragment_t *fr);
+static void ngx_http_ssi_cache_rbtree_insert_value(ngx_rbtree_node_t *temp,
+    ngx_rbtree_node_t *node, ngx_rbtree_node_t *sentinel);
+static ngx_int_t ngx_http_ssi_cache_init_zone(ngx_shm_zone_t *shm_zone,
+    void *data);
 static ngx_int_t ngx_http_ssi_echo(ngx_http_request_t *r,
     ngx_http_ssi_ctx_t *ctx, ngx_str_t **params);
 static ngx_int_t ngx_http_ssi_config(ngx_http_request_t *r,
@@ -103,6 +172,11 @@ static ngx_int_t ngx_http_ssi_date_gmt_local_variable(ngx_http_request_t *r,
     ngx_http_variable_value_t *v, uintptr_t gmt);
 
 static char *ngx_http_ssi_types(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+static char *ngx_http_ssi_cache_zone(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf);
+static char *ngx_http_ssi_template_cache(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf);
+static void ngx_http_ssi_template_cache_cleanup(void *data);
 
 static ngx_int_t ngx_http_ssi_preconfiguration(ngx_conf_t *cf);
 static void *ngx_http_ssi_create_main_conf(ngx_conf_t *cf);
@@ -158,6 +232,20 @@ static ngx_command_t  ngx_http_ssi_filter_commands[] = {
       0,
       NULL },
 
+    { ngx_string("ssi_template_cache"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_TAKE1,
+      ngx_http_ssi_template_cache,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      0,
+      NULL },
+
+    { ngx_string("ssi_cache_zone"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_TAKE2,
+      ngx_http_ssi_cache_zone,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      0,
+      NULL },
+
       ngx_null_command
 };
 
@@ -196,6 +284,7 @@ ngx_module_t  ngx_http_ssi_filter_module = {
 
 static ngx_http_output_header_filter_pt  ngx_http_next_header_filter;
 static ngx_http_output_body_filter_pt    ngx_http_next_body_filter;
+static ngx_http_output_body_filter_pt    ngx_http_ssi_cache_next_body_filter;
 
 
 static u_char ngx_http_ssi_string[] = "<!--";
@@ -209,6 +298,7 @@ static ngx_str_t ngx_http_ssi_null_string = ngx_null_string;
 #define  NGX_HTTP_SSI_INCLUDE_WAIT     2
 #define  NGX_HTTP_SSI_INCLUDE_SET      3
 #define  NGX_HTTP_SSI_INCLUDE_STUB     4
+#define  NGX_HTTP_SSI_INCLUDE_CACHE    5
 
 #define  NGX_HTTP_SSI_ECHO_VAR         0
 #define  NGX_HTTP_SSI_ECHO_DEFAULT     1
@@ -231,6 +321,7 @@ static ngx_http_ssi_param_t  ngx_http_ssi_include_params[] = {
     { ngx_string("wait"), NGX_HTTP_SSI_INCLUDE_WAIT, 0, 0 },
     { ngx_string("set"), NGX_HTTP_SSI_INCLUDE_SET, 0, 0 },
     { ngx_string("stub"), NGX_HTTP_SSI_INCLUDE_STUB, 0, 0 },
+    { ngx_string("cache"), NGX_HTTP_SSI_INCLUDE_CACHE, 0, 0 },
     { ngx_null_string, 0, 0, 0 }
 };
 
@@ -319,8 +410,21 @@ ngx_http_ssi_header_filter(ngx_http_request_t *r)
     ngx_uint_t                i;
     ngx_str_t                *type;
     ngx_http_ssi_ctx_t       *ctx;
+    ngx_http_ssi_fragment_t  *fr;
     ngx_http_ssi_loc_conf_t  *slcf;
 
+    if (r->post_subrequest
+        && r->post_subrequest->handler == ngx_http_ssi_cache_store
+        && r->headers_out.status == NGX_HTTP_OK)
+    {
+        /* the response of the cacheable include is captured in memory */
+
+        fr = r->post_subrequest->data;
+        fr->capture = 1;
+
+        r->filter_need_in_memory = 1;
+    }
+
     slcf = ngx_http_get_module_loc_conf(r, ngx_http_ssi_filter_module);
 
     if (!slcf->enable
@@ -373,7 +477,13 @@ found:
     ctx->errmsg.data = (u_char *)
                      "[an error occurred while processing the directive]";
 
-    r->filter_need_in_memory = 1;
+    if (ngx_http_ssi_template_lookup(r, ctx) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    if (ctx->template == NULL || ctx->record) {
+        r->filter_need_in_memory = 1;
+    }
 
     if (r == r->main) {
         ngx_http_clear_content_length(r);
@@ -387,20 +497,13 @@ found:
 static ngx_int_t
 ngx_http_ssi_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
 {
-    size_t                     len;
     ngx_int_t                  rc;
     ngx_buf_t                 *b;
-    ngx_uint_t                 i, index;
     ngx_chain_t               *cl, **ll;
-    ngx_table_elt_t           *param;
     ngx_http_request_t        *pr;
     ngx_http_ssi_ctx_t        *ctx, *mctx;
     ngx_http_ssi_block_t      *bl;
-    ngx_http_ssi_param_t      *prm;
-    ngx_http_ssi_command_t    *cmd;
     ngx_http_ssi_loc_conf_t   *slcf;
-    ngx_http_ssi_main_conf_t  *smcf;
-    ngx_str_t                 *params[NGX_HTTP_SSI_MAX_PARAMS + 1];
 
     ctx = ngx_http_get_module_ctx(r, ngx_http_ssi_filter_module);
 
@@ -454,6 +557,38 @@ ngx_http_ssi_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
         }
     }
 
+    if (ctx->template && !ctx->record) {
+
+        if (ctx->segment == 0 && ctx->buf == NULL && ctx->in) {
+            b = ctx->in->buf;
+
+            if (ngx_buf_in_memory(b)) {
+
+                /* the response is needed in memory by another filter */
+
+                ctx->template = NULL;
+
+            } else if (!b->in_file
+                       || b->file_pos != 0
+                       || b->file_last != ctx->template->size
+                       || b->file->name.len != ctx->template->name.len
+                       || ngx_strncmp(b->file->name.data,
+                                      ctx->template->name.data,
+                                      b->file->name.len)
+                          != 0)
+            {
+                ngx_log_error(NGX_LOG_ALERT, r->connection->log, 0,
+                              "unexpected response for ssi template \"%V\"",
+                              &ctx->template->name);
+                return NGX_ERROR;
+            }
+        }
+
+        if (ctx->template) {
+            return ngx_http_ssi_replay(r, ctx);
+        }
+    }
+
     slcf = ngx_http_get_module_loc_conf(r, ngx_http_ssi_filter_module);
 
     ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
@@ -489,6 +624,11 @@ ngx_http_ssi_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
                 return rc;
             }
 
+            if (ctx->record && ngx_http_ssi_record(r, ctx, rc) != NGX_OK) {
+                ctx->template = NULL;
+                ctx->record = 0;
+            }
+
             if (ctx->copy_start != ctx->copy_end) {
 
                 if (ctx->output) {
@@ -631,293 +771,942 @@ ngx_http_ssi_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
             }
 
 
-            b = NULL;
+            b = NULL;
+
+            if (rc == NGX_OK) {
+
+                rc = ngx_http_ssi_command(r, ctx);
+
+                if (rc == NGX_OK) {
+                    continue;
+                }
+
+                if (rc == NGX_DONE || rc == NGX_AGAIN || rc == NGX_ERROR) {
+                    return rc;
+                }
+            }
+
+
+            /* rc == NGX_HTTP_SSI_ERROR */
+
+            if (slcf->silent_errors) {
+                continue;
+            }
+
+            b = ngx_http_ssi_errmsg(r, ctx);
+            if (b == NULL) {
+                return NGX_ERROR;
+            }
+
+            continue;
+        }
+
+        if (ctx->record && ctx->buf->file_last == ctx->template->size) {
+            ngx_http_ssi_template_insert(r, ctx->template);
+            ctx->template = NULL;
+            ctx->record = 0;
+        }
+
+        if (ctx->buf->last_buf || ngx_buf_in_memory(ctx->buf)) {
+            if (b == NULL) {
+                if (ctx->free) {
+                    cl = ctx->free;
+                    ctx->free = ctx->free->next;
+                    b = cl->buf;
+                    ngx_memzero(b, sizeof(ngx_buf_t));
+
+                } else {
+                    b = ngx_calloc_buf(r->pool);
+                    if (b == NULL) {
+                        return NGX_ERROR;
+                    }
+
+                    cl = ngx_alloc_chain_link(r->pool);
+                    if (cl == NULL) {
+                        return NGX_ERROR;
+                    }
+
+                    cl->buf = b;
+                }
+
+                b->sync = 1;
+
+                cl->next = NULL;
+                *ctx->last_out = cl;
+                ctx->last_out = &cl->next;
+            }
+
+            b->last_buf = ctx->buf->last_buf;
+            b->shadow = ctx->buf;
+
+            if (slcf->ignore_recycled_buffers == 0)  {
+                b->recycled = ctx->buf->recycled;
+            }
+        }
+
+        ctx->buf = NULL;
+
+        ctx->saved = ctx->looked;
+    }
+
+    if (ctx->out == NULL && ctx->busy == NULL) {
+        return NGX_OK;
+    }
+
+    return ngx_http_ssi_output(r, ctx);
+}
+
+
+static ngx_buf_t *
+ngx_http_ssi_errmsg(ngx_http_request_t *r, ngx_http_ssi_ctx_t *ctx)
+{
+    ngx_buf_t    *b;
+    ngx_chain_t  *cl;
+
+    if (ctx->free) {
+        cl = ctx->free;
+        ctx->free = ctx->free->next;
+        b = cl->buf;
+        ngx_memzero(b, sizeof(ngx_buf_t));
+
+    } else {
+        b = ngx_calloc_buf(r->pool);
+        if (b == NULL) {
+            return NULL;
+        }
+
+        cl = ngx_alloc_chain_link(r->pool);
+        if (cl == NULL) {
+            return NULL;
+        }
+
+        cl->buf = b;
+    }
+
+    b->memory = 1;
+    b->pos = ctx->errmsg.data;
+    b->last = ctx->errmsg.data + ctx->errmsg.len;
+
+    cl->next = NULL;
+    *ctx->last_out = cl;
+    ctx->last_out = &cl->next;
+
+    return b;
+}
+
+
+static ngx_int_t
+ngx_http_ssi_replay(ngx_http_request_t *r, ngx_http_ssi_ctx_t *ctx)
+{
+    ngx_int_t                 rc;
+    ngx_buf_t                *b;
+    ngx_uint_t                i;
+    ngx_chain_t              *cl;
+    ngx_table_elt_t          *param, *tp;
+    ngx_http_ssi_segment_t   *seg;
+    ngx_http_ssi_loc_conf_t  *slcf;
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http ssi replay \"%V\" %ui", &r->uri, ctx->segment);
+
+    if (ctx->buf == NULL && ctx->segment == 0 && ctx->in) {
+        ctx->buf = ctx->in->buf;
+        ctx->in = ctx->in->next;
+    }
+
+    if (ctx->buf == NULL) {
+        goto rest;
+    }
+
+    slcf = ngx_http_get_module_loc_conf(r, ngx_http_ssi_filter_module);
+
+    while (ctx->segment < ctx->template->segments.nelts) {
+
+        seg = (ngx_http_ssi_segment_t *) ctx->template->segments.elts
+              + ctx->segment++;
+
+        switch (seg->type) {
+
+        case NGX_HTTP_SSI_FILE_TEXT:
+        case NGX_HTTP_SSI_MEMORY_TEXT:
+
+            if (!ctx->output) {
+                continue;
+            }
+
+            if (ctx->free) {
+                cl = ctx->free;
+                ctx->free = ctx->free->next;
+                b = cl->buf;
+
+            } else {
+                b = ngx_alloc_buf(r->pool);
+                if (b == NULL) {
+                    return NGX_ERROR;
+                }
+
+                cl = ngx_alloc_chain_link(r->pool);
+                if (cl == NULL) {
+                    return NGX_ERROR;
+                }
+
+                cl->buf = b;
+            }
+
+            if (seg->type == NGX_HTTP_SSI_FILE_TEXT) {
+                ngx_memcpy(b, ctx->buf, sizeof(ngx_buf_t));
+
+                b->file_pos = seg->start;
+                b->file_last = seg->end;
+                b->shadow = NULL;
+                b->last_buf = 0;
+                b->recycled = 0;
+
+            } else {
+                ngx_memzero(b, sizeof(ngx_buf_t));
+
+                b->memory = 1;
+                b->pos = seg->text.data;
+                b->last = seg->text.data + seg->text.len;
+            }
+
+            cl->next = NULL;
+            *ctx->last_out = cl;
+            ctx->last_out = &cl->next;
+
+            continue;
+
+        case NGX_HTTP_SSI_COMMAND:
+
+            ctx->command = seg->text;
+            ctx->key = seg->key;
+            ctx->params.nelts = 0;
+
+            /* the command handlers may change the parameter values */
+
+            tp = seg->params->elts;
+
+            for (i = 0; i < seg->params->nelts; i++) {
+                param = ngx_array_push(&ctx->params);
+                if (param == NULL) {
+                    return NGX_ERROR;
+                }
+
+                param->key = tp[i].key;
+                param->value.len = tp[i].value.len;
+                param->value.data = ngx_palloc(r->pool, tp[i].value.len);
+                if (param->value.data == NULL) {
+                    return NGX_ERROR;
+                }
+
+                ngx_memcpy(param->value.data, tp[i].value.data,
+                           tp[i].value.len);
+            }
+
+            rc = ngx_http_ssi_command(r, ctx);
+
+            if (rc == NGX_OK) {
+                continue;
+            }
+
+            if (rc == NGX_DONE || rc == NGX_AGAIN || rc == NGX_ERROR) {
+                return rc;
+            }
+
+            break;
+
+        default: /* NGX_HTTP_SSI_PARSE_ERROR */
+            break;
+        }
+
+        /* rc == NGX_HTTP_SSI_ERROR */
+
+        if (!slcf->silent_errors) {
+            if (ngx_http_ssi_errmsg(r, ctx) == NULL) {
+                return NGX_ERROR;
+            }
+        }
+    }
+
+    b = ngx_calloc_buf(r->pool);
+    if (b == NULL) {
+        return NGX_ERROR;
+    }
+
+    cl = ngx_alloc_chain_link(r->pool);
+    if (cl == NULL) {
+        return NGX_ERROR;
+    }
+
+    b->sync = 1;
+    b->last_buf = ctx->buf->last_buf;
+
+    cl->buf = b;
+    cl->next = NULL;
+    *ctx->last_out = cl;
+    ctx->last_out = &cl->next;
+
+    ctx->buf->file_pos = ctx->buf->file_last;
+    ctx->buf = NULL;
+
+rest:
+
+    /* the special buffers that follow the file are passed as is */
+
+    while (ctx->in) {
+        cl = ngx_alloc_chain_link(r->pool);
+        if (cl == NULL) {
+            return NGX_ERROR;
+        }
+
+        cl->buf = ctx->in->buf;
+        cl->next = NULL;
+        *ctx->last_out = cl;
+        ctx->last_out = &cl->next;
+
+        ctx->in = ctx->in->next;
+    }
+
+    if (ctx->out == NULL && ctx->busy == NULL) {
+        return NGX_OK;
+    }
+
+    return ngx_http_ssi_output(r, ctx);
+}
+
+
+static ngx_int_t
+ngx_http_ssi_record(ngx_http_request_t *r, ngx_http_ssi_ctx_t *ctx,
+    ngx_int_t rc)
+{
+    off_t                     start, end;
+    size_t                    len;
+    u_char                   *p;
+    ngx_uint_t                i;
+    ngx_pool_t               *pool;
+    ngx_table_elt_t          *param, *tp;
+    ngx_http_ssi_segment_t   *seg, *prev;
+    ngx_http_ssi_template_t  *tpl;
+    ngx_http_ssi_loc_conf_t  *slcf;
+
+    tpl = ctx->template;
+    pool = tpl->pool;
+
+    if (!ctx->buf->in_file) {
+        return NGX_DECLINED;
+    }
+
+    if (ctx->copy_start != ctx->copy_end) {
+
+        start = ctx->buf->file_pos + (ctx->copy_start - ctx->buf->pos)
+                - ctx->saved;
+        end = ctx->buf->file_pos + (ctx->copy_end - ctx->buf->pos);
+
+        len = (size_t) (end - start);
+
+        prev = NULL;
+
+        if (tpl->segments.nelts) {
+            prev = (ngx_http_ssi_segment_t *) tpl->segments.elts
+                   + tpl->segments.nelts - 1;
+        }
+
+        slcf = ngx_http_get_module_loc_conf(r, ngx_http_ssi_filter_module);
+
+        if (len >= slcf->min_file_chunk) {
+
+            if (prev && prev->type == NGX_HTTP_SSI_FILE_TEXT
+                && prev->end == start)
+            {
+                prev->end = end;
+
+            } else {
+                seg = ngx_array_push(&tpl->segments);
+                if (seg == NULL) {
+                    return NGX_ERROR;
+                }
+
+                ngx_memzero(seg, sizeof(ngx_http_ssi_segment_t));
+
+                seg->type = NGX_HTTP_SSI_FILE_TEXT;
+                seg->start = start;
+                seg->end = end;
+            }
+
+        } else {
+
+            /* the short texts are kept in memory as with ssi_min_file_chunk */
+
+            if (prev && prev->type == NGX_HTTP_SSI_MEMORY_TEXT
+                && prev->end == start)
+            {
+                seg = prev;
+
+            } else {
+                seg = ngx_array_push(&tpl->segments);
+                if (seg == NULL) {
+                    return NGX_ERROR;
+                }
+
+                ngx_memzero(seg, sizeof(ngx_http_ssi_segment_t));
+
+                seg->type = NGX_HTTP_SSI_MEMORY_TEXT;
+                seg->start = start;
+            }
+
+            p = ngx_palloc(pool, seg->text.len + len);
+            if (p == NULL) {
+                return NGX_ERROR;
+            }
+
+            ngx_memcpy(p, seg->text.data, seg->text.len);
+
+            seg->text.data = p;
+            p += seg->text.len;
+
+            if (ctx->saved) {
+                p = ngx_cpymem(p, ngx_http_ssi_string, ctx->saved);
+            }
+
+            ngx_memcpy(p, ctx->copy_start, ctx->copy_end - ctx->copy_start);
+
+            seg->text.len += len;
+            seg->end = end;
+        }
+    }
+
+    if (rc == NGX_AGAIN) {
+        return NGX_OK;
+    }
+
+    seg = ngx_array_push(&tpl->segments);
+    if (seg == NULL) {
+        return NGX_ERROR;
+    }
+
+    ngx_memzero(seg, sizeof(ngx_http_ssi_segment_t));
+
+    if (rc == NGX_HTTP_SSI_ERROR) {
+        seg->type = NGX_HTTP_SSI_PARSE_ERROR;
+        return NGX_OK;
+    }
+
+    /* rc == NGX_OK */
+
+    /* the block texts may be needed in memory, so they are not cached */
+
+    if ((ctx->command.len == 5
+         && ngx_strncmp(ctx->command.data, "block", 5) == 0)
+        || (ctx->command.len == 8
+            && ngx_strncmp(ctx->command.data, "endblock", 8) == 0))
+    {
+        return NGX_DECLINED;
+    }
+
+    seg->type = NGX_HTTP_SSI_COMMAND;
+    seg->key = ctx->key;
+
+    seg->text.len = ctx->command.len;
+    seg->text.data = ngx_pstrdup(pool, &ctx->command);
+    if (seg->text.data == NULL) {
+        return NGX_ERROR;
+    }
+
+    seg->params = ngx_array_create(pool, ctx->params.nelts + 1,
+                                   sizeof(ngx_table_elt_t));
+    if (seg->params == NULL) {
+        return NGX_ERROR;
+    }
+
+    param = ctx->params.elts;
+
+    for (i = 0; i < ctx->params.nelts; i++) {
+        tp = ngx_array_push(seg->params);
+        if (tp == NULL) {
+            return NGX_ERROR;
+        }
+
+        tp->key.len = param[i].key.len;
+        tp->key.data = ngx_pstrdup(pool, &param[i].key);
+        tp->value.len = param[i].value.len;
+        tp->value.data = ngx_pstrdup(pool, &param[i].value);
+
+        if (tp->key.data == NULL || tp->value.data == NULL) {
+            return NGX_ERROR;
+        }
+    }
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_ssi_template_lookup(ngx_http_request_t *r, ngx_http_ssi_ctx_t *ctx)
+{
+    u_char                    *last;
+    size_t                     root;
+    uint32_t                   hash;
+    ngx_str_t                  path;
+    ngx_pool_t                *pool;
+    ngx_pool_cleanup_t        *cln;
+    ngx_http_ssi_template_t   *tpl;
+    ngx_http_ssi_main_conf_t  *smcf;
+    ngx_http_core_loc_conf_t  *clcf;
+
+    smcf = ngx_http_get_module_main_conf(r, ngx_http_ssi_filter_module);
+
+    if (smcf->templates == NULL) {
+        return NGX_OK;
+    }
+
+    clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
+
+    /* only the static files sent with sendfile() are cached */
+
+    if (clcf->handler
+        || !r->connection->sendfile
+        || r->headers_out.status != NGX_HTTP_OK
+        || r->headers_out.content_encoding
+        || r->headers_out.last_modified_time == -1
+        || r->headers_out.content_length_n <= 0)
+    {
+        return NGX_OK;
+    }
+
+    last = ngx_http_map_uri_to_path(r, &path, &root, 0);
+    if (last == NULL) {
+        return NGX_ERROR;
+    }
+
+    path.len = last - path.data;
+
+    hash = ngx_crc32_long(path.data, path.len);
+
+    tpl = ngx_http_ssi_template_find(smcf->templates, hash, &path);
+
+    /*
+     * the mtime has a one second resolution, so the template of the file
+     * modified in the same second when it was parsed is not used: the file
+     * may have been changed after the parsing without the size change
+     */
+
+    if (tpl) {
+        if (tpl->mtime == r->headers_out.last_modified_time
+            && tpl->size == r->headers_out.content_length_n
+            && tpl->mtime < tpl->created)
+        {
+            ngx_queue_remove(&tpl->queue);
+            ngx_queue_insert_head(&smcf->templates->queue, &tpl->queue);
+
+            goto found;
+        }
+
+        ngx_http_ssi_template_delete(smcf->templates, tpl);
+    }
+
+    pool = ngx_create_pool(1024, ngx_cycle->log);
+    if (pool == NULL) {
+        return NGX_ERROR;
+    }
+
+    tpl = ngx_pcalloc(pool, sizeof(ngx_http_ssi_template_t));
+    if (tpl == NULL) {
+        ngx_destroy_pool(pool);
+        return NGX_ERROR;
+    }
+
+    tpl->pool = pool;
+
+    if (ngx_array_init(&tpl->segments, pool, 16,
+                       sizeof(ngx_http_ssi_segment_t))
+        != NGX_OK)
+    {
+        ngx_destroy_pool(pool);
+        return NGX_ERROR;
+    }
+
+    tpl->name.len = path.len;
+    tpl->name.data = ngx_pstrdup(pool, &path);
+    if (tpl->name.data == NULL) {
+        ngx_destroy_pool(pool);
+        return NGX_ERROR;
+    }
+
+    tpl->node.key = hash;
+    tpl->mtime = r->headers_out.last_modified_time;
+    tpl->size = r->headers_out.content_length_n;
+    tpl->created = ngx_time();
+    tpl->removed = 1;
+
+    ctx->record = 1;
+
+found:
+
+    cln = ngx_pool_cleanup_add(r->pool, 0);
+    if (cln == NULL) {
+        if (tpl->count == 0 && tpl->removed) {
+            ngx_destroy_pool(tpl->pool);
+        }
+
+        return NGX_ERROR;
+    }
+
+    cln->handler = ngx_http_ssi_template_cleanup;
+    cln->data = tpl;
+
+    tpl->count++;
+
+    ctx->template = tpl;
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http ssi template \"%V\" record:%d",
+                   &tpl->name, ctx->record);
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_http_ssi_template_insert(ngx_http_request_t *r,
+    ngx_http_ssi_template_t *tpl)
+{
+    ngx_queue_t               *q;
+    ngx_http_ssi_template_t   *old;
+    ngx_http_ssi_templates_t  *templates;
+    ngx_http_ssi_main_conf_t  *smcf;
+
+    smcf = ngx_http_get_module_main_conf(r, ngx_http_ssi_filter_module);
+    templates = smcf->templates;
+
+    old = ngx_http_ssi_template_find(templates, (uint32_t) tpl->node.key,
+                                     &tpl->name);
+    if (old) {
+        ngx_http_ssi_template_delete(templates, old);
+    }
+
+    if (templates->current == templates->max) {
+        q = ngx_queue_last(&templates->queue);
+        old = ngx_queue_data(q, ngx_http_ssi_template_t, queue);
+        ngx_http_ssi_template_delete(templates, old);
+    }
+
+    ngx_rbtree_insert(&templates->rbtree, &tpl->node);
+    ngx_queue_insert_head(&templates->queue, &tpl->queue);
+
+    templates->current++;
+    tpl->removed = 0;
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http ssi template \"%V\" segments:%ui",
+                   &tpl->name, tpl->segments.nelts);
+}
+
+
+static void
+ngx_http_ssi_template_delete(ngx_http_ssi_templates_t *templates,
+    ngx_http_ssi_template_t *tpl)
+{
+    ngx_rbtree_delete(&templates->rbtree, &tpl->node);
+    ngx_queue_remove(&tpl->queue);
+
+    templates->current--;
+    tpl->removed = 1;
+
+    if (tpl->count == 0) {
+        ngx_destroy_pool(tpl->pool);
+    }
+}
+
+
+static ngx_http_ssi_template_t *
+ngx_http_ssi_template_find(ngx_http_ssi_templates_t *templates,
+    uint32_t hash, ngx_str_t *name)
+{
+    ngx_int_t                 rc;
+    ngx_rbtree_node_t        *node, *sentinel;
+    ngx_http_ssi_template_t  *tpl;
+
+    node = templates->rbtree.root;
+    sentinel = templates->rbtree.sentinel;
+
+    while (node != sentinel) {
+
+        if (hash < node->key) {
+            node = node->left;
+            continue;
+        }
+
+        if (hash > node->key) {
+            node = node->right;
+            continue;
+        }
+
+        /* hash == node->key */
 
-            if (rc == NGX_OK) {
+        tpl = (ngx_http_ssi_template_t *) node;
 
-                smcf = ngx_http_get_module_main_conf(r,
-                                                   ngx_http_ssi_filter_module);
+        rc = ngx_memn2cmp(name->data, tpl->name.data, name->len,
+                          tpl->name.len);
 
-                cmd = ngx_hash_find(&smcf->hash, ctx->key, ctx->command.data,
-                                    ctx->command.len);
+        if (rc == 0) {
+            return tpl;
+        }
 
-                if (cmd == NULL) {
-                    if (ctx->output) {
-                        ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
-                                      "invalid SSI command: \"%V\"",
-                                      &ctx->command);
-                        goto ssi_error;
-                    }
+        node = (rc < 0) ? node->left : node->right;
+    }
 
-                    continue;
-                }
+    return NULL;
+}
 
-                if (cmd->conditional
-                    && (ctx->conditional == 0
-                        || ctx->conditional > cmd->conditional))
-                {
-                    ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
-                                  "invalid context of SSI command: \"%V\"",
-                                  &ctx->command);
-                    goto ssi_error;
-                }
 
-                if (!ctx->output && !cmd->block) {
+static void
+ngx_http_ssi_template_rbtree_insert_value(ngx_rbtree_node_t *temp,
+    ngx_rbtree_node_t *node, ngx_rbtree_node_t *sentinel)
+{
+    ngx_rbtree_node_t        **p;
+    ngx_http_ssi_template_t   *tpl, *tplt;
 
-                    if (ctx->block) {
+    for ( ;; ) {
 
-                        /* reconstruct the SSI command text */
+        if (node->key < temp->key) {
 
-                        len = 5 + ctx->command.len + 4;
+            p = &temp->left;
 
-                        param = ctx->params.elts;
-                        for (i = 0; i < ctx->params.nelts; i++) {
-                            len += 1 + param[i].key.len + 2
-                                + param[i].value.len + 1;
-                        }
+        } else if (node->key > temp->key) {
 
-                        b = ngx_create_temp_buf(r->pool, len);
+            p = &temp->right;
 
-                        if (b == NULL) {
-                            return NGX_ERROR;
-                        }
+        } else { /* node->key == temp->key */
 
-                        cl = ngx_alloc_chain_link(r->pool);
-                        if (cl == NULL) {
-                            return NGX_ERROR;
-                        }
+            tpl = (ngx_http_ssi_template_t *) node;
+            tplt = (ngx_http_ssi_template_t *) temp;
 
-                        cl->buf = b;
-                        cl->next = NULL;
+            p = (ngx_memn2cmp(tpl->name.data, tplt->name.data,
+                              tpl->name.len, tplt->name.len) < 0)
+                ? &temp->left : &temp->right;
+        }
 
-                        *b->last++ = '<';
-                        *b->last++ = '!';
-                        *b->last++ = '-';
-                        *b->last++ = '-';
-                        *b->last++ = '#';
-
-                        b->last = ngx_cpymem(b->last, ctx->command.data,
-                                             ctx->command.len);
-
-                        for (i = 0; i < ctx->params.nelts; i++) {
-                            *b->last++ = ' ';
-                            b->last = ngx_cpymem(b->last, param[i].key.data,
-                                                 param[i].key.len);
-                            *b->last++ = '=';
-                            *b->last++ = '"';
-                            b->last = ngx_cpymem(b->last, param[i].value.data,
-                                                 param[i].value.len);
-                            *b->last++ = '"';
-                        }
+        if (*p == sentinel) {
+            break;
+        }
 
-                        *b->last++ = ' ';
-                        *b->last++ = '-';
-                        *b->last++ = '-';
-                        *b->last++ = '>';
+        temp = *p;
+    }
 
-                        mctx = ngx_http_get_module_ctx(r->main,
-                                                   ngx_http_ssi_filter_module);
-                        bl = mctx->blocks->elts;
-                        for (ll = &bl[mctx->blocks->nelts - 1].bufs;
-                             *ll;
-                             ll = &(*ll)->next)
-                        {
-                            /* void */
-                        }
+    *p = node;
+    node->parent = temp;
+    node->left = sentinel;
+    node->right = sentinel;
+    ngx_rbt_red(node);
+}
 
-                        *ll = cl;
 
-                        b = NULL;
+static void
+ngx_http_ssi_template_cleanup(void *data)
+{
+    ngx_http_ssi_template_t  *tpl = data;
 
-                        continue;
-                    }
+    tpl->count--;
 
-                    if (cmd->conditional == 0) {
-                        continue;
-                    }
-                }
+    if (tpl->count == 0 && tpl->removed) {
+        ngx_destroy_pool(tpl->pool);
+    }
+}
 
-                if (ctx->params.nelts > NGX_HTTP_SSI_MAX_PARAMS) {
-                    ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
-                                  "too many SSI command paramters: \"%V\"",
-                                  &ctx->command);
-                    goto ssi_error;
-                }
 
-                ngx_memzero(params,
-                           (NGX_HTTP_SSI_MAX_PARAMS + 1) * sizeof(ngx_str_t *));
+static ngx_int_t
+ngx_http_ssi_command(ngx_http_request_t *r, ngx_http_ssi_ctx_t *ctx)
+{
+    size_t                     len;
+    ngx_int_t                  rc;
+    ngx_buf_t                 *b;
+    ngx_uint_t                 i, index;
+    ngx_chain_t               *cl, **ll;
+    ngx_table_elt_t           *param;
+    ngx_http_ssi_ctx_t        *mctx;
+    ngx_http_ssi_block_t      *bl;
+    ngx_http_ssi_param_t      *prm;
+    ngx_http_ssi_command_t    *cmd;
+    ngx_http_ssi_main_conf_t  *smcf;
+    ngx_str_t                 *params[NGX_HTTP_SSI_MAX_PARAMS + 1];
 
-                param = ctx->params.elts;
+    smcf = ngx_http_get_module_main_conf(r, ngx_http_ssi_filter_module);
 
-                for (i = 0; i < ctx->params.nelts; i++) {
+    cmd = ngx_hash_find(&smcf->hash, ctx->key, ctx->command.data,
+                        ctx->command.len);
 
-                    for (prm = cmd->params; prm->name.len; prm++) {
+    if (cmd == NULL) {
+        if (ctx->output) {
+            ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
+                          "invalid SSI command: \"%V\"", &ctx->command);
+            return NGX_HTTP_SSI_ERROR;
+        }
 
-                        if (param[i].key.len != prm->name.len
-                            || ngx_strncmp(param[i].key.data, prm->name.data,
-                                           prm->name.len) != 0)
-                        {
-                            continue;
-                        }
+        return NGX_OK;
+    }
 
-                        if (!prm->multiple) {
-                            if (params[prm->index]) {
-                                ngx_log_error(NGX_LOG_ERR,
-                                              r->connection->log, 0,
-                                              "duplicate \"%V\" parameter "
-                                              "in \"%V\" SSI command",
-                                              &param[i].key, &ctx->command);
+    if (cmd->conditional
+        && (ctx->conditional == 0 || ctx->conditional > cmd->conditional))
+    {
+        ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
+                      "invalid context of SSI command: \"%V\"",
+                      &ctx->command);
+        return NGX_HTTP_SSI_ERROR;
+    }
 
-                                goto ssi_error;
-                            }
+    if (!ctx->output && !cmd->block) {
 
-                            params[prm->index] = &param[i].value;
+        if (ctx->block) {
 
-                            break;
-                        }
+            /* reconstruct the SSI command text */
 
-                        for (index = prm->index; params[index]; index++) {
-                            /* void */
-                        }
+            len = 5 + ctx->command.len + 4;
 
-                        params[index] = &param[i].value;
+            param = ctx->params.elts;
+            for (i = 0; i < ctx->params.nelts; i++) {
+                len += 1 + param[i].key.len + 2 + param[i].value.len + 1;
+            }
 
-                        break;
-                    }
+            b = ngx_create_temp_buf(r->pool, len);
 
-                    if (prm->name.len == 0) {
-                        ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
-                                      "invalid parameter name: \"%V\" "
-                                      "in \"%V\" SSI command",
-                                      &param[i].key, &ctx->command);
+            if (b == NULL) {
+                return NGX_ERROR;
+            }
 
-                        goto ssi_error;
-                    }
-                }
+            cl = ngx_alloc_chain_link(r->pool);
+            if (cl == NULL) {
+                return NGX_ERROR;
+            }
 
-                for (prm = cmd->params; prm->name.len; prm++) {
-                    if (prm->mandatory && params[prm->index] == 0) {
-                        ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
-                                      "mandatory \"%V\" parameter is absent "
-                                      "in \"%V\" SSI command",
-                                      &prm->name, &ctx->command);
+            cl->buf = b;
+            cl->next = NULL;
 
-                        goto ssi_error;
-                    }
-                }
+            *b->last++ = '<';
+            *b->last++ = '!';
+            *b->last++ = '-';
+            *b->last++ = '-';
+            *b->last++ = '#';
+
+            b->last = ngx_cpymem(b->last, ctx->command.data,
+                                 ctx->command.len);
+
+            for (i = 0; i < ctx->params.nelts; i++) {
+                *b->last++ = ' ';
+                b->last = ngx_cpymem(b->last, param[i].key.data,
+                                     param[i].key.len);
+                *b->last++ = '=';
+                *b->last++ = '"';
+                b->last = ngx_cpymem(b->last, param[i].value.data,
+                                     param[i].value.len);
+                *b->last++ = '"';
+            }
 
-                if (cmd->flush) {
+            *b->last++ = ' ';
+            *b->last++ = '-';
+            *b->last++ = '-';
+            *b->last++ = '>';
 
-                    if (ctx->out) {
-                        rc = ngx_http_ssi_output(r, ctx);
+            mctx = ngx_http_get_module_ctx(r->main, ngx_http_ssi_filter_module);
+            bl = mctx->blocks->elts;
+            for (ll = &bl[mctx->blocks->nelts - 1].bufs;
+                 *ll;
+                 ll = &(*ll)->next)
+            {
+                /* void */
+            }
 
-                    } else {
-                        rc = ngx_http_next_body_filter(r, NULL);
-                    }
+            *ll = cl;
 
-                    if (rc == NGX_ERROR) {
-                        return NGX_ERROR;
-                    }
-                }
+            return NGX_OK;
+        }
 
-                rc = cmd->handler(r, ctx, params);
+        if (cmd->conditional == 0) {
+            return NGX_OK;
+        }
+    }
 
-                if (rc == NGX_OK) {
-                    continue;
-                }
+    if (ctx->params.nelts > NGX_HTTP_SSI_MAX_PARAMS) {
+        ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
+                      "too many SSI command paramters: \"%V\"",
+                      &ctx->command);
+        return NGX_HTTP_SSI_ERROR;
+    }
 
-                if (rc == NGX_DONE || rc == NGX_AGAIN || rc == NGX_ERROR) {
-                    return rc;
-                }
-            }
+    ngx_memzero(params, (NGX_HTTP_SSI_MAX_PARAMS + 1) * sizeof(ngx_str_t *));
 
+    param = ctx->params.elts;
 
-            /* rc == NGX_HTTP_SSI_ERROR */
+    for (i = 0; i < ctx->params.nelts; i++) {
 
-    ssi_error:
+        for (prm = cmd->params; prm->name.len; prm++) {
 
-            if (slcf->silent_errors) {
+            if (param[i].key.len != prm->name.len
+                || ngx_strncmp(param[i].key.data, prm->name.data,
+                               prm->name.len) != 0)
+            {
                 continue;
             }
 
-            if (ctx->free) {
-                cl = ctx->free;
-                ctx->free = ctx->free->next;
-                b = cl->buf;
-                ngx_memzero(b, sizeof(ngx_buf_t));
+            if (!prm->multiple) {
+                if (params[prm->index]) {
+                    ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
+                                  "duplicate \"%V\" parameter "
+                                  "in \"%V\" SSI command",
+                                  &param[i].key, &ctx->command);
 
-            } else {
-                b = ngx_calloc_buf(r->pool);
-                if (b == NULL) {
-                    return NGX_ERROR;
+                    return NGX_HTTP_SSI_ERROR;
                 }
 
-                cl = ngx_alloc_chain_link(r->pool);
-                if (cl == NULL) {
-                    return NGX_ERROR;
-                }
+                params[prm->index] = &param[i].value;
 
-                cl->buf = b;
+                break;
             }
 
-            b->memory = 1;
-            b->pos = ctx->errmsg.data;
-            b->last = ctx->errmsg.data + ctx->errmsg.len;
+            for (index = prm->index; params[index]; index++) {
+                /* void */
+            }
 
-            cl->next = NULL;
-            *ctx->last_out = cl;
-            ctx->last_out = &cl->next;
+            params[index] = &param[i].value;
 
-            continue;
+            break;
         }
 
-        if (ctx->buf->last_buf || ngx_buf_in_memory(ctx->buf)) {
-            if (b == NULL) {
-                if (ctx->free) {
-                    cl = ctx->free;
-                    ctx->free = ctx->free->next;
-                    b = cl->buf;
-                    ngx_memzero(b, sizeof(ngx_buf_t));
-
-                } else {
-                    b = ngx_calloc_buf(r->pool);
-                    if (b == NULL) {
-                        return NGX_ERROR;
-                    }
+        if (prm->name.len == 0) {
+            ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
+                          "invalid parameter name: \"%V\" "
+                          "in \"%V\" SSI command",
+                          &param[i].key, &ctx->command);
 
-                    cl = ngx_alloc_chain_link(r->pool);
-                    if (cl == NULL) {
-                        return NGX_ERROR;
-                    }
+            return NGX_HTTP_SSI_ERROR;
+        }
+    }
 
-                    cl->buf = b;
-                }
+    for (prm = cmd->params; prm->name.len; prm++) {
+        if (prm->mandatory && params[prm->index] == 0) {
+            ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
+                          "mandatory \"%V\" parameter is absent "
+                          "in \"%V\" SSI command",
+                          &prm->name, &ctx->command);
 
-                b->sync = 1;
+            return NGX_HTTP_SSI_ERROR;
+        }
+    }
 
-                cl->next = NULL;
-                *ctx->last_out = cl;
-                ctx->last_out = &cl->next;
-            }
+    if (cmd->flush) {
 
-            b->last_buf = ctx->buf->last_buf;
-            b->shadow = ctx->buf;
+        if (ctx->out) {
+            rc = ngx_http_ssi_output(r, ctx);
 
-            if (slcf->ignore_recycled_buffers == 0)  {
-                b->recycled = ctx->buf->recycled;
-            }
+        } else {
+            rc = ngx_http_next_body_filter(r, NULL);
         }
 
-        ctx->buf = NULL;
-
-        ctx->saved = ctx->looked;
-    }
-
-    if (ctx->out == NULL && ctx->busy == NULL) {
-        return NGX_OK;
+        if (rc == NGX_ERROR) {
+            return NGX_ERROR;
+        }
     }
 
-    return ngx_http_ssi_output(r, ctx);
+    return cmd->handler(r, ctx, params);
 }
 
 
@@ -1862,7 +2651,9 @@ ngx_http_ssi_include(ngx_http_request_t *r, ngx_http_ssi_ctx_t *ctx,
     u_char                      *dst, *src;
     size_t                       len;
     ngx_int_t                    rc, key;
-    ngx_str_t                   *uri, *file, *wait, *set, *stub, args;
+    time_t                       valid;
+    ngx_str_t                   *uri, *file, *wait, *set, *stub, *cache;
+    ngx_str_t                    args, value;
     ngx_buf_t                   *b;
     ngx_uint_t                   flags, i;
     ngx_chain_t                 *cl, *tl, **ll, *out;
@@ -1870,6 +2661,8 @@ ngx_http_ssi_include(ngx_http_request_t *r, ngx_http_ssi_ctx_t *ctx,
     ngx_http_ssi_var_t          *var;
     ngx_http_ssi_ctx_t          *mctx;
     ngx_http_ssi_block_t        *bl;
+    ngx_http_ssi_fragment_t     *fr;
+    ngx_http_ssi_main_conf_t    *smcf;
     ngx_http_post_subrequest_t  *psr;
 
     uri = params[NGX_HTTP_SSI_INCLUDE_VIRTUAL];
@@ -1877,6 +2670,7 @@ ngx_http_ssi_include(ngx_http_request_t *r, ngx_http_ssi_ctx_t *ctx,
     wait = params[NGX_HTTP_SSI_INCLUDE_WAIT];
     set = params[NGX_HTTP_SSI_INCLUDE_SET];
     stub = params[NGX_HTTP_SSI_INCLUDE_STUB];
+    cache = params[NGX_HTTP_SSI_INCLUDE_CACHE];
 
     if (uri && file) {
         ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
@@ -1920,6 +2714,35 @@ ngx_http_ssi_include(ngx_http_request_t *r, ngx_http_ssi_ctx_t *ctx,
         }
     }
 
+    valid = 0;
+    smcf = ngx_http_get_module_main_conf(r, ngx_http_ssi_filter_module);
+
+    if (cache) {
+        if (smcf->cache_zone == NULL) {
+            ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
+                          "\"cache\" parameter requires \"ssi_cache_zone\"");
+            return NGX_HTTP_SSI_ERROR;
+        }
+
+        valid = ngx_parse_time(cache, 1);
+
+        if (valid == NGX_ERROR || valid == 0) {
+            ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
+                          "invalid value \"%V\" in the \"cache\" parameter",
+                          cache);
+            return NGX_HTTP_SSI_ERROR;
+        }
+    }
+
+    if (r->post_subrequest
+        && r->post_subrequest->handler == ngx_http_ssi_cache_store)
+    {
+        /* the fragment with includes is not cached */
+
+        fr = r->post_subrequest->data;
+        fr->capture = 0;
+    }
+
     if (uri == NULL) {
         uri = file;
     }
@@ -2050,18 +2873,95 @@ ngx_http_ssi_include(ngx_http_request_t *r, ngx_http_ssi_ctx_t *ctx,
                 }
             }
 
-            var = ngx_list_push(mctx->variables);
-            if (var == NULL) {
-                return NGX_ERROR;
-            }
+            var = ngx_list_push(mctx->variables);
+            if (var == NULL) {
+                return NGX_ERROR;
+            }
+
+            var->name = *set;
+            var->key = key;
+            var->value = ngx_http_ssi_null_string;
+            psr->data = &var->value;
+        }
+
+        flags |= NGX_HTTP_SUBREQUEST_IN_MEMORY;
+    }
+
+    if (valid) {
+        fr = ngx_pcalloc(r->pool, sizeof(ngx_http_ssi_fragment_t));
+        if (fr == NULL) {
+            return NGX_ERROR;
+        }
+
+        fr->key.len = r->headers_in.server.len + uri->len + 1 + args.len;
+        fr->key.data = ngx_palloc(r->pool, fr->key.len);
+        if (fr->key.data == NULL) {
+            return NGX_ERROR;
+        }
+
+        ngx_sprintf(fr->key.data, "%V%V?%V", &r->headers_in.server, uri, &args);
+
+        fr->hash = ngx_crc32_short(fr->key.data, fr->key.len);
+        fr->valid = valid;
+        fr->last = &fr->bufs;
+        fr->max_size = smcf->cache_zone->shm.size / 8;
+
+        rc = ngx_http_ssi_cache_lookup(r, fr, &value);
+
+        if (rc == NGX_ERROR) {
+            return NGX_ERROR;
+        }
+
+#if (NGX_HTTP_STATUS)
+        ngx_http_status_cache(r, rc == NGX_OK);
+#endif
+
+        if (rc == NGX_OK) {
+
+            /* the fragment is served without a subrequest and waiting */
+
+            if (set) {
+                *(ngx_str_t *) psr->data = value;
+                return NGX_OK;
+            }
+
+            if (value.len == 0) {
+                return NGX_OK;
+            }
+
+            b = ngx_calloc_buf(r->pool);
+            if (b == NULL) {
+                return NGX_ERROR;
+            }
+
+            cl = ngx_alloc_chain_link(r->pool);
+            if (cl == NULL) {
+                return NGX_ERROR;
+            }
+
+            b->memory = 1;
+            b->pos = value.data;
+            b->last = value.data + value.len;
+
+            cl->buf = b;
+            cl->next = NULL;
+            *ctx->last_out = cl;
+            ctx->last_out = &cl->next;
+
+            return NGX_OK;
+        }
 
-            var->name = *set;
-            var->key = key;
-            var->value = ngx_http_ssi_null_string;
-            psr->data = &var->value;
+        /* NGX_DECLINED */
+
+        fr->post = psr;
+
+        psr = ngx_palloc(r->pool, sizeof(ngx_http_post_subrequest_t));
+        if (psr == NULL) {
+            return NGX_ERROR;
         }
 
-        flags |= NGX_HTTP_SUBREQUEST_IN_MEMORY;
+        psr->handler = ngx_http_ssi_cache_store;
+        psr->data = fr;
     }
 
     rc = ngx_http_subrequest(r, uri, &args, &sr, psr, flags);
@@ -2134,6 +3034,328 @@ ngx_http_ssi_set_variable(ngx_http_request_t *r, void *data, ngx_int_t rc)
 }
 
 
+static ngx_int_t
+ngx_http_ssi_cache_lookup(ngx_http_request_t *r, ngx_http_ssi_fragment_t *fr,
+    ngx_str_t *value)
+{
+    ngx_int_t                   rc;
+    ngx_http_ssi_cache_t       *cache;
+    ngx_http_ssi_cache_node_t  *fn;
+    ngx_http_ssi_main_conf_t   *smcf;
+
+    smcf = ngx_http_get_module_main_conf(r, ngx_http_ssi_filter_module);
+    cache = smcf->cache_zone->data;
+
+    rc = NGX_DECLINED;
+
+    ngx_shmtx_lock(&cache->shpool->mutex);
+
+    fn = ngx_http_ssi_cache_find(cache, fr);
+
+    if (fn == NULL) {
+        goto done;
+    }
+
+    if (fn->expire <= ngx_time()) {
+        ngx_queue_remove(&fn->queue);
+        ngx_rbtree_delete(&cache->sh->rbtree, &fn->node);
+        ngx_slab_free_locked(cache->shpool, fn);
+        goto done;
+    }
+
+    value->len = fn->len;
+    value->data = ngx_palloc(r->pool, fn->len);
+    if (value->data == NULL) {
+        rc = NGX_ERROR;
+        goto done;
+    }
+
+    ngx_memcpy(value->data, fn->data + fn->key_len, fn->len);
+
+    ngx_queue_remove(&fn->queue);
+    ngx_queue_insert_head(&cache->sh->queue, &fn->queue);
+
+    rc = NGX_OK;
+
+done:
+
+    ngx_shmtx_unlock(&cache->shpool->mutex);
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "ssi cache lookup \"%V\": %i", &fr->key, rc);
+
+    return rc;
+}
+
+
+static ngx_int_t
+ngx_http_ssi_cache_store(ngx_http_request_t *r, void *data, ngx_int_t rc)
+{
+    ngx_http_ssi_fragment_t *fr = data;
+
+    u_char                     *p;
+    size_t                      n;
+    ngx_uint_t                  i;
+    ngx_chain_t                *cl, tl;
+    ngx_buf_t                   b;
+    ngx_queue_t                *q;
+    ngx_http_ssi_cache_t       *cache;
+    ngx_http_ssi_cache_node_t  *fn;
+    ngx_http_ssi_main_conf_t   *smcf;
+
+    if (rc == NGX_AGAIN) {
+
+        /*
+         * the response is not sent completely yet, the handler is called
+         * again with the final code
+         */
+
+        goto post;
+    }
+
+    if (r->subrequest_in_memory && r->upstream) {
+
+        /* the "set" include */
+
+        fr->capture = (r->upstream->headers_in.status_n == NGX_HTTP_OK);
+
+        if (fr->capture) {
+            ngx_memzero(&b, sizeof(ngx_buf_t));
+            b.pos = r->upstream->buffer.pos;
+            b.last = r->upstream->buffer.last;
+
+            tl.buf = &b;
+            tl.next = NULL;
+
+            fr->bufs = &tl;
+            fr->size = b.last - b.pos;
+        }
+    }
+
+    if (!fr->capture
+        || rc != NGX_OK
+        || r->connection->error
+        || fr->size > fr->max_size)
+    {
+        goto done;
+    }
+
+    smcf = ngx_http_get_module_main_conf(r, ngx_http_ssi_filter_module);
+    cache = smcf->cache_zone->data;
+
+    n = offsetof(ngx_http_ssi_cache_node_t, data) + fr->key.len + fr->size;
+
+    ngx_shmtx_lock(&cache->shpool->mutex);
+
+    fn = ngx_http_ssi_cache_find(cache, fr);
+
+    if (fn) {
+        ngx_queue_remove(&fn->queue);
+        ngx_rbtree_delete(&cache->sh->rbtree, &fn->node);
+        ngx_slab_free_locked(cache->shpool, fn);
+    }
+
+    /* the least recently used fragments are evicted to free the memory */
+
+    for (i = 0; /* void */ ; i++) {
+
+        fn = ngx_slab_alloc_locked(cache->shpool, n);
+
+        if (fn || i == 16 || ngx_queue_empty(&cache->sh->queue)) {
+            break;
+        }
+
+        q = ngx_queue_last(&cache->sh->queue);
+        ngx_queue_remove(q);
+
+        fn = ngx_queue_data(q, ngx_http_ssi_cache_node_t, queue);
+        ngx_rbtree_delete(&cache->sh->rbtree, &fn->node);
+        ngx_slab_free_locked(cache->shpool, fn);
+    }
+
+    if (fn == NULL) {
+        ngx_shmtx_unlock(&cache->shpool->mutex);
+
+        ngx_log_error(NGX_LOG_WARN, r->connection->log, 0,
+                      "could not allocate fragment \"%V\" in ssi cache zone "
+                      "\"%V\"", &fr->key, &smcf->cache_zone->name);
+        goto done;
+    }
+
+    fn->node.key = fr->hash;
+    fn->expire = ngx_time() + fr->valid;
+    fn->len = fr->size;
+    fn->key_len = (u_short) fr->key.len;
+
+    p = ngx_cpymem(fn->data, fr->key.data, fr->key.len);
+
+    for (cl = fr->bufs; cl; cl = cl->next) {
+        p = ngx_cpymem(p, cl->buf->pos, cl->buf->last - cl->buf->pos);
+    }
+
+    ngx_rbtree_insert(&cache->sh->rbtree, &fn->node);
+    ngx_queue_insert_head(&cache->sh->queue, &fn->queue);
+
+    ngx_shmtx_unlock(&cache->shpool->mutex);
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "ssi cache store \"%V\": %uz", &fr->key, fr->size);
+
+done:
+
+    fr->capture = 0;
+    fr->bufs = NULL;
+
+post:
+
+    if (fr->post) {
+        return fr->post->handler(r, fr->post->data, rc);
+    }
+
+    return rc;
+}
+
+
+static ngx_http_ssi_cache_node_t *
+ngx_http_ssi_cache_find(ngx_http_ssi_cache_t *cache,
+    ngx_http_ssi_fragment_t *fr)
+{
+    ngx_int_t                   rc;
+    ngx_rbtree_node_t          *node, *sentinel;
+    ngx_http_ssi_cache_node_t  *fn;
+
+    node = cache->sh->rbtree.root;
+    sentinel = cache->sh->rbtree.sentinel;
+
+    while (node != sentinel) {
+
+        if (fr->hash < node->key) {
+            node = node->left;
+            continue;
+        }
+
+        if (fr->hash > node->key) {
+            node = node->right;
+            continue;
+        }
+
+        /* fr->hash == node->key */
+
+        fn = (ngx_http_ssi_cache_node_t *) node;
+
+        rc = ngx_memn2cmp(fr->key.data, fn->data, fr->key.len, fn->key_len);
+
+        if (rc == 0) {
+            return fn;
+        }
+
+        node = (rc < 0) ? node->left : node->right;
+    }
+
+    return NULL;
+}
+
+
+static void
+ngx_http_ssi_cache_rbtree_insert_value(ngx_rbtree_node_t *temp,
+    ngx_rbtree_node_t *node, ngx_rbtree_node_t *sentinel)
+{
+    ngx_rbtree_node_t          **p;
+    ngx_http_ssi_cache_node_t   *fn, *fnt;
+
+    for ( ;; ) {
+
+        if (node->key < temp->key) {
+
+            p = &temp->left;
+
+        } else if (node->key > temp->key) {
+
+            p = &temp->right;
+
+        } else { /* node->key == temp->key */
+
+            fn = (ngx_http_ssi_cache_node_t *) node;
+            fnt = (ngx_http_ssi_cache_node_t *) temp;
+
+            p = (ngx_memn2cmp(fn->data, fnt->data, fn->key_len, fnt->key_len)
+                 < 0)
+                ? &temp->left : &temp->right;
+        }
+
+        if (*p == sentinel) {
+            break;
+        }
+
+        temp = *p;
+    }
+
+    *p = node;
+    node->parent = temp;
+    node->left = sentinel;
+    node->right = sentinel;
+    ngx_rbt_red(node);
+}
+
+
+static ngx_int_t
+ngx_http_ssi_cache_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
+{
+    size_t                    len;
+    ngx_buf_t                *b;
+    ngx_chain_t              *cl, *tl;
+    ngx_http_ssi_fragment_t  *fr;
+
+    if (r->post_subrequest == NULL
+        || r->post_subrequest->handler != ngx_http_ssi_cache_store)
+    {
+        return ngx_http_ssi_cache_next_body_filter(r, in);
+    }
+
+    fr = r->post_subrequest->data;
+
+    for (cl = in; cl && fr->capture; cl = cl->next) {
+
+        if (ngx_buf_special(cl->buf)) {
+            continue;
+        }
+
+        if (!ngx_buf_in_memory(cl->buf)) {
+            fr->capture = 0;
+            break;
+        }
+
+        len = cl->buf->last - cl->buf->pos;
+
+        if (fr->size + len > fr->max_size) {
+            fr->capture = 0;
+            break;
+        }
+
+        b = ngx_create_temp_buf(r->pool, len);
+        if (b == NULL) {
+            return NGX_ERROR;
+        }
+
+        b->last = ngx_cpymem(b->pos, cl->buf->pos, len);
+
+        tl = ngx_alloc_chain_link(r->pool);
+        if (tl == NULL) {
+            return NGX_ERROR;
+        }
+
+        tl->buf = b;
+        tl->next = NULL;
+        *fr->last = tl;
+        fr->last = &tl->next;
+
+        fr->size += len;
+    }
+
+    return ngx_http_ssi_cache_next_body_filter(r, in);
+}
+
+
 static ngx_int_t
 ngx_http_ssi_echo(ngx_http_request_t *r, ngx_http_ssi_ctx_t *ctx,
     ngx_str_t **params)
@@ -2791,6 +4013,163 @@ ngx_http_ssi_preconfiguration(ngx_conf_t *cf)
 }
 
 
+static char *
+ngx_http_ssi_cache_zone(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_http_ssi_main_conf_t *smcf = conf;
+
+    ssize_t                n;
+    ngx_str_t             *value;
+    ngx_http_ssi_cache_t  *cache;
+
+    if (smcf->cache_zone) {
+        return "is duplicate";
+    }
+
+    value = cf->args->elts;
+
+    n = ngx_parse_size(&value[2]);
+
+    if (n == NGX_ERROR) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid size of ssi_cache_zone \"%V\"", &value[2]);
+        return NGX_CONF_ERROR;
+    }
+
+    if (n < (ngx_int_t) (8 * ngx_pagesize)) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "ssi_cache_zone \"%V\" is too small", &value[1]);
+        return NGX_CONF_ERROR;
+    }
+
+    cache = ngx_pcalloc(cf->pool, sizeof(ngx_http_ssi_cache_t));
+    if (cache == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    smcf->cache_zone = ngx_shared_memory_add(cf, &value[1], n,
+                                             &ngx_http_ssi_filter_module);
+    if (smcf->cache_zone == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    if (smcf->cache_zone->data) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "duplicate ssi_cache_zone \"%V\"", &value[1]);
+        return NGX_CONF_ERROR;
+    }
+
+    smcf->cache_zone->init = ngx_http_ssi_cache_init_zone;
+    smcf->cache_zone->data = cache;
+
+    return NGX_CONF_OK;
+}
+
+
+static char *
+ngx_http_ssi_template_cache(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_http_ssi_main_conf_t *smcf = conf;
+
+    ngx_int_t                  max;
+    ngx_str_t                 *value;
+    ngx_pool_cleanup_t        *cln;
+    ngx_rbtree_node_t         *sentinel;
+    ngx_http_ssi_templates_t  *templates;
+
+    if (smcf->templates) {
+        return "is duplicate";
+    }
+
+    value = cf->args->elts;
+
+    if (ngx_strcmp(value[1].data, "off") == 0) {
+        return NGX_CONF_OK;
+    }
+
+    max = ngx_atoi(value[1].data, value[1].len);
+
+    if (max == NGX_ERROR || max == 0) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid number of ssi templates \"%V\"",
+                           &value[1]);
+        return NGX_CONF_ERROR;
+    }
+
+    templates = ngx_pcalloc(cf->pool, sizeof(ngx_http_ssi_templates_t));
+    if (templates == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    sentinel = &templates->sentinel;
+
+    ngx_rbtree_init(&templates->rbtree, sentinel,
+                    ngx_http_ssi_template_rbtree_insert_value);
+
+    ngx_queue_init(&templates->queue);
+
+    templates->max = max;
+
+    cln = ngx_pool_cleanup_add(cf->pool, 0);
+    if (cln == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    cln->handler = ngx_http_ssi_template_cache_cleanup;
+    cln->data = templates;
+
+    smcf->templates = templates;
+
+    return NGX_CONF_OK;
+}
+
+
+static void
+ngx_http_ssi_template_cache_cleanup(void *data)
+{
+    ngx_http_ssi_templates_t  *templates = data;
+
+    ngx_queue_t              *q;
+    ngx_http_ssi_template_t  *tpl;
+
+    while (!ngx_queue_empty(&templates->queue)) {
+        q = ngx_queue_last(&templates->queue);
+        tpl = ngx_queue_data(q, ngx_http_ssi_template_t, queue);
+
+        ngx_http_ssi_template_delete(templates, tpl);
+    }
+}
+
+
+static ngx_int_t
+ngx_http_ssi_cache_init_zone(ngx_shm_zone_t *shm_zone, void *data)
+{
+    ngx_http_ssi_cache_t  *ocache = data;
+
+    ngx_http_ssi_cache_t  *cache;
+
+    cache = shm_zone->data;
+    cache->shpool = (ngx_slab_pool_t *) shm_zone->shm.addr;
+
+    if (ocache) {
+        cache->sh = ocache->sh;
+        return NGX_OK;
+    }
+
+    cache->sh = ngx_slab_alloc(cache->shpool, sizeof(ngx_http_ssi_cache_sh_t));
+    if (cache->sh == NULL) {
+        return NGX_ERROR;
+    }
+
+    ngx_rbtree_init(&cache->sh->rbtree, &cache->sh->sentinel,
+                    ngx_http_ssi_cache_rbtree_insert_value);
+
+    ngx_queue_init(&cache->sh->queue);
+
+    return NGX_OK;
+}
+
+
 static void *
 ngx_http_ssi_create_main_conf(ngx_conf_t *cf)
 {
@@ -2911,6 +4290,9 @@ ngx_http_ssi_filter_init(ngx_conf_t *cf)
     ngx_http_next_header_filter = ngx_http_top_header_filter;
     ngx_http_top_header_filter = ngx_http_ssi_header_filter;
 
+    ngx_http_ssi_cache_next_body_filter = ngx_http_top_body_filter;
+    ngx_http_top_body_filter = ngx_http_ssi_cache_body_filter;
+
     ngx_http_next_body_filter = ngx_http_top_body_filter;
     ngx_http_top_body_filter = ngx_http_ssi_body_filter;
 
@@ -29,9 +29,57 @@
 #define NGX_HTTP_SSI_ENTITY_ENCODING  2
 
 
+#define NGX_HTTP_SSI_FILE_TEXT        1
+#define NGX_HTTP_SSI_MEMORY_TEXT      2
+#define NGX_HTTP_SSI_COMMAND          3
+#define NGX_HTTP_SSI_PARSE_ERROR      4
+
+
+typedef struct {
+    ngx_uint_t                type;
+
+    off_t                     start;
+    off_t                     end;
+
+    ngx_str_t                 text;      /* the text or the command name */
+    ngx_uint_t                key;
+    ngx_array_t              *params;    /* array of ngx_table_elt_t */
+} ngx_http_ssi_segment_t;
+
+
+typedef struct {
+    ngx_rbtree_node_t         node;
+    ngx_queue_t               queue;
+
+    ngx_str_t                 name;
+    time_t                    mtime;
+    off_t                     size;
+    time_t                    created;
+
+    ngx_array_t               segments;  /* array of ngx_http_ssi_segment_t */
+    ngx_pool_t               *pool;
+
+    ngx_uint_t                count;
+    unsigned                  removed:1;
+} ngx_http_ssi_template_t;
+
+
+typedef struct {
+    ngx_rbtree_t              rbtree;
+    ngx_rbtree_node_t         sentinel;
+    ngx_queue_t               queue;
+
+    ngx_uint_t                current;
+    ngx_uint_t                max;
+} ngx_http_ssi_templates_t;
+
+
 typedef struct {
     ngx_hash_t                hash;
     ngx_hash_keys_arrays_t    commands;
+
+    ngx_shm_zone_t           *cache_zone;
+    ngx_http_ssi_templates_t *templates;
 } ngx_http_ssi_main_conf_t;
 
 
@@ -64,11 +112,15 @@ typedef struct {
     ngx_list_t               *variables;
     ngx_array_t              *blocks;
 
+    ngx_http_ssi_template_t  *template;
+    ngx_uint_t                segment;
+
     unsigned                  conditional:2;
     unsigned                  encoding:2;
     unsigned                  block:1;
     unsigned                  output:1;
     unsigned                  output_chosen:1;
+    unsigned                  record:1;
 
     ngx_http_request_t       *wait;
     void                     *value_buf;
@@ -0,0 +1,2066 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+
+
+/*
+ * The counters are kept in the shared memory zone "status" as the array
+ * of slots: every worker claims its own slot on the first update and
+ * increments the counters there without the locked instructions, the last
+ * slot is shared by the processes that have not found a free slot and
+ * is updated atomically.  The status handler sums all slots.
+ *
+ * The latencies are kept in microseconds in the log-linear histograms:
+ * the values below 8 have own buckets, and every next power of two range
+ * is split into 8 buckets, so a bucket is at most 1/8 of its value wide.
+ * The values above 2^26 usec (67 seconds) go to the last bucket.
+ */
+
+#define NGX_HTTP_STATUS_JSON            0
+#define NGX_HTTP_STATUS_PROMETHEUS      1
+
+
+#define NGX_HTTP_STATUS_REQUESTS        0
+#define NGX_HTTP_STATUS_RECEIVED        1
+#define NGX_HTTP_STATUS_SENT            2
+#define NGX_HTTP_STATUS_1XX             3
+#define NGX_HTTP_STATUS_SSL_HANDSHAKES  8
+#define NGX_HTTP_STATUS_SSL_REUSES      9
+#define NGX_HTTP_STATUS_CACHE_HITS      10
+#define NGX_HTTP_STATUS_CACHE_MISSES    11
+#define NGX_HTTP_STATUS_LATENCY         12
+#define NGX_HTTP_STATUS_ZONE_COUNTERS                                        \
+    (NGX_HTTP_STATUS_LATENCY                                                 \
+     + NGX_HTTP_STATUS_LATENCY_PHASES * NGX_HTTP_STATUS_HIST)
+
+#define NGX_HTTP_STATUS_HIST_BITS       3
+#define NGX_HTTP_STATUS_HIST_SUB        (1 << NGX_HTTP_STATUS_HIST_BITS)
+#define NGX_HTTP_STATUS_HIST_MAX        26
+#define NGX_HTTP_STATUS_HIST_BUCKETS                                         \
+    ((NGX_HTTP_STATUS_HIST_MAX - NGX_HTTP_STATUS_HIST_BITS + 1)              \
+     << NGX_HTTP_STATUS_HIST_BITS)
+#define NGX_HTTP_STATUS_HIST_SUM        NGX_HTTP_STATUS_HIST_BUCKETS
+#define NGX_HTTP_STATUS_HIST            (NGX_HTTP_STATUS_HIST_BUCKETS + 1)
+
+#define NGX_HTTP_STATUS_QUANTILES       4
+
+#define NGX_HTTP_STATUS_PEER_ACTIVE     0
+#define NGX_HTTP_STATUS_PEER_REQUESTS   1
+#define NGX_HTTP_STATUS_PEER_FAILS      2
+#define NGX_HTTP_STATUS_PEER_TIME       3
+#define NGX_HTTP_STATUS_PEER_BUCKET     4
+#define NGX_HTTP_STATUS_BUCKETS         12
+#define NGX_HTTP_STATUS_PEER_COUNTERS                                        \
+    (NGX_HTTP_STATUS_PEER_BUCKET + NGX_HTTP_STATUS_BUCKETS)
+
+#define NGX_HTTP_STATUS_MAX_SLOTS       64
+
+
+typedef struct {
+    uint32_t                         signature;
+    ngx_uint_t                       nslots;
+    ngx_uint_t                       stride;
+    ngx_atomic_t                    *owner;
+    ngx_atomic_t                    *counters;
+} ngx_http_status_sh_t;
+
+
+typedef struct {
+    ngx_str_t                        name;
+    ngx_http_upstream_srv_conf_t    *upstream;
+    ngx_http_upstream_init_peer_pt   init;
+    ngx_http_upstream_rr_peers_t    *peers;
+    ngx_http_upstream_rr_peers_t    *backup;
+    ngx_uint_t                       counter;
+} ngx_http_status_upstream_t;
+
+
+typedef struct {
+    ngx_array_t                      zones;      /* of ngx_str_t */
+    ngx_array_t                      upstreams;
+                                              /* ngx_http_status_upstream_t */
+
+    ngx_shm_zone_t                  *shm_zone;
+    ngx_http_status_sh_t            *sh;
+
+    uint32_t                         signature;
+    ngx_uint_t                       ncounters;
+    ngx_uint_t                       nslots;
+
+    ngx_uint_t                       slot;
+    ngx_atomic_t                    *counters;
+
+    ngx_flag_t                       enable;
+} ngx_http_status_main_conf_t;
+
+
+typedef struct {
+    ngx_uint_t                       format;
+    ngx_uint_t                       zone;
+} ngx_http_status_loc_conf_t;
+
+
+typedef struct {
+    void                            *data;
+    ngx_event_get_peer_pt            get;
+    ngx_event_free_peer_pt           free;
+#if (NGX_HTTP_SSL)
+    ngx_event_set_peer_session_pt    set_session;
+    ngx_event_save_peer_session_pt   save_session;
+#endif
+
+    ngx_http_status_main_conf_t     *smcf;
+    ngx_http_status_upstream_t      *upstream;
+    ngx_uint_t                       counter;
+    ngx_msec_t                       start;
+} ngx_http_status_peer_data_t;
+
+
+/* the snapshot of the slab allocator statistics of a shared memory zone */
+
+typedef struct {
+    ngx_str_t                       *name;
+    ngx_uint_t                       pages;
+    ngx_uint_t                       free;
+    ngx_uint_t                       reqs;
+    ngx_uint_t                       fails;
+    ngx_uint_t                       min_shift;
+    ngx_uint_t                       nslots;
+    ngx_slab_stat_t                 *slots;
+} ngx_http_status_slab_t;
+
+
+static ngx_int_t ngx_http_status_handler(ngx_http_request_t *r);
+static ngx_buf_t *ngx_http_status_json(ngx_http_request_t *r,
+    ngx_http_status_main_conf_t *smcf, ngx_atomic_int_t *total);
+static ngx_buf_t *ngx_http_status_prometheus(ngx_http_request_t *r,
+    ngx_http_status_main_conf_t *smcf, ngx_atomic_int_t *total);
+static u_char *ngx_http_status_escape(u_char *dst, ngx_str_t *src);
+static uint64_t ngx_http_status_quantile(ngx_atomic_int_t *hist,
+    ngx_atomic_int_t count, ngx_uint_t q);
+static uint64_t ngx_http_status_bucket_max(ngx_uint_t n);
+static u_char *ngx_http_status_loop_json(u_char *p, ngx_atomic_int_t *h);
+static ngx_array_t *ngx_http_status_slabs(ngx_http_request_t *r);
+static ngx_int_t ngx_http_status_log_handler(ngx_http_request_t *r);
+static void ngx_http_status_latency(ngx_http_status_main_conf_t *smcf,
+    ngx_atomic_t *counters, ngx_uint_t phase, uint64_t start, uint64_t end);
+static ngx_atomic_t *ngx_http_status_counters(
+    ngx_http_status_main_conf_t *smcf);
+static ngx_int_t ngx_http_status_init_peer(ngx_http_request_t *r,
+    ngx_http_upstream_srv_conf_t *us);
+static ngx_int_t ngx_http_status_get_peer(ngx_peer_connection_t *pc,
+    void *data);
+static void ngx_http_status_free_peer(ngx_peer_connection_t *pc, void *data,
+    ngx_uint_t state);
+#if (NGX_HTTP_SSL)
+static ngx_int_t ngx_http_status_set_peer_session(ngx_peer_connection_t *pc,
+    void *data);
+static void ngx_http_status_save_peer_session(ngx_peer_connection_t *pc,
+    void *data);
+#endif
+static ngx_int_t ngx_http_status_init_zone(ngx_shm_zone_t *shm_zone,
+    void *data);
+
+static char *ngx_http_status(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+static char *ngx_http_status_zone(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf);
+static void *ngx_http_status_create_main_conf(ngx_conf_t *cf);
+static void *ngx_http_status_create_loc_conf(ngx_conf_t *cf);
+static char *ngx_http_status_merge_loc_conf(ngx_conf_t *cf, void *parent,
+    void *child);
+static ngx_int_t ngx_http_status_init(ngx_conf_t *cf);
+
+
+#if (NGX_HTTP_UPSTREAM_IP_HASH)
+ngx_int_t ngx_http_upstream_get_ip_hash_peer(ngx_peer_connection_t *pc,
+    void *data);
+#endif
+
+
+static ngx_command_t  ngx_http_status_commands[] = {
+
+    { ngx_string("status"),
+      NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_NOARGS|NGX_CONF_TAKE1,
+      ngx_http_status,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      0,
+      NULL },
+
+    { ngx_string("status_zone"),
+      NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
+      ngx_http_status_zone,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      0,
+      NULL },
+
+      ngx_null_command
+};
+
+
+static ngx_http_module_t  ngx_http_status_module_ctx = {
+    NULL,                                  /* preconfiguration */
+    ngx_http_status_init,                  /* postconfiguration */
+
+    ngx_http_status_create_main_conf,      /* create main configuration */
+    NULL,                                  /* init main configuration */
+
+    NULL,                                  /* create server configuration */
+    NULL,                                  /* merge server configuration */
+
+    ngx_http_status_create_loc_conf,       /* create location configuration */
+    ngx_http_status_merge_loc_conf         /* merge location configuration */
+};
+
+
+ngx_module_t  ngx_http_status_module = {
+    NGX_MODULE_V1,
+    &ngx_http_status_module_ctx,           /* module context */
+    ngx_http_status_commands,              /* module directives */
+    NGX_HTTP_MODULE,                       /* module type */
+    NULL,                                  /* init master */
+    NULL,                                  /* init module */
+    NULL,                                  /* init process */
+    NULL,                                  /* init thread */
+    NULL,                                  /* exit thread */
+    NULL,                                  /* exit process */
+    NULL,                                  /* exit master */
+    NGX_MODULE_V1_PADDING
+};
+
+
+/* the upper bounds of the upstream response time buckets in milliseconds */
+
+static ngx_msec_t  ngx_http_status_bounds[NGX_HTTP_STATUS_BUCKETS - 1] = {
+    5, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000
+};
+
+static ngx_str_t  ngx_http_status_le[NGX_HTTP_STATUS_BUCKETS] = {
+    ngx_string("0.005"), ngx_string("0.01"), ngx_string("0.025"),
+    ngx_string("0.05"), ngx_string("0.1"), ngx_string("0.25"),
+    ngx_string("0.5"), ngx_string("1"), ngx_string("2.5"),
+    ngx_string("5"), ngx_string("10"), ngx_string("+Inf")
+};
+
+
+static ngx_str_t  ngx_http_status_phases[NGX_HTTP_STATUS_LATENCY_PHASES] = {
+    ngx_string("first_byte"),
+    ngx_string("header"),
+    ngx_string("upstream_connect"),
+    ngx_string("upstream_header"),
+    ngx_string("send")
+};
+
+
+/* the quantiles in the thousandths */
+
+static ngx_uint_t  ngx_http_status_quantiles[NGX_HTTP_STATUS_QUANTILES] = {
+    500, 900, 990, 999
+};
+
+static char  *ngx_http_status_quantile_names[NGX_HTTP_STATUS_QUANTILES] = {
+    "0.5", "0.9", "0.99", "0.999"
+};
+
+
+static ngx_inline ngx_uint_t
+ngx_http_status_bucket(uint64_t usec)
+{
+    ngx_uint_t  m;
+
+    if (usec < NGX_HTTP_STATUS_HIST_SUB) {
+        return (ngx_uint_t) usec;
+    }
+
+    if (usec >> NGX_HTTP_STATUS_HIST_MAX) {
+        return NGX_HTTP_STATUS_HIST_BUCKETS - 1;
+    }
+
+    /* m is the most significant bit of usec */
+
+    for (m = NGX_HTTP_STATUS_HIST_BITS; usec >> (m + 1); m++) { /* void */ }
+
+    return ((m - NGX_HTTP_STATUS_HIST_BITS + 1) << NGX_HTTP_STATUS_HIST_BITS)
+           + (ngx_uint_t) ((usec >> (m - NGX_HTTP_STATUS_HIST_BITS))
+                           & (NGX_HTTP_STATUS_HIST_SUB - 1));
+}
+
+
+static ngx_inline void
+ngx_http_status_add(ngx_http_status_main_conf_t *smcf, ngx_atomic_t *counters,
+    ngx_uint_t n, ngx_atomic_int_t add)
+{
+    if (smcf->slot == smcf->nslots) {
+        (void) ngx_atomic_fetch_add(&counters[n], add);
+        return;
+    }
+
+    counters[n] += add;
+}
+
+
+static ngx_int_t
+ngx_http_status_handler(ngx_http_request_t *r)
+{
+    ngx_int_t                     rc;
+    ngx_buf_t                    *b;
+    ngx_uint_t                    i, n;
+    ngx_chain_t                   out;
+    ngx_atomic_t                 *counters;
+    ngx_atomic_int_t             *total;
+    ngx_http_status_sh_t         *sh;
+    ngx_http_status_loc_conf_t   *slcf;
+    ngx_http_status_main_conf_t  *smcf;
+
+    if (r->method != NGX_HTTP_GET && r->method != NGX_HTTP_HEAD) {
+        return NGX_HTTP_NOT_ALLOWED;
+    }
+
+    rc = ngx_http_discard_request_body(r);
+
+    if (rc != NGX_OK) {
+        return rc;
+    }
+
+    slcf = ngx_http_get_module_loc_conf(r, ngx_http_status_module);
+
+    if (slcf->format == NGX_HTTP_STATUS_PROMETHEUS) {
+        r->headers_out.content_type.len =
+                                    sizeof("text/plain; version=0.0.4") - 1;
+        r->headers_out.content_type.data =
+                                    (u_char *) "text/plain; version=0.0.4";
+
+    } else {
+        r->headers_out.content_type.len = sizeof("application/json") - 1;
+        r->headers_out.content_type.data = (u_char *) "application/json";
+    }
+
+    if (r->method == NGX_HTTP_HEAD) {
+        r->headers_out.status = NGX_HTTP_OK;
+
+        rc = ngx_http_send_header(r);
+
+        if (rc == NGX_ERROR || rc > NGX_OK || r->header_only) {
+            return rc;
+        }
+    }
+
+    smcf = ngx_http_get_module_main_conf(r, ngx_http_status_module);
+
+    total = ngx_pcalloc(r->pool, (smcf->ncounters + 1)
+                                 * sizeof(ngx_atomic_int_t));
+    if (total == NULL) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+
+    sh = smcf->sh;
+
+    for (i = 0; i <= sh->nslots; i++) {
+        counters = sh->counters + i * sh->stride;
+
+        for (n = 0; n < smcf->ncounters; n++) {
+            total[n] += (ngx_atomic_int_t) counters[n];
+        }
+    }
+
+    if (slcf->format == NGX_HTTP_STATUS_PROMETHEUS) {
+        b = ngx_http_status_prometheus(r, smcf, total);
+
+    } else {
+        b = ngx_http_status_json(r, smcf, total);
+    }
+
+    if (b == NULL) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+
+    out.buf = b;
+    out.next = NULL;
+
+    r->headers_out.status = NGX_HTTP_OK;
+    r->headers_out.content_length_n = b->last - b->pos;
+
+    b->last_buf = 1;
+
+    rc = ngx_http_send_header(r);
+
+    if (rc == NGX_ERROR || rc > NGX_OK || r->header_only) {
+        return rc;
+    }
+
+    return ngx_http_output_filter(r, &out);
+}
+
+
+static ngx_buf_t *
+ngx_http_status_json(ngx_http_request_t *r, ngx_http_status_main_conf_t *smcf,
+    ngx_atomic_int_t *total)
+{
+    size_t                       size;
+    ngx_buf_t                   *b;
+    ngx_str_t                   *zone, *name;
+    ngx_uint_t                   i, j, k, n, npeers;
+    ngx_array_t                 *slabs;
+    ngx_slab_stat_t             *st;
+    ngx_atomic_int_t            *c, *h, count;
+    ngx_http_status_slab_t      *sl;
+    ngx_http_status_upstream_t  *us;
+
+    zone = smcf->zones.elts;
+    us = smcf->upstreams.elts;
+
+    size = sizeof("{}\n") + sizeof("\"connections\":{\"accepted\":,"
+                "\"handled\":,\"active\":,\"reading\":,\"writing\":,"
+                "\"waiting\":},\"requests\":,") + 7 * NGX_ATOMIC_T_LEN
+           + sizeof("\"slabs\":{},\"server_zones\":{},\"upstreams\":{}");
+
+    slabs = ngx_http_status_slabs(r);
+    if (slabs == NULL) {
+        return NULL;
+    }
+
+    sl = slabs->elts;
+
+    for (i = 0; i < slabs->nelts; i++) {
+        size += 2 * sl[i].name->len + sizeof("\"\":{\"pages\":{\"used\":,"
+                "\"free\":},\"reqs\":,\"fails\":,\"slots\":{}},")
+                + 4 * NGX_INT_T_LEN
+                + sl[i].nslots * (sizeof("\"\":{\"used\":,\"free\":,"
+                                         "\"reqs\":,\"fails\":},")
+                                  + 5 * NGX_INT_T_LEN);
+    }
+
+    if (ngx_event_loop_stats) {
+        size += sizeof("\"event_loop\":{\"iterations\":,\"busy_us\":,"
+                       "\"events\":,\"timers\":,\"posted\":,\"stalls\":,"
+                       "\"duration_us\":{\"buckets\":{}},"
+                       "\"batch\":{\"buckets\":{}}},")
+                + 6 * NGX_ATOMIC_T_LEN
+                + 2 * NGX_EVENT_STAT_BUCKETS
+                  * (NGX_INT64_LEN + NGX_ATOMIC_T_LEN + 4);
+    }
+
+    for (i = 0; i < smcf->zones.nelts; i++) {
+        size += 2 * zone[i].len + 256
+                + NGX_HTTP_STATUS_LATENCY * NGX_ATOMIC_T_LEN
+                + NGX_HTTP_STATUS_LATENCY_PHASES
+                  * (128 + (2 + NGX_HTTP_STATUS_QUANTILES) * NGX_INT64_LEN
+                     + NGX_HTTP_STATUS_HIST_BUCKETS
+                       * (NGX_INT64_LEN + NGX_ATOMIC_T_LEN + 4));
+    }
+
+    for (i = 0; i < smcf->upstreams.nelts; i++) {
+        size += 2 * us[i].name.len + sizeof("\"\":{\"peers\":[]},");
+
+        npeers = us[i].peers->number
+                 + (us[i].backup ? us[i].backup->number : 0);
+
+        for (j = 0; j < npeers; j++) {
+            name = (j < us[i].peers->number)
+                   ? &us[i].peers->peer[j].name
+                   : &us[i].backup->peer[j - us[i].peers->number].name;
+
+            size += 2 * name->len + 256
+                    + NGX_HTTP_STATUS_PEER_COUNTERS * (NGX_ATOMIC_T_LEN + 16);
+        }
+    }
+
+    b = ngx_create_temp_buf(r->pool, size);
+    if (b == NULL) {
+        return NULL;
+    }
+
+    *b->last++ = '{';
+
+#if (NGX_STAT_STUB)
+
+    {
+    ngx_atomic_int_t  ac, rd, wr;
+
+    ac = *ngx_stat_active;
+    rd = *ngx_stat_reading;
+    wr = *ngx_stat_writing;
+
+    b->last = ngx_sprintf(b->last, "\"connections\":{\"accepted\":%uA,"
+                          "\"handled\":%uA,\"active\":%uA,\"reading\":%uA,"
+                          "\"writing\":%uA,\"waiting\":%uA},"
+                          "\"requests\":%uA,",
+                          *ngx_stat_accepted, *ngx_stat_handled,
+                          ac, rd, wr, ac - (rd + wr), *ngx_stat_requests);
+    }
+
+#endif
+
+    if (ngx_event_loop_stats) {
+        c = ngx_palloc(r->pool,
+                       NGX_EVENT_STAT_COUNTERS * sizeof(ngx_atomic_int_t));
+        if (c == NULL) {
+            return NULL;
+        }
+
+        ngx_event_loop_stats_sum(c);
+
+        b->last = ngx_sprintf(b->last, "\"event_loop\":{\"iterations\":%uA,"
+                              "\"busy_us\":%uA,\"events\":%uA,"
+                              "\"timers\":%uA,\"posted\":%uA,"
+                              "\"stalls\":%uA,\"duration_us\":{",
+                              c[NGX_EVENT_STAT_ITERATIONS],
+                              c[NGX_EVENT_STAT_BUSY],
+                              c[NGX_EVENT_STAT_EVENTS],
+                              c[NGX_EVENT_STAT_TIMERS],
+                              c[NGX_EVENT_STAT_POSTED],
+                              c[NGX_EVENT_STAT_STALLS]);
+
+        b->last = ngx_http_status_loop_json(b->last,
+                                            &c[NGX_EVENT_STAT_DURATION]);
+
+        b->last = ngx_cpymem(b->last, "},\"batch\":{",
+                             sizeof("},\"batch\":{") - 1);
+
+        b->last = ngx_http_status_loop_json(b->last, &c[NGX_EVENT_STAT_BATCH]);
+
+        b->last = ngx_cpymem(b->last, "}},", 3);
+    }
+
+    b->last = ngx_cpymem(b->last, "\"slabs\":{", sizeof("\"slabs\":{") - 1);
+
+    for (i = 0; i < slabs->nelts; i++) {
+
+        if (i) {
+            *b->last++ = ',';
+        }
+
+        *b->last++ = '"';
+        b->last = ngx_http_status_escape(b->last, sl[i].name);
+
+        b->last = ngx_sprintf(b->last, "\":{\"pages\":{\"used\":%ui,"
+                              "\"free\":%ui},\"reqs\":%ui,\"fails\":%ui,"
+                              "\"slots\":{",
+                              sl[i].pages - sl[i].free, sl[i].free,
+                              sl[i].reqs, sl[i].fails);
+
+        n = 0;
+
+        for (j = 0; j < sl[i].nslots; j++) {
+            st = &sl[i].slots[j];
+
+            if (st->total == 0 && st->reqs == 0) {
+                continue;
+            }
+
+            b->last = ngx_sprintf(b->last, "%s\"%ui\":{\"used\":%ui,"
+                                  "\"free\":%ui,\"reqs\":%ui,\"fails\":%ui}",
+                                  n++ ? "," : "",
+                                  (ngx_uint_t) 1 << (sl[i].min_shift + j),
+                                  st->used, st->total - st->used,
+                                  st->reqs, st->fails);
+        }
+
+        b->last = ngx_cpymem(b->last, "}}", 2);
+    }
+
+    b->last = ngx_cpymem(b->last, "},", 2);
+
+    b->last = ngx_cpymem(b->last, "\"server_zones\":{",
+                         sizeof("\"server_zones\":{") - 1);
+
+    for (i = 0; i < smcf->zones.nelts; i++) {
+        c = &total[i * NGX_HTTP_STATUS_ZONE_COUNTERS];
+
+        if (i) {
+            *b->last++ = ',';
+        }
+
+        *b->last++ = '"';
+        b->last = ngx_http_status_escape(b->last, &zone[i]);
+
+        b->last = ngx_sprintf(b->last, "\":{\"requests\":%A,"
+                              "\"received\":%A,\"sent\":%A,\"responses\":{"
+                              "\"1xx\":%A,\"2xx\":%A,\"3xx\":%A,\"4xx\":%A,"
+                              "\"5xx\":%A},\"ssl\":{\"handshakes\":%A,"
+                              "\"session_reuses\":%A},\"cache\":{"
+                              "\"hits\":%A,\"misses\":%A},\"latency\":{",
+                              c[NGX_HTTP_STATUS_REQUESTS],
+                              c[NGX_HTTP_STATUS_RECEIVED],
+                              c[NGX_HTTP_STATUS_SENT],
+                              c[NGX_HTTP_STATUS_1XX],
+                              c[NGX_HTTP_STATUS_1XX + 1],
+                              c[NGX_HTTP_STATUS_1XX + 2],
+                              c[NGX_HTTP_STATUS_1XX + 3],
+                              c[NGX_HTTP_STATUS_1XX + 4],
+                              c[NGX_HTTP_STATUS_SSL_HANDSHAKES],
+                              c[NGX_HTTP_STATUS_SSL_REUSES],
+                              c[NGX_HTTP_STATUS_CACHE_HITS],
+                              c[NGX_HTTP_STATUS_CACHE_MISSES]);
+
+        for (j = 0; j < NGX_HTTP_STATUS_LATENCY_PHASES; j++) {
+            h = &c[NGX_HTTP_STATUS_LATENCY + j * NGX_HTTP_STATUS_HIST];
+
+            count = 0;
+
+            for (k = 0; k < NGX_HTTP_STATUS_HIST_BUCKETS; k++) {
+                count += h[k];
+            }
+
+            b->last = ngx_sprintf(b->last, "%s\"%V\":{\"count\":%A,"
+                                  "\"sum_us\":%A",
+                                  j ? "," : "", &ngx_http_status_phases[j],
+                                  count, h[NGX_HTTP_STATUS_HIST_SUM]);
+
+            for (k = 0; k < NGX_HTTP_STATUS_QUANTILES; k++) {
+                b->last = ngx_sprintf(b->last, ",\"p%ui\":%uL",
+                                      ngx_http_status_quantiles[k] % 10
+                                      ? ngx_http_status_quantiles[k]
+                                      : ngx_http_status_quantiles[k] / 10,
+                                      ngx_http_status_quantile(h, count,
+                                                ngx_http_status_quantiles[k]));
+            }
+
+            /* the non-empty buckets by their upper bounds */
+
+            b->last = ngx_cpymem(b->last, ",\"buckets\":{",
+                                 sizeof(",\"buckets\":{") - 1);
+
+            n = 0;
+
+            for (k = 0; k < NGX_HTTP_STATUS_HIST_BUCKETS; k++) {
+                if (h[k] == 0) {
+                    continue;
+                }
+
+                b->last = ngx_sprintf(b->last, "%s\"%uL\":%A",
+                                      n++ ? "," : "",
+                                      ngx_http_status_bucket_max(k), h[k]);
+            }
+
+            b->last = ngx_cpymem(b->last, "}}", 2);
+        }
+
+        b->last = ngx_cpymem(b->last, "}}", 2);
+    }
+
+    b->last = ngx_cpymem(b->last, "},\"upstreams\":{",
+                         sizeof("},\"upstreams\":{") - 1);
+
+    for (i = 0; i < smcf->upstreams.nelts; i++) {
+
+        if (i) {
+            *b->last++ = ',';
+        }
+
+        *b->last++ = '"';
+        b->last = ngx_http_status_escape(b->last, &us[i].name);
+        b->last = ngx_cpymem(b->last, "\":{\"peers\":[",
+                             sizeof("\":{\"peers\":[") - 1);
+
+        npeers = us[i].peers->number
+                 + (us[i].backup ? us[i].backup->number : 0);
+
+        for (j = 0; j < npeers; j++) {
+            c = &total[us[i].counter + j * NGX_HTTP_STATUS_PEER_COUNTERS];
+
+            if (j) {
+                *b->last++ = ',';
+            }
+
+            name = (j < us[i].peers->number)
+                   ? &us[i].peers->peer[j].name
+                   : &us[i].backup->peer[j - us[i].peers->number].name;
+
+            b->last = ngx_cpymem(b->last, "{\"server\":\"",
+                                 sizeof("{\"server\":\"") - 1);
+            b->last = ngx_http_status_escape(b->last, name);
+
+            b->last = ngx_sprintf(b->last, "\",\"backup\":%s,\"active\":%A,"
+                                  "\"requests\":%A,\"fails\":%A,"
+                                  "\"response_time\":{\"buckets\":{",
+                                  (j < us[i].peers->number) ? "false" : "true",
+                                  c[NGX_HTTP_STATUS_PEER_ACTIVE] > 0
+                                      ? c[NGX_HTTP_STATUS_PEER_ACTIVE] : 0,
+                                  c[NGX_HTTP_STATUS_PEER_REQUESTS],
+                                  c[NGX_HTTP_STATUS_PEER_FAILS]);
+
+            n = 0;
+
+            for (k = 0; k < NGX_HTTP_STATUS_BUCKETS; k++) {
+                n += c[NGX_HTTP_STATUS_PEER_BUCKET + k];
+
+                if (k < NGX_HTTP_STATUS_BUCKETS - 1) {
+                    b->last = ngx_sprintf(b->last, "\"%M\":%ui,",
+                                          ngx_http_status_bounds[k], n);
+
+                } else {
+                    b->last = ngx_sprintf(b->last, "\"+Inf\":%ui},", n);
+                }
+            }
+
+            b->last = ngx_sprintf(b->last, "\"sum_ms\":%A,\"count\":%ui}}",
+                                  c[NGX_HTTP_STATUS_PEER_TIME], n);
+        }
+
+        b->last = ngx_cpymem(b->last, "]}", 2);
+    }
+
+    b->last = ngx_cpymem(b->last, "}}\n", 3);
+
+    return b;
+}
+
+
+static ngx_buf_t *
+ngx_http_status_prometheus(ngx_http_request_t *r,
+    ngx_http_status_main_conf_t *smcf, ngx_atomic_int_t *total)
+{
+    size_t                       size, len, max;
+    u_char                      *p, *label;
+    uint64_t                     usec;
+    ngx_buf_t                   *b;
+    ngx_str_t                   *zone, *name;
+    ngx_uint_t                   i, j, k, n, npeers;
+    ngx_array_t                 *slabs;
+    ngx_slab_stat_t             *st;
+    ngx_atomic_int_t            *c, *h, count;
+    ngx_http_status_slab_t      *sl;
+    ngx_http_status_upstream_t  *us;
+
+    static char  *metrics[] = {
+        "nginx_server_zone_requests_total",
+        "nginx_server_zone_received_bytes_total",
+        "nginx_server_zone_sent_bytes_total",
+        "nginx_server_zone_responses_total",
+        NULL, NULL, NULL, NULL,
+        "nginx_server_zone_ssl_handshakes_total",
+        "nginx_server_zone_ssl_session_reuses_total",
+        "nginx_server_zone_cache_hits_total",
+        "nginx_server_zone_cache_misses_total"
+    };
+
+    zone = smcf->zones.elts;
+    us = smcf->upstreams.elts;
+
+    /* the metric type lines */
+
+    size = 4096;
+    max = 0;
+
+    slabs = ngx_http_status_slabs(r);
+    if (slabs == NULL) {
+        return NULL;
+    }
+
+    sl = slabs->elts;
+
+    for (i = 0; i < slabs->nelts; i++) {
+        size += (4 + 4 * sl[i].nslots)
+                * (2 * sl[i].name->len + 64 + NGX_INT_T_LEN);
+
+        if (max < 2 * sl[i].name->len) {
+            max = 2 * sl[i].name->len;
+        }
+    }
+
+    if (ngx_event_loop_stats) {
+        size += 2 * NGX_EVENT_STAT_BUCKETS
+                * (sizeof("nginx_event_loop_duration_seconds_bucket{le=\"\"} ")
+                   + NGX_INT64_LEN + 8 + NGX_ATOMIC_T_LEN);
+    }
+
+    for (i = 0; i < smcf->zones.nelts; i++) {
+        size += (NGX_HTTP_STATUS_LATENCY
+                 + NGX_HTTP_STATUS_LATENCY_PHASES
+                   * (NGX_HTTP_STATUS_QUANTILES + 2))
+                * (2 * zone[i].len + 96 + NGX_INT64_LEN);
+
+        if (max < 2 * zone[i].len) {
+            max = 2 * zone[i].len;
+        }
+    }
+
+    for (i = 0; i < smcf->upstreams.nelts; i++) {
+
+        npeers = us[i].peers->number
+                 + (us[i].backup ? us[i].backup->number : 0);
+
+        for (j = 0; j < npeers; j++) {
+            name = (j < us[i].peers->number)
+                   ? &us[i].peers->peer[j].name
+                   : &us[i].backup->peer[j - us[i].peers->number].name;
+
+            len = 2 * (us[i].name.len + name->len)
+                  + sizeof("upstream=\"\",peer=\"\"") - 1;
+
+            size += NGX_HTTP_STATUS_PEER_COUNTERS
+                    * (len + 96 + NGX_ATOMIC_T_LEN);
+
+            if (max < len) {
+                max = len;
+            }
+        }
+    }
+
+    b = ngx_create_temp_buf(r->pool, size);
+    if (b == NULL) {
+        return NULL;
+    }
+
+#if (NGX_STAT_STUB)
+
+    {
+    ngx_atomic_int_t  ac, rd, wr;
+
+    ac = *ngx_stat_active;
+    rd = *ngx_stat_reading;
+    wr = *ngx_stat_writing;
+
+    b->last = ngx_sprintf(b->last,
+                 "# TYPE nginx_connections_accepted_total counter\n"
+                 "nginx_connections_accepted_total %uA\n"
+                 "# TYPE nginx_connections_handled_total counter\n"
+                 "nginx_connections_handled_total %uA\n"
+                 "# TYPE nginx_connections gauge\n"
+                 "nginx_connections{state=\"active\"} %uA\n"
+                 "nginx_connections{state=\"reading\"} %uA\n"
+                 "nginx_connections{state=\"writing\"} %uA\n"
+                 "nginx_connections{state=\"waiting\"} %uA\n"
+                 "# TYPE nginx_requests_total counter\n"
+                 "nginx_requests_total %uA\n",
+                 *ngx_stat_accepted, *ngx_stat_handled,
+                 ac, rd, wr, ac - (rd + wr), *ngx_stat_requests);
+    }
+
+#endif
+
+    if (ngx_event_loop_stats) {
+        c = ngx_palloc(r->pool,
+                       NGX_EVENT_STAT_COUNTERS * sizeof(ngx_atomic_int_t));
+        if (c == NULL) {
+            return NULL;
+        }
+
+        ngx_event_loop_stats_sum(c);
+
+        b->last = ngx_sprintf(b->last,
+                 "# TYPE nginx_event_loop_iterations_total counter\n"
+                 "nginx_event_loop_iterations_total %uA\n"
+                 "# TYPE nginx_event_loop_handlers_total counter\n"
+                 "nginx_event_loop_handlers_total{source=\"events\"} %uA\n"
+                 "nginx_event_loop_handlers_total{source=\"timers\"} %uA\n"
+                 "nginx_event_loop_handlers_total{source=\"posted\"} %uA\n"
+                 "# TYPE nginx_event_loop_stalls_total counter\n"
+                 "nginx_event_loop_stalls_total %uA\n"
+                 "# TYPE nginx_event_loop_duration_seconds histogram\n",
+                 c[NGX_EVENT_STAT_ITERATIONS],
+                 c[NGX_EVENT_STAT_EVENTS],
+                 c[NGX_EVENT_STAT_TIMERS],
+                 c[NGX_EVENT_STAT_POSTED],
+                 c[NGX_EVENT_STAT_STALLS]);
+
+        h = &c[NGX_EVENT_STAT_DURATION];
+        count = 0;
+
+        for (k = 0; k < NGX_EVENT_STAT_BUCKETS - 1; k++) {
+            count += h[k];
+            usec = k ? ((uint64_t) 1 << k) - 1 : 0;
+
+            b->last = ngx_sprintf(b->last,
+                                  "nginx_event_loop_duration_seconds_bucket{"
+                                  "le=\"%uL.%06uL\"} %A\n",
+                                  usec / 1000000, usec % 1000000, count);
+        }
+
+        b->last = ngx_sprintf(b->last,
+                 "nginx_event_loop_duration_seconds_bucket{le=\"+Inf\"} %A\n"
+                 "nginx_event_loop_duration_seconds_sum %A.%06A\n"
+                 "nginx_event_loop_duration_seconds_count %A\n"
+                 "# TYPE nginx_event_loop_batch_events histogram\n",
+                 count + h[k],
+                 c[NGX_EVENT_STAT_BUSY] / 1000000,
+                 c[NGX_EVENT_STAT_BUSY] % 1000000,
+                 c[NGX_EVENT_STAT_ITERATIONS]);
+
+        h = &c[NGX_EVENT_STAT_BATCH];
+        count = 0;
+
+        for (k = 0; k < NGX_EVENT_STAT_BUCKETS - 1; k++) {
+            count += h[k];
+
+            b->last = ngx_sprintf(b->last,
+                                  "nginx_event_loop_batch_events_bucket{"
+                                  "le=\"%uL\"} %A\n",
+                                  k ? ((uint64_t) 1 << k) - 1 : 0, count);
+        }
+
+        b->last = ngx_sprintf(b->last,
+                              "nginx_event_loop_batch_events_bucket{"
+                              "le=\"+Inf\"} %A\n"
+                              "nginx_event_loop_batch_events_sum %A\n"
+                              "nginx_event_loop_batch_events_count %A\n",
+                              count + h[k],
+                              c[NGX_EVENT_STAT_EVENTS],
+                              c[NGX_EVENT_STAT_ITERATIONS]);
+    }
+
+    label = ngx_palloc(r->pool, max);
+    if (label == NULL) {
+        return NULL;
+    }
+
+    if (slabs->nelts) {
+        b->last = ngx_cpymem(b->last, "# TYPE nginx_slab_pages gauge\n",
+                             sizeof("# TYPE nginx_slab_pages gauge\n") - 1);
+    }
+
+    for (i = 0; i < slabs->nelts; i++) {
+        p = ngx_http_status_escape(label, sl[i].name);
+        len = p - label;
+
+        b->last = ngx_sprintf(b->last,
+                              "nginx_slab_pages{zone=\"%*s\",state=\"used\"} "
+                              "%ui\n"
+                              "nginx_slab_pages{zone=\"%*s\",state=\"free\"} "
+                              "%ui\n",
+                              len, label, sl[i].pages - sl[i].free,
+                              len, label, sl[i].free);
+    }
+
+    if (slabs->nelts) {
+        b->last = ngx_cpymem(b->last, "# TYPE nginx_slab_chunks gauge\n",
+                             sizeof("# TYPE nginx_slab_chunks gauge\n") - 1);
+    }
+
+    for (i = 0; i < slabs->nelts; i++) {
+        p = ngx_http_status_escape(label, sl[i].name);
+        len = p - label;
+
+        for (j = 0; j < sl[i].nslots; j++) {
+            st = &sl[i].slots[j];
+
+            if (st->total == 0 && st->reqs == 0) {
+                continue;
+            }
+
+            k = (ngx_uint_t) 1 << (sl[i].min_shift + j);
+
+            b->last = ngx_sprintf(b->last,
+                                  "nginx_slab_chunks{zone=\"%*s\",size=\"%ui\","
+                                  "state=\"used\"} %ui\n"
+                                  "nginx_slab_chunks{zone=\"%*s\",size=\"%ui\","
+                                  "state=\"free\"} %ui\n",
+                                  len, label, k, st->used,
+                                  len, label, k, st->total - st->used);
+        }
+    }
+
+    for (n = 0; slabs->nelts && n < 2; n++) {
+
+        b->last = ngx_sprintf(b->last, "# TYPE nginx_slab_%s_total counter\n",
+                              n ? "fails" : "requests");
+
+        for (i = 0; i < slabs->nelts; i++) {
+            p = ngx_http_status_escape(label, sl[i].name);
+            len = p - label;
+
+            /* the allocations of the whole pages */
+
+            b->last = ngx_sprintf(b->last,
+                                  "nginx_slab_%s_total{zone=\"%*s\","
+                                  "size=\"page\"} %ui\n",
+                                  n ? "fails" : "requests", len, label,
+                                  n ? sl[i].fails : sl[i].reqs);
+
+            for (j = 0; j < sl[i].nslots; j++) {
+                st = &sl[i].slots[j];
+
+                if (st->total == 0 && st->reqs == 0) {
+                    continue;
+                }
+
+                b->last = ngx_sprintf(b->last,
+                                      "nginx_slab_%s_total{zone=\"%*s\","
+                                      "size=\"%ui\"} %ui\n",
+                                      n ? "fails" : "requests", len, label,
+                                      (ngx_uint_t) 1 << (sl[i].min_shift + j),
+                                      n ? st->fails : st->reqs);
+            }
+        }
+    }
+
+    for (n = 0; n < NGX_HTTP_STATUS_LATENCY; n++) {
+
+        if (metrics[n] == NULL || smcf->zones.nelts == 0) {
+            continue;
+        }
+
+        b->last = ngx_sprintf(b->last, "# TYPE %s counter\n", metrics[n]);
+
+        for (i = 0; i < smcf->zones.nelts; i++) {
+            c = &total[i * NGX_HTTP_STATUS_ZONE_COUNTERS];
+
+            p = ngx_http_status_escape(label, &zone[i]);
+            len = p - label;
+
+            if (n != NGX_HTTP_STATUS_1XX) {
+                b->last = ngx_sprintf(b->last, "%s{zone=\"%*s\"} %A\n",
+                                      metrics[n], len, label, c[n]);
+                continue;
+            }
+
+            for (k = 0; k < 5; k++) {
+                b->last = ngx_sprintf(b->last,
+                                      "%s{zone=\"%*s\",code=\"%uixx\"} %A\n",
+                                      metrics[n], len, label, k + 1, c[n + k]);
+            }
+        }
+    }
+
+    if (smcf->zones.nelts) {
+        b->last = ngx_cpymem(b->last,
+                  "# TYPE nginx_server_zone_latency_seconds summary\n",
+                  sizeof("# TYPE nginx_server_zone_latency_seconds summary\n")
+                  - 1);
+    }
+
+    for (i = 0; i < smcf->zones.nelts; i++) {
+        c = &total[i * NGX_HTTP_STATUS_ZONE_COUNTERS];
+
+        p = ngx_http_status_escape(label, &zone[i]);
+        len = p - label;
+
+        for (j = 0; j < NGX_HTTP_STATUS_LATENCY_PHASES; j++) {
+            h = &c[NGX_HTTP_STATUS_LATENCY + j * NGX_HTTP_STATUS_HIST];
+
+            count = 0;
+
+            for (k = 0; k < NGX_HTTP_STATUS_HIST_BUCKETS; k++) {
+                count += h[k];
+            }
+
+            for (k = 0; k < NGX_HTTP_STATUS_QUANTILES; k++) {
+                usec = ngx_http_status_quantile(h, count,
+                                                ngx_http_status_quantiles[k]);
+
+                b->last = ngx_sprintf(b->last,
+                                      "nginx_server_zone_latency_seconds{"
+                                      "zone=\"%*s\",phase=\"%V\","
+                                      "quantile=\"%s\"} %uL.%06uL\n",
+                                      len, label, &ngx_http_status_phases[j],
+                                      ngx_http_status_quantile_names[k],
+                                      usec / 1000000, usec % 1000000);
+            }
+
+            b->last = ngx_sprintf(b->last,
+                                  "nginx_server_zone_latency_seconds_sum{"
+                                  "zone=\"%*s\",phase=\"%V\"} %A.%06A\n"
+                                  "nginx_server_zone_latency_seconds_count{"
+                                  "zone=\"%*s\",phase=\"%V\"} %A\n",
+                                  len, label, &ngx_http_status_phases[j],
+                                  h[NGX_HTTP_STATUS_HIST_SUM] / 1000000,
+                                  h[NGX_HTTP_STATUS_HIST_SUM] % 1000000,
+                                  len, label, &ngx_http_status_phases[j],
+                                  count);
+        }
+    }
+
+    if (smcf->upstreams.nelts == 0) {
+        return b;
+    }
+
+    for (n = 0; n < NGX_HTTP_STATUS_PEER_BUCKET; n++) {
+
+        switch (n) {
+
+        case NGX_HTTP_STATUS_PEER_ACTIVE:
+            b->last = ngx_cpymem(b->last,
+                         "# TYPE nginx_upstream_peer_active gauge\n",
+                         sizeof("# TYPE nginx_upstream_peer_active gauge\n")
+                         - 1);
+            break;
+
+        case NGX_HTTP_STATUS_PEER_REQUESTS:
+            b->last = ngx_cpymem(b->last,
+                 "# TYPE nginx_upstream_peer_requests_total counter\n",
+                 sizeof("# TYPE nginx_upstream_peer_requests_total counter\n")
+                 - 1);
+            break;
+
+        case NGX_HTTP_STATUS_PEER_FAILS:
+            b->last = ngx_cpymem(b->last,
+                 "# TYPE nginx_upstream_peer_fails_total counter\n",
+                 sizeof("# TYPE nginx_upstream_peer_fails_total counter\n")
+                 - 1);
+            break;
+
+        default: /* NGX_HTTP_STATUS_PEER_TIME */
+            b->last = ngx_cpymem(b->last,
+                 "# TYPE nginx_upstream_peer_response_seconds histogram\n",
+                 sizeof("# TYPE nginx_upstream_peer_response_seconds "
+                        "histogram\n") - 1);
+            break;
+        }
+
+        for (i = 0; i < smcf->upstreams.nelts; i++) {
+
+            npeers = us[i].peers->number
+                     + (us[i].backup ? us[i].backup->number : 0);
+
+            for (j = 0; j < npeers; j++) {
+                c = &total[us[i].counter + j * NGX_HTTP_STATUS_PEER_COUNTERS];
+
+                name = (j < us[i].peers->number)
+                       ? &us[i].peers->peer[j].name
+                       : &us[i].backup->peer[j - us[i].peers->number].name;
+
+                p = ngx_cpymem(label, "upstream=\"", sizeof("upstream=\"") - 1);
+                p = ngx_http_status_escape(p, &us[i].name);
+                p = ngx_cpymem(p, "\",peer=\"", sizeof("\",peer=\"") - 1);
+                p = ngx_http_status_escape(p, name);
+                *p++ = '"';
+                len = p - label;
+
+                switch (n) {
+
+                case NGX_HTTP_STATUS_PEER_ACTIVE:
+                    b->last = ngx_sprintf(b->last,
+                                     "nginx_upstream_peer_active{%*s} %A\n",
+                                     len, label, c[n] > 0 ? c[n] : 0);
+                    break;
+
+                case NGX_HTTP_STATUS_PEER_REQUESTS:
+                    b->last = ngx_sprintf(b->last,
+                               "nginx_upstream_peer_requests_total{%*s} %A\n",
+                               len, label, c[n]);
+                    break;
+
+                case NGX_HTTP_STATUS_PEER_FAILS:
+                    b->last = ngx_sprintf(b->last,
+                                  "nginx_upstream_peer_fails_total{%*s} %A\n",
+                                  len, label, c[n]);
+                    break;
+
+                default: /* NGX_HTTP_STATUS_PEER_TIME */
+
+                    for (k = 0; k < NGX_HTTP_STATUS_BUCKETS; k++) {
+                        total[smcf->ncounters] +=
+                                            c[NGX_HTTP_STATUS_PEER_BUCKET + k];
+
+                        b->last = ngx_sprintf(b->last,
+                                    "nginx_upstream_peer_response_seconds_"
+                                    "bucket{%*s,le=\"%V\"} %A\n",
+                                    len, label, &ngx_http_status_le[k],
+                                    total[smcf->ncounters]);
+                    }
+
+                    b->last = ngx_sprintf(b->last,
+                                    "nginx_upstream_peer_response_seconds_"
+                                    "sum{%*s} %A.%03A\n"
+                                    "nginx_upstream_peer_response_seconds_"
+                                    "count{%*s} %A\n",
+                                    len, label, c[n] / 1000, c[n] % 1000,
+                                    len, label, total[smcf->ncounters]);
+
+                    total[smcf->ncounters] = 0;
+
+                    break;
+                }
+            }
+        }
+    }
+
+    return b;
+}
+
+
+static u_char *
+ngx_http_status_escape(u_char *dst, ngx_str_t *src)
+{
+    u_char      ch;
+    ngx_uint_t  i;
+
+    for (i = 0; i < src->len; i++) {
+        ch = src->data[i];
+
+        if (ch == '"' || ch == '\\') {
+            *dst++ = '\\';
+        }
+
+        *dst++ = ch;
+    }
+
+    return dst;
+}
+
+
+static uint64_t
+ngx_http_status_quantile(ngx_atomic_int_t *hist, ngx_atomic_int_t count,
+    ngx_uint_t q)
+{
+    ngx_uint_t        n;
+    ngx_atomic_int_t  rank;
+
+    if (count <= 0) {
+        return 0;
+    }
+
+    rank = (count * q + 999) / 1000;
+
+    for (n = 0; n < NGX_HTTP_STATUS_HIST_BUCKETS - 1; n++) {
+        rank -= hist[n];
+
+        if (rank <= 0) {
+            break;
+        }
+    }
+
+    return ngx_http_status_bucket_max(n);
+}
+
+
+static uint64_t
+ngx_http_status_bucket_max(ngx_uint_t n)
+{
+    ngx_uint_t  shift;
+
+    if (n < NGX_HTTP_STATUS_HIST_SUB) {
+        return n;
+    }
+
+    shift = (n >> NGX_HTTP_STATUS_HIST_BITS) - 1;
+
+    return (((uint64_t) (NGX_HTTP_STATUS_HIST_SUB
+                         + (n & (NGX_HTTP_STATUS_HIST_SUB - 1))) + 1) << shift)
+           - 1;
+}
+
+
+static ngx_array_t *
+ngx_http_status_slabs(ngx_http_request_t *r)
+{
+    ngx_uint_t               i;
+    ngx_array_t             *slabs;
+    ngx_shm_zone_t          *shm_zone;
+    ngx_slab_pool_t         *shpool;
+    ngx_list_part_t         *part;
+    ngx_http_status_slab_t  *sl;
+
+    slabs = ngx_array_create(r->pool, 4, sizeof(ngx_http_status_slab_t));
+    if (slabs == NULL) {
+        return NULL;
+    }
+
+    part = (ngx_list_part_t *) &ngx_cycle->shared_memory.part;
+    shm_zone = part->elts;
+
+    for (i = 0; /* void */ ; i++) {
+
+        if (i >= part->nelts) {
+            if (part->next == NULL) {
+                break;
+            }
+
+            part = part->next;
+            shm_zone = part->elts;
+            i = 0;
+        }
+
+        shpool = (ngx_slab_pool_t *) shm_zone[i].shm.addr;
+
+        sl = ngx_array_push(slabs);
+        if (sl == NULL) {
+            return NULL;
+        }
+
+        sl->name = &shm_zone[i].name;
+        sl->min_shift = shpool->min_shift;
+        sl->nslots = ngx_pagesize_shift - shpool->min_shift;
+
+        sl->slots = ngx_palloc(r->pool, sl->nslots * sizeof(ngx_slab_stat_t));
+        if (sl->slots == NULL) {
+            return NULL;
+        }
+
+        /* the counters are copied under the lock to be consistent */
+
+        ngx_shmtx_lock(&shpool->mutex);
+
+        sl->pages = shpool->npages;
+        sl->free = shpool->pfree;
+        sl->reqs = shpool->preqs;
+        sl->fails = shpool->pfails;
+
+        ngx_memcpy(sl->slots, shpool->stats,
+                   sl->nslots * sizeof(ngx_slab_stat_t));
+
+        ngx_shmtx_unlock(&shpool->mutex);
+    }
+
+    return slabs;
+}
+
+
+/* the non-empty event loop histogram buckets by their upper bounds */
+
+static u_char *
+ngx_http_status_loop_json(u_char *p, ngx_atomic_int_t *h)
+{
+    ngx_uint_t  k, n;
+
+    p = ngx_cpymem(p, "\"buckets\":{", sizeof("\"buckets\":{") - 1);
+
+    n = 0;
+
+    for (k = 0; k < NGX_EVENT_STAT_BUCKETS; k++) {
+        if (h[k] == 0) {
+            continue;
+        }
+
+        if (k == NGX_EVENT_STAT_BUCKETS - 1) {
+            p = ngx_sprintf(p, "%s\"+Inf\":%A", n++ ? "," : "", h[k]);
+
+        } else {
+            p = ngx_sprintf(p, "%s\"%uL\":%A", n++ ? "," : "",
+                            k ? ((uint64_t) 1 << k) - 1 : 0, h[k]);
+        }
+    }
+
+    *p++ = '}';
+
+    return p;
+}
+
+
+static ngx_int_t
+ngx_http_status_log_handler(ngx_http_request_t *r)
+{
+    uint64_t                      now, start;
+    ngx_uint_t                    n, status;
+    ngx_atomic_t                 *counters;
+    ngx_http_status_loc_conf_t   *slcf;
+    ngx_http_status_main_conf_t  *smcf;
+
+    slcf = ngx_http_get_module_loc_conf(r, ngx_http_status_module);
+
+    if (slcf->zone == NGX_CONF_UNSET_UINT) {
+        return NGX_OK;
+    }
+
+    smcf = ngx_http_get_module_main_conf(r, ngx_http_status_module);
+
+    counters = ngx_http_status_counters(smcf);
+    counters += slcf->zone * NGX_HTTP_STATUS_ZONE_COUNTERS;
+
+    ngx_http_status_add(smcf, counters, NGX_HTTP_STATUS_REQUESTS, 1);
+    ngx_http_status_add(smcf, counters, NGX_HTTP_STATUS_RECEIVED,
+                        (ngx_atomic_int_t) r->request_length);
+    ngx_http_status_add(smcf, counters, NGX_HTTP_STATUS_SENT,
+                        (ngx_atomic_int_t) r->connection->sent);
+
+    status = r->err_status ? r->err_status : r->headers_out.status;
+
+    n = status / 100;
+
+    if (n >= 1 && n <= 5) {
+        ngx_http_status_add(smcf, counters, NGX_HTTP_STATUS_1XX + n - 1, 1);
+    }
+
+#if (NGX_HTTP_SSL)
+
+    if (r->connection->ssl && r->connection->requests == 1) {
+        ngx_http_status_add(smcf, counters, NGX_HTTP_STATUS_SSL_HANDSHAKES, 1);
+
+        if (SSL_session_reused(r->connection->ssl->connection)) {
+            ngx_http_status_add(smcf, counters, NGX_HTTP_STATUS_SSL_REUSES, 1);
+        }
+    }
+
+#endif
+
+    if (r->header_usec) {
+        ngx_http_status_latency(smcf, counters, NGX_HTTP_STATUS_LATENCY_HEADER,
+                                r->start_usec, r->header_usec);
+    }
+
+    if (r->first_byte_usec) {
+
+        /* the first request is counted from the connection accept */
+
+        start = (r->connection->requests == 1) ? r->connection->start_usec
+                                                : r->start_usec;
+
+        ngx_http_status_latency(smcf, counters,
+                                NGX_HTTP_STATUS_LATENCY_FIRST_BYTE,
+                                start, r->first_byte_usec);
+
+        now = ngx_http_status_usec();
+
+        ngx_http_status_latency(smcf, counters, NGX_HTTP_STATUS_LATENCY_SEND,
+                                r->first_byte_usec, now);
+    }
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_http_status_latency(ngx_http_status_main_conf_t *smcf,
+    ngx_atomic_t *counters, ngx_uint_t phase, uint64_t start, uint64_t end)
+{
+    uint64_t  usec;
+
+    /* the time may go backwards */
+
+    usec = (end > start) ? end - start : 0;
+
+    counters += NGX_HTTP_STATUS_LATENCY + phase * NGX_HTTP_STATUS_HIST;
+
+    ngx_http_status_add(smcf, counters, ngx_http_status_bucket(usec), 1);
+    ngx_http_status_add(smcf, counters, NGX_HTTP_STATUS_HIST_SUM,
+                        (ngx_atomic_int_t) usec);
+}
+
+
+void
+ngx_http_status_upstream_latency(ngx_http_request_t *r, ngx_uint_t phase)
+{
+    uint64_t                      now, start;
+    ngx_atomic_t                 *counters;
+    ngx_http_upstream_t          *u;
+    ngx_http_status_loc_conf_t   *slcf;
+    ngx_http_status_main_conf_t  *smcf;
+
+    u = r->upstream;
+
+    now = ngx_http_status_usec();
+    start = u->start_usec;
+
+    /* the upstream header time is counted from the connection establishment */
+
+    u->start_usec = (phase == NGX_HTTP_STATUS_LATENCY_UPSTREAM_CONNECT) ? now
+                                                                         : 0;
+
+    slcf = ngx_http_get_module_loc_conf(r, ngx_http_status_module);
+
+    if (slcf->zone == NGX_CONF_UNSET_UINT) {
+        return;
+    }
+
+    smcf = ngx_http_get_module_main_conf(r, ngx_http_status_module);
+
+    counters = ngx_http_status_counters(smcf);
+    counters += slcf->zone * NGX_HTTP_STATUS_ZONE_COUNTERS;
+
+    ngx_http_status_latency(smcf, counters, phase, start, now);
+}
+
+
+void
+ngx_http_status_cache(ngx_http_request_t *r, ngx_uint_t hit)
+{
+    ngx_atomic_t                 *counters;
+    ngx_http_status_loc_conf_t   *slcf;
+    ngx_http_status_main_conf_t  *smcf;
+
+    slcf = ngx_http_get_module_loc_conf(r, ngx_http_status_module);
+
+    if (slcf->zone == NGX_CONF_UNSET_UINT) {
+        return;
+    }
+
+    smcf = ngx_http_get_module_main_conf(r, ngx_http_status_module);
+
+    counters = ngx_http_status_counters(smcf);
+    counters += slcf->zone * NGX_HTTP_STATUS_ZONE_COUNTERS;
+
+    ngx_http_status_add(smcf, counters,
+                        hit ? NGX_HTTP_STATUS_CACHE_HITS
+                            : NGX_HTTP_STATUS_CACHE_MISSES,
+                        1);
+}
+
+
+static ngx_atomic_t *
+ngx_http_status_counters(ngx_http_status_main_conf_t *smcf)
+{
+    ngx_pid_t              pid;
+    ngx_uint_t             i;
+    ngx_http_status_sh_t  *sh;
+
+    if (smcf->counters) {
+        return smcf->counters;
+    }
+
+    sh = smcf->sh;
+
+    for (i = 0; i < sh->nslots; i++) {
+        pid = (ngx_pid_t) sh->owner[i];
+
+        if (pid == ngx_pid) {
+            break;
+        }
+
+        if (pid == 0) {
+            if (ngx_atomic_cmp_set(&sh->owner[i], 0, ngx_pid)) {
+                break;
+            }
+
+            continue;
+        }
+
+        /* the slot of an exited worker is taken over with its counters */
+
+        if (kill(pid, 0) == -1 && ngx_errno == NGX_ESRCH) {
+            if (ngx_atomic_cmp_set(&sh->owner[i], pid, ngx_pid)) {
+                break;
+            }
+        }
+    }
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, ngx_cycle->log, 0,
+                   "status slot: %ui", i);
+
+    smcf->slot = i;
+    smcf->counters = sh->counters + i * sh->stride;
+
+    return smcf->counters;
+}
+
+
+static ngx_int_t
+ngx_http_status_init_peer(ngx_http_request_t *r,
+    ngx_http_upstream_srv_conf_t *us)
+{
+    ngx_uint_t                    i;
+    ngx_http_upstream_t          *u;
+    ngx_http_status_upstream_t   *sus;
+    ngx_http_status_peer_data_t  *sp;
+    ngx_http_status_main_conf_t  *smcf;
+
+    smcf = ngx_http_get_module_main_conf(r, ngx_http_status_module);
+
+    sus = smcf->upstreams.elts;
+
+    for (i = 0; i < smcf->upstreams.nelts; i++) {
+        if (sus[i].upstream == us) {
+            break;
+        }
+    }
+
+    /* the upstream is always found, it was wrapped at the configuration */
+
+    if (sus[i].init(r, us) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    sp = ngx_palloc(r->pool, sizeof(ngx_http_status_peer_data_t));
+    if (sp == NULL) {
+        return NGX_ERROR;
+    }
+
+    u = r->upstream;
+
+    sp->data = u->peer.data;
+    sp->get = u->peer.get;
+    sp->free = u->peer.free;
+
+    sp->smcf = smcf;
+    sp->upstream = &sus[i];
+    sp->counter = NGX_CONF_UNSET_UINT;
+
+    u->peer.data = sp;
+    u->peer.get = ngx_http_status_get_peer;
+    u->peer.free = ngx_http_status_free_peer;
+
+#if (NGX_HTTP_SSL)
+    sp->set_session = u->peer.set_session;
+    sp->save_session = u->peer.save_session;
+
+    u->peer.set_session = ngx_http_status_set_peer_session;
+    u->peer.save_session = ngx_http_status_save_peer_session;
+#endif
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_status_get_peer(ngx_peer_connection_t *pc, void *data)
+{
+    ngx_http_status_peer_data_t *sp = data;
+
+    ngx_int_t                          rc;
+    ngx_uint_t                         n;
+    ngx_atomic_t                      *counters;
+    ngx_http_upstream_rr_peer_data_t  *rrp;
+
+    rc = sp->get(pc, sp->data);
+
+    if (rc != NGX_OK && rc != NGX_DONE) {
+        return rc;
+    }
+
+    /* both the round robin and ip_hash data start with the round robin data */
+
+    if (sp->get != ngx_http_upstream_get_round_robin_peer
+#if (NGX_HTTP_UPSTREAM_IP_HASH)
+        && sp->get != ngx_http_upstream_get_ip_hash_peer
+#endif
+       )
+    {
+        return rc;
+    }
+
+    rrp = sp->data;
+
+    if (rrp->peers == sp->upstream->peers) {
+        n = rrp->current;
+
+    } else if (rrp->peers == sp->upstream->backup) {
+        n = sp->upstream->peers->number + rrp->current;
+
+    } else {
+        return rc;
+    }
+
+    sp->counter = sp->upstream->counter + n * NGX_HTTP_STATUS_PEER_COUNTERS;
+    sp->start = ngx_current_msec;
+
+    counters = ngx_http_status_counters(sp->smcf) + sp->counter;
+
+    ngx_http_status_add(sp->smcf, counters, NGX_HTTP_STATUS_PEER_ACTIVE, 1);
+    ngx_http_status_add(sp->smcf, counters, NGX_HTTP_STATUS_PEER_REQUESTS, 1);
+
+    return rc;
+}
+
+
+static void
+ngx_http_status_free_peer(ngx_peer_connection_t *pc, void *data,
+    ngx_uint_t state)
+{
+    ngx_http_status_peer_data_t *sp = data;
+
+    ngx_uint_t     n;
+    ngx_msec_t     ms;
+    ngx_atomic_t  *counters;
+
+    if (sp->counter != NGX_CONF_UNSET_UINT) {
+
+        counters = ngx_http_status_counters(sp->smcf) + sp->counter;
+
+        ngx_http_status_add(sp->smcf, counters, NGX_HTTP_STATUS_PEER_ACTIVE,
+                            -1);
+
+        if (state & NGX_PEER_FAILED) {
+            ngx_http_status_add(sp->smcf, counters, NGX_HTTP_STATUS_PEER_FAILS,
+                                1);
+
+        } else {
+            ms = (ngx_msec_t) (ngx_current_msec - sp->start);
+
+            for (n = 0; n < NGX_HTTP_STATUS_BUCKETS - 1; n++) {
+                if (ms <= ngx_http_status_bounds[n]) {
+                    break;
+                }
+            }
+
+            ngx_http_status_add(sp->smcf, counters,
+                                NGX_HTTP_STATUS_PEER_BUCKET + n, 1);
+            ngx_http_status_add(sp->smcf, counters, NGX_HTTP_STATUS_PEER_TIME,
+                                (ngx_atomic_int_t) ms);
+        }
+
+        sp->counter = NGX_CONF_UNSET_UINT;
+    }
+
+    sp->free(pc, sp->data, state);
+}
+
+
+#if (NGX_HTTP_SSL)
+
+static ngx_int_t
+ngx_http_status_set_peer_session(ngx_peer_connection_t *pc, void *data)
+{
+    ngx_http_status_peer_data_t *sp = data;
+
+    return sp->set_session(pc, sp->data);
+}
+
+
+static void
+ngx_http_status_save_peer_session(ngx_peer_connection_t *pc, void *data)
+{
+    ngx_http_status_peer_data_t *sp = data;
+
+    sp->save_session(pc, sp->data);
+}
+
+#endif
+
+
+static ngx_int_t
+ngx_http_status_init_zone(ngx_shm_zone_t *shm_zone, void *data)
+{
+    ngx_http_status_main_conf_t  *osmcf = data;
+
+    size_t                        size;
+    ngx_uint_t                    stride;
+    ngx_slab_pool_t              *shpool;
+    ngx_http_status_sh_t         *sh;
+    ngx_http_status_main_conf_t  *smcf;
+
+    smcf = shm_zone->data;
+
+    stride = ngx_align(smcf->ncounters, NGX_CPU_CACHE_LINE
+                                        / sizeof(ngx_atomic_t));
+
+    size = ngx_align(smcf->nslots * sizeof(ngx_atomic_t), NGX_CPU_CACHE_LINE)
+           + (smcf->nslots + 1) * stride * sizeof(ngx_atomic_t);
+
+    if (osmcf) {
+        sh = osmcf->sh;
+
+        if (sh->signature == smcf->signature
+            && sh->nslots == smcf->nslots
+            && sh->stride == stride)
+        {
+            smcf->sh = sh;
+            return NGX_OK;
+        }
+
+        /*
+         * the zone name includes the layout, so this is not expected;
+         * the old workers still update the old table, it is left intact
+         */
+    }
+
+    shpool = (ngx_slab_pool_t *) shm_zone->shm.addr;
+
+    sh = ngx_slab_alloc(shpool, sizeof(ngx_http_status_sh_t));
+    if (sh == NULL) {
+        return NGX_ERROR;
+    }
+
+    sh->owner = ngx_slab_alloc(shpool, size);
+    if (sh->owner == NULL) {
+        return NGX_ERROR;
+    }
+
+    ngx_memzero((void *) sh->owner, size);
+
+    sh->signature = smcf->signature;
+    sh->nslots = smcf->nslots;
+    sh->stride = stride;
+    sh->counters = (ngx_atomic_t *) ((u_char *) sh->owner
+                     + ngx_align(smcf->nslots * sizeof(ngx_atomic_t),
+                                 NGX_CPU_CACHE_LINE));
+
+    smcf->sh = sh;
+
+    return NGX_OK;
+}
+
+
+static char *
+ngx_http_status(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_http_status_loc_conf_t *slcf = conf;
+
+    ngx_str_t                    *value;
+    ngx_http_core_loc_conf_t     *clcf;
+    ngx_http_status_main_conf_t  *smcf;
+
+    if (slcf->format != NGX_CONF_UNSET_UINT) {
+        return "is duplicate";
+    }
+
+    slcf->format = NGX_HTTP_STATUS_JSON;
+
+    if (cf->args->nelts == 2) {
+        value = cf->args->elts;
+
+        if (ngx_strcmp(value[1].data, "prometheus") == 0) {
+            slcf->format = NGX_HTTP_STATUS_PROMETHEUS;
+
+        } else if (ngx_strcmp(value[1].data, "json") != 0) {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "invalid status format \"%V\"", &value[1]);
+            return NGX_CONF_ERROR;
+        }
+    }
+
+    smcf = ngx_http_conf_get_module_main_conf(cf, ngx_http_status_module);
+    smcf->enable = 1;
+
+    clcf = ngx_http_conf_get_module_loc_conf(cf, ngx_http_core_module);
+    clcf->handler = ngx_http_status_handler;
+
+    return NGX_CONF_OK;
+}
+
+
+static char *
+ngx_http_status_zone(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_http_status_loc_conf_t *slcf = conf;
+
+    ngx_str_t                    *value, *zone;
+    ngx_uint_t                    i;
+    ngx_http_status_main_conf_t  *smcf;
+
+    if (slcf->zone != NGX_CONF_UNSET_UINT) {
+        return "is duplicate";
+    }
+
+    value = cf->args->elts;
+
+    smcf = ngx_http_conf_get_module_main_conf(cf, ngx_http_status_module);
+    smcf->enable = 1;
+
+    zone = smcf->zones.elts;
+
+    for (i = 0; i < smcf->zones.nelts; i++) {
+        if (zone[i].len == value[1].len
+            && ngx_strncmp(zone[i].data, value[1].data, value[1].len) == 0)
+        {
+            slcf->zone = i;
+            return NGX_CONF_OK;
+        }
+    }
+
+    zone = ngx_array_push(&smcf->zones);
+    if (zone == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    *zone = value[1];
+    slcf->zone = i;
+
+    return NGX_CONF_OK;
+}
+
+
+static void *
+ngx_http_status_create_main_conf(ngx_conf_t *cf)
+{
+    ngx_http_status_main_conf_t  *smcf;
+
+    smcf = ngx_pcalloc(cf->pool, sizeof(ngx_http_status_main_conf_t));
+    if (smcf == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    /*
+     * set by ngx_pcalloc():
+     *
+     *     smcf->shm_zone = NULL;
+     *     smcf->sh = NULL;
+     *     smcf->counters = NULL;
+     *     smcf->enable = 0;
+     */
+
+    if (ngx_array_init(&smcf->zones, cf->pool, 4, sizeof(ngx_str_t))
+        != NGX_OK)
+    {
+        return NGX_CONF_ERROR;
+    }
+
+    if (ngx_array_init(&smcf->upstreams, cf->pool, 4,
+                       sizeof(ngx_http_status_upstream_t))
+        != NGX_OK)
+    {
+        return NGX_CONF_ERROR;
+    }
+
+    smcf->slot = NGX_CONF_UNSET_UINT;
+
+    return smcf;
+}
+
+
+static void *
+ngx_http_status_create_loc_conf(ngx_conf_t *cf)
+{
+    ngx_http_status_loc_conf_t  *slcf;
+
+    slcf = ngx_palloc(cf->pool, sizeof(ngx_http_status_loc_conf_t));
+    if (slcf == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    slcf->format = NGX_CONF_UNSET_UINT;
+    slcf->zone = NGX_CONF_UNSET_UINT;
+
+    return slcf;
+}
+
+
+static char *
+ngx_http_status_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child)
+{
+    ngx_http_status_loc_conf_t *prev = parent;
+    ngx_http_status_loc_conf_t *conf = child;
+
+    ngx_conf_merge_uint_value(conf->format, prev->format,
+                              NGX_HTTP_STATUS_JSON);
+    ngx_conf_merge_uint_value(conf->zone, prev->zone, NGX_CONF_UNSET_UINT);
+
+    return NGX_CONF_OK;
+}
+
+
+static ngx_int_t
+ngx_http_status_init(ngx_conf_t *cf)
+{
+    u_char                          *p;
+    size_t                           size;
+    uint32_t                         crc;
+    ngx_str_t                       *zone, name;
+    ngx_uint_t                       i, j, n;
+    ngx_shm_zone_t                  *shm_zone;
+    ngx_http_handler_pt             *h;
+    ngx_http_upstream_rr_peers_t    *peers;
+    ngx_http_status_upstream_t      *sus;
+    ngx_http_upstream_srv_conf_t   **uscfp;
+    ngx_http_core_main_conf_t       *cmcf;
+    ngx_http_status_main_conf_t     *smcf;
+    ngx_http_upstream_main_conf_t   *umcf;
+
+    smcf = ngx_http_conf_get_module_main_conf(cf, ngx_http_status_module);
+
+    if (!smcf->enable) {
+        return NGX_OK;
+    }
+
+    ngx_crc32_init(crc);
+
+    zone = smcf->zones.elts;
+
+    for (i = 0; i < smcf->zones.nelts; i++) {
+        ngx_crc32_update(&crc, zone[i].data, zone[i].len + 1);
+    }
+
+    n = smcf->zones.nelts * NGX_HTTP_STATUS_ZONE_COUNTERS;
+
+    /* wrap the round robin based upstreams */
+
+    umcf = ngx_http_conf_get_module_main_conf(cf, ngx_http_upstream_module);
+
+    uscfp = umcf->upstreams.elts;
+
+    for (i = 0; i < umcf->upstreams.nelts; i++) {
+
+        peers = uscfp[i]->peer.data;
+
+        if (peers == NULL || uscfp[i]->peer.init == NULL) {
+            continue;
+        }
+
+        sus = ngx_array_push(&smcf->upstreams);
+        if (sus == NULL) {
+            return NGX_ERROR;
+        }
+
+        sus->name = uscfp[i]->host;
+
+        if (uscfp[i]->port) {
+            sus->name.len = uscfp[i]->host.len + sizeof(":65535") - 1;
+
+            sus->name.data = ngx_palloc(cf->pool, sus->name.len);
+            if (sus->name.data == NULL) {
+                return NGX_ERROR;
+            }
+
+            p = ngx_sprintf(sus->name.data, "%V:%d",
+                            &uscfp[i]->host, (int) uscfp[i]->port);
+
+            sus->name.len = p - sus->name.data;
+        }
+
+        sus->upstream = uscfp[i];
+        sus->init = uscfp[i]->peer.init;
+        sus->peers = peers;
+        sus->backup = peers->next;
+        sus->counter = n;
+
+        uscfp[i]->peer.init = ngx_http_status_init_peer;
+
+        ngx_crc32_update(&crc, sus->name.data, sus->name.len);
+
+        for (j = 0; j < peers->number; j++) {
+            ngx_crc32_update(&crc, peers->peer[j].name.data,
+                             peers->peer[j].name.len);
+        }
+
+        n += peers->number * NGX_HTTP_STATUS_PEER_COUNTERS;
+
+        if (sus->backup) {
+            for (j = 0; j < sus->backup->number; j++) {
+                ngx_crc32_update(&crc, sus->backup->peer[j].name.data,
+                                 sus->backup->peer[j].name.len);
+            }
+
+            n += sus->backup->number * NGX_HTTP_STATUS_PEER_COUNTERS;
+        }
+    }
+
+    ngx_crc32_final(crc);
+
+    smcf->signature = crc;
+    smcf->ncounters = n;
+
+    /* a slot per worker for the CPUs and the workers of the old cycle */
+
+    smcf->nslots = 2 * ngx_ncpu;
+
+    if (smcf->nslots > NGX_HTTP_STATUS_MAX_SLOTS) {
+        smcf->nslots = NGX_HTTP_STATUS_MAX_SLOTS;
+    }
+
+    size = (smcf->nslots + 1) * (ngx_align(n, 16) + 1) * sizeof(ngx_atomic_t);
+
+    size = ngx_align(size + size / 64 + 8 * ngx_pagesize, ngx_pagesize);
+
+    /*
+     * a zone is reused on reload only if the layout of the counters is
+     * the same, otherwise the new workers get a new zone, while the old
+     * ones keep updating the old zone until they exit
+     */
+
+    name.len = sizeof("status_ffffffff_") - 1 + NGX_INT_T_LEN;
+
+    name.data = ngx_palloc(cf->pool, name.len);
+    if (name.data == NULL) {
+        return NGX_ERROR;
+    }
+
+    name.len = ngx_sprintf(name.data, "status_%08xD_%ui",
+                           smcf->signature, smcf->nslots)
+               - name.data;
+
+    shm_zone = ngx_shared_memory_add(cf, &name, size,
+                                     &ngx_http_status_module);
+    if (shm_zone == NULL) {
+        return NGX_ERROR;
+    }
+
+    shm_zone->init = ngx_http_status_init_zone;
+    shm_zone->data = smcf;
+
+    smcf->shm_zone = shm_zone;
+
+    cmcf = ngx_http_conf_get_module_main_conf(cf, ngx_http_core_module);
+
+    h = ngx_array_push(&cmcf->phases[NGX_HTTP_LOG_PHASE].handlers);
+    if (h == NULL) {
+        return NGX_ERROR;
+    }
+
+    *h = ngx_http_status_log_handler;
+
+    return NGX_OK;
+}
@@ -0,0 +1,43 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ */
+
+
+#ifndef _NGX_HTTP_STATUS_H_INCLUDED_
+#define _NGX_HTTP_STATUS_H_INCLUDED_
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+
+
+#define NGX_HTTP_STATUS_LATENCY_FIRST_BYTE        0
+#define NGX_HTTP_STATUS_LATENCY_HEADER            1
+#define NGX_HTTP_STATUS_LATENCY_UPSTREAM_CONNECT  2
+#define NGX_HTTP_STATUS_LATENCY_UPSTREAM_HEADER   3
+#define NGX_HTTP_STATUS_LATENCY_SEND              4
+#define NGX_HTTP_STATUS_LATENCY_PHASES            5
+
+
+static ngx_inline uint64_t
+ngx_http_status_usec(void)
+{
+    struct timeval  tv;
+
+    ngx_gettimeofday(&tv);
+
+    return (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+
+void ngx_http_status_cache(ngx_http_request_t *r, ngx_uint_t hit);
+void ngx_http_status_upstream_latency(ngx_http_request_t *r,
+    ngx_uint_t phase);
+
+
+extern ngx_module_t  ngx_http_status_module;
+
+
+#endif /* _NGX_HTTP_STATUS_H_INCLUDED_ */
@@ -9,6 +9,14 @@
 #include <ngx_http.h>
 
 
+typedef struct {
+    ngx_flag_t  buffers;
+} ngx_http_stub_status_loc_conf_t;
+
+
+static void *ngx_http_stub_status_create_loc_conf(ngx_conf_t *cf);
+static char *ngx_http_stub_status_merge_loc_conf(ngx_conf_t *cf,
+    void *parent, void *child);
 static char *ngx_http_set_status(ngx_conf_t *cf, ngx_command_t *cmd,
                                  void *conf);
 
@@ -21,6 +29,13 @@ static ngx_command_t  ngx_http_status_commands[] = {
       0,
       NULL },
 
+    { ngx_string("stub_status_buffers"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_FLAG,
+      ngx_conf_set_flag_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_stub_status_loc_conf_t, buffers),
+      NULL },
+
       ngx_null_command
 };
 
@@ -36,8 +51,8 @@ static ngx_http_module_t  ngx_http_stub_status_module_ctx = {
     NULL,                                  /* create server configuration */
     NULL,                                  /* merge server configuration */
 
-    NULL,                                  /* create location configuration */
-    NULL                                   /* merge location configuration */
+    ngx_http_stub_status_create_loc_conf,  /* create location configuration */
+    ngx_http_stub_status_merge_loc_conf    /* merge location configuration */
 };
 
 
@@ -65,6 +80,8 @@ static ngx_int_t ngx_http_status_handler(ngx_http_request_t *r)
     ngx_chain_t        out;
     ngx_atomic_int_t   ap, hn, ac, rq, rd, wr;
 
+    ngx_http_stub_status_loc_conf_t  *sscf;
+
     if (r->method != NGX_HTTP_GET && r->method != NGX_HTTP_HEAD) {
         return NGX_HTTP_NOT_ALLOWED;
     }
@@ -93,6 +110,12 @@ static ngx_int_t ngx_http_status_handler(ngx_http_request_t *r)
            + 6 + 3 * NGX_ATOMIC_T_LEN
            + sizeof("Reading:  Writing:  Waiting:  \n") + 3 * NGX_ATOMIC_T_LEN;
 
+    sscf = ngx_http_get_module_loc_conf(r, ngx_http_stub_status_module);
+
+    if (sscf->buffers) {
+        size += sizeof("Output buffers cached:  \n") + NGX_ATOMIC_T_LEN;
+    }
+
     b = ngx_create_temp_buf(r->pool, size);
     if (b == NULL) {
         return NGX_HTTP_INTERNAL_SERVER_ERROR;
@@ -118,6 +141,13 @@ static ngx_int_t ngx_http_status_handler(ngx_http_request_t *r)
     b->last = ngx_sprintf(b->last, "Reading: %uA Writing: %uA Waiting: %uA \n",
                           rd, wr, ac - (rd + wr));
 
+    /* the line is not shown by default to keep the output format */
+
+    if (sscf->buffers) {
+        b->last = ngx_sprintf(b->last, "Output buffers cached: %uA \n",
+                              *ngx_stat_output_cached);
+    }
+
     r->headers_out.status = NGX_HTTP_OK;
     r->headers_out.content_length_n = b->last - b->pos;
 
@@ -142,3 +172,31 @@ static char *ngx_http_set_status(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 
     return NGX_CONF_OK;
 }
+
+
+static void *
+ngx_http_stub_status_create_loc_conf(ngx_conf_t *cf)
+{
+    ngx_http_stub_status_loc_conf_t  *conf;
+
+    conf = ngx_palloc(cf->pool, sizeof(ngx_http_stub_status_loc_conf_t));
+    if (conf == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    conf->buffers = NGX_CONF_UNSET;
+
+    return conf;
+}
+
+
+static char *
+ngx_http_stub_status_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child)
+{
+    ngx_http_stub_status_loc_conf_t *prev = parent;
+    ngx_http_stub_status_loc_conf_t *conf = child;
+
+    ngx_conf_merge_value(conf->buffers, prev->buffers, 0);
+
+    return NGX_CONF_OK;
+}
@@ -13,43 +13,69 @@ typedef struct {
     ngx_str_t      match;
     ngx_str_t      sub;
 
-    ngx_array_t   *types;     /* array of ngx_str_t */
-
     ngx_array_t   *sub_lengths;
     ngx_array_t   *sub_values;
+} ngx_http_sub_match_t;
 
-    ngx_flag_t     once;
-} ngx_http_sub_loc_conf_t;
 
+/*
+ * the Aho-Corasick automaton of all match strings of a location,
+ * it is built as a DFA over the classes of the lowercased characters
+ * that occur in the match strings, the class 0 is any other character
+ */
 
-typedef enum {
-    sub_start_state = 0,
-    sub_match_state,
-} ngx_http_sub_state_e;
+typedef struct {
+    ngx_uint_t     nclasses;
+    size_t         max_len;
+
+    u_short       *next;      /* [state * nclasses + class] */
+    u_short       *depth;
+    u_short       *output;    /* the match index + 1 or 0 */
+    u_short       *dict;      /* the longest suffix state with output */
+
+    u_char         classes[256];
+} ngx_http_sub_tables_t;
 
 
 typedef struct {
-    ngx_str_t      match;
+    ngx_array_t             *matches;     /* array of ngx_http_sub_match_t */
+    ngx_http_sub_tables_t   *tables;
 
-    ngx_uint_t     once;   /* unsigned  once:1 */
+    ngx_array_t             *types;       /* array of ngx_str_t */
 
-    ngx_buf_t     *buf;
+    ngx_flag_t               once;
+} ngx_http_sub_loc_conf_t;
 
-    u_char        *pos;
-    u_char        *copy_start;
-    u_char        *copy_end;
 
-    ngx_chain_t   *in;
-    ngx_chain_t   *out;
-    ngx_chain_t  **last_out;
-    ngx_chain_t   *busy;
-    ngx_chain_t   *free;
+typedef struct {
+    ngx_http_sub_tables_t   *tables;
+    ngx_http_sub_match_t    *matches;
+    ngx_str_t               *subs;
 
-    ngx_str_t      sub;
+    u_char                  *found;       /* the once matched strings */
+    ngx_uint_t               left;
+
+    ngx_uint_t               once;   /* unsigned  once:1 */
+
+    ngx_buf_t               *buf;
 
-    ngx_uint_t     state;
-    size_t         saved;
-    size_t         looked;
+    u_char                  *pos;
+    u_char                  *copy_start;
+    u_char                  *copy_end;
+
+    ngx_chain_t             *in;
+    ngx_chain_t             *out;
+    ngx_chain_t            **last_out;
+    ngx_chain_t             *busy;
+    ngx_chain_t             *free;
+
+    ngx_uint_t               state;
+    ngx_uint_t               index;
+
+    /* the partial match bytes of the previous buffers */
+    u_char                  *saved;
+    size_t                   saved_len;
+    size_t                   flush_saved;
 } ngx_http_sub_ctx_t;
 
 
@@ -57,6 +83,10 @@ static ngx_int_t ngx_http_sub_output(ngx_http_request_t *r,
     ngx_http_sub_ctx_t *ctx);
 static ngx_int_t ngx_http_sub_parse(ngx_http_request_t *r,
     ngx_http_sub_ctx_t *ctx);
+static ngx_chain_t *ngx_http_sub_copy(ngx_http_request_t *r,
+    ngx_http_sub_ctx_t *ctx, u_char *start, u_char *end);
+static ngx_chain_t *ngx_http_sub_saved(ngx_http_request_t *r,
+    ngx_http_sub_ctx_t *ctx, size_t len);
 
 static char * ngx_http_sub_filter(ngx_conf_t *cf, ngx_command_t *cmd,
     void *conf);
@@ -64,6 +94,8 @@ static char *ngx_http_sub_types(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
 static void *ngx_http_sub_create_conf(ngx_conf_t *cf);
 static char *ngx_http_sub_merge_conf(ngx_conf_t *cf,
     void *parent, void *child);
+static ngx_int_t ngx_http_sub_init_tables(ngx_conf_t *cf,
+    ngx_http_sub_loc_conf_t *slcf);
 static ngx_int_t ngx_http_sub_filter_init(ngx_conf_t *cf);
 
 
@@ -139,7 +171,7 @@ ngx_http_sub_header_filter(ngx_http_request_t *r)
 
     slcf = ngx_http_get_module_loc_conf(r, ngx_http_sub_filter_module);
 
-    if (slcf->match.len == 0
+    if (slcf->tables == NULL
         || r->headers_out.content_type.len == 0
         || r->headers_out.content_length_n == 0)
     {
@@ -165,11 +197,30 @@ found:
         return NGX_ERROR;
     }
 
+    ctx->subs = ngx_pcalloc(r->pool, slcf->matches->nelts * sizeof(ngx_str_t));
+    if (ctx->subs == NULL) {
+        return NGX_ERROR;
+    }
+
+    ctx->saved = ngx_palloc(r->pool, slcf->tables->max_len);
+    if (ctx->saved == NULL) {
+        return NGX_ERROR;
+    }
+
+    if (slcf->once) {
+        ctx->found = ngx_pcalloc(r->pool, slcf->matches->nelts);
+        if (ctx->found == NULL) {
+            return NGX_ERROR;
+        }
+
+        ctx->left = slcf->matches->nelts;
+    }
+
     ngx_http_set_ctx(r, ctx, ngx_http_sub_filter_module);
 
-    ctx->match = slcf->match;
+    ctx->tables = slcf->tables;
+    ctx->matches = slcf->matches->elts;
     ctx->last_out = &ctx->out;
-    ctx->sub = slcf->sub;
 
     r->filter_need_in_memory = 1;
 
@@ -185,11 +236,13 @@ found:
 static ngx_int_t
 ngx_http_sub_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
 {
+    size_t                     n, keep, flush;
     ngx_int_t                  rc;
     ngx_buf_t                 *b;
+    ngx_str_t                 *sub;
     ngx_chain_t               *cl;
     ngx_http_sub_ctx_t        *ctx;
-    ngx_http_sub_loc_conf_t   *slcf;
+    ngx_http_sub_match_t      *match;
 
     ctx = ngx_http_get_module_ctx(r, ngx_http_sub_filter_module);
 
@@ -235,117 +288,61 @@ ngx_http_sub_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
             ctx->pos = ctx->buf->pos;
         }
 
-        if (ctx->state == sub_start_state) {
-            ctx->copy_start = ctx->pos;
-            ctx->copy_end = ctx->pos;
-        }
+        ctx->copy_start = ctx->pos;
 
         b = NULL;
 
         while (ctx->pos < ctx->buf->last) {
 
-            ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
-                           "saved: %d state: %d", ctx->saved, ctx->state);
-
             rc = ngx_http_sub_parse(r, ctx);
 
             ngx_log_debug4(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
-                           "parse: %d, looked: %d %p-%p",
-                           rc, ctx->looked, ctx->copy_start, ctx->copy_end);
+                           "parse: %d, saved: %uz %p-%p",
+                           rc, ctx->saved_len,
+                           ctx->copy_start, ctx->copy_end);
 
-            if (rc == NGX_ERROR) {
-                return rc;
+            if (rc == NGX_AGAIN) {
+                break;
             }
 
-            if (ctx->copy_start != ctx->copy_end) {
-
-                ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
-                               "saved: %d", ctx->saved);
-
-                if (ctx->saved) {
-
-                    if (ctx->free) {
-                        cl = ctx->free;
-                        ctx->free = ctx->free->next;
-                        b = cl->buf;
-                        ngx_memzero(b, sizeof(ngx_buf_t));
-
-                    } else {
-                        b = ngx_calloc_buf(r->pool);
-                        if (b == NULL) {
-                            return NGX_ERROR;
-                        }
-
-                        cl = ngx_alloc_chain_link(r->pool);
-                        if (cl == NULL) {
-                            return NGX_ERROR;
-                        }
-
-                        cl->buf = b;
-                    }
-
-                    b->memory = 1;
-                    b->pos = ctx->match.data;
-                    b->last = ctx->match.data + ctx->saved;
-
-                    *ctx->last_out = cl;
-                    ctx->last_out = &cl->next;
-
-                    ctx->saved = 0;
-                }
-
-                if (ctx->free) {
-                    cl = ctx->free;
-                    ctx->free = ctx->free->next;
-                    b = cl->buf;
-
-                } else {
-                    b = ngx_alloc_buf(r->pool);
-                    if (b == NULL) {
-                        return NGX_ERROR;
-                    }
-
-                    cl = ngx_alloc_chain_link(r->pool);
-                    if (cl == NULL) {
-                        return NGX_ERROR;
-                    }
+            /* rc == NGX_OK */
 
-                    cl->buf = b;
+            if (ctx->flush_saved) {
+                if (ngx_http_sub_saved(r, ctx, ctx->flush_saved) == NULL) {
+                    return NGX_ERROR;
                 }
+            }
 
-                ngx_memcpy(b, ctx->buf, sizeof(ngx_buf_t));
-
-                b->pos = ctx->copy_start;
-                b->last = ctx->copy_end;
-                b->shadow = NULL;
-                b->last_buf = 0;
-                b->recycled = 0;
+            ctx->saved_len = 0;
 
-                if (b->in_file) {
-                    b->file_last = b->file_pos + (b->last - ctx->buf->pos);
-                    b->file_pos += b->pos - ctx->buf->pos;
+            if (ctx->copy_start != ctx->copy_end) {
+                cl = ngx_http_sub_copy(r, ctx, ctx->copy_start,
+                                       ctx->copy_end);
+                if (cl == NULL) {
+                    return NGX_ERROR;
                 }
 
-                cl->next = NULL;
-                *ctx->last_out = cl;
-                ctx->last_out = &cl->next;
+                b = cl->buf;
             }
 
-            if (ctx->state == sub_start_state) {
-                ctx->copy_start = ctx->pos;
-                ctx->copy_end = ctx->pos;
+            ctx->copy_start = ctx->pos;
 
-            } else {
-                ctx->copy_start = NULL;
-                ctx->copy_end = NULL;
-            }
+            match = &ctx->matches[ctx->index];
+            sub = &ctx->subs[ctx->index];
 
-            if (rc == NGX_AGAIN) {
-                continue;
-            }
+            if (sub->data == NULL) {
 
+                if (match->sub_lengths == NULL) {
+                    *sub = match->sub;
 
-            /* rc == NGX_OK */
+                } else if (ngx_http_script_run(r, sub,
+                                               match->sub_lengths->elts, 0,
+                                               match->sub_values->elts)
+                           == NULL)
+                {
+                    return NGX_ERROR;
+                }
+            }
 
             b = ngx_calloc_buf(r->pool);
             if (b == NULL) {
@@ -357,22 +354,10 @@ ngx_http_sub_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
                 return NGX_ERROR;
             }
 
-            slcf = ngx_http_get_module_loc_conf(r, ngx_http_sub_filter_module);
-
-            if (ctx->sub.data == NULL) {
-
-                if (ngx_http_script_run(r, &ctx->sub, slcf->sub_lengths->elts,
-                                        0, slcf->sub_values->elts)
-                    == NULL)
-                {
-                    return NGX_ERROR;
-                }
-            }
-
-            if (ctx->sub.len) {
+            if (sub->len) {
                 b->memory = 1;
-                b->pos = ctx->sub.data;
-                b->last = ctx->sub.data + ctx->sub.len;
+                b->pos = sub->data;
+                b->last = sub->data + sub->len;
 
             } else {
                 b->sync = 1;
@@ -383,9 +368,60 @@ ngx_http_sub_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
             *ctx->last_out = cl;
             ctx->last_out = &cl->next;
 
-            ctx->once = slcf->once;
+            if (ctx->found && ctx->found[ctx->index] == 0) {
+                ctx->found[ctx->index] = 1;
 
-            continue;
+                if (--ctx->left == 0) {
+                    ctx->once = 1;
+                }
+            }
+        }
+
+        /*
+         * the bytes of a partial match at the end of the buffer
+         * are kept until the next buffer
+         */
+
+        n = ctx->buf->last - ctx->copy_start;
+
+        if (ctx->buf->last_buf) {
+            keep = 0;
+            ctx->state = 0;
+
+        } else {
+            keep = ctx->tables->depth[ctx->state];
+        }
+
+        flush = (keep > n) ? ctx->saved_len - (keep - n) : ctx->saved_len;
+
+        if (flush) {
+            if (ngx_http_sub_saved(r, ctx, flush) == NULL) {
+                return NGX_ERROR;
+            }
+
+            ngx_memmove(ctx->saved, ctx->saved + flush,
+                        ctx->saved_len - flush);
+            ctx->saved_len -= flush;
+        }
+
+        if (keep > n) {
+            keep = n;
+        }
+
+        if (ctx->buf->last - keep != ctx->copy_start) {
+            cl = ngx_http_sub_copy(r, ctx, ctx->copy_start,
+                                   ctx->buf->last - keep);
+            if (cl == NULL) {
+                return NGX_ERROR;
+            }
+
+            b = cl->buf;
+        }
+
+        if (keep) {
+            ngx_memcpy(ctx->saved + ctx->saved_len, ctx->buf->last - keep,
+                       keep);
+            ctx->saved_len += keep;
         }
 
         if (ctx->buf->last_buf || ngx_buf_in_memory(ctx->buf)) {
@@ -424,8 +460,6 @@ ngx_http_sub_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
         }
 
         ctx->buf = NULL;
-
-        ctx->saved = ctx->looked;
     }
 
     if (ctx->out == NULL && ctx->busy == NULL) {
@@ -436,6 +470,83 @@ ngx_http_sub_body_filter(ngx_http_request_t *r, ngx_chain_t *in)
 }
 
 
+static ngx_chain_t *
+ngx_http_sub_copy(ngx_http_request_t *r, ngx_http_sub_ctx_t *ctx,
+    u_char *start, u_char *end)
+{
+    ngx_buf_t    *b;
+    ngx_chain_t  *cl;
+
+    if (ctx->free) {
+        cl = ctx->free;
+        ctx->free = ctx->free->next;
+        b = cl->buf;
+
+    } else {
+        b = ngx_alloc_buf(r->pool);
+        if (b == NULL) {
+            return NULL;
+        }
+
+        cl = ngx_alloc_chain_link(r->pool);
+        if (cl == NULL) {
+            return NULL;
+        }
+
+        cl->buf = b;
+    }
+
+    ngx_memcpy(b, ctx->buf, sizeof(ngx_buf_t));
+
+    b->pos = start;
+    b->last = end;
+    b->shadow = NULL;
+    b->last_buf = 0;
+    b->recycled = 0;
+
+    if (b->in_file) {
+        b->file_last = b->file_pos + (b->last - ctx->buf->pos);
+        b->file_pos += b->pos - ctx->buf->pos;
+    }
+
+    cl->next = NULL;
+    *ctx->last_out = cl;
+    ctx->last_out = &cl->next;
+
+    return cl;
+}
+
+
+static ngx_chain_t *
+ngx_http_sub_saved(ngx_http_request_t *r, ngx_http_sub_ctx_t *ctx,
+    size_t len)
+{
+    ngx_buf_t    *b;
+    ngx_chain_t  *cl;
+
+    /* the saved bytes turned out not to be a match, they are sent as is */
+
+    b = ngx_create_temp_buf(r->pool, len);
+    if (b == NULL) {
+        return NULL;
+    }
+
+    b->last = ngx_cpymem(b->pos, ctx->saved, len);
+
+    cl = ngx_alloc_chain_link(r->pool);
+    if (cl == NULL) {
+        return NULL;
+    }
+
+    cl->buf = b;
+    cl->next = NULL;
+    *ctx->last_out = cl;
+    ctx->last_out = &cl->next;
+
+    return cl;
+}
+
+
 static ngx_int_t
 ngx_http_sub_output(ngx_http_request_t *r, ngx_http_sub_ctx_t *ctx)
 {
@@ -492,7 +603,9 @@ ngx_http_sub_output(ngx_http_request_t *r, ngx_http_sub_ctx_t *ctx)
 
         ctx->busy = cl->next;
 
-        if (ngx_buf_in_memory(b) || b->in_file) {
+        if (b->tag == (ngx_buf_tag_t) &ngx_http_sub_filter_module
+            || (!b->temporary && (ngx_buf_in_memory(b) || b->in_file)))
+        {
             /* add data bufs only to the free buf chain */
 
             cl->next = ctx->free;
@@ -514,114 +627,73 @@ ngx_http_sub_output(ngx_http_request_t *r, ngx_http_sub_ctx_t *ctx)
 static ngx_int_t
 ngx_http_sub_parse(ngx_http_request_t *r, ngx_http_sub_ctx_t *ctx)
 {
-    u_char                *p, *last, *copy_end, ch, match;
-    size_t                 looked;
-    ngx_http_sub_state_e   state;
+    u_char                 *p, *last, *classes;
+    size_t                  len, n;
+    u_short                *next, *output, *dict;
+    ngx_uint_t              state, m, nclasses;
+    ngx_http_sub_tables_t  *tables;
 
     if (ctx->once) {
-        ctx->copy_start = ctx->pos;
-        ctx->copy_end = ctx->buf->last;
         ctx->pos = ctx->buf->last;
-        ctx->looked = 0;
 
         ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0, "once");
 
         return NGX_AGAIN;
     }
 
+    tables = ctx->tables;
+
+    next = tables->next;
+    output = tables->output;
+    dict = tables->dict;
+    classes = tables->classes;
+    nclasses = tables->nclasses;
+
     state = ctx->state;
-    looked = ctx->looked;
     last = ctx->buf->last;
-    copy_end = ctx->copy_end;
 
     for (p = ctx->pos; p < last; p++) {
 
-        ch = *p;
-        ch = ngx_tolower(ch);
-
-        if (state == sub_start_state) {
-
-            /* the tight loop */
-
-            match = ctx->match.data[0];
-
-            for ( ;; ) {
-                if (ch == match) {
-                    copy_end = p;
-                    looked = 1;
-                    state = sub_match_state;
-
-                    goto match_started;
-                }
-
-                if (++p == last) {
-                    break;
-                }
-
-                ch = *p;
-                ch = ngx_tolower(ch);
-            }
-
-            ctx->state = state;
-            ctx->pos = p;
-            ctx->looked = looked;
-            ctx->copy_end = p;
-
-            if (ctx->copy_start == NULL) {
-                ctx->copy_start = ctx->buf->pos;
-            }
-
-            return NGX_AGAIN;
-
-        match_started:
+        state = next[state * nclasses + classes[*p]];
 
+        if (output[state] == 0 && dict[state] == 0) {
             continue;
         }
 
-        /* state == sub_match_state */
-
-        if (ch == ctx->match.data[looked]) {
-            looked++;
-
-            if (looked == ctx->match.len) {
-                if ((size_t) (p - ctx->pos) < looked) {
-                    ctx->saved = 0;
-                }
-
-                ctx->state = sub_start_state;
-                ctx->pos = p + 1;
-                ctx->looked = 0;
-                ctx->copy_end = copy_end;
+        /* the longest not yet replaced string that ends here */
 
-                if (ctx->copy_start == NULL && copy_end) {
-                    ctx->copy_start = ctx->buf->pos;
-                }
+        for (m = output[state] ? state : dict[state]; m; m = dict[m]) {
 
-                return NGX_OK;
+            if (ctx->found == NULL || ctx->found[output[m] - 1] == 0) {
+                goto found;
             }
-
-        } else if (ch == ctx->match.data[0]) {
-            copy_end = p;
-            looked = 1;
-
-        } else {
-            copy_end = p;
-            looked = 0;
-            state = sub_start_state;
         }
     }
 
     ctx->state = state;
     ctx->pos = p;
-    ctx->looked = looked;
 
-    ctx->copy_end = (state == sub_start_state) ? p : copy_end;
+    return NGX_AGAIN;
+
+found:
+
+    len = tables->depth[m];
+    n = p + 1 - ctx->copy_start;
 
-    if (ctx->copy_start == NULL && ctx->copy_end) {
-        ctx->copy_start = ctx->buf->pos;
+    if (len <= n) {
+        ctx->copy_end = p + 1 - len;
+        ctx->flush_saved = ctx->saved_len;
+
+    } else {
+        ctx->copy_end = ctx->copy_start;
+        ctx->flush_saved = ctx->saved_len - (len - n);
     }
 
-    return NGX_AGAIN;
+    ctx->index = output[m] - 1;
+    ctx->state = 0;
+    ctx->pos = p + 1;
+
+    return NGX_OK;
 }
 
 
@@ -633,15 +705,33 @@ ngx_http_sub_filter(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
     ngx_str_t                  *value;
     ngx_int_t                   n;
     ngx_uint_t                  i;
+    ngx_http_sub_match_t       *match;
     ngx_http_script_compile_t   sc;
 
-    if (slcf->match.len) {
-        return "is duplicate";
+    if (slcf->matches == NULL) {
+        slcf->matches = ngx_array_create(cf->pool, 4,
+                                         sizeof(ngx_http_sub_match_t));
+        if (slcf->matches == NULL) {
+            return NGX_CONF_ERROR;
+        }
     }
 
     value = cf->args->elts;
 
-    slcf->match = value[1];
+    /* the empty string disables the inherited substitutions */
+
+    if (value[1].len == 0) {
+        return NGX_CONF_OK;
+    }
+
+    match = ngx_array_push(slcf->matches);
+    if (match == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    ngx_memzero(match, sizeof(ngx_http_sub_match_t));
+
+    match->match = value[1];
 
     for (i = 0; i < value[1].len; i++) {
         value[1].data[i] = ngx_tolower(value[1].data[i]);
@@ -650,7 +740,7 @@ ngx_http_sub_filter(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
     n = ngx_http_script_variables_count(&value[2]);
 
     if (n == 0) {
-        slcf->sub = value[2];
+        match->sub = value[2];
         return NGX_CONF_OK;
     }
 
@@ -658,8 +748,8 @@ ngx_http_sub_filter(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 
     sc.cf = cf;
     sc.source = &value[2];
-    sc.lengths = &slcf->sub_lengths;
-    sc.values = &slcf->sub_values;
+    sc.lengths = &match->sub_lengths;
+    sc.values = &match->sub_values;
     sc.variables = n;
     sc.complete_lengths = 1;
     sc.complete_values = 1;
@@ -735,12 +825,8 @@ ngx_http_sub_create_conf(ngx_conf_t *cf)
     /*
      * set by ngx_pcalloc():
      *
-     *     conf->match.len = 0;
-     *     conf->match.data = NULL;
-     *     conf->sub.len = 0;
-     *     conf->sub.data = NULL;
-     *     conf->sub_lengths = NULL;
-     *     conf->sub_values = NULL;
+     *     conf->matches = NULL;
+     *     conf->tables = NULL;
      *     conf->types = NULL;
      */
 
@@ -759,12 +845,20 @@ ngx_http_sub_merge_conf(ngx_conf_t *cf, void *parent, void *child)
     ngx_str_t  *type;
 
     ngx_conf_merge_value(conf->once, prev->once, 1);
-    ngx_conf_merge_str_value(conf->match, prev->match, "");
 
-    if (conf->sub.data == NULL && conf->sub_lengths == NULL) {
-        conf->sub = prev->sub;
-        conf->sub_lengths = prev->sub_lengths;
-        conf->sub_values = prev->sub_values;
+    if (conf->matches == NULL) {
+
+        /* the tables of the main level are built on the first merge */
+
+        if (ngx_http_sub_init_tables(cf, prev) != NGX_OK) {
+            return NGX_CONF_ERROR;
+        }
+
+        conf->matches = prev->matches;
+        conf->tables = prev->tables;
+
+    } else if (ngx_http_sub_init_tables(cf, conf) != NGX_OK) {
+        return NGX_CONF_ERROR;
     }
 
     if (conf->types == NULL) {
@@ -791,6 +885,148 @@ ngx_http_sub_merge_conf(ngx_conf_t *cf, void *parent, void *child)
 }
 
 
+static ngx_int_t
+ngx_http_sub_init_tables(ngx_conf_t *cf, ngx_http_sub_loc_conf_t *slcf)
+{
+    u_char                 *p, ch;
+    size_t                  len;
+    u_short                *next, *fail, *queue;
+    ngx_uint_t              i, k, c, s, t, nstates, nclasses, head, tail;
+    ngx_http_sub_match_t   *match;
+    ngx_http_sub_tables_t  *tables;
+
+    if (slcf->tables || slcf->matches == NULL || slcf->matches->nelts == 0) {
+        return NGX_OK;
+    }
+
+    tables = ngx_pcalloc(cf->pool, sizeof(ngx_http_sub_tables_t));
+    if (tables == NULL) {
+        return NGX_ERROR;
+    }
+
+    match = slcf->matches->elts;
+
+    /* the character classes, a letter and its uppercase share a class */
+
+    nclasses = 1;
+    nstates = 1;
+
+    for (i = 0; i < slcf->matches->nelts; i++) {
+
+        len = match[i].match.len;
+
+        if (len > tables->max_len) {
+            tables->max_len = len;
+        }
+
+        nstates += len;
+
+        for (p = match[i].match.data; p < match[i].match.data + len; p++) {
+            ch = *p;
+
+            if (tables->classes[ch]) {
+                continue;
+            }
+
+            tables->classes[ch] = (u_char) nclasses;
+
+            if (ch >= 'a' && ch <= 'z') {
+                tables->classes[ch & ~0x20] = (u_char) nclasses;
+            }
+
+            nclasses++;
+        }
+    }
+
+    if (nstates > 0xffff) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "too long sub_filter strings");
+        return NGX_ERROR;
+    }
+
+    tables->nclasses = nclasses;
+
+    next = ngx_pcalloc(cf->pool, nstates * nclasses * sizeof(u_short));
+    tables->depth = ngx_pcalloc(cf->pool, nstates * sizeof(u_short));
+    tables->output = ngx_pcalloc(cf->pool, nstates * sizeof(u_short));
+    tables->dict = ngx_pcalloc(cf->pool, nstates * sizeof(u_short));
+
+    fail = ngx_pcalloc(cf->temp_pool, nstates * sizeof(u_short));
+    queue = ngx_palloc(cf->temp_pool, nstates * sizeof(u_short));
+
+    if (next == NULL || tables->depth == NULL || tables->output == NULL
+        || tables->dict == NULL || fail == NULL || queue == NULL)
+    {
+        return NGX_ERROR;
+    }
+
+    tables->next = next;
+
+    /* the trie, the state 0 is the root, so 0 means no transition yet */
+
+    t = 1;
+
+    for (i = 0; i < slcf->matches->nelts; i++) {
+
+        s = 0;
+
+        for (k = 0; k < match[i].match.len; k++) {
+            c = tables->classes[match[i].match.data[k]];
+
+            if (next[s * nclasses + c] == 0) {
+                next[s * nclasses + c] = (u_short) t;
+                tables->depth[t] = (u_short) (k + 1);
+                t++;
+            }
+
+            s = next[s * nclasses + c];
+        }
+
+        if (tables->output[s] == 0) {
+            tables->output[s] = (u_short) (i + 1);
+        }
+    }
+
+    /* the failure links in the breadth-first order turn the trie into DFA */
+
+    head = 0;
+    tail = 0;
+
+    for (c = 0; c < nclasses; c++) {
+        t = next[c];
+
+        if (t) {
+            fail[t] = 0;
+            queue[tail++] = (u_short) t;
+        }
+    }
+
+    while (head < tail) {
+        s = queue[head++];
+
+        for (c = 0; c < nclasses; c++) {
+            t = next[s * nclasses + c];
+
+            if (t == 0) {
+                next[s * nclasses + c] = next[fail[s] * nclasses + c];
+                continue;
+            }
+
+            fail[t] = next[fail[s] * nclasses + c];
+
+            tables->dict[t] = tables->output[fail[t]] ? fail[t]
+                                                      : tables->dict[fail[t]];
+
+            queue[tail++] = (u_short) t;
+        }
+    }
+
+    slcf->tables = tables;
+
+    return NGX_OK;
+}
+
+
 static ngx_int_t
 ngx_http_sub_filter_init(ngx_conf_t *cf)
 {
@@ -0,0 +1,416 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+
+
+/*
+ * The trace is the array of the spans allocated in the main request pool:
+ * every span is the monotonic time in microseconds since the request start
+ * and the event with its data.  The phase spans are recorded when the phase
+ * changes only, so the several handlers of one phase give one span.  When
+ * the array is full the spans are counted as dropped.
+ *
+ * The trace is written to the trace_log as one line after the request is
+ * completed if the request is sampled or is slower than trace_slow.
+ * If neither of them is set then all requests are written.
+ */
+
+
+typedef struct {
+    ngx_open_file_t           *file;
+    ngx_uint_t                 sample;
+    ngx_uint_t                 sampled;
+    ngx_msec_t                 slow;
+} ngx_http_trace_srv_conf_t;
+
+
+static void *ngx_http_trace_create_srv_conf(ngx_conf_t *cf);
+static char *ngx_http_trace_merge_srv_conf(ngx_conf_t *cf, void *parent,
+    void *child);
+static char *ngx_http_trace_log(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf);
+static char *ngx_http_trace_sample(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf);
+static ngx_int_t ngx_http_trace_init(ngx_conf_t *cf);
+
+
+static ngx_command_t  ngx_http_trace_commands[] = {
+
+    { ngx_string("trace_log"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_CONF_TAKE1,
+      ngx_http_trace_log,
+      NGX_HTTP_SRV_CONF_OFFSET,
+      0,
+      NULL },
+
+    { ngx_string("trace_sample"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_CONF_TAKE1,
+      ngx_http_trace_sample,
+      NGX_HTTP_SRV_CONF_OFFSET,
+      0,
+      NULL },
+
+    { ngx_string("trace_slow"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_msec_slot,
+      NGX_HTTP_SRV_CONF_OFFSET,
+      offsetof(ngx_http_trace_srv_conf_t, slow),
+      NULL },
+
+      ngx_null_command
+};
+
+
+static ngx_http_module_t  ngx_http_trace_module_ctx = {
+    NULL,                                  /* preconfiguration */
+    ngx_http_trace_init,                   /* postconfiguration */
+
+    NULL,                                  /* create main configuration */
+    NULL,                                  /* init main configuration */
+
+    ngx_http_trace_create_srv_conf,        /* create server configuration */
+    ngx_http_trace_merge_srv_conf,         /* merge server configuration */
+
+    NULL,                                  /* create location configuration */
+    NULL                                   /* merge location configuration */
+};
+
+
+ngx_module_t  ngx_http_trace_module = {
+    NGX_MODULE_V1,
+    &ngx_http_trace_module_ctx,            /* module context */
+    ngx_http_trace_commands,               /* module directives */
+    NGX_HTTP_MODULE,                       /* module type */
+    NULL,                                  /* init master */
+    NULL,                                  /* init module */
+    NULL,                                  /* init process */
+    NULL,                                  /* init thread */
+    NULL,                                  /* exit thread */
+    NULL,                                  /* exit process */
+    NULL,                                  /* exit master */
+    NGX_MODULE_V1_PADDING
+};
+
+
+static ngx_str_t  ngx_http_trace_phases[] = {
+    ngx_string("post_read"),
+    ngx_string("server_rewrite"),
+    ngx_string("find_config"),
+    ngx_string("rewrite"),
+    ngx_string("post_rewrite"),
+    ngx_string("preaccess"),
+    ngx_string("access"),
+    ngx_string("post_access"),
+    ngx_string("try_files"),
+    ngx_string("content"),
+    ngx_string("log")
+};
+
+
+static ngx_str_t  ngx_http_trace_events[] = {
+    ngx_null_string,
+    ngx_null_string,
+    ngx_string("body"),
+    ngx_string("upstream_connect"),
+    ngx_string("upstream_send"),
+    ngx_string("upstream_header"),
+    ngx_string("upstream_next"),
+    ngx_string("upstream_done"),
+    ngx_string("pipe_read"),
+    ngx_string("pipe_write")
+};
+
+
+void
+ngx_http_trace_add(ngx_http_trace_t *trace, ngx_uint_t event, uint64_t data)
+{
+    ngx_http_trace_span_t  *span;
+
+    if (event == NGX_HTTP_TRACE_PHASE && trace->nspans) {
+        span = &trace->spans[trace->nspans - 1];
+
+        if (span->event == NGX_HTTP_TRACE_PHASE && span->data == data) {
+            return;
+        }
+    }
+
+    if (trace->nspans == NGX_HTTP_TRACE_SPANS) {
+        trace->dropped++;
+        return;
+    }
+
+    span = &trace->spans[trace->nspans++];
+
+    span->usec = (uint32_t) (ngx_monotonic_usec() - trace->start);
+    span->event = (uint32_t) event;
+    span->data = data;
+}
+
+
+static ngx_int_t
+ngx_http_trace_start_handler(ngx_http_request_t *r)
+{
+    ngx_time_t                 *tp;
+    ngx_msec_int_t              ms;
+    ngx_http_trace_t           *trace;
+    ngx_http_trace_srv_conf_t  *tscf;
+
+    if (r != r->main || r->trace) {
+        return NGX_DECLINED;
+    }
+
+    tscf = ngx_http_get_module_srv_conf(r, ngx_http_trace_module);
+
+    if (tscf->file == NULL) {
+        return NGX_DECLINED;
+    }
+
+    trace = ngx_palloc(r->pool, sizeof(ngx_http_trace_t));
+    if (trace == NULL) {
+        return NGX_DECLINED;
+    }
+
+    /* the spans are counted from the start of the request reading */
+
+    tp = ngx_timeofday();
+
+    ms = (ngx_msec_int_t)
+             ((tp->sec - r->start_sec) * 1000 + (tp->msec - r->start_msec));
+    ms = (ms >= 0) ? ms : 0;
+
+    trace->start = ngx_monotonic_usec() - (uint64_t) ms * 1000;
+    trace->nspans = 0;
+    trace->dropped = 0;
+
+    r->trace = trace;
+
+    ngx_http_trace_add(trace, NGX_HTTP_TRACE_PHASE, NGX_HTTP_POST_READ_PHASE);
+
+    return NGX_DECLINED;
+}
+
+
+static ngx_int_t
+ngx_http_trace_log_handler(ngx_http_request_t *r)
+{
+    u_char                     *line, *p;
+    size_t                      len;
+    uint64_t                    total;
+    ngx_str_t                  *name;
+    ngx_uint_t                  i, status;
+    ngx_http_trace_t           *trace;
+    ngx_http_trace_span_t      *span;
+    ngx_http_trace_srv_conf_t  *tscf;
+
+    trace = r->trace;
+
+    if (trace == NULL) {
+        return NGX_OK;
+    }
+
+    r->trace = NULL;
+
+    total = ngx_monotonic_usec() - trace->start;
+
+    tscf = ngx_http_get_module_srv_conf(r, ngx_http_trace_module);
+
+    if (tscf->file == NULL) {
+        return NGX_OK;
+    }
+
+    if (tscf->sample || tscf->slow) {
+
+        if (!(tscf->slow && total >= (uint64_t) tscf->slow * 1000)
+            && !(tscf->sample && tscf->sampled++ % tscf->sample == 0))
+        {
+            return NGX_OK;
+        }
+    }
+
+    status = r->err_status ? r->err_status : r->headers_out.status;
+
+    len = ngx_cached_http_log_time.len + sizeof(" *\"\" ") - 1
+          + NGX_ATOMIC_T_LEN + r->request_line.len + NGX_INT_T_LEN
+          + 1 + NGX_INT64_LEN + sizeof(".000000") - 1
+          + trace->nspans * (sizeof(" upstream_connect:@.000000") - 1
+                             + NGX_INT64_LEN * 2)
+          + sizeof(" dropped:") - 1 + NGX_INT_T_LEN + 1;
+
+    line = ngx_palloc(r->pool, len);
+    if (line == NULL) {
+        return NGX_ERROR;
+    }
+
+    p = ngx_cpymem(line, ngx_cached_http_log_time.data,
+                   ngx_cached_http_log_time.len);
+
+    p = ngx_sprintf(p, " *%uA \"%V\" %ui %uL.%06uL",
+                    r->connection->number, &r->request_line, status,
+                    total / 1000000, total % 1000000);
+
+    for (i = 0; i < trace->nspans; i++) {
+        span = &trace->spans[i];
+
+        if (span->event == NGX_HTTP_TRACE_PHASE) {
+            name = &ngx_http_trace_phases[span->data];
+            p = ngx_sprintf(p, " %V", name);
+
+        } else {
+            name = &ngx_http_trace_events[span->event];
+
+            if (span->data) {
+                p = ngx_sprintf(p, " %V:%uL", name, span->data);
+
+            } else {
+                p = ngx_sprintf(p, " %V", name);
+            }
+        }
+
+        p = ngx_sprintf(p, "@%uD.%06uD",
+                        span->usec / 1000000, span->usec % 1000000);
+    }
+
+    if (trace->dropped) {
+        p = ngx_sprintf(p, " dropped:%ui", trace->dropped);
+    }
+
+    *p++ = LF;
+
+    (void) ngx_write_fd(tscf->file->fd, line, p - line);
+
+    return NGX_OK;
+}
+
+
+static void *
+ngx_http_trace_create_srv_conf(ngx_conf_t *cf)
+{
+    ngx_http_trace_srv_conf_t  *conf;
+
+    conf = ngx_pcalloc(cf->pool, sizeof(ngx_http_trace_srv_conf_t));
+    if (conf == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    /*
+     * set by ngx_pcalloc():
+     *
+     *     conf->sampled = 0;
+     */
+
+    conf->file = NGX_CONF_UNSET_PTR;
+    conf->sample = NGX_CONF_UNSET_UINT;
+    conf->slow = NGX_CONF_UNSET_MSEC;
+
+    return conf;
+}
+
+
+static char *
+ngx_http_trace_merge_srv_conf(ngx_conf_t *cf, void *parent, void *child)
+{
+    ngx_http_trace_srv_conf_t *prev = parent;
+    ngx_http_trace_srv_conf_t *conf = child;
+
+    ngx_conf_merge_ptr_value(conf->file, prev->file, NULL);
+    ngx_conf_merge_uint_value(conf->sample, prev->sample, 0);
+    ngx_conf_merge_msec_value(conf->slow, prev->slow, 0);
+
+    return NGX_CONF_OK;
+}
+
+
+static char *
+ngx_http_trace_log(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_http_trace_srv_conf_t *tscf = conf;
+
+    ngx_str_t  *value;
+
+    if (tscf->file != NGX_CONF_UNSET_PTR) {
+        return "is duplicate";
+    }
+
+    value = cf->args->elts;
+
+    if (ngx_strcmp(value[1].data, "off") == 0) {
+        tscf->file = NULL;
+        return NGX_CONF_OK;
+    }
+
+    tscf->file = ngx_conf_open_file(cf->cycle, &value[1]);
+    if (tscf->file == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    return NGX_CONF_OK;
+}
+
+
+static char *
+ngx_http_trace_sample(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_http_trace_srv_conf_t *tscf = conf;
+
+    ngx_int_t   n;
+    ngx_str_t  *value;
+
+    if (tscf->sample != NGX_CONF_UNSET_UINT) {
+        return "is duplicate";
+    }
+
+    value = cf->args->elts;
+
+    if (value[1].len <= 2 || ngx_strncmp(value[1].data, "1/", 2) != 0) {
+        goto invalid;
+    }
+
+    n = ngx_atoi(value[1].data + 2, value[1].len - 2);
+
+    if (n == NGX_ERROR || n == 0) {
+        goto invalid;
+    }
+
+    tscf->sample = n;
+
+    return NGX_CONF_OK;
+
+invalid:
+
+    ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                       "invalid sample rate \"%V\"", &value[1]);
+
+    return NGX_CONF_ERROR;
+}
+
+
+static ngx_int_t
+ngx_http_trace_init(ngx_conf_t *cf)
+{
+    ngx_http_handler_pt        *h;
+    ngx_http_core_main_conf_t  *cmcf;
+
+    cmcf = ngx_http_conf_get_module_main_conf(cf, ngx_http_core_module);
+
+    h = ngx_array_push(&cmcf->phases[NGX_HTTP_POST_READ_PHASE].handlers);
+    if (h == NULL) {
+        return NGX_ERROR;
+    }
+
+    *h = ngx_http_trace_start_handler;
+
+    h = ngx_array_push(&cmcf->phases[NGX_HTTP_LOG_PHASE].handlers);
+    if (h == NULL) {
+        return NGX_ERROR;
+    }
+
+    *h = ngx_http_trace_log_handler;
+
+    return NGX_OK;
+}
@@ -0,0 +1,60 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ */
+
+
+#ifndef _NGX_HTTP_TRACE_H_INCLUDED_
+#define _NGX_HTTP_TRACE_H_INCLUDED_
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+
+
+#define NGX_HTTP_TRACE_PHASE             1
+#define NGX_HTTP_TRACE_BODY              2
+#define NGX_HTTP_TRACE_UPSTREAM_CONNECT  3
+#define NGX_HTTP_TRACE_UPSTREAM_SEND     4
+#define NGX_HTTP_TRACE_UPSTREAM_HEADER   5
+#define NGX_HTTP_TRACE_UPSTREAM_NEXT     6
+#define NGX_HTTP_TRACE_UPSTREAM_DONE     7
+#define NGX_HTTP_TRACE_PIPE_READ         8
+#define NGX_HTTP_TRACE_PIPE_WRITE        9
+
+
+#define NGX_HTTP_TRACE_SPANS             64
+
+
+typedef struct {
+    uint32_t                  usec;
+    uint32_t                  event;
+    uint64_t                  data;
+} ngx_http_trace_span_t;
+
+
+struct ngx_http_trace_s {
+    uint64_t                  start;
+    ngx_uint_t                nspans;
+    ngx_uint_t                dropped;
+    ngx_http_trace_span_t     spans[NGX_HTTP_TRACE_SPANS];
+};
+
+
+#define ngx_http_trace(r, ev, data)                                           \
+    do {                                                                      \
+        if ((r)->main->trace) {                                               \
+            ngx_http_trace_add((r)->main->trace, ev, data);                   \
+        }                                                                     \
+    } while (0)
+
+
+void ngx_http_trace_add(ngx_http_trace_t *trace, ngx_uint_t event,
+    uint64_t data);
+
+
+extern ngx_module_t  ngx_http_trace_module;
+
+
+#endif /* _NGX_HTTP_TRACE_H_INCLUDED_ */
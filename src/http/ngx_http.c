@@ -438,6 +438,7 @@ ngx_http_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
             find_config_index = n;
 
             ph->checker = ngx_http_core_find_config_phase;
+            ph->phase = i;
             n++;
             ph++;
 
@@ -455,6 +456,7 @@ ngx_http_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
             if (use_rewrite) {
                 ph->checker = ngx_http_core_post_rewrite_phase;
                 ph->next = find_config_index;
+                ph->phase = i;
                 n++;
                 ph++;
             }
@@ -470,6 +472,7 @@ ngx_http_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
             if (use_access) {
                 ph->checker = ngx_http_core_post_access_phase;
                 ph->next = n;
+                ph->phase = i;
                 ph++;
             }
 
@@ -478,6 +481,7 @@ ngx_http_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
         case NGX_HTTP_TRY_FILES_PHASE:
             if (cmcf->try_files) {
                 ph->checker = ngx_http_core_try_files_phase;
+                ph->phase = i;
                 n++;
                 ph++;
             }
@@ -498,6 +502,7 @@ ngx_http_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
             ph->checker = checker;
             ph->handler = h[j];
             ph->next = n;
+            ph->phase = i;
             ph++;
         }
     }
@@ -16,6 +16,7 @@
 typedef struct ngx_http_request_s   ngx_http_request_t;
 typedef struct ngx_http_upstream_s  ngx_http_upstream_t;
 typedef struct ngx_http_log_ctx_s   ngx_http_log_ctx_t;
+typedef struct ngx_http_trace_s     ngx_http_trace_t;
 
 typedef ngx_int_t (*ngx_http_header_handler_pt)(ngx_http_request_t *r,
     ngx_table_elt_t *h, ngx_uint_t offset);
@@ -44,6 +45,12 @@ typedef u_char *(*ngx_http_log_handler_pt)(ngx_http_request_t *r,
 #if (NGX_HTTP_SSL)
 #include <ngx_http_ssl_module.h>
 #endif
+#if (NGX_HTTP_STATUS)
+#include <ngx_http_status_module.h>
+#endif
+#if (NGX_HTTP_TRACING)
+#include <ngx_http_trace_module.h>
+#endif
 
 
 struct ngx_http_log_ctx_s {
@@ -75,6 +75,7 @@ static char *ngx_http_core_internal(ngx_conf_t *cf, ngx_command_t *cmd,
 static char *ngx_http_core_resolver(ngx_conf_t *cf, ngx_command_t *cmd,
     void *conf);
 #if (NGX_HTTP_GZIP)
+static ngx_uint_t ngx_http_gzip_quantity(u_char **pos, u_char *last);
 static char *ngx_http_gzip_disable(ngx_conf_t *cf, ngx_command_t *cmd,
     void *conf);
 #endif
@@ -433,6 +434,13 @@ static ngx_command_t  ngx_http_core_commands[] = {
       offsetof(ngx_http_core_loc_conf_t, keepalive_requests),
       NULL },
 
+    { ngx_string("max_ranges"),
+      NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_num_slot,
+      NGX_HTTP_LOC_CONF_OFFSET,
+      offsetof(ngx_http_core_loc_conf_t, max_ranges),
+      NULL },
+
     { ngx_string("satisfy"),
       NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
       ngx_conf_set_enum_slot,
@@ -764,6 +772,10 @@ ngx_http_core_run_phases(ngx_http_request_t *r)
 
     while (ph[r->phase_handler].checker) {
 
+#if (NGX_HTTP_TRACING)
+        ngx_http_trace(r, NGX_HTTP_TRACE_PHASE, ph[r->phase_handler].phase);
+#endif
+
         rc = ph[r->phase_handler].checker(r, &ph[r->phase_handler]);
 
         if (rc == NGX_OK) {
@@ -1277,6 +1289,7 @@ ngx_http_update_location_config(ngx_http_request_t *r)
 
     if (r == r->main) {
         r->connection->log->file = clcf->err_log->file;
+        r->connection->log->syslog = clcf->err_log->syslog;
 
         if (!(r->connection->log->log_level & NGX_LOG_DEBUG_CONNECTION)) {
             r->connection->log->log_level = clcf->err_log->log_level;
@@ -1775,11 +1788,10 @@ ngx_http_gzip_ok(ngx_http_request_t *r)
 
     r->gzip = 2;
 
+    /* the encodings themselves are tested by ngx_http_gzip_accept() */
+
     if (r != r->main
         || r->headers_in.accept_encoding == NULL
-        || ngx_strcasestrn(r->headers_in.accept_encoding->value.data,
-                           "gzip", 4 - 1)
-           == NULL
 
         /*
          * if the URL (without the "http://" prefix) is longer than 253 bytes,
@@ -1909,6 +1921,120 @@ ok:
     return NGX_OK;
 }
 
+
+/*
+ * ngx_http_gzip_accept() returns the quality of the encoding in the
+ * "Accept-Encoding" header multiplied by 1000, or 0 if the encoding
+ * is not acceptable; "*" matches the encodings that are not listed
+ */
+
+ngx_uint_t
+ngx_http_gzip_accept(ngx_http_request_t *r, ngx_str_t *encoding)
+{
+    u_char      *p, *last, *name;
+    size_t       len;
+    ngx_uint_t   q, any;
+
+    if (r->headers_in.accept_encoding == NULL) {
+        return 0;
+    }
+
+    p = r->headers_in.accept_encoding->value.data;
+    last = p + r->headers_in.accept_encoding->value.len;
+
+    any = 0;
+
+    while (p < last) {
+
+        while (p < last && (*p == ' ' || *p == ',')) {
+            p++;
+        }
+
+        name = p;
+
+        while (p < last && *p != ' ' && *p != ',' && *p != ';') {
+            p++;
+        }
+
+        len = p - name;
+
+        q = ngx_http_gzip_quantity(&p, last);
+
+        if (len == encoding->len
+            && ngx_strncasecmp(name, encoding->data, len) == 0)
+        {
+            return q;
+        }
+
+        if (len == 1 && *name == '*') {
+            any = q;
+        }
+    }
+
+    return any;
+}
+
+
+static ngx_uint_t
+ngx_http_gzip_quantity(u_char **pos, u_char *last)
+{
+    u_char      *p;
+    ngx_uint_t   q, n, scale;
+
+    p = *pos;
+    q = 1000;
+
+    while (p < last && *p != ',') {
+
+        if (*p != ';') {
+            p++;
+            continue;
+        }
+
+        p++;
+
+        while (p < last && *p == ' ') {
+            p++;
+        }
+
+        if (last - p < 3 || (p[0] != 'q' && p[0] != 'Q') || p[1] != '=') {
+            continue;
+        }
+
+        p += 2;
+
+        /* "0", "0.5", "1", "1.000" */
+
+        if (*p < '0' || *p > '1') {
+            continue;
+        }
+
+        q = (*p++ - '0') * 1000;
+
+        if (p < last && *p == '.') {
+            p++;
+
+            for (scale = 100, n = 0; scale && p < last; scale /= 10, p++) {
+                if (*p < '0' || *p > '9') {
+                    break;
+                }
+
+                n += (*p - '0') * scale;
+            }
+
+            q += n;
+        }
+
+        if (q > 1000) {
+            q = 1000;
+        }
+    }
+
+    *pos = p;
+
+    return q;
+}
+
 #endif
 
 
@@ -2008,6 +2134,7 @@ ngx_http_subrequest(ngx_http_request_t *r,
     sr->port_text = r->port_text;
 
     sr->variables = r->variables;
+    sr->variables_deps = r->variables_deps;
 
     sr->log_handler = r->log_handler;
 
@@ -2922,6 +3049,7 @@ ngx_http_core_create_loc_conf(ngx_conf_t *cf)
     lcf->keepalive_timeout = NGX_CONF_UNSET_MSEC;
     lcf->keepalive_header = NGX_CONF_UNSET;
     lcf->keepalive_requests = NGX_CONF_UNSET_UINT;
+    lcf->max_ranges = NGX_CONF_UNSET_UINT;
     lcf->lingering_time = NGX_CONF_UNSET_MSEC;
     lcf->lingering_timeout = NGX_CONF_UNSET_MSEC;
     lcf->resolver_timeout = NGX_CONF_UNSET_MSEC;
@@ -3118,6 +3246,8 @@ ngx_http_core_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child)
                               prev->keepalive_header, 0);
     ngx_conf_merge_uint_value(conf->keepalive_requests,
                               prev->keepalive_requests, 100);
+    ngx_conf_merge_uint_value(conf->max_ranges, prev->max_ranges,
+                              NGX_MAX_UINT32_VALUE);
     ngx_conf_merge_msec_value(conf->lingering_time,
                               prev->lingering_time, 30000);
     ngx_conf_merge_msec_value(conf->lingering_timeout,
@@ -3963,11 +4093,36 @@ ngx_http_core_error_log(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 {
     ngx_http_core_loc_conf_t *lcf = conf;
 
-    lcf->err_log = ngx_log_create_errlog(cf->cycle, cf->args);
+    ngx_str_t  *value;
+
+    value = cf->args->elts;
+
+    if (ngx_strncmp(value[1].data, "syslog:", 7) != 0) {
+        lcf->err_log = ngx_log_create_errlog(cf->cycle, cf->args);
+        if (lcf->err_log == NULL) {
+            return NGX_CONF_ERROR;
+        }
+
+        return ngx_set_error_log_levels(cf, lcf->err_log);
+    }
+
+    /*
+     * the messages go to the syslog only, so no file is opened: the file
+     * of the main error log is used where a log must have one
+     */
+
+    lcf->err_log = ngx_pcalloc(cf->pool, sizeof(ngx_log_t));
     if (lcf->err_log == NULL) {
         return NGX_CONF_ERROR;
     }
 
+    lcf->err_log->file = cf->cycle->new_log->file;
+
+    lcf->err_log->syslog = ngx_log_create_syslog(cf, &value[1]);
+    if (lcf->err_log->syslog == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
     return ngx_set_error_log_levels(cf, lcf->err_log);
 }
 
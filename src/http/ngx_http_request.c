@@ -193,6 +193,10 @@ ngx_http_init_connection(ngx_connection_t *c)
 
     c->log_error = NGX_ERROR_INFO;
 
+#if (NGX_HTTP_STATUS)
+    c->start_usec = ngx_http_status_usec();
+#endif
+
     rev = c->read;
     rev->handler = ngx_http_init_request;
     c->write->handler = ngx_http_empty_handler;
@@ -380,6 +384,7 @@ ngx_http_init_request(ngx_event_t *rev)
 
     clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
     c->log->file = clcf->err_log->file;
+    c->log->syslog = clcf->err_log->syslog;
     if (!(c->log->log_level & NGX_LOG_DEBUG_CONNECTION)) {
         c->log->log_level = clcf->err_log->log_level;
     }
@@ -427,6 +432,15 @@ ngx_http_init_request(ngx_event_t *rev)
         return;
     }
 
+    if (cmcf->dependent_variables) {
+        r->variables_deps = ngx_palloc(r->pool, cmcf->variables.nelts
+                                          * sizeof(ngx_http_variable_deps_t));
+        if (r->variables_deps == NULL) {
+            ngx_http_close_request(r, NGX_HTTP_INTERNAL_SERVER_ERROR);
+            return;
+        }
+    }
+
     c->single_connection = 1;
     c->destroyed = 0;
 
@@ -436,6 +450,10 @@ ngx_http_init_request(ngx_event_t *rev)
     r->start_sec = tp->sec;
     r->start_msec = tp->msec;
 
+#if (NGX_HTTP_STATUS)
+    r->start_usec = ngx_http_status_usec();
+#endif
+
     r->method = NGX_HTTP_UNKNOWN;
 
     r->headers_in.content_length_n = -1;
@@ -1495,6 +1513,10 @@ ngx_http_process_request(ngx_http_request_t *r)
     r->stat_writing = 1;
 #endif
 
+#if (NGX_HTTP_STATUS)
+    r->header_usec = ngx_http_status_usec();
+#endif
+
     c->read->handler = ngx_http_request_handler;
     c->write->handler = ngx_http_request_handler;
     r->read_event_handler = ngx_http_block_reading;
@@ -1641,6 +1663,7 @@ found:
 
     clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
     r->connection->log->file = clcf->err_log->file;
+    r->connection->log->syslog = clcf->err_log->syslog;
 
     if (!(r->connection->log->log_level & NGX_LOG_DEBUG_CONNECTION)) {
         r->connection->log->log_level = clcf->err_log->log_level;
@@ -353,6 +353,16 @@ struct ngx_http_request_s {
     time_t                            start_sec;
     ngx_msec_t                        start_msec;
 
+#if (NGX_HTTP_STATUS)
+    uint64_t                          start_usec;
+    uint64_t                          header_usec;
+    uint64_t                          first_byte_usec;
+#endif
+
+#if (NGX_HTTP_TRACING)
+    ngx_http_trace_t                 *trace;
+#endif
+
     ngx_uint_t                        method;
     ngx_uint_t                        http_version;
 
@@ -381,6 +391,7 @@ struct ngx_http_request_s {
     ngx_uint_t                        access_code;
 
     ngx_http_variable_value_t        *variables;
+    ngx_http_variable_deps_t         *variables_deps;
 
     size_t                            limit_rate;
 
@@ -150,6 +150,11 @@ ngx_http_read_client_request_body(ngx_http_request_t *r,
                 }
             }
 
+#if (NGX_HTTP_TRACING)
+            ngx_http_trace(r, NGX_HTTP_TRACE_BODY,
+                           r->headers_in.content_length_n);
+#endif
+
             post_handler(r);
 
             return NGX_OK;
@@ -375,6 +380,10 @@ ngx_http_do_read_client_request_body(ngx_http_request_t *r)
         rb->bufs = rb->bufs->next;
     }
 
+#if (NGX_HTTP_TRACING)
+    ngx_http_trace(r, NGX_HTTP_TRACE_BODY, r->headers_in.content_length_n);
+#endif
+
     rb->post_handler(r);
 
     return NGX_OK;
@@ -37,7 +37,7 @@ ngx_http_script_compile(ngx_http_script_compile_t *sc)
     ngx_int_t                             index, *p;
     ngx_str_t                             name;
     uintptr_t                            *code;
-    ngx_uint_t                            i, n, bracket;
+    ngx_uint_t                            i, n, bracket, literal;
     ngx_http_script_var_code_t           *var_code;
     ngx_http_script_copy_code_t          *copy;
     ngx_http_script_copy_capture_code_t  *copy_capture;
@@ -79,6 +79,13 @@ ngx_http_script_compile(ngx_http_script_compile_t *sc)
 
     sc->variables = 0;
 
+    /*
+     * the lengths of all literal parts are constant, so they are folded
+     * into the single length code, "literal" is its offset in the lengths
+     */
+
+    literal = NGX_CONF_UNSET_UINT;
+
     for (i = 0; i < sc->source->len; /* void */ ) {
 
         name.len = 0;
@@ -265,15 +272,25 @@ ngx_http_script_compile(ngx_http_script_compile_t *sc)
 
         sc->size += name.len;
 
-        copy = ngx_http_script_add_code(*sc->lengths,
-                                        sizeof(ngx_http_script_copy_code_t),
-                                        NULL);
-        if (copy == NULL) {
-            return NGX_ERROR;
-        }
+        if (literal != NGX_CONF_UNSET_UINT) {
+            copy = (ngx_http_script_copy_code_t *)
+                       ((u_char *) (*sc->lengths)->elts + literal);
+            copy->len += name.len;
 
-        copy->code = (ngx_http_script_code_pt) ngx_http_script_copy_len_code;
-        copy->len = name.len;
+        } else {
+            literal = (*sc->lengths)->nelts;
+
+            copy = ngx_http_script_add_code(*sc->lengths,
+                                           sizeof(ngx_http_script_copy_code_t),
+                                           NULL);
+            if (copy == NULL) {
+                return NGX_ERROR;
+            }
+
+            copy->code = (ngx_http_script_code_pt)
+                                                 ngx_http_script_copy_len_code;
+            copy->len = name.len;
+        }
 
         size = (sizeof(ngx_http_script_copy_code_t) + name.len
                    + sizeof(uintptr_t) - 1)
@@ -328,6 +345,7 @@ ngx_http_script_run(ngx_http_request_t *r, ngx_str_t *value,
     ngx_http_script_code_pt       code;
     ngx_http_script_len_code_pt   lcode;
     ngx_http_script_engine_t      e;
+    ngx_http_variable_value_t    *regs[NGX_HTTP_SCRIPT_REGS];
     ngx_http_core_main_conf_t    *cmcf;
 
     cmcf = ngx_http_get_module_main_conf(r, ngx_http_core_module);
@@ -344,6 +362,7 @@ ngx_http_script_run(ngx_http_request_t *r, ngx_str_t *value,
     e.ip = code_lengths;
     e.request = r;
     e.flushed = 1;
+    e.regs = regs;
 
     while (*(uintptr_t *) e.ip) {
         lcode = *(ngx_http_script_len_code_pt *) e.ip;
@@ -475,6 +494,10 @@ ngx_http_script_copy_var_len_code(ngx_http_script_engine_t *e)
         value = ngx_http_get_flushed_variable(e->request, code->index);
     }
 
+    if (e->regs && e->nregs < NGX_HTTP_SCRIPT_REGS) {
+        e->regs[e->nregs++] = value;
+    }
+
     if (value && !value->not_found) {
         return value->len;
     }
@@ -493,13 +516,24 @@ ngx_http_script_copy_var_code(ngx_http_script_engine_t *e)
 
     e->ip += sizeof(ngx_http_script_var_code_t);
 
+    if (e->reg < e->nregs) {
+        value = e->regs[e->reg++];
+
+    } else {
+        value = NULL;
+    }
+
     if (!e->skip) {
 
-        if (e->flushed) {
-            value = ngx_http_get_indexed_variable(e->request, code->index);
+        if (value == NULL) {
+            if (e->flushed) {
+                value = ngx_http_get_indexed_variable(e->request,
+                                                      code->index);
 
-        } else {
-            value = ngx_http_get_flushed_variable(e->request, code->index);
+            } else {
+                value = ngx_http_get_flushed_variable(e->request,
+                                                      code->index);
+            }
         }
 
         if (value && !value->not_found) {
@@ -707,6 +741,7 @@ ngx_http_script_regex_start_code(ngx_http_script_engine_t *e)
 
     if (code->lengths == NULL) {
         e->buf.len = code->size;
+        e->nregs = 0;
 
         if (code->uri) {
             if (rc && (r->quoted_uri || r->plus_in_uri)) {
@@ -728,6 +763,7 @@ ngx_http_script_regex_start_code(ngx_http_script_engine_t *e)
         le.captures = e->captures;
         le.ncaptures = e->ncaptures;
         le.quote = code->redirect;
+        le.regs = e->regs;
 
         len = 0;
 
@@ -738,6 +774,8 @@ ngx_http_script_regex_start_code(ngx_http_script_engine_t *e)
 
         e->buf.len = len;
         e->is_args = le.is_args;
+        e->nregs = le.nregs;
+        e->reg = 0;
     }
 
     if (code->add_args && r->args.len) {
@@ -1125,11 +1163,15 @@ ngx_http_script_complex_value_code(ngx_http_script_engine_t *e)
     le.captures = e->captures;
     le.ncaptures = e->ncaptures;
     le.quote = e->quote;
+    le.regs = e->regs;
 
     for (len = 0; *(uintptr_t *) le.ip; len += lcode(&le)) {
         lcode = *(ngx_http_script_len_code_pt *) le.ip;
     }
 
+    e->nregs = le.nregs;
+    e->reg = 0;
+
     e->buf.len = len;
     e->buf.data = ngx_palloc(e->request->pool, len);
     if (e->buf.data == NULL) {
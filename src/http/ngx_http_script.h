@@ -13,11 +13,22 @@
 #include <ngx_http.h>
 
 
+#define NGX_HTTP_SCRIPT_REGS  16
+
+
 typedef struct {
     u_char                     *ip;
     u_char                     *pos;
     ngx_http_variable_value_t  *sp;
 
+    /*
+     * the variable values fetched by the lengths codes are kept
+     * in the registers and are reused by the values codes
+     */
+    ngx_http_variable_value_t **regs;
+    ngx_uint_t                  nregs;
+    ngx_uint_t                  reg;
+
     ngx_str_t                   buf;
     ngx_str_t                   line;
 
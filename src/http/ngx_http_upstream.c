@@ -669,6 +669,14 @@ ngx_http_upstream_connect(ngx_http_request_t *r, ngx_http_upstream_t *u)
     u->state->response_sec = tp->sec;
     u->state->response_msec = tp->msec;
 
+#if (NGX_HTTP_STATUS)
+    u->start_usec = ngx_http_status_usec();
+#endif
+
+#if (NGX_HTTP_TRACING)
+    ngx_http_trace(r, NGX_HTTP_TRACE_UPSTREAM_CONNECT, u->peer.tries);
+#endif
+
     rc = ngx_event_connect_peer(&u->peer);
 
     ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
@@ -920,6 +928,19 @@ ngx_http_upstream_send_request(ngx_http_request_t *r, ngx_http_upstream_t *u)
         return;
     }
 
+#if (NGX_HTTP_STATUS)
+    if (!u->request_sent) {
+        ngx_http_status_upstream_latency(r,
+                                      NGX_HTTP_STATUS_LATENCY_UPSTREAM_CONNECT);
+    }
+#endif
+
+#if (NGX_HTTP_TRACING)
+    if (!u->request_sent) {
+        ngx_http_trace(r, NGX_HTTP_TRACE_UPSTREAM_SEND, 0);
+    }
+#endif
+
     c->log->action = "sending request to upstream";
 
     rc = ngx_output_chain(&u->output, u->request_sent ? NULL : u->request_bufs);
@@ -1129,6 +1150,19 @@ ngx_http_upstream_process_header(ngx_event_t *rev)
 
         u->buffer.last += n;
 
+#if (NGX_HTTP_STATUS)
+        if (u->start_usec) {
+            ngx_http_status_upstream_latency(r,
+                                       NGX_HTTP_STATUS_LATENCY_UPSTREAM_HEADER);
+        }
+#endif
+
+#if (NGX_HTTP_TRACING)
+        if (u->buffer.last - n == u->buffer.start) {
+            ngx_http_trace(r, NGX_HTTP_TRACE_UPSTREAM_HEADER, n);
+        }
+#endif
+
 #if 0
         u->valid_header_in = 0;
 
@@ -1960,6 +1994,9 @@ static void
 ngx_http_upstream_process_body(ngx_event_t *ev)
 {
     ngx_uint_t            del;
+#if (NGX_HTTP_TRACING)
+    off_t                 read_length, sent;
+#endif
     ngx_temp_file_t      *tf;
     ngx_event_pipe_t     *p;
     ngx_connection_t     *c, *downstream;
@@ -1988,6 +2025,11 @@ ngx_http_upstream_process_body(ngx_event_t *ev)
 
     p = u->pipe;
 
+#if (NGX_HTTP_TRACING)
+    read_length = p->read_length;
+    sent = downstream->sent;
+#endif
+
     if (ev->timedout) {
         if (ev->write) {
             if (ev->delayed) {
@@ -2051,6 +2093,19 @@ ngx_http_upstream_process_body(ngx_event_t *ev)
         }
     }
 
+#if (NGX_HTTP_TRACING)
+
+    if (p->read_length != read_length) {
+        ngx_http_trace(r, NGX_HTTP_TRACE_PIPE_READ,
+                       p->read_length - read_length);
+    }
+
+    if (downstream->sent != sent) {
+        ngx_http_trace(r, NGX_HTTP_TRACE_PIPE_WRITE, downstream->sent - sent);
+    }
+
+#endif
+
     if (u->peer.connection) {
 
         if (u->store) {
@@ -2218,6 +2273,10 @@ ngx_http_upstream_next(ngx_http_request_t *r, ngx_http_upstream_t *u,
     ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
                    "http next upstream, %xi", ft_type);
 
+#if (NGX_HTTP_TRACING)
+    ngx_http_trace(r, NGX_HTTP_TRACE_UPSTREAM_NEXT, ft_type);
+#endif
+
 #if 0
     ngx_http_busy_unlock(u->conf->busy_lock, &u->busy_lock);
 #endif
@@ -2348,6 +2407,10 @@ ngx_http_upstream_finalize_request(ngx_http_request_t *r,
     ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
                    "finalize http upstream request: %i", rc);
 
+#if (NGX_HTTP_TRACING)
+    ngx_http_trace(r, NGX_HTTP_TRACE_UPSTREAM_DONE, rc);
+#endif
+
     if (u->cleanup) {
         *u->cleanup = NULL;
     }
@@ -248,6 +248,10 @@ struct ngx_http_upstream_s {
 
     ngx_http_upstream_state_t      *state;
 
+#if (NGX_HTTP_STATUS)
+    uint64_t                        start_usec;
+#endif
+
     ngx_str_t                       method;
     ngx_str_t                       schema;
     ngx_str_t                       uri;
@@ -151,34 +151,34 @@ static ngx_http_variable_t  ngx_http_core_variables[] = {
 
     { ngx_string("uri"), NULL, ngx_http_variable_request,
       offsetof(ngx_http_request_t, uri),
-      NGX_HTTP_VAR_NOCACHEABLE, 0 },
+      NGX_HTTP_VAR_DEP_URI, 0 },
 
     { ngx_string("document_uri"), NULL, ngx_http_variable_request,
       offsetof(ngx_http_request_t, uri),
-      NGX_HTTP_VAR_NOCACHEABLE, 0 },
+      NGX_HTTP_VAR_DEP_URI, 0 },
 
     { ngx_string("request"), NULL, ngx_http_variable_request,
       offsetof(ngx_http_request_t, request_line), 0, 0 },
 
     { ngx_string("document_root"), NULL,
-      ngx_http_variable_document_root, 0, NGX_HTTP_VAR_NOCACHEABLE, 0 },
+      ngx_http_variable_document_root, 0, NGX_HTTP_VAR_DEP_LOCATION, 0 },
 
     { ngx_string("query_string"), NULL, ngx_http_variable_request,
       offsetof(ngx_http_request_t, args),
-      NGX_HTTP_VAR_NOCACHEABLE, 0 },
+      NGX_HTTP_VAR_DEP_ARGS, 0 },
 
     { ngx_string("args"),
       ngx_http_variable_request_set,
       ngx_http_variable_request,
       offsetof(ngx_http_request_t, args),
-      NGX_HTTP_VAR_CHANGEABLE|NGX_HTTP_VAR_NOCACHEABLE, 0 },
+      NGX_HTTP_VAR_CHANGEABLE|NGX_HTTP_VAR_DEP_ARGS, 0 },
 
     { ngx_string("is_args"), NULL, ngx_http_variable_is_args,
-      0, NGX_HTTP_VAR_NOCACHEABLE, 0 },
+      0, NGX_HTTP_VAR_DEP_ARGS, 0 },
 
     { ngx_string("request_filename"), NULL,
       ngx_http_variable_request_filename, 0,
-      NGX_HTTP_VAR_NOCACHEABLE, 0 },
+      NGX_HTTP_VAR_DEP_URI|NGX_HTTP_VAR_DEP_LOCATION, 0 },
 
     { ngx_string("server_name"), NULL, ngx_http_variable_server_name, 0, 0, 0 },
 
@@ -366,6 +366,7 @@ ngx_http_variable_value_t *
 ngx_http_get_indexed_variable(ngx_http_request_t *r, ngx_uint_t index)
 {
     ngx_http_variable_t        *v;
+    ngx_http_variable_deps_t   *deps;
     ngx_http_core_main_conf_t  *cmcf;
 
     cmcf = ngx_http_get_module_main_conf(r, ngx_http_core_module);
@@ -376,11 +377,45 @@ ngx_http_get_indexed_variable(ngx_http_request_t *r, ngx_uint_t index)
         return NULL;
     }
 
+    v = cmcf->variables.elts;
+
     if (r->variables[index].not_found || r->variables[index].valid) {
-        return &r->variables[index];
+
+        if (!(v[index].flags & NGX_HTTP_VAR_DEPENDENT)) {
+            return &r->variables[index];
+        }
+
+        /* the subrequests share the cached values, so compare the state */
+
+        deps = &r->variables_deps[index];
+
+        if ((!(v[index].flags & NGX_HTTP_VAR_DEP_URI)
+             || (deps->uri == r->uri.data && deps->uri_len == r->uri.len))
+            && (!(v[index].flags & NGX_HTTP_VAR_DEP_ARGS)
+                || (deps->args == r->args.data
+                    && deps->args_len == r->args.len))
+            && (!(v[index].flags & NGX_HTTP_VAR_DEP_LOCATION)
+                || deps->loc_conf == r->loc_conf))
+        {
+            return &r->variables[index];
+        }
+
+        ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                       "http variable \"%V\" is stale", &v[index].name);
+
+        r->variables[index].valid = 0;
+        r->variables[index].not_found = 0;
     }
 
-    v = cmcf->variables.elts;
+    if (v[index].flags & NGX_HTTP_VAR_DEPENDENT) {
+        deps = &r->variables_deps[index];
+
+        deps->uri = r->uri.data;
+        deps->uri_len = r->uri.len;
+        deps->args = r->args.data;
+        deps->args_len = r->args.len;
+        deps->loc_conf = r->loc_conf;
+    }
 
     if (v[index].get_handler(r, &r->variables[index], v[index].data)
         == NGX_OK)
@@ -406,11 +441,7 @@ ngx_http_get_flushed_variable(ngx_http_request_t *r, ngx_uint_t index)
 
     v = &r->variables[index];
 
-    if (v->valid) {
-        if (!v->no_cacheable) {
-            return v;
-        }
-
+    if (v->valid && v->no_cacheable) {
         v->valid = 0;
         v->not_found = 0;
     }
@@ -1029,7 +1060,7 @@ ngx_http_variable_document_root(ngx_http_request_t *r,
 
         v->len = path.len;
         v->valid = 1;
-        v->no_cacheable = 0;
+        v->no_cacheable = 1;
         v->not_found = 0;
         v->data = path.data;
     }
@@ -1042,18 +1073,23 @@ static ngx_int_t
 ngx_http_variable_request_filename(ngx_http_request_t *r,
     ngx_http_variable_value_t *v, uintptr_t data)
 {
-    size_t     root;
-    ngx_str_t  path;
+    size_t                     root;
+    ngx_str_t                  path;
+    ngx_http_core_loc_conf_t  *clcf;
 
     if (ngx_http_map_uri_to_path(r, &path, &root, 0) == NULL) {
         return NGX_ERROR;
     }
 
+    clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
+
     /* ngx_http_map_uri_to_path() allocates memory for terminating '\0' */
 
     v->len = path.len - 1;
     v->valid = 1;
-    v->no_cacheable = 0;
+
+    /* the root with variables may depend on anything */
+    v->no_cacheable = (clcf->root_lengths != NULL);
     v->not_found = 0;
     v->data = path.data;
 
@@ -1476,6 +1512,10 @@ ngx_http_variables_init_vars(ngx_conf_t *cf)
 
                 av->index = i;
 
+                if (v[i].flags & NGX_HTTP_VAR_DEPENDENT) {
+                    cmcf->dependent_variables++;
+                }
+
                 goto next;
             }
         }
@@ -31,6 +31,26 @@ typedef ngx_int_t (*ngx_http_get_variable_pt) (ngx_http_request_t *r,
 #define NGX_HTTP_VAR_INDEXED      4
 #define NGX_HTTP_VAR_NOHASH       8
 
+/*
+ * the value depends on the request state only, it is cached and
+ * it is recalculated if the URI, the arguments, or the location are changed
+ */
+#define NGX_HTTP_VAR_DEP_URI      16
+#define NGX_HTTP_VAR_DEP_ARGS     32
+#define NGX_HTTP_VAR_DEP_LOCATION 64
+
+#define NGX_HTTP_VAR_DEPENDENT                                                \
+    (NGX_HTTP_VAR_DEP_URI|NGX_HTTP_VAR_DEP_ARGS|NGX_HTTP_VAR_DEP_LOCATION)
+
+
+typedef struct {
+    u_char                       *uri;
+    size_t                        uri_len;
+    u_char                       *args;
+    size_t                        args_len;
+    void                        **loc_conf;
+} ngx_http_variable_deps_t;
+
 
 struct ngx_http_variable_s {
     ngx_str_t                     name;   /* must be first to build the hash */
@@ -232,6 +232,12 @@ ngx_http_write_filter(ngx_http_request_t *r, ngx_chain_t *in)
 
     sent = c->sent;
 
+#if (NGX_HTTP_STATUS)
+    if (r->main->first_byte_usec == 0) {
+        r->main->first_byte_usec = ngx_http_status_usec();
+    }
+#endif
+
     ngx_log_debug1(NGX_LOG_DEBUG_HTTP, c->log, 0,
                    "http write filter limit %O", limit);
 
@@ -26,19 +26,12 @@
 #define NGX_SENDFILE_LIMIT  2147483647L
 
 
-#if (IOV_MAX > 64)
-#define NGX_HEADERS  64
-#else
-#define NGX_HEADERS  IOV_MAX
-#endif
-
-
 ngx_chain_t *
 ngx_linux_sendfile_chain(ngx_connection_t *c, ngx_chain_t *in, off_t limit)
 {
     int            rc, tcp_nodelay;
     off_t          size, send, prev_send, aligned, sent, fprev;
-    u_char        *prev;
+    u_char        *p, *prev, *last;
     size_t         file_size;
     ngx_err_t      err;
     ngx_buf_t     *file;
@@ -46,7 +39,8 @@ ngx_linux_sendfile_chain(ngx_connection_t *c, ngx_chain_t *in, off_t limit)
     ngx_array_t    header;
     ngx_event_t   *wev;
     ngx_chain_t   *cl;
-    struct iovec  *iov, headers[NGX_HEADERS];
+    struct iovec  *iov, headers[NGX_IOVS_MAX];
+    u_char         stage[NGX_IOV_STAGE];
 #if (NGX_HAVE_SENDFILE64)
     off_t          offset;
 #else
@@ -71,7 +65,7 @@ ngx_linux_sendfile_chain(ngx_connection_t *c, ngx_chain_t *in, off_t limit)
 
     header.elts = headers;
     header.size = sizeof(struct iovec);
-    header.nalloc = NGX_HEADERS;
+    header.nalloc = NGX_IOVS_MAX;
     header.pool = c->pool;
 
     for ( ;; ) {
@@ -84,12 +78,13 @@ ngx_linux_sendfile_chain(ngx_connection_t *c, ngx_chain_t *in, off_t limit)
         header.nelts = 0;
 
         prev = NULL;
+        last = stage;
         iov = NULL;
 
         /* create the iovec and coalesce the neighbouring bufs */
 
         for (cl = in;
-             cl && header.nelts < IOV_MAX && send < limit;
+             cl && header.nelts < NGX_IOVS_MAX && send < limit;
              cl = cl->next)
         {
             if (ngx_buf_special(cl->buf)) {
@@ -127,7 +122,17 @@ ngx_linux_sendfile_chain(ngx_connection_t *c, ngx_chain_t *in, off_t limit)
                 size = limit - send;
             }
 
-            if (prev == cl->buf->pos) {
+            p = cl->buf->pos;
+
+            if (size < NGX_IOV_SMALL_BUF
+                && size <= stage + NGX_IOV_STAGE - last)
+            {
+                ngx_memcpy(last, p, (size_t) size);
+                p = last;
+                last += (size_t) size;
+            }
+
+            if (prev == p) {
                 iov->iov_len += (size_t) size;
 
             } else {
@@ -136,11 +141,11 @@ ngx_linux_sendfile_chain(ngx_connection_t *c, ngx_chain_t *in, off_t limit)
                     return NGX_CHAIN_ERROR;
                 }
 
-                iov->iov_base = (void *) cl->buf->pos;
+                iov->iov_base = (void *) p;
                 iov->iov_len = (size_t) size;
             }
 
-            prev = cl->buf->pos + (size_t) size;
+            prev = p + (size_t) size;
             send += size;
         }
 
@@ -16,6 +16,22 @@
 #define NGX_IO_ZEROCOPY    2
 
 
+#if (IOV_MAX > 1024)
+#define NGX_IOVS_MAX       1024
+#else
+#define NGX_IOVS_MAX       IOV_MAX
+#endif
+
+/*
+ * the memory bufs smaller than NGX_IOV_SMALL_BUF are copied to the stack
+ * buffer of one Ethernet MSS, so the neighbouring small bufs such as
+ * the chunk sizes or the SSI text pieces are sent as one iovec
+ */
+
+#define NGX_IOV_SMALL_BUF  128
+#define NGX_IOV_STAGE      1460
+
+
 typedef ssize_t (*ngx_recv_pt)(ngx_connection_t *c, u_char *buf, size_t size);
 typedef ssize_t (*ngx_recv_chain_pt)(ngx_connection_t *c, ngx_chain_t *in);
 typedef ssize_t (*ngx_send_pt)(ngx_connection_t *c, u_char *buf, size_t size);
@@ -388,9 +388,16 @@ ngx_signal_handler(int signo)
 
         case ngx_signal_value(NGX_RECONFIGURE_SIGNAL):
         case ngx_signal_value(NGX_CHANGEBIN_SIGNAL):
-        case SIGIO:
             action = ", ignoring";
             break;
+
+        case SIGIO:
+
+            /* the log ring wakeup of the log writer, it is not logged */
+
+            ngx_sigio = 1;
+            ngx_set_errno(err);
+            return;
         }
 
         break;
@@ -13,6 +13,7 @@
 static void ngx_start_worker_processes(ngx_cycle_t *cycle, ngx_int_t n,
     ngx_int_t type);
 static void ngx_start_garbage_collector(ngx_cycle_t *cycle, ngx_int_t type);
+static void ngx_start_log_writer(ngx_cycle_t *cycle, ngx_int_t type);
 static void ngx_signal_worker_processes(ngx_cycle_t *cycle, int signo);
 static ngx_uint_t ngx_reap_children(ngx_cycle_t *cycle);
 static void ngx_master_process_exit(ngx_cycle_t *cycle);
@@ -27,6 +28,10 @@ static ngx_thread_value_t ngx_worker_thread_cycle(void *data);
 #if 0
 static void ngx_garbage_collector_cycle(ngx_cycle_t *cycle, void *data);
 #endif
+static void ngx_log_writer_cycle(ngx_cycle_t *cycle, void *data);
+static void ngx_log_writer_handler(ngx_event_t *ev);
+static ngx_msec_t ngx_log_writer_flush(ngx_cycle_t *cycle);
+static void ngx_log_writer_exit(ngx_cycle_t *cycle);
 
 
 ngx_uint_t    ngx_process;
@@ -124,6 +129,7 @@ ngx_master_process_cycle(ngx_cycle_t *cycle)
     ngx_start_worker_processes(cycle, ccf->worker_processes,
                                NGX_PROCESS_RESPAWN);
     ngx_start_garbage_collector(cycle, NGX_PROCESS_RESPAWN);
+    ngx_start_log_writer(cycle, NGX_PROCESS_RESPAWN);
 
     ngx_new_binary = 0;
     delay = 0;
@@ -205,6 +211,7 @@ ngx_master_process_cycle(ngx_cycle_t *cycle)
                 ngx_start_worker_processes(cycle, ccf->worker_processes,
                                            NGX_PROCESS_RESPAWN);
                 ngx_start_garbage_collector(cycle, NGX_PROCESS_RESPAWN);
+                ngx_start_log_writer(cycle, NGX_PROCESS_RESPAWN);
                 ngx_noaccepting = 0;
 
                 continue;
@@ -224,6 +231,7 @@ ngx_master_process_cycle(ngx_cycle_t *cycle)
             ngx_start_worker_processes(cycle, ccf->worker_processes,
                                        NGX_PROCESS_JUST_RESPAWN);
             ngx_start_garbage_collector(cycle, NGX_PROCESS_JUST_RESPAWN);
+            ngx_start_log_writer(cycle, NGX_PROCESS_JUST_RESPAWN);
             live = 1;
             ngx_signal_worker_processes(cycle,
                                         ngx_signal_value(NGX_SHUTDOWN_SIGNAL));
@@ -234,6 +242,7 @@ ngx_master_process_cycle(ngx_cycle_t *cycle)
             ngx_start_worker_processes(cycle, ccf->worker_processes,
                                        NGX_PROCESS_RESPAWN);
             ngx_start_garbage_collector(cycle, NGX_PROCESS_RESPAWN);
+            ngx_start_log_writer(cycle, NGX_PROCESS_RESPAWN);
             live = 1;
         }
 
@@ -402,6 +411,41 @@ ngx_start_garbage_collector(ngx_cycle_t *cycle, ngx_int_t type)
 }
 
 
+static void
+ngx_start_log_writer(ngx_cycle_t *cycle, ngx_int_t type)
+{
+    ngx_uint_t        i;
+    ngx_list_part_t  *part;
+    ngx_open_file_t  *file;
+
+    part = &cycle->open_files.part;
+    file = part->elts;
+
+    for (i = 0; /* void */ ; i++) {
+
+        if (i >= part->nelts) {
+            if (part->next == NULL) {
+                return;
+            }
+            part = part->next;
+            file = part->elts;
+            i = 0;
+        }
+
+        if (file[i].ring) {
+            break;
+        }
+    }
+
+    ngx_log_error(NGX_LOG_NOTICE, cycle->log, 0, "start log writer process");
+
+    cpu_affinity = 0;
+
+    ngx_spawn_process(cycle, ngx_log_writer_cycle, NULL,
+                      "log writer process", type);
+}
+
+
 static void
 ngx_signal_worker_processes(ngx_cycle_t *cycle, int signo)
 {
@@ -665,13 +709,15 @@ ngx_master_process_exit(ngx_cycle_t *cycle)
      * Copy ngx_cycle->log related data to the special static exit cycle,
      * log, and log file structures enough to allow a signal handler to log.
      * The handler may be called when standard ngx_cycle->log allocated from
-     * ngx_cycle->pool is already destroyed.
+     * ngx_cycle->pool is already destroyed.  The syslog peer is allocated
+     * from the pool too, so the exit log writes to the file only.
      */
 
     ngx_exit_log_file.fd = ngx_cycle->log->file->fd;
 
     ngx_exit_log = *ngx_cycle->log;
     ngx_exit_log.file = &ngx_exit_log_file;
+    ngx_exit_log.syslog = NULL;
 
     ngx_exit_cycle.log = &ngx_exit_log;
     ngx_cycle = &ngx_exit_cycle;
@@ -1019,13 +1065,15 @@ ngx_worker_process_exit(ngx_cycle_t *cycle)
      * Copy ngx_cycle->log related data to the special static exit cycle,
      * log, and log file structures enough to allow a signal handler to log.
      * The handler may be called when standard ngx_cycle->log allocated from
-     * ngx_cycle->pool is already destroyed.
+     * ngx_cycle->pool is already destroyed.  The syslog peer is allocated
+     * from the pool too, so the exit log writes to the file only.
      */
 
     ngx_exit_log_file.fd = ngx_cycle->log->file->fd;
 
     ngx_exit_log = *ngx_cycle->log;
     ngx_exit_log.file = &ngx_exit_log_file;
+    ngx_exit_log.syslog = NULL;
 
     ngx_exit_cycle.log = &ngx_exit_log;
     ngx_cycle = &ngx_exit_cycle;
@@ -1305,3 +1353,205 @@ ngx_garbage_collector_cycle(ngx_cycle_t *cycle, void *data)
 }
 
 #endif
+
+
+static void
+ngx_log_writer_cycle(ngx_cycle_t *cycle, void *data)
+{
+    ngx_event_t  ev;
+
+    ngx_worker_process_init(cycle, 0);
+
+    /* the log writer does not accept connections */
+
+    ngx_close_listening_sockets(cycle);
+
+    ngx_setproctitle("log writer process");
+
+    ngx_memzero(&ev, sizeof(ngx_event_t));
+
+    ev.handler = ngx_log_writer_handler;
+    ev.data = cycle;
+    ev.log = cycle->log;
+
+    ngx_log_writer_handler(&ev);
+
+    for ( ;; ) {
+
+        ngx_process_events_and_timers(cycle);
+
+        if (ngx_terminate || ngx_quit) {
+            ngx_log_error(NGX_LOG_NOTICE, cycle->log, 0, "exiting");
+
+            ngx_log_writer_exit(cycle);
+
+            ngx_worker_process_exit(cycle);
+        }
+
+        if (ngx_sigio) {
+
+            /* a ring is filled over the half */
+
+            ngx_sigio = 0;
+
+            if (ev.timer_set) {
+                ngx_del_timer(&ev);
+            }
+
+            ngx_log_writer_handler(&ev);
+        }
+
+        if (ngx_reopen) {
+            ngx_reopen = 0;
+            ngx_log_error(NGX_LOG_NOTICE, cycle->log, 0, "reopening logs");
+            ngx_reopen_files(cycle, -1);
+        }
+    }
+}
+
+
+static void
+ngx_log_writer_handler(ngx_event_t *ev)
+{
+    ngx_msec_t  flush;
+
+    flush = ngx_log_writer_flush(ev->data);
+
+    ngx_add_timer(ev, flush);
+}
+
+
+static ngx_msec_t
+ngx_log_writer_flush(ngx_cycle_t *cycle)
+{
+    ngx_uint_t        i;
+    ngx_msec_t        flush;
+    ngx_list_part_t  *part;
+    ngx_open_file_t  *file;
+
+    flush = NGX_TIMER_INFINITE;
+
+    part = &cycle->open_files.part;
+    file = part->elts;
+
+    for (i = 0; /* void */ ; i++) {
+
+        if (i >= part->nelts) {
+            if (part->next == NULL) {
+                break;
+            }
+            part = part->next;
+            file = part->elts;
+            i = 0;
+        }
+
+        if (file[i].ring == NULL) {
+            continue;
+        }
+
+        /* a writer of the old cycle may still own the ring */
+
+        if (ngx_log_ring_attach(file[i].ring) != NGX_OK) {
+            continue;
+        }
+
+        (void) ngx_log_ring_flush(file[i].ring, &file[i], cycle->log);
+
+        if (flush > file[i].ring->flush) {
+            flush = file[i].ring->flush;
+        }
+    }
+
+    if (flush == NGX_TIMER_INFINITE) {
+
+        /* all rings are still owned by the old writer */
+
+        flush = NGX_LOG_RING_FLUSH;
+    }
+
+    return flush;
+}
+
+
+static void
+ngx_log_writer_exit(ngx_cycle_t *cycle)
+{
+    ngx_uint_t        i, busy;
+    ngx_msec_t        start;
+    ngx_list_part_t  *part;
+    ngx_open_file_t  *file;
+
+    /*
+     * the closed rings do not accept the new records and the workers
+     * write their lines synchronously, so the rings are drained until
+     * the records reserved before the closing are committed and written
+     */
+
+    part = &cycle->open_files.part;
+    file = part->elts;
+
+    for (i = 0; /* void */ ; i++) {
+
+        if (i >= part->nelts) {
+            if (part->next == NULL) {
+                break;
+            }
+            part = part->next;
+            file = part->elts;
+            i = 0;
+        }
+
+        if (file[i].ring && ngx_log_ring_attach(file[i].ring) == NGX_OK) {
+            ngx_log_ring_close(file[i].ring);
+        }
+    }
+
+    start = ngx_current_msec;
+
+    do {
+        busy = 0;
+
+        part = &cycle->open_files.part;
+        file = part->elts;
+
+        for (i = 0; /* void */ ; i++) {
+
+            if (i >= part->nelts) {
+                if (part->next == NULL) {
+                    break;
+                }
+                part = part->next;
+                file = part->elts;
+                i = 0;
+            }
+
+            if (file[i].ring == NULL
+                || file[i].ring->writer != (ngx_atomic_uint_t) ngx_pid)
+            {
+                continue;
+            }
+
+            (void) ngx_log_ring_flush(file[i].ring, &file[i], cycle->log);
+
+            if (!ngx_log_ring_empty(file[i].ring)) {
+
+                if (ngx_current_msec - start < NGX_LOG_RING_STALL) {
+                    busy = 1;
+                    continue;
+                }
+
+                ngx_log_error(NGX_LOG_ALERT, cycle->log, 0,
+                              "\"%V\" log ring is not drained",
+                              &file[i].name);
+            }
+
+            ngx_log_ring_detach(file[i].ring);
+        }
+
+        if (busy) {
+            ngx_msleep(10);
+            ngx_time_update(0, 0);
+        }
+
+    } while (busy);
+}
@@ -9,17 +9,10 @@
 #include <ngx_event.h>
 
 
-#if (IOV_MAX > 64)
-#define NGX_IOVS  64
-#else
-#define NGX_IOVS  IOV_MAX
-#endif
-
-
 ngx_chain_t *
 ngx_writev_chain(ngx_connection_t *c, ngx_chain_t *in, off_t limit)
 {
-    u_char        *prev;
+    u_char        *p, *prev, *last;
     ssize_t        n, size, sent;
     off_t          send, prev_send;
     ngx_uint_t     eintr, complete;
@@ -27,7 +20,8 @@ ngx_writev_chain(ngx_connection_t *c, ngx_chain_t *in, off_t limit)
     ngx_array_t    vec;
     ngx_chain_t   *cl;
     ngx_event_t   *wev;
-    struct iovec  *iov, iovs[NGX_IOVS];
+    struct iovec  *iov, iovs[NGX_IOVS_MAX];
+    u_char         stage[NGX_IOV_STAGE];
 
     wev = c->write;
 
@@ -57,11 +51,12 @@ ngx_writev_chain(ngx_connection_t *c, ngx_chain_t *in, off_t limit)
 
     vec.elts = iovs;
     vec.size = sizeof(struct iovec);
-    vec.nalloc = NGX_IOVS;
+    vec.nalloc = NGX_IOVS_MAX;
     vec.pool = c->pool;
 
     for ( ;; ) {
         prev = NULL;
+        last = stage;
         iov = NULL;
         eintr = 0;
         prev_send = send;
@@ -70,7 +65,9 @@ ngx_writev_chain(ngx_connection_t *c, ngx_chain_t *in, off_t limit)
 
         /* create the iovec and coalesce the neighbouring bufs */
 
-        for (cl = in; cl && vec.nelts < IOV_MAX && send < limit; cl = cl->next)
+        for (cl = in;
+             cl && vec.nelts < NGX_IOVS_MAX && send < limit;
+             cl = cl->next)
         {
             if (ngx_buf_special(cl->buf)) {
                 continue;
@@ -88,7 +85,17 @@ ngx_writev_chain(ngx_connection_t *c, ngx_chain_t *in, off_t limit)
                 size = (ssize_t) (limit - send);
             }
 
-            if (prev == cl->buf->pos) {
+            p = cl->buf->pos;
+
+            if (size < NGX_IOV_SMALL_BUF
+                && size <= stage + NGX_IOV_STAGE - last)
+            {
+                ngx_memcpy(last, p, size);
+                p = last;
+                last += size;
+            }
+
+            if (prev == p) {
                 iov->iov_len += size;
 
             } else {
@@ -97,11 +104,11 @@ ngx_writev_chain(ngx_connection_t *c, ngx_chain_t *in, off_t limit)
                     return NGX_CHAIN_ERROR;
                 }
 
-                iov->iov_base = (void *) cl->buf->pos;
+                iov->iov_base = (void *) p;
                 iov->iov_len = size;
             }
 
-            prev = cl->buf->pos + size;
+            prev = p + size;
             send += size;
         }
 